@@ -3,17 +3,13 @@
 
 using namespace metal;
 
-struct Uniforms
-{
-    matrix_float4x4 localToClip;
-    matrix_float4x4 localToView;
-};
+#include "MetalCommon.h"
 
 struct Vertex
 {
-    float3 position [[attribute(0)]];
+    float4 position [[attribute(0)]];
     float2 texcoord [[attribute(1)]];
-    float3 normal [[attribute(3)]];
+    float4 normal [[attribute(3)]];
 };
 
 struct ColorInOut
@@ -28,8 +24,8 @@ vertex ColorInOut depthnormals_vertex( Vertex vert [[stage_in]],
 {
     ColorInOut out;
     
-    float4 in_position = float4( vert.position.xyz, 1.0 );
-    float4 in_normal = float4( vert.normal.xyz, 0.0 );
+    float4 in_position = float4( DecodePosition( vert.position, uniforms ), 1.0 );
+    float4 in_normal = float4( DecodeNormal( vert.normal, uniforms ), 0.0 );
     out.position = uniforms.localToClip * in_position;
     out.mvPosition = uniforms.localToView * in_position;
     out.normal = uniforms.localToView * in_normal;
@@ -6,6 +6,13 @@ struct Uniforms
     matrix_float4x4 localToView;
     matrix_float4x4 localToWorld;
     matrix_float4x4 localToShadowClip;
+    float4 tex0scaleOffset;
+    int boneOffset;
+    int isVR;
+    float f0;
+    int boneCount;
+    float4 positionScale; // w is 1 if normals and tangents are octahedral-encoded.
+    float4 positionOffset;
     matrix_float4x4 clipToView;
     float4 lightPosition;
     float4 lightDirection;
@@ -17,10 +24,36 @@ struct Uniforms
     uint windowWidth;
     uint windowHeight;
     uint numLights; // 16 bits for point light count, 16 for spot light count
-    float f0;
-    float4 tex0scaleOffset;
+    uint padding1;
     float4 tilesXY;
-    matrix_float4x4 boneMatrices[ 80 ];
-    int isVR;
+    matrix_float4x4 boneMatrices[ 80 ]; // Window of the bone palette starting at boneOffset.
 };
 
+static float3 DecodeOctahedral( float2 e )
+{
+    float3 v = float3( e.xy, 1.0f - abs( e.x ) - abs( e.y ) );
+
+    if (v.z < 0)
+    {
+        v.xy = (1.0f - abs( v.yx )) * float2( v.x >= 0 ? 1.0f : -1.0f, v.y >= 0 ? 1.0f : -1.0f );
+    }
+
+    return normalize( v );
+}
+
+// Positions of quantized vertices are normalized to their submesh's bounds, other vertex formats have identity scale.
+static float3 DecodePosition( float4 pos, constant Uniforms& uniforms )
+{
+    return pos.xyz * uniforms.positionScale.xyz + uniforms.positionOffset.xyz;
+}
+
+static float3 DecodeNormal( float4 normal, constant Uniforms& uniforms )
+{
+    return uniforms.positionScale.w != 0 ? DecodeOctahedral( normal.xy ) : normal.xyz;
+}
+
+// Quantized vertices store the tangent handedness in position w.
+static float4 DecodeTangent( float4 tangent, float4 pos, constant Uniforms& uniforms )
+{
+    return uniforms.positionScale.w != 0 ? float4( DecodeOctahedral( tangent.xy ), pos.w ) : tangent;
+}
@@ -7,7 +7,7 @@ using namespace metal;
 
 struct Vertex
 {
-    float3 position [[attribute(0)]];
+    float4 position [[attribute(0)]];
 };
 
 struct VertexSkin
@@ -48,7 +48,7 @@ vertex ColorInOut moments_vertex(Vertex vert [[stage_in]],
 {
     ColorInOut out;
 
-    float4 in_position = float4( vert.position, 1.0 );
+    float4 in_position = float4( DecodePosition( vert.position, uniforms ), 1.0 );
     out.position = uniforms.localToClip * in_position;
 
     if (uniforms.lightType == 2)
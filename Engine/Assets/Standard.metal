@@ -24,9 +24,9 @@ struct StandardColorInOut
 
 struct StandardVertex
 {
-    float3 position [[attribute(0)]];
+    float4 position [[attribute(0)]];
     float2 texcoord [[attribute(1)]];
-    float3 normal [[attribute(3)]];
+    float4 normal [[attribute(3)]];
     float4 tangent [[attribute(4)]];
     float4 color [[attribute(2)]];
 };
@@ -80,7 +80,9 @@ vertex StandardColorInOut standard_vertex( StandardVertex vert [[stage_in]],
 {
     StandardColorInOut out;
     
-    float4 in_position = float4( vert.position, 1.0 );
+    float4 in_position = float4( DecodePosition( vert.position, uniforms ), 1.0 );
+    const float3 normal = DecodeNormal( vert.normal, uniforms );
+    const float4 tangent = DecodeTangent( vert.tangent, vert.position, uniforms );
     out.position = uniforms.localToClip * in_position;
     out.positionVS = (uniforms.localToView * in_position).xyz;
     out.positionWS = (uniforms.localToWorld * in_position).xyz;
@@ -88,12 +90,12 @@ vertex StandardColorInOut standard_vertex( StandardVertex vert [[stage_in]],
     out.color = half4( vert.color );
     out.projCoord = uniforms.localToShadowClip * in_position;
     
-    out.tangentVS_u.xyz = (uniforms.localToView * float4( vert.tangent.xyz, 0 )).xyz;
+    out.tangentVS_u.xyz = (uniforms.localToView * float4( tangent.xyz, 0 )).xyz;
     out.tangentVS_u.w = vert.texcoord.x;
-    float3 ct = cross( vert.normal, vert.tangent.xyz ) * vert.tangent.w;
+    float3 ct = cross( normal, tangent.xyz ) * tangent.w;
     out.bitangentVS_v.xyz = normalize( uniforms.localToView * float4( ct, 0 ) ).xyz;
     out.bitangentVS_v.w = vert.texcoord.y;
-    out.normalVS = (uniforms.localToView * float4( vert.normal, 0 )).xyz;
+    out.normalVS = (uniforms.localToView * float4( normal, 0 )).xyz;
     
     return out;
 }
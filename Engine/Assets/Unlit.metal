@@ -42,7 +42,7 @@ float VSM( texture2d<float, access::sample> shadowMap, float4 projCoord, float d
 
 struct Vertex
 {
-    float3 position [[attribute(0)]];
+    float4 position [[attribute(0)]];
     float2 texcoord [[attribute(1)]];
     float4 color [[attribute(2)]];
 };
@@ -52,7 +52,7 @@ vertex ColorInOut unlit_vertex(Vertex vert [[stage_in]],
 {
     ColorInOut out;
 
-    float4 in_position = float4( vert.position, 1.0 );
+    float4 in_position = float4( DecodePosition( vert.position, uniforms ), 1.0 );
     
     out.position = uniforms.localToClip * in_position;
     out.color = half4( vert.color );
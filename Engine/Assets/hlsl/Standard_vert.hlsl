@@ -8,10 +8,10 @@
 
 struct VS_INPUT
 {
-    float3 pos : POSITION;
+    float4 pos : POSITION;
     float2 uv : TEXCOORD0;
     float4 color : COLOR;
-    float3 normal : NORMAL;
+    float4 normal : NORMAL;
     float4 tangent : TANGENT;
 };
 
@@ -28,14 +28,16 @@ struct PS_INPUT
 PS_INPUT main( VS_INPUT input )
 {
     PS_INPUT output = (PS_INPUT)0;
-    float4 position = float4( input.pos, 1.0f );
+    float4 position = float4( DecodePosition( input.pos ), 1.0f );
+    float3 normal = DecodeNormal( input.normal );
+    float4 tangent = DecodeTangent( input.tangent, input.pos );
 
     output.pos = mul( localToClip, position );
     output.positionVS_u = float4( mul( localToView, position ).xyz, input.uv.x );
     output.positionWS_v = float4( mul( localToWorld, position ).xyz, input.uv.y );
-    output.normalVS = mul( localToView, float4(input.normal, 0) ).xyz;
-    output.tangentVS = mul( localToView, float4(input.tangent.xyz, 0) ).xyz;
-    float3 ct = cross( input.normal, input.tangent.xyz ) * input.tangent.w;
+    output.normalVS = mul( localToView, float4(normal, 0) ).xyz;
+    output.tangentVS = mul( localToView, float4(tangent.xyz, 0) ).xyz;
+    float3 ct = cross( normal, tangent.xyz ) * tangent.w;
     output.bitangentVS.xyz = mul( localToView, float4( ct, 0 ) ).xyz;
 
     return output;
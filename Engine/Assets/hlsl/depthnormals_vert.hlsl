@@ -13,11 +13,12 @@ struct VSOutput
 
 #include "ubo.h"
 
-VSOutput main( float3 pos : POSITION, float3 normal : NORMAL )
+VSOutput main( float4 pos : POSITION, float4 normal : NORMAL )
 {
+    float4 position = float4( DecodePosition( pos ), 1.0 );
     VSOutput vsOut;
-    vsOut.pos = mul( localToClip, float4( pos, 1.0 ) );
-    vsOut.mvPosition = mul( localToView, float4( pos, 1.0 ) ).xyz;
-    vsOut.normal = mul( localToView, float4( normal, 0.0 ) ).xyz;
+    vsOut.pos = mul( localToClip, position );
+    vsOut.mvPosition = mul( localToView, position ).xyz;
+    vsOut.normal = mul( localToView, float4( DecodeNormal( normal ), 0.0 ) ).xyz;
     return vsOut;
 }
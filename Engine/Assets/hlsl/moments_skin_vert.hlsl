@@ -14,10 +14,10 @@ struct VSOutput
 VSOutput main( float3 pos : POSITION, float2 uv : TEXCOORD, float3 nor : NORMAL, float4 tangent : TANGENT, float4 color : COLOR, float4 boneWeights : WEIGHTS, uint4 boneIndex : BONES )
 {
     VSOutput vsOut;
-    float4 position2 = mul( boneMatrices[ boneIndex.x ], float4( pos, 1.0f ) ) * boneWeights.x;
-    position2 += mul( boneMatrices[ boneIndex.y ], float4( pos, 1.0f ) ) * boneWeights.y;
-    position2 += mul( boneMatrices[ boneIndex.z ], float4( pos, 1.0f ) ) * boneWeights.z;
-    position2 += mul( boneMatrices[ boneIndex.w ], float4( pos, 1.0f ) ) * boneWeights.w;
+    float4 position2 = mul( GetBoneMatrix( boneIndex.x ), float4( pos, 1.0f ) ) * boneWeights.x;
+    position2 += mul( GetBoneMatrix( boneIndex.y ), float4( pos, 1.0f ) ) * boneWeights.y;
+    position2 += mul( GetBoneMatrix( boneIndex.z ), float4( pos, 1.0f ) ) * boneWeights.z;
+    position2 += mul( GetBoneMatrix( boneIndex.w ), float4( pos, 1.0f ) ) * boneWeights.w;
     vsOut.pos = mul( localToClip, position2 );
 
 #if !VULKAN
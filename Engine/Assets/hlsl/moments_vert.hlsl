@@ -11,10 +11,10 @@ struct VSOutput
 
 #include "ubo.h"
 
-VSOutput main( float3 pos : POSITION, float3 normal : NORMAL )
+VSOutput main( float4 pos : POSITION, float4 normal : NORMAL )
 {
     VSOutput vsOut;
-    vsOut.pos = mul( localToClip, float4( pos, 1.0f ) );
+    vsOut.pos = mul( localToClip, float4( DecodePosition( pos ), 1.0f ) );
 #if !VULKAN
     vsOut.pos.y = -vsOut.pos.y;
 #endif
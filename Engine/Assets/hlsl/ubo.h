@@ -1,9 +1,21 @@
-layout(set=0, binding=0) cbuffer cbPerFrame : register(b0)
+#if VULKAN
+layout(set=0, binding=0) cbuffer cbPerDraw : register(b0)
 {
     matrix localToClip;
     matrix localToView;
     matrix localToWorld;
     matrix localToShadowClip;
+    float4 tex0scaleOffset;
+    int boneOffset;
+    int isVR;
+    float f0;
+    int boneCount;
+    float4 positionScale; // w is 1 if normals and tangents are octahedral-encoded.
+    float4 positionOffset;
+};
+
+layout(set=0, binding=13) cbuffer cbPerPass : register(b1)
+{
     matrix clipToView;
     float4 lightPosition;
     float4 lightDirection;
@@ -15,9 +27,77 @@ layout(set=0, binding=0) cbuffer cbPerFrame : register(b0)
     uint windowWidth;
     uint windowHeight;
     uint numLights; // 16 bits for point light count, 16 for spot light count
-    float f0;
-    float4 tex0scaleOffset;
+    uint padding1;
     float4 tilesXY;
-    matrix boneMatrices[ 80 ];
+};
+
+layout(set=0, binding=14) StructuredBuffer< float4x4 > bonePalette : register(t8);
+
+float4x4 GetBoneMatrix( uint index )
+{
+    return bonePalette[ boneOffset + index ];
+}
+#else
+cbuffer cbPerFrame : register(b0)
+{
+    matrix localToClip;
+    matrix localToView;
+    matrix localToWorld;
+    matrix localToShadowClip;
+    float4 tex0scaleOffset;
+    int boneOffset;
     int isVR;
+    float f0;
+    int boneCount;
+    float4 positionScale; // w is 1 if normals and tangents are octahedral-encoded.
+    float4 positionOffset;
+    matrix clipToView;
+    float4 lightPosition;
+    float4 lightDirection;
+    float4 lightColor;
+    float lightConeAngle;
+    int lightType;
+    float minAmbient;
+    uint maxNumLightsPerTile;
+    uint windowWidth;
+    uint windowHeight;
+    uint numLights; // 16 bits for point light count, 16 for spot light count
+    uint padding1;
+    float4 tilesXY;
+    matrix boneMatrices[ 80 ]; // Window of the bone palette starting at boneOffset.
 };
+
+float4x4 GetBoneMatrix( uint index )
+{
+    return boneMatrices[ index ];
+}
+#endif
+
+float3 DecodeOctahedral( float2 e )
+{
+    float3 v = float3( e.xy, 1.0f - abs( e.x ) - abs( e.y ) );
+
+    if (v.z < 0)
+    {
+        v.xy = (1.0f - abs( v.yx )) * float2( v.x >= 0 ? 1.0f : -1.0f, v.y >= 0 ? 1.0f : -1.0f );
+    }
+
+    return normalize( v );
+}
+
+// Positions of quantized vertices are normalized to their submesh's bounds, other vertex formats have identity scale.
+float3 DecodePosition( float4 pos )
+{
+    return pos.xyz * positionScale.xyz + positionOffset.xyz;
+}
+
+float3 DecodeNormal( float4 normal )
+{
+    return positionScale.w != 0 ? DecodeOctahedral( normal.xy ) : normal.xyz;
+}
+
+// Quantized vertices store the tangent handedness in position w.
+float4 DecodeTangent( float4 tangent, float4 pos )
+{
+    return positionScale.w != 0 ? float4( DecodeOctahedral( tangent.xy ), pos.w ) : tangent;
+}
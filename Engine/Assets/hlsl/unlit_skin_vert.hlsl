@@ -16,10 +16,10 @@ struct VSOutput
 
 VSOutput main( float3 pos : POSITION, float2 uv : TEXCOORD, float3 nor : NORMAL, float4 tangent : TANGENT, float4 color : COLOR, float4 boneWeights : WEIGHTS, uint4 boneIndex : BONES )
 {
-    float4 position2 = mul( boneMatrices[ boneIndex.x ], float4( pos, 1.0 ) ) * boneWeights.x;
-    position2 += mul( boneMatrices[ boneIndex.y ], float4( pos, 1.0 ) ) * boneWeights.y;
-    position2 += mul( boneMatrices[ boneIndex.z ], float4( pos, 1.0 ) ) * boneWeights.z;
-    position2 += mul( boneMatrices[ boneIndex.w ], float4( pos, 1.0 ) ) * boneWeights.w;
+    float4 position2 = mul( GetBoneMatrix( boneIndex.x ), float4( pos, 1.0 ) ) * boneWeights.x;
+    position2 += mul( GetBoneMatrix( boneIndex.y ), float4( pos, 1.0 ) ) * boneWeights.y;
+    position2 += mul( GetBoneMatrix( boneIndex.z ), float4( pos, 1.0 ) ) * boneWeights.z;
+    position2 += mul( GetBoneMatrix( boneIndex.w ), float4( pos, 1.0 ) ) * boneWeights.w;
 
     VSOutput vsOut;
     vsOut.pos = mul( localToClip, position2 );
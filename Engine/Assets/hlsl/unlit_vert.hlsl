@@ -14,10 +14,11 @@ struct VSOutput
     
 #include "ubo.h"
 
-VSOutput main( float3 pos : POSITION, float2 uv : TEXCOORD, float4 color : COLOR )
+VSOutput main( float4 pos : POSITION, float2 uv : TEXCOORD, float4 color : COLOR )
 {
+    float4 position = float4( DecodePosition( pos ), 1.0 );
     VSOutput vsOut;
-    vsOut.pos = mul( localToClip, float4( pos, 1.0 ) );
+    vsOut.pos = mul( localToClip, position );
     
     if (isVR == 1)
     {
@@ -26,6 +27,6 @@ VSOutput main( float3 pos : POSITION, float2 uv : TEXCOORD, float4 color : COLOR
 
     vsOut.uv = uv;
     vsOut.color = color;
-    vsOut.projCoord = mul( localToShadowClip, float4( pos, 1.0 ) );
+    vsOut.projCoord = mul( localToShadowClip, position );
     return vsOut;
 }
@@ -3,6 +3,8 @@
 #include <vector>
 #include <sstream>
 #include <string>
+#include "Statistics.hpp"
+#include "System.hpp"
 
 std::vector< ae3d::DirectionalLightComponent > directionalLightComponents;
 unsigned nextFreeDirectionalLightComponent = 0;
@@ -12,7 +14,9 @@ unsigned ae3d::DirectionalLightComponent::New()
 {
     if (nextFreeDirectionalLightComponent == directionalLightComponents.size())
     {
+        const std::size_t oldCapacity = directionalLightComponents.capacity();
         directionalLightComponents.resize( directionalLightComponents.size() + 10 );
+        Statistics::TrackResize( System::Statistics::MemoryTag::Components, oldCapacity * sizeof( DirectionalLightComponent ), directionalLightComponents.capacity() * sizeof( DirectionalLightComponent ) );
     }
 
     return nextFreeDirectionalLightComponent++;
@@ -1,6 +1,8 @@
 // This is an independent project of an individual developer. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "MeshRendererComponent.hpp"
+#include <algorithm>
+#include <map>
 #include <string>
 #include <vector>
 #include "Frustum.hpp"
@@ -9,16 +11,18 @@
 #include "Mesh.hpp"
 #include "Material.hpp"
 #include "Shader.hpp"
+#include "Statistics.hpp"
 #include "System.hpp"
 #include "SubMesh.hpp"
 #include "VertexBuffer.hpp"
 #include "Vec3.hpp"
+#include "WorkerPool.hpp"
 
 using namespace ae3d;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 namespace MathUtil
@@ -30,11 +34,144 @@ namespace MathUtil
 std::vector< ae3d::MeshRendererComponent > meshRendererComponents;
 unsigned nextFreeMeshRendererComponent = 0;
 
+namespace
+{
+    // Culled faces between visible meshlets are drawn anyway if there are fewer of them than this, because another draw call would cost more.
+    constexpr int MinSkippedFaceCount = 256;
+    // Large submeshes skip only longer runs of culled faces, so they are drawn with at most about this many draw calls.
+    constexpr int MaxFaceRangeCount = 32;
+}
+
+namespace SkinGlobal
+{
+    // Instances of the same submesh at the same animation frame share a palette.
+    struct PaletteKey
+    {
+        const SubMesh* subMesh;
+        int animFrame;
+
+        bool operator<( const PaletteKey& other ) const
+        {
+            return subMesh != other.subMesh ? subMesh < other.subMesh : animFrame < other.animFrame;
+        }
+    };
+
+    struct PendingPalette
+    {
+        const SubMesh* subMesh;
+        int animFrame;
+        int offset;
+    };
+
+    // Palettes below this count are evaluated on the calling thread.
+    constexpr std::size_t MinPalettesPerThread = 8;
+
+    std::map< PaletteKey, int > paletteOffsets;
+    std::vector< PendingPalette > pendingPalettes;
+    std::vector< Matrix44 > palettes;
+}
+
+static void EvaluatePalettes( std::size_t begin, std::size_t end )
+{
+    for (std::size_t p = begin; p < end; ++p)
+    {
+        const SkinGlobal::PendingPalette& pending = SkinGlobal::pendingPalettes[ p ];
+        Matrix44* palette = &SkinGlobal::palettes[ pending.offset ];
+
+        for (std::size_t j = 0; j < pending.subMesh->joints.size(); ++j)
+        {
+            const auto& joint = pending.subMesh->joints[ j ];
+
+            if (joint.animTransforms.empty())
+            {
+                palette[ j ].MakeIdentity();
+                continue;
+            }
+
+            const std::size_t frames = joint.animTransforms.size();
+            Matrix44::Multiply( joint.globalBindposeInverse, joint.animTransforms[ pending.animFrame % frames ], palette[ j ] );
+        }
+    }
+}
+
+void ae3d::MeshRendererComponent::UpdateSkinPalettes()
+{
+    SkinGlobal::paletteOffsets.clear();
+    SkinGlobal::pendingPalettes.clear();
+    int matrixCount = 0;
+
+    for (unsigned componentIndex = 0; componentIndex < nextFreeMeshRendererComponent; ++componentIndex)
+    {
+        MeshRendererComponent& component = meshRendererComponents[ componentIndex ];
+
+        if (!component.mesh || !component.isEnabled)
+        {
+            continue;
+        }
+
+        component.UpdateSubMeshArrays();
+
+        int subMeshCount = 0;
+        const SubMesh* subMeshes = component.mesh->GetSubMeshes( subMeshCount );
+
+        for (int subMeshIndex = 0; subMeshIndex < subMeshCount && subMeshIndex < (int)component.subMeshPaletteOffsets.count; ++subMeshIndex)
+        {
+            component.subMeshPaletteOffsets[ subMeshIndex ] = -1;
+
+            if (subMeshes[ subMeshIndex ].joints.empty())
+            {
+                continue;
+            }
+
+            const SkinGlobal::PaletteKey key = { &subMeshes[ subMeshIndex ], component.animFrame };
+            auto it = SkinGlobal::paletteOffsets.find( key );
+
+            if (it == SkinGlobal::paletteOffsets.end())
+            {
+                it = SkinGlobal::paletteOffsets.insert( std::make_pair( key, matrixCount ) ).first;
+                SkinGlobal::pendingPalettes.push_back( { key.subMesh, key.animFrame, matrixCount } );
+                matrixCount += (int)subMeshes[ subMeshIndex ].joints.size();
+            }
+
+            component.subMeshPaletteOffsets[ subMeshIndex ] = it->second;
+        }
+    }
+
+    SkinGlobal::palettes.resize( matrixCount );
+
+    const std::size_t paletteCount = SkinGlobal::pendingPalettes.size();
+    const std::size_t threadCount = std::min( (std::size_t)WorkerPool::GetThreadCount(), paletteCount / SkinGlobal::MinPalettesPerThread );
+
+    if (threadCount < 2)
+    {
+        EvaluatePalettes( 0, paletteCount );
+    }
+    else
+    {
+        struct Split
+        {
+            std::size_t paletteCount;
+            std::size_t palettesPerJob;
+        } split = { paletteCount, (paletteCount + threadCount - 1) / threadCount };
+
+        WorkerPool::Run( (int)threadCount, []( int jobIndex, void* userData )
+        {
+            const Split& jobSplit = *static_cast< const Split* >( userData );
+            const std::size_t begin = std::min( jobSplit.paletteCount, jobIndex * jobSplit.palettesPerJob );
+            EvaluatePalettes( begin, std::min( jobSplit.paletteCount, begin + jobSplit.palettesPerJob ) );
+        }, &split );
+    }
+
+    GfxDevice::SetBonePalette( SkinGlobal::palettes.data(), matrixCount );
+}
+
 unsigned ae3d::MeshRendererComponent::New()
 {
     if (nextFreeMeshRendererComponent == meshRendererComponents.size())
     {
+        const std::size_t oldCapacity = meshRendererComponents.capacity();
         meshRendererComponents.resize( meshRendererComponents.size() + 10 );
+        Statistics::TrackResize( System::Statistics::MemoryTag::Components, oldCapacity * sizeof( MeshRendererComponent ), meshRendererComponents.capacity() * sizeof( MeshRendererComponent ) );
     }
     
     return nextFreeMeshRendererComponent++;
@@ -79,6 +216,7 @@ void ae3d::MeshRendererComponent::Cull( const class Frustum& cameraFrustum, cons
         return;
     }
 
+    UpdateSubMeshArrays();
     isCulled = false;
     
     Vec3 aabbWorld[ 8 ];
@@ -99,11 +237,36 @@ void ae3d::MeshRendererComponent::Cull( const class Frustum& cameraFrustum, cons
     }
 
     int subMeshCount = 0;
-    SubMesh* subMeshes = mesh->GetSubMeshes( subMeshCount);
+    const SubMesh* subMeshes = mesh->GetSubMeshes( subMeshCount );
+
+    // The other per-submesh arrays were resized by UpdateSubMeshArrays(). Ranges are only counted here because they depend on the meshlets.
+    unsigned faceRangeCount = 0;
+
+    for (int subMeshIndex = 0; subMeshIndex < subMeshCount; ++subMeshIndex)
+    {
+        subMeshFirstFaceRange[ subMeshIndex ] = faceRangeCount;
+        faceRangeCount += (unsigned)subMeshes[ subMeshIndex ].meshlets.size();
+    }
+
+    if (faceRanges.count < faceRangeCount)
+    {
+        faceRanges.Allocate( faceRangeCount );
+    }
+
+    // Meshlets are tested in local space, so their bounds don't need to be transformed.
+    Frustum localFrustum;
+    bool isLocalFrustumValid = false;
+
+    // Mirroring transforms flip the winding of faces, and non-uniform scale changes the angles the cone cutoffs were computed from,
+    // so back faces are only culled by their normals under rotation, translation and uniform scale.
+    const float* m = localToWorld.m;
+    const bool isMirrored = Vec3::Dot( Vec3::Cross( Vec3( m[ 0 ], m[ 1 ], m[ 2 ] ), Vec3( m[ 4 ], m[ 5 ], m[ 6 ] ) ), Vec3( m[ 8 ], m[ 9 ], m[ 10 ] ) ) < 0;
+    const bool canCullBackFaces = !isMirrored && localToWorld.HasUniformScale();
 
     for (int subMeshIndex = 0; subMeshIndex < subMeshCount; ++subMeshIndex)
     {
         isSubMeshCulled[ subMeshIndex ] = false;
+        subMeshFaceRangeCount[ subMeshIndex ] = 0;
 
         if (materials[ subMeshIndex ] == nullptr || !materials[ subMeshIndex ]->IsValidShader())
         {
@@ -127,31 +290,88 @@ void ae3d::MeshRendererComponent::Cull( const class Frustum& cameraFrustum, cons
         if (!cameraFrustum.BoxInFrustum( meshAabbMinWorld, meshAabbMaxWorld ))
         {
             isSubMeshCulled[ subMeshIndex ] = true;
+            continue;
+        }
+
+        // Skinned meshlets move away from their bounds.
+        if (subMeshes[ subMeshIndex ].meshlets.empty() || !subMeshes[ subMeshIndex ].joints.empty())
+        {
+            continue;
+        }
+
+        if (!isLocalFrustumValid)
+        {
+            cameraFrustum.GetLocalFrustum( localToWorld, localFrustum );
+            isLocalFrustumValid = true;
         }
+
+        CullMeshlets( subMeshes[ subMeshIndex ], (unsigned)subMeshIndex, localFrustum, materials[ subMeshIndex ]->IsBackFaceCulled() && canCullBackFaces );
     }
 }
 
-void ae3d::MeshRendererComponent::ApplySkin( unsigned subMeshIndex )
+void ae3d::MeshRendererComponent::CullMeshlets( const SubMesh& subMesh, unsigned subMeshIndex, const Frustum& localFrustum, bool cullBackFaces )
 {
-    int subMeshCount = 0;
-    SubMesh* subMeshes = mesh->GetSubMeshes( subMeshCount );
+    const unsigned firstFaceRange = subMeshFirstFaceRange[ subMeshIndex ];
+    const int minSkippedFaceCount = std::max( MinSkippedFaceCount, subMesh.vertexBuffer.GetFaceCount() / 3 / MaxFaceRangeCount );
+    unsigned rangeCount = 0;
 
-    if (!subMeshes[ subMeshIndex ].joints.empty())
+    for (const Meshlet& meshlet : subMesh.meshlets)
     {
-        for (std::size_t j = 0; j < subMeshes[ subMeshIndex ].joints.size(); ++j)
+        if (!localFrustum.BoxInFrustum( meshlet.aabbMin, meshlet.aabbMax ))
         {
-            const auto& joint = subMeshes[ subMeshIndex ].joints[ j ];
-            
-            if (!joint.animTransforms.empty())
+            continue;
+        }
+
+        if (cullBackFaces)
+        {
+            const Vec3 center = (meshlet.aabbMin + meshlet.aabbMax) * 0.5f;
+            const float radius = (meshlet.aabbMax - meshlet.aabbMin).Length() * 0.5f;
+
+            if (localFrustum.ConeFacesAway( center, radius, meshlet.coneAxis, meshlet.coneCutoff ))
             {
-                const std::size_t frames = joint.animTransforms.size();
-                Matrix44::Multiply( joint.globalBindposeInverse,
-                                   joint.animTransforms[ animFrame % frames ],
-                                   GfxDeviceGlobal::perObjectUboStruct.boneMatrices[ j ] );
+                continue;
             }
         }
+
+        FaceRange* previous = rangeCount > 0 ? &faceRanges[ firstFaceRange + rangeCount - 1 ] : nullptr;
+
+        if (previous != nullptr && meshlet.firstFace - previous->end < minSkippedFaceCount)
+        {
+            previous->end = std::max( previous->end, meshlet.firstFace + meshlet.faceCount );
+        }
+        else
+        {
+            faceRanges[ firstFaceRange + rangeCount ] = { meshlet.firstFace, meshlet.firstFace + meshlet.faceCount };
+            ++rangeCount;
+        }
+    }
+
+    subMeshFaceRangeCount[ subMeshIndex ] = rangeCount;
+    isSubMeshCulled[ subMeshIndex ] = rangeCount == 0;
+}
+
+bool ae3d::MeshRendererComponent::ApplySkin( unsigned subMeshIndex )
+{
+    int subMeshCount = 0;
+    const SubMesh* subMeshes = mesh->GetSubMeshes( subMeshCount );
+
+    if (subMeshes[ subMeshIndex ].joints.empty())
+    {
+        GfxDeviceGlobal::perObjectUboStruct.boneCount = 0;
+        return true;
+    }
+
+    // Another palette's bones would skin the mesh into a wrong pose.
+    const int offset = subMeshIndex < subMeshPaletteOffsets.count ? subMeshPaletteOffsets[ subMeshIndex ] : -1;
+
+    if (offset < 0)
+    {
+        return false;
     }
 
+    GfxDeviceGlobal::perObjectUboStruct.boneOffset = offset;
+    GfxDeviceGlobal::perObjectUboStruct.boneCount = (int)subMeshes[ subMeshIndex ].joints.size();
+    return true;
 }
 
 void ae3d::MeshRendererComponent::Render( const Matrix44& localToView, const Matrix44& localToClip, const Matrix44& localToWorld,
@@ -162,9 +382,11 @@ void ae3d::MeshRendererComponent::Render( const Matrix44& localToView, const Mat
     {
         return;
     }
-    
+
+    UpdateSubMeshArrays();
+
 	int subMeshCount = 0;
-    SubMesh* subMeshes = mesh->GetSubMeshes( subMeshCount );
+    const SubMesh* subMeshes = mesh->GetSubMeshes( subMeshCount );
 
     for (int subMeshIndex = 0; subMeshIndex < subMeshCount; ++subMeshIndex)
     {
@@ -190,6 +412,11 @@ void ae3d::MeshRendererComponent::Render( const Matrix44& localToView, const Mat
             shader = overrideSkinShader;
         }
         
+        if (!ApplySkin( subMeshIndex ))
+        {
+            continue;
+        }
+
         GfxDevice::CullMode cullMode = GfxDevice::CullMode::Back;
         GfxDevice::BlendMode blendMode = GfxDevice::BlendMode::Off;
 
@@ -202,7 +429,6 @@ void ae3d::MeshRendererComponent::Render( const Matrix44& localToView, const Mat
             shader->Use();
             GfxDeviceGlobal::perObjectUboStruct.localToClip = localToClip;
             GfxDeviceGlobal::perObjectUboStruct.localToView = localToView;
-            ApplySkin( subMeshIndex );
         }
         else
         {
@@ -219,8 +445,6 @@ void ae3d::MeshRendererComponent::Render( const Matrix44& localToView, const Mat
             GfxDeviceGlobal::perObjectUboStruct.localToView = localToView;
             GfxDeviceGlobal::perObjectUboStruct.localToWorld = localToWorld;
             GfxDeviceGlobal::perObjectUboStruct.localToShadowClip = localToShadowClip;
-
-            ApplySkin( subMeshIndex );
             
             if (!materials[ subMeshIndex ]->IsBackFaceCulled())
             {
@@ -249,8 +473,19 @@ void ae3d::MeshRendererComponent::Render( const Matrix44& localToView, const Mat
             depthFunc = GfxDevice::DepthFunc::NoneWriteOff;
         }
         
-        GfxDevice::Draw( subMeshes[ subMeshIndex ].vertexBuffer, 0, subMeshes[ subMeshIndex ].vertexBuffer.GetFaceCount() / 3,
-                         *shader, blendMode, depthFunc, cullMode, isWireframe ? GfxDevice::FillMode::Wireframe : GfxDevice::FillMode::Solid, GfxDevice::PrimitiveTopology::Triangles );
+        const GfxDevice::FillMode fillMode = isWireframe ? GfxDevice::FillMode::Wireframe : GfxDevice::FillMode::Solid;
+
+        if (subMeshFaceRangeCount[ subMeshIndex ] == 0)
+        {
+            GfxDevice::Draw( subMeshes[ subMeshIndex ].vertexBuffer, 0, subMeshes[ subMeshIndex ].vertexBuffer.GetFaceCount() / 3,
+                             *shader, blendMode, depthFunc, cullMode, fillMode, GfxDevice::PrimitiveTopology::Triangles );
+        }
+
+        for (unsigned r = 0; r < subMeshFaceRangeCount[ subMeshIndex ]; ++r)
+        {
+            const FaceRange& range = faceRanges[ subMeshFirstFaceRange[ subMeshIndex ] + r ];
+            GfxDevice::Draw( subMeshes[ subMeshIndex ].vertexBuffer, range.begin, range.end, *shader, blendMode, depthFunc, cullMode, fillMode, GfxDevice::PrimitiveTopology::Triangles );
+        }
 
         if (isAabbDrawingEnabled)
         {
@@ -338,9 +573,45 @@ void ae3d::MeshRendererComponent::SetMesh( Mesh* aMesh )
 
     if (mesh != nullptr)
     {
-        int subMeshCount = 0;
-        mesh->GetSubMeshes( subMeshCount );
-        materials.Allocate( subMeshCount );
-        isSubMeshCulled.Allocate( subMeshCount );
+        AllocateSubMeshArrays();
+    }
+}
+
+void ae3d::MeshRendererComponent::UpdateSubMeshArrays()
+{
+    if (mesh->GetGeneration() != meshGeneration)
+    {
+        AllocateSubMeshArrays();
+    }
+}
+
+void ae3d::MeshRendererComponent::AllocateSubMeshArrays()
+{
+    int subMeshCount = 0;
+    mesh->GetSubMeshes( subMeshCount );
+    meshGeneration = mesh->GetGeneration();
+
+    // Submeshes that are still there after a reload keep their materials.
+    if (materials.count != (unsigned)subMeshCount)
+    {
+        Array< Material* > newMaterials( (unsigned)subMeshCount );
+
+        for (unsigned i = 0; i < newMaterials.count && i < materials.count; ++i)
+        {
+            newMaterials[ i ] = materials[ i ];
+        }
+
+        materials = newMaterials;
+    }
+
+    isSubMeshCulled.Allocate( subMeshCount );
+    subMeshFirstFaceRange.Allocate( subMeshCount );
+    subMeshFaceRangeCount.Allocate( subMeshCount );
+    subMeshPaletteOffsets.Allocate( subMeshCount );
+
+    for (unsigned i = 0; i < subMeshPaletteOffsets.count; ++i)
+    {
+        subMeshPaletteOffsets[ i ] = -1;
+        subMeshFaceRangeCount[ i ] = 0;
     }
 }
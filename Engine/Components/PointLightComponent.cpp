@@ -3,6 +3,8 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include "Statistics.hpp"
+#include "System.hpp"
 
 extern bool someLightCastsShadow;
 std::vector< ae3d::PointLightComponent > pointLightComponents;
@@ -12,7 +14,9 @@ unsigned ae3d::PointLightComponent::New()
 {
     if (nextFreePointLightComponent == pointLightComponents.size())
     {
+        const std::size_t oldCapacity = pointLightComponents.capacity();
         pointLightComponents.resize( pointLightComponents.size() + 10 );
+        Statistics::TrackResize( System::Statistics::MemoryTag::Components, oldCapacity * sizeof( PointLightComponent ), pointLightComponents.capacity() * sizeof( PointLightComponent ) );
     }
     
     return nextFreePointLightComponent++;
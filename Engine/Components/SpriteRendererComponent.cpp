@@ -20,7 +20,7 @@ unsigned nextFreeSpriteComponent = 0;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 struct Drawable
@@ -173,7 +173,7 @@ void RenderQueue::Render( ae3d::GfxDevice::BlendMode blendMode, const float* loc
     {
         renderer.builtinShaders.spriteRendererShader.Use();
         GfxDeviceGlobal::perObjectUboStruct.localToClip.InitFrom( localToClip );
-        GfxDeviceGlobal::perObjectUboStruct.lightColor = ae3d::Vec4( 1, 1, 1, 1 );
+        ae3d::GfxDevice::EditPassUniforms().lightColor = ae3d::Vec4( 1, 1, 1, 1 );
 
         if (drawable.texture->IsRenderTexture())
         {
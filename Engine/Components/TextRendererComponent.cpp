@@ -16,7 +16,7 @@ unsigned nextFreeTextComponent = 0;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 unsigned ae3d::TextRendererComponent::New()
@@ -124,7 +124,7 @@ void ae3d::TextRendererComponent::Render( const float* localToClip )
         shader->Use();
         shader->SetTexture(  m().font->GetTexture(), 0 );
         GfxDeviceGlobal::perObjectUboStruct.localToClip.InitFrom( localToClip );
-        GfxDeviceGlobal::perObjectUboStruct.lightColor = Vec4( 1, 1, 1, 1 );
+        GfxDevice::EditPassUniforms().lightColor = Vec4( 1, 1, 1, 1 );
         
         GfxDevice::Draw( m().vertexBuffer, 0, m().vertexBuffer.GetFaceCount() / 3, *m().shader, ae3d::GfxDevice::BlendMode::AlphaBlend,
                          ae3d::GfxDevice::DepthFunc::LessOrEqualWriteOff, ae3d::GfxDevice::CullMode::Off, ae3d::GfxDevice::FillMode::Solid, GfxDevice::PrimitiveTopology::Triangles );
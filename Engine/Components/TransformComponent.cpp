@@ -6,6 +6,7 @@
 #include <string>
 #include <sstream>
 #include "Matrix.hpp"
+#include "Statistics.hpp"
 #include "System.hpp"
 
 namespace
@@ -99,6 +100,7 @@ void ae3d::TransformComponent::OffsetRotate( const Vec3& axis, float angleDeg )
 
 void ae3d::TransformComponent::UpdateLocalMatrices()
 {
+    AE3D_ZONE( "TransformComponent::UpdateLocalMatrices" );
     for (unsigned componentIndex = 0; componentIndex < nextFreeTransformComponent; ++componentIndex)
     {
         transformComponents[ componentIndex ].SolveLocalMatrix();
@@ -0,0 +1,40 @@
+#include "AudioSystem.hpp"
+#include "FileSystem.hpp"
+
+// Silent audio system for headless builds. Clips get handles but are never decoded.
+
+namespace AudioGlobal
+{
+    unsigned clipCount = 0;
+}
+
+void ae3d::AudioSystem::Init()
+{
+}
+
+void ae3d::AudioSystem::Deinit()
+{
+    AudioGlobal::clipCount = 0;
+}
+
+unsigned ae3d::AudioSystem::GetClipIdForData( const FileSystem::FileContentsData& /*clipData*/ )
+{
+    return AudioGlobal::clipCount++;
+}
+
+float ae3d::AudioSystem::GetClipLengthForId( unsigned /*handle*/ )
+{
+    return 0;
+}
+
+void ae3d::AudioSystem::Play( unsigned /*clipId*/, bool /*isLooping*/ )
+{
+}
+
+void ae3d::AudioSystem::SetListenerPosition( float /*x*/, float /*y*/, float /*z*/ )
+{
+}
+
+void ae3d::AudioSystem::SetListenerOrientation( float /*forwardX*/, float /*forwardY*/, float /*forwardZ*/ )
+{
+}
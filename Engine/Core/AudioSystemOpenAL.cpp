@@ -9,6 +9,7 @@
 #include "Array.hpp"
 #include "FileSystem.hpp"
 #include "FileWatcher.hpp"
+#include "Statistics.hpp"
 #include "System.hpp"
 
 extern ae3d::FileWatcher fileWatcher;
@@ -101,10 +102,18 @@ void LoadOgg( const ae3d::FileSystem::FileContentsData& clipData, ClipInfo& info
     
     const ALenum format = vinfo.channels == 2 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
     
+    const std::size_t decodedBytes = (std::size_t)len * (std::size_t)channels * sizeof( short );
+    Statistics::TrackAlloc( ae3d::System::Statistics::MemoryTag::Audio, decodedBytes );
+
     alBufferData( info.bufID, format, &decoded[0], len, vinfo.sample_rate );
 
     info.lengthInSeconds = stb_vorbis_stream_length_in_seconds( vorbis );
 
+    // alBufferData copied the samples.
+    free( decoded );
+    Statistics::TrackFree( ae3d::System::Statistics::MemoryTag::Audio, decodedBytes );
+    stb_vorbis_close( vorbis );
+
     CheckOpenALError("Loading ogg");
 }
 
@@ -188,6 +197,7 @@ void LoadWav( const ae3d::FileSystem::FileContentsData& clipData, ClipInfo& info
     ifs.seekg( dataPos );
     
     wav.data.resize( dataSize );
+    Statistics::TrackAlloc( ae3d::System::Statistics::MemoryTag::Audio, wav.data.size() );
     
     ifs.read( (char*)wav.data.data(), dataSize );
     
@@ -220,6 +230,7 @@ void LoadWav( const ae3d::FileSystem::FileContentsData& clipData, ClipInfo& info
     CheckOpenALError( "Loading .wav data." );
     
     info.lengthInSeconds = dataSize / static_cast< float >(wav.bytesPerSecond);
+    Statistics::TrackFree( ae3d::System::Statistics::MemoryTag::Audio, wav.data.size() );
 }
 }
 
@@ -1,14 +1,35 @@
 #include "FileSystem.hpp"
+#include "Lz4.hpp"
+#include "PakFormat.hpp"
+#include "Statistics.hpp"
 #include "System.hpp"
+#include "WorkerPool.hpp"
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
+#if _MSC_VER
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #if VK_USE_PLATFORM_ANDROID_KHR
 #include <android/asset_manager.h>
 #endif
 
 #if RENDERER_METAL
-const char* GetFullPath( const char* fileName )
+std::string GetFullPath( const char* fileName )
 {
     if (fileName && fileName[ 0 ] == '/')
     {
@@ -26,31 +47,451 @@ const char* GetFullPath( const char* fileName )
     return [dir fileSystemRepresentation];
 }
 #else
-const char* GetFullPath( const char* fileName )
+std::string GetFullPath( const char* fileName )
 {
-    static std::string fName;
-    fName = fileName;
+    std::string fName( fileName );
     std::replace( std::begin( fName ), std::end( fName ), '\\', '/' );
-    return fName.c_str();
+    return fName;
 }
 #endif
 
-struct PakFile
+/// Read-only memory mapping of a whole file.
+struct FileMapping
 {
-    struct FileEntry
-    {
-        std::string path;
-        std::vector< unsigned char > contents;
-    };
+    FileMapping() = default;
+    FileMapping( const FileMapping& ) = delete;
+    FileMapping& operator=( const FileMapping& ) = delete;
+    ~FileMapping();
+
+    const unsigned char* bytes = nullptr;
+    std::size_t byteCount = 0;
+#if _MSC_VER
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+/// Memory-mapped .pak v2 file. See PakFormat.hpp.
+struct PakFile : FileMapping
+{
+    ~PakFile();
+
+    /// \return Entry of path or null if the file is not in the pak or is corrupted.
+    const Pak::TocEntry* Find( const std::string& filePath ) const;
+    /// Copies or decompresses size bytes of entry starting at offset into outData.
+    /// \return False if the range is outside the entry or its data is invalid.
+    bool Read( const Pak::TocEntry& entry, std::size_t offset, std::size_t size, unsigned char* outData ) const;
 
-    std::vector< FileEntry > entries;
     std::string path;
+    const Pak::TocEntry* toc = nullptr;
+    unsigned entryCount = 0;
+    const char* paths = nullptr;
+    /// Block tables of compressed entries are validated on their first access.
+    std::unique_ptr< std::atomic< bool >[] > isEntryValidated;
 };
 
 namespace Global
 {
-    PakFile pakFiles[ 5 ];
-	unsigned packFileCount = 0;
+    /// Readers keep a reference while they read, so UnloadPakFile() doesn't unmap a pak under them.
+    std::vector< std::shared_ptr< PakFile > > pakFiles;
+    std::mutex pakFilesMutex;
+}
+
+namespace
+{
+    /// Compressed blocks of a read are split across workers when there are at least two times this many. Smaller reads are decoded on the calling thread.
+    constexpr std::size_t MinBlocksPerThread = 4;
+
+    /// Maps path read-only into outMapping's bytes. Fails for empty files.
+    bool MapFile( const char* path, FileMapping& outMapping )
+    {
+#if _MSC_VER
+        outMapping.file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr );
+
+        if (outMapping.file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+
+        if (!GetFileSizeEx( outMapping.file, &size ) || size.QuadPart == 0)
+        {
+            return false;
+        }
+
+        outMapping.mapping = CreateFileMappingA( outMapping.file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+
+        if (outMapping.mapping == nullptr)
+        {
+            return false;
+        }
+
+        outMapping.bytes = (const unsigned char*)MapViewOfFile( outMapping.mapping, FILE_MAP_READ, 0, 0, 0 );
+        outMapping.byteCount = (std::size_t)size.QuadPart;
+        return outMapping.bytes != nullptr;
+#else
+        const int fd = open( path, O_RDONLY );
+
+        if (fd == -1)
+        {
+            return false;
+        }
+
+        struct stat inode;
+
+        if (fstat( fd, &inode ) == -1 || inode.st_size == 0)
+        {
+            close( fd );
+            return false;
+        }
+
+        void* bytes = mmap( nullptr, (std::size_t)inode.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        close( fd );
+
+        if (bytes == MAP_FAILED)
+        {
+            return false;
+        }
+
+        outMapping.bytes = (const unsigned char*)bytes;
+        outMapping.byteCount = (std::size_t)inode.st_size;
+        return true;
+#endif
+    }
+
+    /// \return True if header and TOC of a mapped pak are within its bytes.
+    bool ParseToc( PakFile& pakFile )
+    {
+        Pak::Header header;
+
+        if (pakFile.byteCount < sizeof( header ))
+        {
+            return false;
+        }
+
+        std::memcpy( &header, pakFile.bytes, sizeof( header ) );
+
+        if (std::memcmp( header.magic, Pak::Magic, sizeof( Pak::Magic ) ) != 0 || header.version != Pak::Version)
+        {
+            return false;
+        }
+
+        const std::uint64_t tocBytes = (std::uint64_t)header.entryCount * sizeof( Pak::TocEntry );
+
+        if (header.tocOffset % alignof( Pak::TocEntry ) != 0 || header.tocOffset > pakFile.byteCount || tocBytes > pakFile.byteCount - header.tocOffset ||
+            header.pathsOffset > pakFile.byteCount || header.pathBytes > pakFile.byteCount - header.pathsOffset)
+        {
+            return false;
+        }
+
+        pakFile.toc = reinterpret_cast< const Pak::TocEntry* >( pakFile.bytes + header.tocOffset );
+        pakFile.entryCount = header.entryCount;
+        pakFile.paths = reinterpret_cast< const char* >( pakFile.bytes + header.pathsOffset );
+
+        for (unsigned i = 0; i < pakFile.entryCount; ++i)
+        {
+            const Pak::TocEntry& entry = pakFile.toc[ i ];
+
+            // Compressed entries' block tables are validated in StoredSize() on their first access.
+            const std::uint64_t minStoredSize = (entry.flags & Pak::EntryCompressed) ? sizeof( Pak::CompressedHeader ) : entry.size;
+
+            if (entry.pathOffset > header.pathBytes || entry.pathLength > header.pathBytes - entry.pathOffset ||
+                entry.offset > pakFile.byteCount || minStoredSize > pakFile.byteCount - entry.offset ||
+                (i > 0 && entry.pathHash < pakFile.toc[ i - 1 ].pathHash))
+            {
+                return false;
+            }
+        }
+
+        pakFile.isEntryValidated.reset( new std::atomic< bool >[ pakFile.entryCount ] );
+
+        for (unsigned i = 0; i < pakFile.entryCount; ++i)
+        {
+            pakFile.isEntryValidated[ i ] = false;
+        }
+
+        Statistics::TrackAlloc( ae3d::System::Statistics::MemoryTag::PakFiles, pakFile.entryCount * sizeof( std::atomic< bool > ) );
+        return true;
+    }
+
+    /// \return Bytes of entry in the pak file, or 0 if a compressed entry's block table is invalid.
+    std::uint64_t StoredSize( const PakFile& pakFile, const Pak::TocEntry& entry )
+    {
+        if (!(entry.flags & Pak::EntryCompressed))
+        {
+            return entry.size;
+        }
+
+        const unsigned char* contents = pakFile.bytes + entry.offset;
+        const std::uint64_t available = pakFile.byteCount - entry.offset;
+        Pak::CompressedHeader header;
+        std::memcpy( &header, contents, sizeof( header ) );
+
+        if (header.blockSize == 0 || header.blockCount != (entry.size + header.blockSize - 1) / header.blockSize)
+        {
+            return 0;
+        }
+
+        std::uint64_t storedSize = sizeof( header ) + (std::uint64_t)header.blockCount * sizeof( std::uint32_t );
+
+        if (storedSize > available)
+        {
+            return 0;
+        }
+
+        for (std::uint32_t b = 0; b < header.blockCount; ++b)
+        {
+            std::uint32_t blockSize;
+            std::memcpy( &blockSize, contents + sizeof( header ) + b * sizeof( std::uint32_t ), sizeof( blockSize ) );
+            const std::uint64_t uncompressedSize = b + 1 < header.blockCount ? header.blockSize : entry.size - (std::uint64_t)b * header.blockSize;
+
+            if ((blockSize & Pak::BlockUncompressed) && (blockSize & ~Pak::BlockUncompressed) != uncompressedSize)
+            {
+                return 0;
+            }
+
+            storedSize += blockSize & ~Pak::BlockUncompressed;
+        }
+
+        return storedSize <= available ? storedSize : 0;
+    }
+
+    /// Checksums the stored bytes of every entry, so it reads the whole pak.
+    /// \return True if no entry is corrupted.
+    bool VerifyChecksums( PakFile& pakFile )
+    {
+        bool isValid = true;
+
+        for (unsigned i = 0; i < pakFile.entryCount; ++i)
+        {
+            const Pak::TocEntry& entry = pakFile.toc[ i ];
+            const std::uint64_t storedSize = StoredSize( pakFile, entry );
+
+            if ((storedSize == 0 && entry.size != 0) || Pak::Checksum( pakFile.bytes + entry.offset, (std::size_t)storedSize ) != entry.checksum)
+            {
+                ae3d::System::Print( "LoadPakFile: %.*s in %s is corrupted.\n", (int)entry.pathLength, pakFile.paths + entry.pathOffset, pakFile.path.c_str() );
+                isValid = false;
+            }
+            else
+            {
+                pakFile.isEntryValidated[ i ] = true;
+            }
+        }
+
+        return isValid;
+    }
+
+    /// \return Entry of path in the first loaded pak that contains it, or null.
+    const Pak::TocEntry* FindInPakFiles( const std::string& path, std::shared_ptr< PakFile >& outPakFile )
+    {
+        std::vector< std::shared_ptr< PakFile > > pakFiles;
+        {
+            std::lock_guard< std::mutex > lock( Global::pakFilesMutex );
+            pakFiles = Global::pakFiles;
+        }
+
+        for (const auto& pakFile : pakFiles)
+        {
+            const Pak::TocEntry* entry = pakFile->Find( path );
+
+            if (entry != nullptr)
+            {
+                outPakFile = pakFile;
+                return entry;
+            }
+        }
+
+        return nullptr;
+    }
+}
+
+FileMapping::~FileMapping()
+{
+#if _MSC_VER
+    if (bytes != nullptr)
+    {
+        UnmapViewOfFile( bytes );
+    }
+
+    if (mapping != nullptr)
+    {
+        CloseHandle( mapping );
+    }
+
+    if (file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle( file );
+    }
+#else
+    if (bytes != nullptr)
+    {
+        munmap( const_cast< unsigned char* >( bytes ), byteCount );
+    }
+#endif
+}
+
+PakFile::~PakFile()
+{
+    if (isEntryValidated)
+    {
+        Statistics::TrackFree( ae3d::System::Statistics::MemoryTag::PakFiles, entryCount * sizeof( std::atomic< bool > ) );
+    }
+}
+
+const Pak::TocEntry* PakFile::Find( const std::string& filePath ) const
+{
+    const std::uint64_t hash = Pak::HashPath( filePath.data(), filePath.size() );
+    const Pak::TocEntry* end = toc + entryCount;
+    const Pak::TocEntry* entry = std::lower_bound( toc, end, hash, []( const Pak::TocEntry& a, std::uint64_t b ) { return a.pathHash < b; } );
+
+    for (; entry != end && entry->pathHash == hash; ++entry)
+    {
+        if (entry->pathLength != filePath.size() || std::memcmp( paths + entry->pathOffset, filePath.data(), filePath.size() ) != 0)
+        {
+            continue;
+        }
+
+        std::atomic< bool >& isValidated = isEntryValidated[ entry - toc ];
+
+        // Only the block table is read, so partial reads and views don't touch the rest of the entry.
+        if (!isValidated.load( std::memory_order_acquire ))
+        {
+            if (StoredSize( *this, *entry ) == 0 && entry->size != 0)
+            {
+                ae3d::System::Print( "FileSystem: %s in %s is corrupted.\n", filePath.c_str(), path.c_str() );
+                return nullptr;
+            }
+
+            isValidated.store( true, std::memory_order_release );
+        }
+
+        return entry;
+    }
+
+    return nullptr;
+}
+
+bool PakFile::Read( const Pak::TocEntry& entry, std::size_t offset, std::size_t size, unsigned char* outData ) const
+{
+    if (offset > entry.size || size > entry.size - offset)
+    {
+        return false;
+    }
+
+    if (size == 0)
+    {
+        return true;
+    }
+
+    const unsigned char* contents = bytes + entry.offset;
+
+    if (!(entry.flags & Pak::EntryCompressed))
+    {
+        std::memcpy( outData, contents + offset, size );
+        return true;
+    }
+
+    Pak::CompressedHeader header;
+    std::memcpy( &header, contents, sizeof( header ) );
+
+    const std::size_t firstBlock = offset / header.blockSize;
+    const std::size_t endBlock = (offset + size - 1) / header.blockSize + 1;
+
+    // A block starts after the sizes of the blocks before it.
+    std::vector< std::uint64_t > blockOffsets( endBlock - firstBlock );
+    std::vector< std::uint32_t > blockSizes( endBlock - firstBlock );
+    std::uint64_t blockOffset = sizeof( header ) + (std::uint64_t)header.blockCount * sizeof( std::uint32_t );
+
+    for (std::size_t b = 0; b < endBlock; ++b)
+    {
+        std::uint32_t blockSize;
+        std::memcpy( &blockSize, contents + sizeof( header ) + b * sizeof( std::uint32_t ), sizeof( blockSize ) );
+
+        if (b >= firstBlock)
+        {
+            blockOffsets[ b - firstBlock ] = blockOffset;
+            blockSizes[ b - firstBlock ] = blockSize;
+        }
+
+        blockOffset += blockSize & ~Pak::BlockUncompressed;
+    }
+
+    const std::uint64_t rangeBegin = offset;
+    const std::uint64_t rangeEnd = rangeBegin + size;
+    std::atomic< bool > isValid( true );
+
+    auto decodeBlocks = [&]( std::size_t begin, std::size_t end )
+    {
+        std::vector< unsigned char > partialBlock;
+
+        for (std::size_t i = begin; i < end && isValid; ++i)
+        {
+            const std::uint64_t blockIndex = firstBlock + i;
+            const std::uint64_t blockBegin = blockIndex * header.blockSize;
+            const std::size_t blockLength = (std::size_t)std::min( (std::uint64_t)header.blockSize, entry.size - blockBegin );
+            const unsigned char* src = contents + blockOffsets[ i ];
+            const std::size_t srcSize = blockSizes[ i ] & ~Pak::BlockUncompressed;
+
+            // Blocks inside the range are decoded directly into outData, partially covered ones at the ends through a temporary.
+            const bool isInsideRange = blockBegin >= rangeBegin && blockBegin + blockLength <= rangeEnd;
+
+            if (!isInsideRange)
+            {
+                partialBlock.resize( blockLength );
+            }
+
+            unsigned char* dst = isInsideRange ? outData + (blockBegin - rangeBegin) : partialBlock.data();
+
+            if (blockSizes[ i ] & Pak::BlockUncompressed)
+            {
+                std::memcpy( dst, src, blockLength );
+            }
+            else if (!Lz4::Decompress( src, srcSize, dst, blockLength ))
+            {
+                isValid = false;
+                return;
+            }
+
+            if (!isInsideRange)
+            {
+                const std::uint64_t copyBegin = std::max( rangeBegin, blockBegin );
+                const std::uint64_t copyEnd = std::min( rangeEnd, blockBegin + blockLength );
+                std::memcpy( outData + (copyBegin - rangeBegin), partialBlock.data() + (copyBegin - blockBegin), copyEnd - copyBegin );
+            }
+        }
+    };
+
+    const std::size_t blockCount = endBlock - firstBlock;
+    const std::size_t threadCount = std::min( (std::size_t)ae3d::WorkerPool::GetThreadCount(), blockCount / MinBlocksPerThread );
+
+    if (threadCount < 2)
+    {
+        decodeBlocks( 0, blockCount );
+    }
+    else
+    {
+        struct Split
+        {
+            const decltype( decodeBlocks )* decode;
+            std::size_t blockCount;
+            std::size_t blocksPerJob;
+        } split = { &decodeBlocks, blockCount, (blockCount + threadCount - 1) / threadCount };
+
+        ae3d::WorkerPool::Run( (int)threadCount, []( int jobIndex, void* userData )
+        {
+            const Split& jobSplit = *static_cast< const Split* >( userData );
+            const std::size_t begin = std::min( jobSplit.blockCount, jobIndex * jobSplit.blocksPerJob );
+            (*jobSplit.decode)( begin, std::min( jobSplit.blockCount, begin + jobSplit.blocksPerJob ) );
+        }, &split );
+    }
+
+    if (!isValid)
+    {
+        ae3d::System::Print( "FileSystem: Could not decompress an entry in %s.\n", path.c_str() );
+    }
+
+    return isValid;
 }
 
 #if VK_USE_PLATFORM_ANDROID_KHR
@@ -59,7 +500,7 @@ extern AAssetManager* assetManager;
 ae3d::FileSystem::FileContentsData ae3d::FileSystem::FileContents( const char* path )
 {
     ae3d::FileSystem::FileContentsData outData;
-    outData.path = outData.path = path == nullptr ? "" : std::string( GetFullPath( path ) );
+    outData.path = outData.path = path == nullptr ? "" : GetFullPath( path );
 
     AAsset* file = AAssetManager_open( assetManager, path, AASSET_MODE_BUFFER );
 
@@ -76,23 +517,22 @@ ae3d::FileSystem::FileContentsData ae3d::FileSystem::FileContents( const char* p
 #else
 ae3d::FileSystem::FileContentsData ae3d::FileSystem::FileContents( const char* path )
 {
+    AE3D_ZONE( "FileSystem::FileContents" );
+
     ae3d::FileSystem::FileContentsData outData;
-    outData.path = path == nullptr ? "" : std::string( GetFullPath( path ) );
+    outData.path = path == nullptr ? "" : GetFullPath( path );
 #if defined __APPLE__
         outData.pathWithoutBundle = path;
 #endif
 
-    for (const auto& pakFile : Global::pakFiles)
+    std::shared_ptr< PakFile > pakFile;
+    const Pak::TocEntry* pakEntry = FindInPakFiles( outData.path, pakFile );
+
+    if (pakEntry != nullptr)
     {
-        for (const auto& entry : pakFile.entries)
-        {
-            if (entry.path == outData.path)
-            {
-                outData.data = entry.contents;
-                outData.isLoaded = true;
-                return outData;
-            }
-        }
+        outData.data.resize( (std::size_t)pakEntry->size );
+        outData.isLoaded = pakFile->Read( *pakEntry, 0, outData.data.size(), outData.data.data() );
+        return outData;
     }
 
     std::ifstream in( outData.path.c_str(), std::ifstream::ate | std::ifstream::binary );
@@ -113,7 +553,70 @@ ae3d::FileSystem::FileContentsData ae3d::FileSystem::FileContents( const char* p
 }
 #endif
 
-void ae3d::FileSystem::LoadPakFile( const char* path )
+ae3d::FileSystem::FileView ae3d::FileSystem::PakFileView( const char* path )
+{
+    FileView view;
+    std::shared_ptr< PakFile > pakFile;
+    const Pak::TocEntry* entry = path != nullptr ? FindInPakFiles( GetFullPath( path ), pakFile ) : nullptr;
+
+    if (entry != nullptr)
+    {
+        view.size = (std::size_t)entry->size;
+        view.data = (entry->flags & Pak::EntryCompressed) ? nullptr : pakFile->bytes + entry->offset;
+    }
+
+    return view;
+}
+
+ae3d::FileSystem::MappedFile::MappedFile( const char* aPath )
+    : path( aPath == nullptr ? "" : GetFullPath( aPath ) )
+{
+    AE3D_ZONE( "FileSystem::MappedFile" );
+
+    std::shared_ptr< PakFile > pakFile;
+    const Pak::TocEntry* entry = FindInPakFiles( path, pakFile );
+
+    if (entry != nullptr && !(entry->flags & Pak::EntryCompressed))
+    {
+        view.data = pakFile->bytes + entry->offset;
+        view.size = (std::size_t)entry->size;
+        owner = pakFile;
+        isLoaded = true;
+        return;
+    }
+
+#if !VK_USE_PLATFORM_ANDROID_KHR
+    if (entry == nullptr)
+    {
+        auto mapping = std::make_shared< FileMapping >();
+
+        if (MapFile( path.c_str(), *mapping ))
+        {
+            view.data = mapping->bytes;
+            view.size = mapping->byteCount;
+            owner = mapping;
+            isLoaded = true;
+            return;
+        }
+    }
+#endif
+
+    // Compressed .pak entries, empty files and Android assets are read into memory.
+    auto contents = std::make_shared< FileContentsData >( FileContents( aPath ) );
+    view.data = contents->data.data();
+    view.size = contents->data.size();
+    isLoaded = contents->isLoaded;
+    owner = contents;
+}
+
+bool ae3d::FileSystem::ReadPakFileRange( const char* path, std::size_t offset, std::size_t size, unsigned char* outData )
+{
+    std::shared_ptr< PakFile > pakFile;
+    const Pak::TocEntry* entry = path != nullptr ? FindInPakFiles( GetFullPath( path ), pakFile ) : nullptr;
+    return entry != nullptr && pakFile->Read( *entry, offset, size, outData );
+}
+
+void ae3d::FileSystem::LoadPakFile( const char* path, bool verifyChecksums )
 {
     if (path == nullptr)
     {
@@ -121,45 +624,227 @@ void ae3d::FileSystem::LoadPakFile( const char* path )
         return;
     }
 
-    unsigned entryCount = 0;
-    std::ifstream ifs( path );
-    if (!ifs.is_open())
+    {
+        std::lock_guard< std::mutex > lock( Global::pakFilesMutex );
+
+        for (const auto& pakFile : Global::pakFiles)
+        {
+            if (pakFile->path == path)
+            {
+                System::Print( "LoadPakFile: %s is already loaded\n", path );
+                return;
+            }
+        }
+    }
+
+    std::shared_ptr< PakFile > pakFile = std::make_shared< PakFile >();
+    pakFile->path = path;
+
+    if (!MapFile( path, *pakFile ))
     {
         System::Print( "LoadPakFile: Could not open %s\n", path );
         return;
     }
 
-    ifs.read( (char*)&entryCount, 4 );
-    auto& pakFile = Global::pakFiles[ Global::packFileCount ];
-	++Global::packFileCount;
-    pakFile.entries.resize( entryCount );
-    pakFile.path = path;
+    if (!ParseToc( *pakFile ))
+    {
+        System::Print( "LoadPakFile: %s is not a valid version %u .pak file. Rebuild it with CombineFiles.\n", path, Pak::Version );
+        return;
+    }
 
-    for (unsigned i = 0; i < entryCount; ++i)
+    if (verifyChecksums && !VerifyChecksums( *pakFile ))
     {
-        auto& entry = pakFile.entries[i];
-        char entryPath[ 128 ];
-        ifs.read( &entryPath[ 0 ], 128 );
-        entry.path = entryPath;
-        unsigned entrySize = 0;
-        ifs.read( (char*)&entrySize, 4 );
-        entry.contents.resize( entrySize );
-        ifs.read( (char*)entry.contents.data(), entrySize );
+        System::Print( "LoadPakFile: Not loading %s because it is corrupted.\n", path );
+        return;
     }
+
+    std::lock_guard< std::mutex > lock( Global::pakFilesMutex );
+    Global::pakFiles.push_back( pakFile );
 }
 
 void ae3d::FileSystem::UnloadPakFile( const char* path )
 {
-    int i = 0;
+    if (path == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard< std::mutex > lock( Global::pakFilesMutex );
 
-    for (const PakFile& pakFile : Global::pakFiles)
+    for (std::size_t i = 0; i < Global::pakFiles.size(); ++i)
     {
-        if (pakFile.path == std::string( path ))
+        if (Global::pakFiles[ i ]->path == path)
         {
-			// FIXME: Do something here.
-            //Global::pakFiles.erase( std::begin( Global::pakFiles ) + i );
+            Global::pakFiles.erase( std::begin( Global::pakFiles ) + i );
             return;
         }
-        ++i;
     }
+
+    System::Print( "UnloadPakFile: %s is not loaded\n", path );
+}
+
+namespace AsyncGlobal
+{
+    struct Request
+    {
+        unsigned id = 0;
+        std::string path;
+        ae3d::FileSystem::ReadPriority priority = ae3d::FileSystem::ReadPriority::Normal;
+        std::function< void( ae3d::FileSystem::FileContentsData& ) > callback;
+    };
+
+    /// A worker takes up to this many queued requests at once, so many small reads don't wake it up for each one.
+    constexpr std::size_t MaxBatchSize = 8;
+
+    struct ThreadPool
+    {
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard< std::mutex > lock( mutex );
+                isStopping = true;
+            }
+
+            wakeCondition.notify_all();
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable wakeCondition;
+        std::condition_variable idleCondition;
+        /// Sorted by priority, then by id.
+        std::vector< Request > queue;
+        std::vector< std::thread > threads;
+        unsigned nextRequestId = 1;
+        std::size_t runningCount = 0;
+        bool isStopping = false;
+    };
+
+    ThreadPool pool;
+
+    void RunWorker()
+    {
+        std::vector< Request > batch;
+
+        for (;;)
+        {
+            {
+                std::unique_lock< std::mutex > lock( pool.mutex );
+                pool.wakeCondition.wait( lock, []() { return pool.isStopping || !pool.queue.empty(); } );
+
+                if (pool.isStopping)
+                {
+                    return;
+                }
+
+                // Leaves work for the other threads when there are only a few requests.
+                const std::size_t batchSize = std::max( std::size_t( 1 ), std::min( MaxBatchSize, pool.queue.size() / pool.threads.size() ) );
+                const ae3d::FileSystem::ReadPriority priority = pool.queue.front().priority;
+                std::size_t count = 0;
+
+                while (count < batchSize && count < pool.queue.size() && pool.queue[ count ].priority == priority)
+                {
+                    batch.push_back( std::move( pool.queue[ count ] ) );
+                    ++count;
+                }
+
+                pool.queue.erase( pool.queue.begin(), pool.queue.begin() + count );
+                pool.runningCount += count;
+            }
+
+            for (Request& request : batch)
+            {
+                ae3d::FileSystem::FileContentsData contents = ae3d::FileSystem::FileContents( request.path.c_str() );
+                request.callback( contents );
+            }
+
+            {
+                std::lock_guard< std::mutex > lock( pool.mutex );
+                pool.runningCount -= batch.size();
+
+                if (pool.queue.empty() && pool.runningCount == 0)
+                {
+                    pool.idleCondition.notify_all();
+                }
+            }
+
+            batch.clear();
+        }
+    }
+}
+
+unsigned ae3d::FileSystem::FileContentsAsync( const char* path, ReadPriority priority, const std::function< void( FileContentsData& ) >& callback )
+{
+    AsyncGlobal::Request request;
+    request.path = path == nullptr ? "" : path;
+    request.priority = priority;
+    request.callback = callback;
+
+    std::lock_guard< std::mutex > lock( AsyncGlobal::pool.mutex );
+
+    if (AsyncGlobal::pool.threads.empty())
+    {
+        const unsigned threadCount = std::max( 2u, std::min( 4u, std::thread::hardware_concurrency() / 2 ) );
+
+        for (unsigned i = 0; i < threadCount; ++i)
+        {
+            AsyncGlobal::pool.threads.emplace_back( AsyncGlobal::RunWorker );
+        }
+    }
+
+    request.id = AsyncGlobal::pool.nextRequestId++;
+    const unsigned id = request.id;
+
+    auto& queue = AsyncGlobal::pool.queue;
+    const auto position = std::upper_bound( queue.begin(), queue.end(), priority, []( ReadPriority a, const AsyncGlobal::Request& b ) { return a > b.priority; } );
+    queue.insert( position, std::move( request ) );
+
+    AsyncGlobal::pool.wakeCondition.notify_one();
+    return id;
+}
+
+std::future< ae3d::FileSystem::FileContentsData > ae3d::FileSystem::FileContentsAsync( const char* path, ReadPriority priority )
+{
+    auto promise = std::make_shared< std::promise< FileContentsData > >();
+    std::future< FileContentsData > future = promise->get_future();
+    FileContentsAsync( path, priority, [promise]( FileContentsData& contents ) { promise->set_value( std::move( contents ) ); } );
+    return future;
+}
+
+bool ae3d::FileSystem::CancelFileContentsAsync( unsigned requestId )
+{
+    AsyncGlobal::Request request;
+    {
+        std::lock_guard< std::mutex > lock( AsyncGlobal::pool.mutex );
+        auto& queue = AsyncGlobal::pool.queue;
+        const auto it = std::find_if( queue.begin(), queue.end(), [requestId]( const AsyncGlobal::Request& r ) { return r.id == requestId; } );
+
+        if (it == queue.end())
+        {
+            return false;
+        }
+
+        request = std::move( *it );
+        queue.erase( it );
+
+        if (queue.empty() && AsyncGlobal::pool.runningCount == 0)
+        {
+            AsyncGlobal::pool.idleCondition.notify_all();
+        }
+    }
+
+    FileContentsData contents;
+    contents.path = request.path;
+    request.callback( contents );
+    return true;
+}
+
+void ae3d::FileSystem::WaitForFileContentsAsync()
+{
+    std::unique_lock< std::mutex > lock( AsyncGlobal::pool.mutex );
+    AsyncGlobal::pool.idleCondition.wait( lock, []() { return AsyncGlobal::pool.queue.empty() && AsyncGlobal::pool.runningCount == 0; } );
 }
@@ -1,57 +1,250 @@
 // This is an independent project of an individual developer. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "FileWatcher.hpp"
-#include <ctime>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+#if _MSC_VER
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
 #include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if __linux__
+#include <cerrno>
+#include <sys/inotify.h>
+#endif
+#include "Statistics.hpp"
 
 ae3d::FileWatcher fileWatcher;
 
-void ae3d::FileWatcher::AddFile( const std::string& path, void(*updateFunc)(const std::string&) )
+namespace
 {
-    pathToEntry[ path ] = Entry();
-    pathToEntry[ path ].path = path;
-    pathToEntry[ path ].updateFunc = updateFunc;
-
-    struct stat inode;
+    /// Changes are reloaded after a file has not changed for this long, so a file that is written in several steps is reloaded once.
+    constexpr std::chrono::milliseconds DebounceWindow( 100 );
+    /// Modification times of files that are not notified are compared at most this often.
+    constexpr std::chrono::milliseconds ModificationTimePollInterval( 250 );
 
-    if (stat( path.c_str(), &inode ) != -1)
+    /// \return Modification time of path in nanoseconds, or -1 if path could not be found.
+    std::int64_t ModificationTimeNS( const std::string& path )
     {
 #if _MSC_VER
-        tm timeinfo;
-        localtime_s( &timeinfo, &inode.st_mtime );
-        tm* timeinfo2 = &timeinfo;
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+        if (!GetFileAttributesExA( path.c_str(), GetFileExInfoStandard, &attributes ))
+        {
+            return -1;
+        }
+
+        // FILETIME is in 100 nanosecond intervals.
+        return (std::int64_t)(((std::uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime) * 100;
+#else
+        struct stat inode;
+
+        if (stat( path.c_str(), &inode ) == -1)
+        {
+            return -1;
+        }
+#if __APPLE__
+        const std::int64_t seconds = inode.st_mtimespec.tv_sec;
+        return seconds * 1000000000 + inode.st_mtimespec.tv_nsec;
 #else
-        tm* timeinfo2 = std::localtime( &inode.st_mtime );
+        const std::int64_t seconds = inode.st_mtim.tv_sec;
+        return seconds * 1000000000 + inode.st_mtim.tv_nsec;
+#endif
 #endif
-        pathToEntry[ path ].hour = timeinfo2->tm_hour;
-        pathToEntry[ path ].minute = timeinfo2->tm_min;
-        pathToEntry[ path ].second = timeinfo2->tm_sec;
+    }
+
+    /// \return Directory part of path, "." if path doesn't have one.
+    std::string DirectoryOf( const std::string& path )
+    {
+        const std::size_t slash = path.find_last_of( '/' );
+
+        if (slash == std::string::npos)
+        {
+            return ".";
+        }
+
+        return slash == 0 ? "/" : path.substr( 0, slash );
     }
 }
 
-void ae3d::FileWatcher::Poll()
+ae3d::FileWatcher::~FileWatcher()
 {
-    struct stat inode = {};
+#if __linux__
+    if (notifyFd != -1)
+    {
+        close( notifyFd );
+    }
+#endif
+}
 
-    for (auto& entry : pathToEntry)
+void ae3d::FileWatcher::AddFile( const std::string& path, void(*updateFunc)(const std::string&) )
+{
+    Entry& entry = pathToEntry[ path ];
+    entry.path = path;
+    entry.updateFunc = updateFunc;
+    entry.modifiedNS = ModificationTimeNS( path );
+    entry.isNotified = entry.isNotified || WatchDirectory( path );
+}
+
+bool ae3d::FileWatcher::WatchDirectory( const std::string& path )
+{
+#if __linux__
+    if (notifyFd == -1)
     {
-        if (stat( entry.second.path.c_str(), &inode ) != -1)
+        notifyFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+        if (notifyFd == -1)
         {
-#if _MSC_VER
-            tm timeinfo;
-            localtime_s( &timeinfo, &inode.st_mtime );
-            tm* timeinfo2 = &timeinfo;
+            return false;
+        }
+    }
+
+    const std::string directory = DirectoryOf( path );
+    auto it = directoryToWatch.find( directory );
+
+    if (it == directoryToWatch.end())
+    {
+        const int watch = inotify_add_watch( notifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE );
+
+        if (watch == -1)
+        {
+            return false;
+        }
+
+        it = directoryToWatch.insert( std::make_pair( directory, watch ) ).first;
+    }
+
+    const std::size_t slash = path.find_last_of( '/' );
+    watchToNameToPath[ it->second ][ slash == std::string::npos ? path : path.substr( slash + 1 ) ] = path;
+    return true;
 #else
-            tm* timeinfo2 = std::localtime( &inode.st_mtime );
+    (void)path;
+    return false;
 #endif
+}
+
+void ae3d::FileWatcher::ReadNotifications()
+{
+#if __linux__
+    if (notifyFd == -1)
+    {
+        return;
+    }
+
+    alignas( inotify_event ) char buffer[ 4096 ];
+    const auto now = std::chrono::steady_clock::now();
+
+    for (;;)
+    {
+        const ssize_t length = read( notifyFd, buffer, sizeof( buffer ) );
 
-            if (timeinfo2->tm_hour != entry.second.hour || timeinfo2->tm_min != entry.second.minute || timeinfo2->tm_sec != entry.second.second)
+        if (length <= 0)
+        {
+            // EAGAIN means there are no more events.
+            if (length == -1 && errno == EINTR)
+            {
+                continue;
+            }
+
+            return;
+        }
+
+        for (ssize_t offset = 0; offset < length; )
+        {
+            const inotify_event* event = reinterpret_cast< const inotify_event* >( buffer + offset );
+            offset += (ssize_t)(sizeof( inotify_event ) + event->len);
+
+            const auto names = watchToNameToPath.find( event->wd );
+
+            if (names == watchToNameToPath.end() || event->len == 0)
             {
-                entry.second.updateFunc( entry.second.path );
-                entry.second.hour = timeinfo2->tm_hour;
-                entry.second.minute = timeinfo2->tm_min;
-                entry.second.second = timeinfo2->tm_sec;
+                continue;
             }
+
+            const auto name = names->second.find( event->name );
+
+            if (name != names->second.end())
+            {
+                pathToChangeTime[ name->second ] = now;
+            }
+        }
+    }
+#endif
+}
+
+void ae3d::FileWatcher::PollModificationTimes()
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    if (now - lastModificationTimePoll < ModificationTimePollInterval)
+    {
+        return;
+    }
+
+    lastModificationTimePoll = now;
+
+    for (auto& entry : pathToEntry)
+    {
+        if (entry.second.isNotified)
+        {
+            continue;
         }
+
+        const std::int64_t modifiedNS = ModificationTimeNS( entry.second.path );
+
+        if (modifiedNS != -1 && modifiedNS != entry.second.modifiedNS)
+        {
+            entry.second.modifiedNS = modifiedNS;
+            pathToChangeTime[ entry.first ] = now;
+        }
+    }
+}
+
+void ae3d::FileWatcher::Poll()
+{
+    AE3D_ZONE( "FileWatcher::Poll" );
+
+    ReadNotifications();
+    PollModificationTimes();
+
+    if (pathToChangeTime.empty())
+    {
+        return;
+    }
+
+    typedef std::pair< void(*)(const std::string&), std::string > Reload;
+    const auto now = std::chrono::steady_clock::now();
+    std::vector< Reload > reloads;
+
+    for (auto it = pathToChangeTime.begin(); it != pathToChangeTime.end(); )
+    {
+        if (now - it->second < DebounceWindow)
+        {
+            ++it;
+            continue;
+        }
+
+        const auto entry = pathToEntry.find( it->first );
+
+        if (entry != pathToEntry.end() && entry->second.updateFunc != nullptr)
+        {
+            reloads.push_back( std::make_pair( entry->second.updateFunc, entry->first ) );
+        }
+
+        it = pathToChangeTime.erase( it );
+    }
+
+    // Reloads of the same kind of asset are dispatched together. updateFunc can call AddFile(), so entries are not referenced while reloading.
+    std::stable_sort( reloads.begin(), reloads.end(), []( const Reload& a, const Reload& b ) { return std::less< void(*)(const std::string&) >()( a.first, b.first ); } );
+
+    for (const auto& reload : reloads)
+    {
+        reload.first( reload.second );
     }
 }
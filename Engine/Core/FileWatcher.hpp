@@ -1,28 +1,53 @@
 #pragma once
 
-#include <string>
+#include <chrono>
+#include <cstdint>
 #include <map>
+#include <string>
 
 namespace ae3d
 {
-    /** Keeps track of files and calls updateFunc when they have changed on disk. This enables asset hotloading. */
+    /** Keeps track of files and calls updateFunc when they have changed on disk. This enables asset hotloading.
+        On Linux changes are received from inotify, elsewhere file modification times are polled. */
     class FileWatcher
     {
     public:
+        FileWatcher() = default;
+        FileWatcher( const FileWatcher& ) = delete;
+        FileWatcher& operator=( const FileWatcher& ) = delete;
+        ~FileWatcher();
+
         void AddFile( const std::string& path, void(*updateFunc)(const std::string&)  );
-        // Scans for all watched file modification timestamps and calls updateFunc if they have been updated.
+        // Collects changes and calls updateFunc for files that have not changed again during the debounce window.
         void Poll();
 
     private:
         struct Entry
         {
-            int hour = 0;
-            int minute = 0;
-            int second = 0;
+            /// Modification time in nanoseconds, -1 if the file could not be found.
+            std::int64_t modifiedNS = -1;
             std::string path;
             void(*updateFunc)(const std::string&) = nullptr;
+            /// True if changes are received from inotify, otherwise the modification time is polled.
+            bool isNotified = false;
         };
-        
+
+        /// Adds path's directory into inotify. Directories are watched instead of files, because editors often save by replacing the file.
+        /// \return True if changes of path will be notified.
+        bool WatchDirectory( const std::string& path );
+        /// Reads pending inotify events into pathToChangeTime.
+        void ReadNotifications();
+        /// Compares modification times of entries that are not notified.
+        void PollModificationTimes();
+
         std::map< std::string, Entry > pathToEntry;
-    };    
+        /// Changed files and the time of their latest change. Entries are reloaded when they have not changed for the debounce window.
+        std::map< std::string, std::chrono::steady_clock::time_point > pathToChangeTime;
+        std::chrono::steady_clock::time_point lastModificationTimePoll;
+        /// inotify descriptor, -1 if not initialized or not supported.
+        int notifyFd = -1;
+        /// inotify watch descriptor to watched file names in its directory and their paths in pathToEntry.
+        std::map< int, std::map< std::string, std::string > > watchToNameToPath;
+        std::map< std::string, int > directoryToWatch;
+    };
 }
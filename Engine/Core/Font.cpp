@@ -6,9 +6,11 @@
 #include "Array.hpp"
 #include "FileSystem.hpp"
 #include "System.hpp"
+#include "Statistics.hpp"
 #include "Texture2D.hpp"
 #include "VertexBuffer.hpp"
 #include "Vec3.hpp"
+#include "ViewStreamBuf.hpp"
 
 namespace BlockType
 {
@@ -69,6 +71,8 @@ void ae3d::Font::CreateVertexBuffer( const char* text, const Vec4& color, Vertex
     
     ae3d::VertexBuffer::VertexPTC* vertices = new ae3d::VertexBuffer::VertexPTC[ textStr.size() * 6 ];
     ae3d::VertexBuffer::Face* faces = new ae3d::VertexBuffer::Face[ textStr.size() * 2 ];
+    const std::size_t tempBytes = textStr.size() * (6 * sizeof( ae3d::VertexBuffer::VertexPTC ) + 2 * sizeof( ae3d::VertexBuffer::Face ));
+    Statistics::TrackAlloc( System::Statistics::MemoryTag::Font, tempBytes );
 
     float accumX = 0;
     float y = 0;
@@ -140,16 +144,32 @@ void ae3d::Font::CreateVertexBuffer( const char* text, const Vec4& color, Vertex
 
     delete[] vertices;
     delete[] faces;
+    Statistics::TrackFree( System::Statistics::MemoryTag::Font, tempBytes );
 }
 
 void ae3d::Font::LoadBMFont( Texture2D* fontTex, const FileSystem::FileContentsData& metaData )
 {
+    FileSystem::FileView view;
+    view.data = metaData.data.data();
+    view.size = metaData.data.size();
+    LoadBMFont( fontTex, view, metaData.path );
+}
+
+void ae3d::Font::LoadBMFont( Texture2D* fontTex, const FileSystem::MappedFile& metaData )
+{
+    LoadBMFont( fontTex, metaData.GetView(), metaData.GetPath() );
+}
+
+void ae3d::Font::LoadBMFont( Texture2D* fontTex, const FileSystem::FileView& metaData, const std::string& path )
+{
+    AE3D_ZONE( "Font::LoadBMFont" );
     if (fontTex != nullptr)
     {
         texture = fontTex;
     }
 
-    std::stringstream metaStream( std::string( std::begin( metaData.data ), std::end( metaData.data ) ) );
+    FileSystem::ViewStreamBuf metaBuf( metaData.data, metaData.size );
+    std::istream metaStream( &metaBuf );
     std::string token;
     // Determines the encoding (text or binary).
     metaStream >> token;
@@ -160,13 +180,14 @@ void ae3d::Font::LoadBMFont( Texture2D* fontTex, const FileSystem::FileContentsD
     }
     else
     {
-        LoadBMFontMetaBinary( metaData );
+        LoadBMFontMetaBinary( metaData, path );
     }
 }
 
-void ae3d::Font::LoadBMFontMetaText( const FileSystem::FileContentsData& metaData )
+void ae3d::Font::LoadBMFontMetaText( const FileSystem::FileView& metaData )
 {
-    std::stringstream metaStream( std::string( metaData.data.begin(), metaData.data.end() ) );
+    FileSystem::ViewStreamBuf metaBuf( metaData.data, metaData.size );
+    std::istream metaStream( &metaBuf );
 
     std::string line;
     std::getline( metaStream, line );
@@ -267,16 +288,17 @@ void ae3d::Font::LoadBMFontMetaText( const FileSystem::FileContentsData& metaDat
     }
 }
 
-void ae3d::Font::LoadBMFontMetaBinary(const FileSystem::FileContentsData& metaData)
+void ae3d::Font::LoadBMFontMetaBinary( const FileSystem::FileView& metaData, const std::string& path )
 {
-    std::stringstream ifs( std::string( metaData.data.begin(), metaData.data.end() ) );
+    FileSystem::ViewStreamBuf metaBuf( metaData.data, metaData.size );
+    std::istream ifs( &metaBuf );
     unsigned char header[ 4 ];
     ifs.read( (char*)&header[ 0 ], 4 );
     const bool validHeaderHead = header[ 0 ] == 66 && header[ 1 ] == 77 && header[ 2 ] == 70;
     
     if (!validHeaderHead)
     {
-        System::Print( "%s does not contain a valid BMFont header!\n", metaData.path.c_str() );
+        System::Print( "%s does not contain a valid BMFont header!\n", path.c_str() );
         return;
     }
     
@@ -284,7 +306,7 @@ void ae3d::Font::LoadBMFontMetaBinary(const FileSystem::FileContentsData& metaDa
     
     if (!validHeaderTail)
     {
-        System::Print( "%s contains a BMFont header but the version is invalid! Valid is version 3.\n", metaData.path.c_str() );
+        System::Print( "%s contains a BMFont header but the version is invalid! Valid is version 3.\n", path.c_str() );
         return;
     }
     
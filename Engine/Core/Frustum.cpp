@@ -1,6 +1,7 @@
 // This is an independent project of an individual developer. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "Frustum.hpp"
+#include "Matrix.hpp"
 
 using namespace ae3d;
 
@@ -60,6 +61,7 @@ void Frustum::SetProjection( float fieldOfView, float aAspect, float aNear, floa
 {
     zNear = aNear;
     zFar  = aFar;
+    isOrthographic = false;
     
     // Computes width and height of the near and far plane sections.
     const float deg2rad = 3.14159265358979f / 180.0f;
@@ -74,6 +76,7 @@ void Frustum::SetProjection( float aLeft, float aRight, float aBottom, float aTo
 {
     zNear = aNear;
     zFar  = aFar;
+    isOrthographic = true;
     
     nearHeight = aTop - aBottom;
     nearWidth  = aRight - aLeft;
@@ -85,6 +88,8 @@ void Frustum::Update( const Vec3& cameraPosition, const Vec3& cameraDirection )
 {
     const Vec3 zAxis = cameraDirection;
     UpdateCornersAndCenters( cameraPosition, zAxis );
+    position = cameraPosition;
+    viewDirection = -zAxis.Normalized();
     
     enum FrustumPlane
     {
@@ -153,6 +158,53 @@ bool Frustum::BoxInFrustum( const Vec3& min, const Vec3& max ) const
     return result;
 }
 
+bool Frustum::ConeFacesAway( const Vec3& center, float radius, const Vec3& coneAxis, float coneCutoff ) const
+{
+    // An orthographic camera sees every point from the same direction, so the bounding sphere doesn't matter.
+    if (isOrthographic)
+    {
+        return Vec3::Dot( viewDirection, coneAxis ) > coneCutoff;
+    }
+
+    const Vec3 toCenter = center - position;
+    return Vec3::Dot( toCenter, coneAxis ) > coneCutoff * toCenter.Length() + radius;
+}
+
+void Frustum::GetLocalFrustum( const Matrix44& localToWorld, Frustum& outLocalFrustum ) const
+{
+    Matrix44 worldToLocal;
+    Matrix44::Invert( localToWorld, worldToLocal );
+
+    outLocalFrustum = *this;
+
+    Vec3* points[] = { &outLocalFrustum.nearTopLeft, &outLocalFrustum.nearTopRight, &outLocalFrustum.nearBottomLeft, &outLocalFrustum.nearBottomRight,
+                       &outLocalFrustum.farTopLeft, &outLocalFrustum.farTopRight, &outLocalFrustum.farBottomLeft, &outLocalFrustum.farBottomRight,
+                       &outLocalFrustum.nearCenter, &outLocalFrustum.farCenter, &outLocalFrustum.position };
+
+    for (Vec3* point : points)
+    {
+        Matrix44::TransformPoint( *point, worldToLocal, point );
+    }
+
+    Matrix44::TransformDirection( viewDirection, worldToLocal, &outLocalFrustum.viewDirection );
+    outLocalFrustum.viewDirection = outLocalFrustum.viewDirection.Normalized();
+
+    // A world-space plane n.p + d = 0 is (M n).p + (n.t + d) = 0 in local space, where p is transformed by M and translated by t.
+    const float* m = localToWorld.m;
+
+    for (Plane& plane : outLocalFrustum.planes)
+    {
+        const Vec3 normal = plane.normal;
+        plane.normal.x = m[ 0 ] * normal.x + m[ 1 ] * normal.y + m[  2 ] * normal.z;
+        plane.normal.y = m[ 4 ] * normal.x + m[ 5 ] * normal.y + m[  6 ] * normal.z;
+        plane.normal.z = m[ 8 ] * normal.x + m[ 9 ] * normal.y + m[ 10 ] * normal.z;
+        plane.d += m[ 12 ] * normal.x + m[ 13 ] * normal.y + m[ 14 ] * normal.z;
+        Matrix44::TransformPoint( plane.a, worldToLocal, &plane.a );
+        Matrix44::TransformPoint( plane.b, worldToLocal, &plane.b );
+        Matrix44::TransformPoint( plane.c, worldToLocal, &plane.c );
+    }
+}
+
 const Vec3& Frustum::NearTopLeft() const { return nearTopLeft; }
 const Vec3& Frustum::NearTopRight() const { return nearTopRight; }
 const Vec3& Frustum::NearBottomLeft() const { return nearBottomLeft; }
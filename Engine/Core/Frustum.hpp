@@ -4,6 +4,8 @@
 
 namespace ae3d
 {
+struct Matrix44;
+
 /**
  View Frustum.
  
@@ -36,6 +38,26 @@ public:
      \return False, if the box is not in the frustum.
      */
     bool BoxInFrustum( const Vec3& min, const Vec3& max ) const;
+
+    /**
+     Tests a cluster of triangles against the camera position using the cluster's normal cone.
+
+     \param center Center of a sphere that contains the cluster.
+     \param radius Radius of a sphere that contains the cluster.
+     \param coneAxis Normalized average of the cluster's face normals.
+     \param coneCutoff Sine of the angle between coneAxis and the face normal farthest from it. 1 if the cluster can't be culled.
+     \return True, if all the cluster's triangles face away from the camera.
+     */
+    bool ConeFacesAway( const Vec3& center, float radius, const Vec3& coneAxis, float coneCutoff ) const;
+
+    /**
+     Calculates the frustum in an object's local space, so the object's local bounds can be tested without transforming them.
+     Plane distances are scaled by the transform, so they are only valid for inside/outside tests.
+
+     \param localToWorld Object's local-to-world matrix.
+     \param outLocalFrustum Frustum in the object's local space.
+     */
+    void GetLocalFrustum( const Matrix44& localToWorld, Frustum& outLocalFrustum ) const;
     
     /**
      Sets values from which the frustum is calculated.
@@ -96,6 +118,9 @@ private:
     
     Vec3 nearCenter; // Near clipping plane center coordinate.
     Vec3 farCenter;  // Far clipping plane center coordinate.
+    Vec3 position; // Camera position.
+    Vec3 viewDirection; // Normalized direction the camera looks at.
+    bool isOrthographic = false;
     float zNear, zFar; // The same as in gluPerspective()
     float nearWidth, nearHeight;
     float farWidth, farHeight;
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/*
+  Compressor and decompressor for the LZ4 block format, used by .pak files.
+  A block is a sequence of: token, literal length bytes, literals, 16-bit match offset, match length bytes.
+  The last sequence only has literals.
+*/
+namespace Lz4
+{
+    const std::size_t MinMatch = 4;
+    /// The last match must start at least this many bytes before the end of the block.
+    const std::size_t MatchStartLimit = 12;
+    /// The last bytes of a block are always literals.
+    const std::size_t LastLiterals = 5;
+    const std::size_t MaxOffset = 65535;
+
+    /// \return Maximum compressed size of size bytes.
+    inline std::size_t CompressBound( std::size_t size )
+    {
+        return size + size / 255 + 16;
+    }
+
+    namespace Detail
+    {
+        inline std::uint32_t Read32( const unsigned char* p )
+        {
+            std::uint32_t value;
+            std::memcpy( &value, p, sizeof( value ) );
+            return value;
+        }
+
+        inline std::uint32_t Hash( std::uint32_t value, int hashBits )
+        {
+            return (value * 2654435761u) >> (32 - hashBits);
+        }
+
+        inline unsigned char* WriteLength( unsigned char* out, std::size_t length )
+        {
+            for (; length >= 255; length -= 255)
+            {
+                *out++ = 255;
+            }
+
+            *out++ = (unsigned char)length;
+            return out;
+        }
+
+        inline unsigned char* WriteSequence( unsigned char* out, const unsigned char* literals, std::size_t literalLength, std::size_t offset, std::size_t matchLength )
+        {
+            unsigned char* token = out++;
+            *token = (unsigned char)((literalLength < 15 ? literalLength : 15) << 4);
+
+            if (literalLength >= 15)
+            {
+                out = WriteLength( out, literalLength - 15 );
+            }
+
+            if (literalLength > 0)
+            {
+                std::memcpy( out, literals, literalLength );
+                out += literalLength;
+            }
+
+            if (matchLength == 0)
+            {
+                return out;
+            }
+
+            *out++ = (unsigned char)(offset & 0xFF);
+            *out++ = (unsigned char)(offset >> 8);
+
+            const std::size_t length = matchLength - MinMatch;
+            *token |= (unsigned char)(length < 15 ? length : 15);
+
+            if (length >= 15)
+            {
+                out = WriteLength( out, length - 15 );
+            }
+
+            return out;
+        }
+    }
+
+    /**
+      Compresses one block.
+
+      \param src Data to compress.
+      \param srcSize Size of src.
+      \param dst Output, must hold CompressBound( srcSize ) bytes.
+      \param level 1 is fastest. Higher levels search more candidates for each match, up to 9.
+      \return Compressed size.
+    */
+    inline std::size_t Compress( const unsigned char* src, std::size_t srcSize, unsigned char* dst, int level )
+    {
+        const int HashBits = 16;
+        const int maxAttempts = level <= 1 ? 1 : 1 << (level < 9 ? level : 9);
+
+        std::vector< std::int32_t > head( std::size_t( 1 ) << HashBits, -1 );
+        std::vector< std::int32_t > previous( maxAttempts > 1 ? srcSize : 0 );
+
+        unsigned char* out = dst;
+        std::size_t anchor = 0;
+        std::size_t pos = 0;
+        const std::size_t matchLimit = srcSize > LastLiterals ? srcSize - LastLiterals : 0;
+
+        while (srcSize > MatchStartLimit && pos < srcSize - MatchStartLimit)
+        {
+            const std::uint32_t sequence = Detail::Read32( src + pos );
+            const std::uint32_t hash = Detail::Hash( sequence, HashBits );
+            std::int32_t candidate = head[ hash ];
+
+            if (!previous.empty())
+            {
+                previous[ pos ] = candidate;
+            }
+
+            head[ hash ] = (std::int32_t)pos;
+
+            std::size_t bestLength = 0;
+            std::size_t bestOffset = 0;
+
+            for (int attempt = 0; attempt < maxAttempts && candidate >= 0 && pos - (std::size_t)candidate <= MaxOffset; ++attempt)
+            {
+                if (Detail::Read32( src + candidate ) == sequence)
+                {
+                    std::size_t length = MinMatch;
+
+                    while (pos + length < matchLimit && src[ candidate + length ] == src[ pos + length ])
+                    {
+                        ++length;
+                    }
+
+                    if (length > bestLength)
+                    {
+                        bestLength = length;
+                        bestOffset = pos - (std::size_t)candidate;
+                    }
+                }
+
+                candidate = previous.empty() ? -1 : previous[ candidate ];
+            }
+
+            if (bestLength < MinMatch)
+            {
+                ++pos;
+                continue;
+            }
+
+            out = Detail::WriteSequence( out, src + anchor, pos - anchor, bestOffset, bestLength );
+
+            // Positions inside the match are added to the chain so later matches can refer to them.
+            for (std::size_t i = pos + 1; i < pos + bestLength && i < srcSize - MatchStartLimit; ++i)
+            {
+                const std::uint32_t h = Detail::Hash( Detail::Read32( src + i ), HashBits );
+
+                if (!previous.empty())
+                {
+                    previous[ i ] = head[ h ];
+                }
+
+                head[ h ] = (std::int32_t)i;
+            }
+
+            pos += bestLength;
+            anchor = pos;
+        }
+
+        out = Detail::WriteSequence( out, src + anchor, srcSize - anchor, 0, 0 );
+        return (std::size_t)(out - dst);
+    }
+
+    /**
+      Decompresses one block. Validates the input, so corrupted data does not read or write out of bounds.
+
+      \param src Compressed block.
+      \param srcSize Size of src.
+      \param dst Output.
+      \param dstSize Uncompressed size of the block.
+      \return True if src decompressed into exactly dstSize bytes.
+    */
+    inline bool Decompress( const unsigned char* src, std::size_t srcSize, unsigned char* dst, std::size_t dstSize )
+    {
+        const unsigned char* in = src;
+        const unsigned char* const inEnd = src + srcSize;
+        std::size_t outPos = 0;
+
+        while (in < inEnd)
+        {
+            const unsigned token = *in++;
+            std::size_t literalLength = token >> 4;
+
+            if (literalLength == 15)
+            {
+                unsigned char byte = 255;
+
+                while (byte == 255)
+                {
+                    if (in == inEnd)
+                    {
+                        return false;
+                    }
+
+                    byte = *in++;
+                    literalLength += byte;
+                }
+            }
+
+            if (literalLength > (std::size_t)(inEnd - in) || literalLength > dstSize - outPos)
+            {
+                return false;
+            }
+
+            if (literalLength > 0)
+            {
+                std::memcpy( dst + outPos, in, literalLength );
+                in += literalLength;
+                outPos += literalLength;
+            }
+
+            if (in == inEnd)
+            {
+                break;
+            }
+
+            if (inEnd - in < 2)
+            {
+                return false;
+            }
+
+            const std::size_t offset = in[ 0 ] | (std::size_t)in[ 1 ] << 8;
+            in += 2;
+            std::size_t matchLength = (token & 15) + MinMatch;
+
+            if ((token & 15) == 15)
+            {
+                unsigned char byte = 255;
+
+                while (byte == 255)
+                {
+                    if (in == inEnd)
+                    {
+                        return false;
+                    }
+
+                    byte = *in++;
+                    matchLength += byte;
+                }
+            }
+
+            if (offset == 0 || offset > outPos || matchLength > dstSize - outPos)
+            {
+                return false;
+            }
+
+            unsigned char* out = dst + outPos;
+            const unsigned char* match = out - offset;
+
+            if (offset >= matchLength)
+            {
+                std::memcpy( out, match, matchLength );
+            }
+            else
+            {
+                for (std::size_t i = 0; i < matchLength; ++i)
+                {
+                    out[ i ] = match[ i ];
+                }
+            }
+
+            outPos += matchLength;
+        }
+
+        return outPos == dstSize;
+    }
+}
@@ -411,6 +411,24 @@ void Matrix44::Transpose( Matrix44& out ) const
 #endif
 }
 
+bool Matrix44::HasUniformScale() const
+{
+    const Vec3 axisX( m[ 0 ], m[ 1 ], m[ 2 ] );
+    const Vec3 axisY( m[ 4 ], m[ 5 ], m[ 6 ] );
+    const Vec3 axisZ( m[ 8 ], m[ 9 ], m[ 10 ] );
+
+    const float lengthSqX = Vec3::Dot( axisX, axisX );
+    const float lengthSqY = Vec3::Dot( axisY, axisY );
+    const float lengthSqZ = Vec3::Dot( axisZ, axisZ );
+
+    // Relative to the scale so that rounding errors in large and small scales are tolerated alike.
+    const float tolerance = 0.001f * lengthSqX;
+
+    return fabs( lengthSqY - lengthSqX ) <= tolerance && fabs( lengthSqZ - lengthSqX ) <= tolerance &&
+           fabs( Vec3::Dot( axisX, axisY ) ) <= tolerance && fabs( Vec3::Dot( axisX, axisZ ) ) <= tolerance &&
+           fabs( Vec3::Dot( axisY, axisZ ) ) <= tolerance;
+}
+
 void Matrix44::Translate( const Vec3& v )
 {
     Matrix44 translateMatrix;
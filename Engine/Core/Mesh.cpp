@@ -1,11 +1,18 @@
 #include "Mesh.hpp"
 #include <vector>
 #include <cstdint>
-#include <sstream>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include "FileSystem.hpp"
 #include "FileWatcher.hpp"
 #include "Matrix.hpp"
+#include "MeshFormat.hpp"
+#include "Statistics.hpp"
 #include "SubMesh.hpp"
 #include "System.hpp"
 #include "VertexBuffer.hpp"
@@ -14,6 +21,69 @@ using namespace ae3d;
 
 extern ae3d::FileWatcher fileWatcher;
 
+namespace
+{
+    /// \return Bytes of the submeshes and their CPU-side arrays.
+    std::size_t GetCpuBytes( const std::vector< SubMesh >& subMeshes )
+    {
+        std::size_t bytes = subMeshes.capacity() * sizeof( SubMesh );
+
+        for (const auto& subMesh : subMeshes)
+        {
+            bytes += subMesh.verticesPTNTC.capacity() * sizeof( VertexBuffer::VertexPTNTC );
+            bytes += subMesh.verticesPTNTC_Skinned.capacity() * sizeof( VertexBuffer::VertexPTNTC_Skinned );
+            bytes += subMesh.verticesPTN.capacity() * sizeof( VertexBuffer::VertexPTN );
+            bytes += subMesh.verticesPTNTC_Quantized.capacity() * sizeof( VertexBuffer::VertexPTNTC_Quantized );
+            bytes += subMesh.indices.capacity() * sizeof( VertexBuffer::Face );
+            bytes += subMesh.indices32.capacity() * sizeof( VertexBuffer::Face32 );
+            bytes += subMesh.joints.capacity() * sizeof( Joint );
+            bytes += subMesh.meshlets.capacity() * sizeof( Meshlet );
+
+            for (const auto& joint : subMesh.joints)
+            {
+                bytes += joint.animTransforms.capacity() * sizeof( Matrix44 );
+            }
+        }
+
+        return bytes;
+    }
+
+    /// Submeshes loaded from a file. Shared by all Mesh instances of the same path and not modified after loading.
+    struct MeshAsset
+    {
+        MeshAsset() = default;
+        MeshAsset( const MeshAsset& ) = delete;
+        MeshAsset& operator=( const MeshAsset& ) = delete;
+
+        ~MeshAsset()
+        {
+            Statistics::TrackFree( System::Statistics::MemoryTag::MeshVertices, trackedBytes );
+        }
+
+        /// Updates memory statistics after subMeshes has changed.
+        void TrackCpuBytes()
+        {
+            const std::size_t bytes = GetCpuBytes( subMeshes );
+            Statistics::TrackResize( System::Statistics::MemoryTag::MeshVertices, trackedBytes, bytes );
+            trackedBytes = bytes;
+        }
+
+        Vec3 aabbMin;
+        Vec3 aabbMax;
+        std::vector< SubMesh > subMeshes;
+        std::string path;
+        std::size_t trackedBytes = 0;
+    };
+
+    /// Mesh instances hold the entry of their path, so a reload replaces the asset of every instance at once.
+    struct MeshCacheEntry
+    {
+        std::shared_ptr< MeshAsset > asset;
+        /// Changes when asset is replaced. Unique across entries, so it also changes when a Mesh is loaded from another path.
+        unsigned generation;
+    };
+}
+
 struct ae3d::Mesh::Impl
 {
     Impl() noexcept
@@ -21,26 +91,21 @@ struct ae3d::Mesh::Impl
         static_assert( sizeof( ae3d::Mesh::Impl ) <= ae3d::Mesh::StorageSize, "Impl too big!");
         static_assert( ae3d::Mesh::StorageAlign % alignof( ae3d::Mesh::Impl ) == 0, "Impl misaligned!");
     }
-    
-    Vec3 aabbMin;
-    Vec3 aabbMax;
-    std::vector< SubMesh > subMeshes;
-    std::string path;
-};
 
-struct MeshCacheEntry
-{
-    std::string path;
-    Vec3 aabbMin;
-    Vec3 aabbMax;
-    std::vector< SubMesh > subMeshes;    
+    /// \return Asset of this mesh. Meshes that have not been loaded have an empty asset.
+    MeshAsset& Asset() const;
+
+    std::shared_ptr< MeshCacheEntry > entry;
 };
 
 namespace
 {
 
-std::vector< MeshCacheEntry > gMeshCache;
-std::vector< Mesh* > gMeshInstances;
+/// Loaded paths. Entries are kept after their last Mesh has been destroyed, so loading the path again is cheap.
+std::unordered_map< std::string, std::shared_ptr< MeshCacheEntry > > gMeshCache;
+
+/// Last generation given to a MeshCacheEntry.
+unsigned gMeshGeneration = 0;
 
 struct membuf : std::streambuf
 {
@@ -58,241 +123,83 @@ struct imemstream : virtual membuf, std::istream
         , std::istream( static_cast<std::streambuf*>(this) ) {
     }
 };
-}
-
-void AddUniqueInstance( Mesh* mesh )
-{
-    bool found = false;
-    
-    for (auto instance : gMeshInstances)
-    {
-        if (instance == mesh)
-        {
-            found = true;
-        }
-    }
-    
-    if (!found)
-    {
-        gMeshInstances.push_back( mesh );
-    }
-}
-
-void MeshReload( const std::string& path )
-{
-    // Invalidates cache
-    for (std::size_t i = 0; i < gMeshCache.size(); ++i)
-    {
-        if (gMeshCache[ i ].path == path)
-        {
-            gMeshCache.erase( std::begin( gMeshCache ) + i );
-            break;
-        }
-    }
-    
-    for (auto instance : gMeshInstances)
-    {
-        if (instance->GetPath() == path)
-        {
-            instance->Load( FileSystem::FileContents( path.c_str() ) );
-        }
-    }
-}
-
-ae3d::Mesh::Mesh()
-{
-    new(&_storage)Impl();
-}
 
-ae3d::Mesh::~Mesh()
+template< typename Vertex >
+Vec3 GetPosition( const Vertex& vertex, const VertexBuffer& )
 {
-    reinterpret_cast< Impl* >(&_storage)->~Impl();
+    return vertex.position;
 }
 
-ae3d::Mesh::Mesh( const Mesh& other )
+/// \return Quantized vertex's position dequantized like the shaders do.
+Vec3 GetPosition( const VertexBuffer::VertexPTNTC_Quantized& vertex, const VertexBuffer& vertexBuffer )
 {
-    new(&_storage)Impl();
-    reinterpret_cast<Impl&>(_storage) = reinterpret_cast<Impl const&>(other._storage);
+    const Vec3 position( vertex.position[ 0 ] / 32767.0f, vertex.position[ 1 ] / 32767.0f, vertex.position[ 2 ] / 32767.0f );
+    return position * vertexBuffer.GetPositionScale() + vertexBuffer.GetPositionOffset();
 }
 
-ae3d::Mesh& ae3d::Mesh::operator=( const Mesh& other )
+/// Copies the positions of faces' vertices into outTriangles, which must have room for 3 vertices for each face.
+template< typename Vertex, typename FaceType >
+void FlattenTriangles( const std::vector< Vertex >& vertices, const std::vector< FaceType >& faces, const VertexBuffer& vertexBuffer, Array< Vec3 >& outTriangles )
 {
-    if (this == &other)
+    for (unsigned faceIndex = 0; faceIndex < (unsigned)faces.size(); ++faceIndex)
     {
-        return *this;
+        const auto& face = faces[ faceIndex ];
+        outTriangles[ faceIndex * 3 + 0 ] = GetPosition( vertices.at( face.a ), vertexBuffer );
+        outTriangles[ faceIndex * 3 + 1 ] = GetPosition( vertices.at( face.b ), vertexBuffer );
+        outTriangles[ faceIndex * 3 + 2 ] = GetPosition( vertices.at( face.c ), vertexBuffer );
     }
-
-    new(&_storage)Impl();
-    reinterpret_cast<Impl&>(_storage) = reinterpret_cast<Impl const&>(other._storage);
-    return *this;
-}
-
-const char* ae3d::Mesh::GetPath() const
-{
-    return m().path.c_str();
-}
-
-const Vec3& ae3d::Mesh::GetAABBMin() const
-{
-    return m().aabbMin;
-}
-
-const Vec3& ae3d::Mesh::GetAABBMax() const
-{
-    return m().aabbMax;
-}
-
-const Vec3& ae3d::Mesh::GetSubMeshAABBMin( unsigned subMeshIndex ) const
-{
-    return m().subMeshes[ subMeshIndex < m().subMeshes.size() ? subMeshIndex : 0 ].aabbMin;
-}
-
-const Vec3& ae3d::Mesh::GetSubMeshAABBMax( unsigned subMeshIndex ) const
-{
-    return m().subMeshes[ subMeshIndex < m().subMeshes.size() ? subMeshIndex : 0 ].aabbMax;
-}
-
-const char* ae3d::Mesh::GetSubMeshName( unsigned index ) const
-{
-    return m().subMeshes[ index < m().subMeshes.size() ? index : 0 ].name.c_str();
-}
-
-ae3d::SubMesh* ae3d::Mesh::GetSubMeshes( int& outCount )
-{
-	outCount = (int)m().subMeshes.size();
-    return m().subMeshes.data();
 }
 
-void ae3d::Mesh::GetSubMeshFlattenedTriangles( unsigned subMeshIndex, Array< Vec3 >& outTriangles ) const
+/// Flattens subMesh's triangles if its vertices are in vertices.
+template< typename Vertex >
+bool FlattenTriangles( const SubMesh& subMesh, const std::vector< Vertex >& vertices, Array< Vec3 >& outTriangles )
 {
-    if (subMeshIndex >= m().subMeshes.size())
-    {
-        System::Print( "Invalid submesh index in GetSubMeshFlattenedTriangles\n" );
-        return;
-    }
-    
-    auto& subMesh = m().subMeshes[ subMeshIndex ];
-    const int faceCount = subMesh.vertexBuffer.GetFaceCount();
-    outTriangles.Allocate( faceCount * 3 );
-    
-    if (!subMesh.verticesPTNTC.empty())
+    if (vertices.empty())
     {
-        for (int faceIndex = 0; faceIndex < faceCount / 3; ++faceIndex)
-        {
-            const auto& face = subMesh.indices[ faceIndex ];
-            outTriangles[ faceIndex * 3 + 0 ] = subMesh.verticesPTNTC.at( face.a ).position;
-            outTriangles[ faceIndex * 3 + 1 ] = subMesh.verticesPTNTC.at( face.b ).position;
-            outTriangles[ faceIndex * 3 + 2 ] = subMesh.verticesPTNTC.at( face.c ).position;
-        }
+        return false;
     }
-    else if (!subMesh.verticesPTN.empty())
+
+    if (subMesh.indices32.empty())
     {
-        for (int faceIndex = 0; faceIndex < faceCount; ++faceIndex)
-        {
-            const auto& face = subMesh.indices[ faceIndex ];
-            outTriangles[ faceIndex * 3 + 0 ] = subMesh.verticesPTN.at( face.a ).position;
-            outTriangles[ faceIndex * 3 + 1 ] = subMesh.verticesPTN.at( face.b ).position;
-            outTriangles[ faceIndex * 3 + 2 ] = subMesh.verticesPTN.at( face.c ).position;
-        }
+        FlattenTriangles( vertices, subMesh.indices, subMesh.vertexBuffer, outTriangles );
     }
     else
     {
-        System::Print("Empty vertex data in subMesh!\n");
+        FlattenTriangles( vertices, subMesh.indices32, subMesh.vertexBuffer, outTriangles );
     }
-}
 
-unsigned ae3d::Mesh::GetSubMeshCount() const
-{
-    return (unsigned)m().subMeshes.size();
+    return true;
 }
 
-ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::FileContentsData& meshData )
+/// Reads a version 1 ("a9") mesh, which is a stream of variable-length fields.
+Mesh::LoadResult ReadVersion1( const FileSystem::FileView& meshData, const std::string& path, Vec3& outAabbMin, Vec3& outAabbMax, std::vector< SubMesh >& outSubMeshes )
 {
-    for (const auto& entry : gMeshCache)
-    {
-        if (entry.path == meshData.path)
-        {
-            m().aabbMin = entry.aabbMin;
-            m().aabbMax = entry.aabbMax;
-            m().subMeshes = entry.subMeshes;
-            m().path = entry.path;
-
-            AddUniqueInstance( this );
-            
-            return LoadResult::Success;
-        }
-    }
-    
-    if (!meshData.isLoaded)
-    {
-        const float s = 1;
-        
-        const VertexBuffer::VertexPTC vertices[ 8 ] =
-        {
-            { Vec3( -s, -s, s ), 0, 0 },
-            { Vec3( s, -s, s ), 0, 0 },
-            { Vec3( s, -s, -s ), 0, 0 },
-            { Vec3( -s, -s, -s ), 0, 0 },
-            { Vec3( -s, s, s ), 0, 0 },
-            { Vec3( s, s, s ), 0, 0 },
-            { Vec3( s, s, -s ), 0, 0 },
-            { Vec3( -s, s, -s ), 0, 0 }
-        };
-        
-        const VertexBuffer::Face indices[ 12 ] =
-        {
-            { 0, 4, 1 },
-            { 4, 5, 1 },
-            { 1, 5, 2 },
-            { 2, 5, 6 },
-            { 2, 6, 3 },
-            { 3, 6, 7 },
-            { 3, 7, 0 },
-            { 0, 7, 4 },
-            { 4, 7, 5 },
-            { 5, 7, 6 },
-            { 3, 0, 2 },
-            { 2, 0, 1 }
-        };
-        
-        m().subMeshes.resize( 1 );
-        auto& firstSubMesh = m().subMeshes[ 0 ];
-        firstSubMesh.vertexBuffer.Generate( indices, 12, vertices, 8, VertexBuffer::Storage::GPU );
-        firstSubMesh.vertexBuffer.SetDebugName( "default mesh" );
-        firstSubMesh.aabbMin = {-s, -s, -s};
-        firstSubMesh.aabbMax = { s,  s, s };
-        return LoadResult::FileNotFound;
-    }
-    
     uint8_t magic[ 2 ];
 
-    imemstream is( (const char*)meshData.data.data(), meshData.data.size() );
+    imemstream is( (const char*)meshData.data, meshData.size );
     is.read( (char*)&magic[ 0 ], sizeof( magic ) );
 
     if (magic[ 0 ] != 'a' || magic[ 1 ] != '9')
     {
-        System::Print( "%s is corrupted or old format: Wrong magic number!\n", meshData.path.c_str() );
-        return LoadResult::Corrupted;
+        System::Print( "%s is corrupted or old format: Wrong magic number!\n", path.c_str() );
+        return Mesh::LoadResult::Corrupted;
     }
 
-    is.read( (char*)&m().aabbMin, sizeof( m().aabbMin ) );
-    is.read( (char*)&m().aabbMax, sizeof( m().aabbMax ) );
-
-    const auto& aabbMin = m().aabbMin;
-    const auto& aabbMax = m().aabbMax;
+    is.read( (char*)&outAabbMin, sizeof( outAabbMin ) );
+    is.read( (char*)&outAabbMax, sizeof( outAabbMax ) );
 
-    if (aabbMin.x > aabbMax.x || aabbMin.y > aabbMax.y || aabbMin.z > aabbMax.z)
+    if (outAabbMin.x > outAabbMax.x || outAabbMin.y > outAabbMax.y || outAabbMin.z > outAabbMax.z)
     {
-        return LoadResult::Corrupted;
+        return Mesh::LoadResult::Corrupted;
     }
     
     uint16_t meshCount;
     is.read( (char*)&meshCount, sizeof( meshCount ) );
 
-    m().subMeshes.clear();
-    m().subMeshes.resize( meshCount );
+    outSubMeshes.clear();
+    outSubMeshes.resize( meshCount );
 
-    for (auto& subMesh : m().subMeshes)
+    for (auto& subMesh : outSubMeshes)
     {
         is.read( (char*)&subMesh.aabbMin, sizeof( subMesh.aabbMin ) );
         is.read( (char*)&subMesh.aabbMax, sizeof( subMesh.aabbMax ) );
@@ -315,7 +222,7 @@ ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::FileContentsData& mes
             try { subMesh.verticesPTNTC.resize( vertexCount ); }
             catch (std::bad_alloc&)
             {
-                return LoadResult::OutOfMemory;
+                return Mesh::LoadResult::OutOfMemory;
             }
         
             is.read( (char*)&subMesh.verticesPTNTC[ 0 ].position.x, vertexCount * sizeof( VertexBuffer::VertexPTNTC ) );
@@ -325,7 +232,7 @@ ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::FileContentsData& mes
             try { subMesh.verticesPTN.resize( vertexCount ); }
             catch (std::bad_alloc&)
             {
-                return LoadResult::OutOfMemory;
+                return Mesh::LoadResult::OutOfMemory;
             }
             
             is.read( (char*)&subMesh.verticesPTN[ 0 ].position.x, vertexCount * sizeof( VertexBuffer::VertexPTN ) );
@@ -335,15 +242,15 @@ ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::FileContentsData& mes
             try { subMesh.verticesPTNTC_Skinned.resize( vertexCount ); }
             catch (std::bad_alloc&)
             {
-                return LoadResult::OutOfMemory;
+                return Mesh::LoadResult::OutOfMemory;
             }
             
             is.read( (char*)&subMesh.verticesPTNTC_Skinned[ 0 ].position.x, vertexCount * sizeof( VertexBuffer::VertexPTNTC_Skinned ) );
         }
         else
         {
-            System::Print( "Mesh %s submesh %s has invalid vertex format %d. Only 0 and 1 are valid!\n", meshData.path.c_str(), subMesh.name.c_str(), vertexFormat );
-            return LoadResult::Corrupted;
+            System::Print( "Mesh %s submesh %s has invalid vertex format %d. Only 0 and 1 are valid!\n", path.c_str(), subMesh.name.c_str(), vertexFormat );
+            return Mesh::LoadResult::Corrupted;
         }
 
         uint16_t faceCount = 0;
@@ -352,7 +259,7 @@ ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::FileContentsData& mes
         try { subMesh.indices.resize( faceCount ); }
         catch (std::bad_alloc&)
         {
-            return LoadResult::OutOfMemory;
+            return Mesh::LoadResult::OutOfMemory;
         }
 
         is.read( (char*)&subMesh.indices[ 0 ], faceCount * sizeof( VertexBuffer::Face ) );
@@ -390,8 +297,8 @@ ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::FileContentsData& mes
                 
                 if (jointNameLength > 128)
                 {
-                    System::Print( "Mesh %s has a joint with too long name, max is 128.\n", meshData.path.c_str() );
-                    return LoadResult::Corrupted;
+                    System::Print( "Mesh %s has a joint with too long name, max is 128.\n", path.c_str() );
+                    return Mesh::LoadResult::Corrupted;
                 }
 
                 is.read( subMesh.joints[ j ].name, jointNameLength );
@@ -402,39 +309,504 @@ ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::FileContentsData& mes
                 is.read( (char*)subMesh.joints[ j ].animTransforms.data(), subMesh.joints[ j ].animTransforms.size() * sizeof( ae3d::Matrix44 ) );
             }
         }
-        
-        const std::size_t pos = meshData.path.find_last_of( '/' );
-        std::string shortPath = meshData.path;
-        
-        if (pos != std::string::npos)
+    }
+    
+    uint8_t terminator = 0;
+    is.read( (char*)&terminator, sizeof( terminator ) );
+
+    return terminator == 100 ? Mesh::LoadResult::Success : Mesh::LoadResult::Corrupted;
+}
+
+/// Copies count elements of a version 2 section into outElements.
+template< typename T >
+Mesh::LoadResult ReadSection( const FileSystem::FileView& meshData, const MeshFormat::Section& section, std::uint64_t count, std::vector< T >& outElements )
+{
+    if (!MeshFormat::IsValid( section, meshData.size ) || section.size != count * sizeof( T ))
+    {
+        return Mesh::LoadResult::Corrupted;
+    }
+
+    try { outElements.resize( count ); }
+    catch (std::bad_alloc&)
+    {
+        return Mesh::LoadResult::OutOfMemory;
+    }
+
+    if (count > 0)
+    {
+        std::memcpy( static_cast< void* >( outElements.data() ), meshData.data + section.offset, section.size );
+    }
+
+    return Mesh::LoadResult::Success;
+}
+
+template< typename Vertex, typename FaceType >
+void GenerateVertexBuffer( SubMesh& subMesh, const FaceType* faces, int faceCount, const Vertex* vertices, int vertexCount )
+{
+    subMesh.vertexBuffer.Generate( faces, faceCount, vertices, vertexCount );
+}
+
+/// Quantized positions are dequantized from -1..1 into the submesh AABB.
+template< typename FaceType >
+void GenerateVertexBuffer( SubMesh& subMesh, const FaceType* faces, int faceCount, const VertexBuffer::VertexPTNTC_Quantized* vertices, int vertexCount )
+{
+    const Vec3 scale = (subMesh.aabbMax - subMesh.aabbMin) * 0.5f;
+    const Vec3 offset = (subMesh.aabbMax + subMesh.aabbMin) * 0.5f;
+    subMesh.vertexBuffer.Generate( faces, faceCount, vertices, vertexCount, scale, offset );
+}
+
+/// Reads the vertices and indices of a version 2 submesh and generates its vertex buffer.
+template< typename Vertex >
+Mesh::LoadResult ReadGeometry( const FileSystem::FileView& meshData, const MeshFormat::SubMeshEntry& entry, std::vector< Vertex >& outVertices, SubMesh& subMesh )
+{
+    Mesh::LoadResult result = ReadSection( meshData, entry.vertices, entry.vertexCount, outVertices );
+
+    if (result == Mesh::LoadResult::Success)
+    {
+        result = entry.indexSize == 4 ? ReadSection( meshData, entry.indices, entry.faceCount, subMesh.indices32 ) : ReadSection( meshData, entry.indices, entry.faceCount, subMesh.indices );
+    }
+
+    if (result != Mesh::LoadResult::Success)
+    {
+        return result;
+    }
+
+    // Sections are aligned, so the mapped file can be uploaded as it is. Unaligned views come from callers that copied the file themselves.
+    const bool isAligned = reinterpret_cast< std::uintptr_t >( meshData.data ) % MeshFormat::SectionAlignment == 0;
+    const Vertex* vertices = isAligned ? reinterpret_cast< const Vertex* >( meshData.data + entry.vertices.offset ) : outVertices.data();
+
+    if (entry.indexSize == 4)
+    {
+        const VertexBuffer::Face32* faces = isAligned ? reinterpret_cast< const VertexBuffer::Face32* >( meshData.data + entry.indices.offset ) : subMesh.indices32.data();
+        GenerateVertexBuffer( subMesh, faces, (int)entry.faceCount, vertices, (int)entry.vertexCount );
+    }
+    else
+    {
+        const VertexBuffer::Face* faces = isAligned ? reinterpret_cast< const VertexBuffer::Face* >( meshData.data + entry.indices.offset ) : subMesh.indices.data();
+        GenerateVertexBuffer( subMesh, faces, (int)entry.faceCount, vertices, (int)entry.vertexCount );
+    }
+
+    return Mesh::LoadResult::Success;
+}
+
+/// Reads the meshlets of a version 3 submesh. Meshlets must be inside the submesh's faces.
+Mesh::LoadResult ReadMeshlets( const FileSystem::FileView& meshData, const MeshFormat::SubMeshEntry& entry, SubMesh& subMesh )
+{
+    std::vector< MeshFormat::MeshletEntry > meshlets;
+    const Mesh::LoadResult result = ReadSection( meshData, entry.meshlets, entry.meshletCount, meshlets );
+
+    if (result != Mesh::LoadResult::Success)
+    {
+        return result;
+    }
+
+    subMesh.meshlets.resize( meshlets.size() );
+
+    for (std::size_t m = 0; m < meshlets.size(); ++m)
+    {
+        const MeshFormat::MeshletEntry& source = meshlets[ m ];
+
+        if (source.firstFace > entry.faceCount || source.faceCount > entry.faceCount - source.firstFace)
         {
-            shortPath = meshData.path.substr( pos );
+            return Mesh::LoadResult::Corrupted;
         }
 
-        std::string subMeshDebugName = shortPath + std::string( ":" ) + subMesh.name;
+        Meshlet& meshlet = subMesh.meshlets[ m ];
+        meshlet.aabbMin = Vec3( source.aabbMin[ 0 ], source.aabbMin[ 1 ], source.aabbMin[ 2 ] );
+        meshlet.aabbMax = Vec3( source.aabbMax[ 0 ], source.aabbMax[ 1 ], source.aabbMax[ 2 ] );
+        meshlet.coneAxis = Vec3( source.coneAxis[ 0 ], source.coneAxis[ 1 ], source.coneAxis[ 2 ] );
+        meshlet.coneCutoff = source.coneCutoff;
+        meshlet.firstFace = (int)source.firstFace;
+        meshlet.faceCount = (int)source.faceCount;
+    }
+
+    return Mesh::LoadResult::Success;
+}
+
+/// Reads a version 2 or 3 mesh. See MeshFormat.hpp.
+Mesh::LoadResult ReadVersion2( const FileSystem::FileView& meshData, const std::string& path, Vec3& outAabbMin, Vec3& outAabbMax, std::vector< SubMesh >& outSubMeshes )
+{
+    MeshFormat::Header header;
+    std::memcpy( &header, meshData.data, sizeof( header ) );
+
+    if (header.version < MeshFormat::MinVersion || header.version > MeshFormat::Version)
+    {
+        System::Print( "%s has unsupported version %u!\n", path.c_str(), header.version );
+        return Mesh::LoadResult::Corrupted;
+    }
+
+    const std::size_t entrySize = MeshFormat::SubMeshEntrySize( header.version );
+
+    if (header.subMeshesOffset > meshData.size || header.subMeshCount > (meshData.size - header.subMeshesOffset) / entrySize)
+    {
+        return Mesh::LoadResult::Corrupted;
+    }
+
+    outAabbMin = Vec3( header.aabbMin[ 0 ], header.aabbMin[ 1 ], header.aabbMin[ 2 ] );
+    outAabbMax = Vec3( header.aabbMax[ 0 ], header.aabbMax[ 1 ], header.aabbMax[ 2 ] );
+
+    if (outAabbMin.x > outAabbMax.x || outAabbMin.y > outAabbMax.y || outAabbMin.z > outAabbMax.z)
+    {
+        return Mesh::LoadResult::Corrupted;
+    }
+
+    outSubMeshes.clear();
+
+    try { outSubMeshes.resize( header.subMeshCount ); }
+    catch (std::bad_alloc&)
+    {
+        return Mesh::LoadResult::OutOfMemory;
+    }
+
+    for (std::size_t s = 0; s < outSubMeshes.size(); ++s)
+    {
+        SubMesh& subMesh = outSubMeshes[ s ];
+        // Version 2 entries don't have meshlets, so they stay empty.
+        MeshFormat::SubMeshEntry entry;
+        std::memset( &entry, 0, sizeof( entry ) );
+        std::memcpy( &entry, meshData.data + header.subMeshesOffset + s * entrySize, entrySize );
+
+        subMesh.aabbMin = Vec3( entry.aabbMin[ 0 ], entry.aabbMin[ 1 ], entry.aabbMin[ 2 ] );
+        subMesh.aabbMax = Vec3( entry.aabbMax[ 0 ], entry.aabbMax[ 1 ], entry.aabbMax[ 2 ] );
+
+        if (!MeshFormat::IsValid( entry.name, meshData.size ) || (entry.indexSize != 2 && entry.indexSize != 4) ||
+            entry.vertexCount > (std::uint32_t)std::numeric_limits< int >::max() || entry.faceCount > (std::uint32_t)std::numeric_limits< int >::max() / 3)
+        {
+            return Mesh::LoadResult::Corrupted;
+        }
+
+        subMesh.name.assign( reinterpret_cast< const char* >( meshData.data + entry.name.offset ), entry.name.size );
+
+        Mesh::LoadResult result = Mesh::LoadResult::Corrupted;
+
+        if (entry.vertexFormat == MeshFormat::PTNTC)
+        {
+            result = ReadGeometry( meshData, entry, subMesh.verticesPTNTC, subMesh );
+        }
+        else if (entry.vertexFormat == MeshFormat::PTN)
+        {
+            result = ReadGeometry( meshData, entry, subMesh.verticesPTN, subMesh );
+        }
+        else if (entry.vertexFormat == MeshFormat::PTNTC_Skinned)
+        {
+            result = ReadGeometry( meshData, entry, subMesh.verticesPTNTC_Skinned, subMesh );
+        }
+        else if (entry.vertexFormat == MeshFormat::PTNTC_Quantized)
+        {
+            result = ReadGeometry( meshData, entry, subMesh.verticesPTNTC_Quantized, subMesh );
+        }
+        else
+        {
+            System::Print( "Mesh %s submesh %s has invalid vertex format %u. Only 0, 1, 2 and 3 are valid!\n", path.c_str(), subMesh.name.c_str(), entry.vertexFormat );
+        }
+
+        if (result != Mesh::LoadResult::Success)
+        {
+            return result;
+        }
+
+        std::vector< MeshFormat::JointEntry > joints;
+        result = ReadSection( meshData, entry.joints, entry.jointCount, joints );
+
+        if (result != Mesh::LoadResult::Success)
+        {
+            return result;
+        }
+
+        result = ReadMeshlets( meshData, entry, subMesh );
+
+        if (result != Mesh::LoadResult::Success)
+        {
+            return result;
+        }
+
+        subMesh.joints.resize( joints.size() );
+
+        for (std::size_t j = 0; j < joints.size(); ++j)
+        {
+            Joint& joint = subMesh.joints[ j ];
+            std::memcpy( &joint.globalBindposeInverse.m[ 0 ], joints[ j ].globalBindposeInverse, sizeof( joints[ j ].globalBindposeInverse ) );
+            joint.parentIndex = joints[ j ].parentIndex;
+
+            const std::size_t nameLength = joints[ j ].nameLength < sizeof( joint.name ) ? joints[ j ].nameLength : sizeof( joint.name ) - 1;
+            std::memcpy( joint.name, joints[ j ].name, nameLength );
+            joint.name[ nameLength ] = 0;
+
+            const MeshFormat::Section& animTransforms = joints[ j ].animTransforms;
+            result = ReadSection( meshData, animTransforms, animTransforms.size / sizeof( Matrix44 ), joint.animTransforms );
+
+            if (result != Mesh::LoadResult::Success)
+            {
+                return result;
+            }
+        }
+    }
+
+    return Mesh::LoadResult::Success;
+}
+
+/// Reads a mesh file into a new asset.
+Mesh::LoadResult LoadAsset( const FileSystem::FileView& meshData, const std::string& path, std::shared_ptr< MeshAsset >& outAsset )
+{
+    std::shared_ptr< MeshAsset > asset = std::make_shared< MeshAsset >();
+    asset->path = path;
+
+    const bool isVersion2 = meshData.size >= sizeof( MeshFormat::Header ) && std::memcmp( meshData.data, MeshFormat::Magic, sizeof( MeshFormat::Magic ) ) == 0;
+    const Mesh::LoadResult result = isVersion2 ? ReadVersion2( meshData, path, asset->aabbMin, asset->aabbMax, asset->subMeshes )
+                                               : ReadVersion1( meshData, path, asset->aabbMin, asset->aabbMax, asset->subMeshes );
+    asset->TrackCpuBytes();
+
+    if (result != Mesh::LoadResult::Success)
+    {
+        return result;
+    }
+
+    const std::size_t pos = path.find_last_of( '/' );
+    const std::string shortPath = pos != std::string::npos ? path.substr( pos ) : path;
+
+    for (auto& subMesh : asset->subMeshes)
+    {
+        const std::string subMeshDebugName = shortPath + std::string( ":" ) + subMesh.name;
         subMesh.vertexBuffer.SetDebugName( subMeshDebugName.c_str() );
     }
+
+    outAsset = std::move( asset );
+    return Mesh::LoadResult::Success;
+}
+
+/// \return Entry of meshes that have not been loaded.
+const std::shared_ptr< MeshCacheEntry >& GetEmptyEntry()
+{
+    static const std::shared_ptr< MeshCacheEntry > entry = std::make_shared< MeshCacheEntry >( MeshCacheEntry{ std::make_shared< MeshAsset >(), ++gMeshGeneration } );
+    return entry;
+}
+
+/// \return Entry of the cube that is shown in place of meshes whose file was not found.
+const std::shared_ptr< MeshCacheEntry >& GetDefaultEntry()
+{
+    static std::shared_ptr< MeshCacheEntry > entry;
+
+    if (entry)
+    {
+        return entry;
+    }
+
+    const float s = 1;
     
-    uint8_t terminator = 0;
-    is.read( (char*)&terminator, sizeof( terminator ) );
+    const VertexBuffer::VertexPTC vertices[ 8 ] =
+    {
+        { Vec3( -s, -s, s ), 0, 0 },
+        { Vec3( s, -s, s ), 0, 0 },
+        { Vec3( s, -s, -s ), 0, 0 },
+        { Vec3( -s, -s, -s ), 0, 0 },
+        { Vec3( -s, s, s ), 0, 0 },
+        { Vec3( s, s, s ), 0, 0 },
+        { Vec3( s, s, -s ), 0, 0 },
+        { Vec3( -s, s, -s ), 0, 0 }
+    };
+    
+    const VertexBuffer::Face indices[ 12 ] =
+    {
+        { 0, 4, 1 },
+        { 4, 5, 1 },
+        { 1, 5, 2 },
+        { 2, 5, 6 },
+        { 2, 6, 3 },
+        { 3, 6, 7 },
+        { 3, 7, 0 },
+        { 0, 7, 4 },
+        { 4, 7, 5 },
+        { 5, 7, 6 },
+        { 3, 0, 2 },
+        { 2, 0, 1 }
+    };
+
+    std::shared_ptr< MeshAsset > asset = std::make_shared< MeshAsset >();
+    asset->subMeshes.resize( 1 );
+    auto& firstSubMesh = asset->subMeshes[ 0 ];
+    firstSubMesh.vertexBuffer.Generate( indices, 12, vertices, 8, VertexBuffer::Storage::GPU );
+    firstSubMesh.vertexBuffer.SetDebugName( "default mesh" );
+    firstSubMesh.aabbMin = {-s, -s, -s};
+    firstSubMesh.aabbMax = { s,  s, s };
+    asset->TrackCpuBytes();
+
+    entry = std::make_shared< MeshCacheEntry >( MeshCacheEntry{ std::move( asset ), ++gMeshGeneration } );
+    return entry;
+}
+}
+
+void MeshReload( const std::string& path )
+{
+    const auto cached = gMeshCache.find( path );
 
-    if (terminator != 100)
+    if (cached == gMeshCache.end())
     {
-        return LoadResult::Corrupted;
+        return;
     }
 
-    MeshCacheEntry cacheEntry;
-    cacheEntry.path = meshData.path;
-    cacheEntry.aabbMin = m().aabbMin;
-    cacheEntry.aabbMax = m().aabbMax;
-    cacheEntry.subMeshes = m().subMeshes;
-    gMeshCache.push_back( cacheEntry );
+    const FileSystem::MappedFile meshFile( path.c_str() );
+    std::shared_ptr< MeshAsset > asset;
+
+    // Instances keep the old asset if the new file can't be loaded, for example if it's still being written.
+    if (meshFile.IsLoaded() && LoadAsset( meshFile.GetView(), path, asset ) == Mesh::LoadResult::Success)
+    {
+        // Frames that the GPU has not finished can still draw the old buffers.
+        for (auto& subMesh : cached->second->asset->subMeshes)
+        {
+            subMesh.vertexBuffer.Release();
+        }
+
+        cached->second->asset = std::move( asset );
+        cached->second->generation = ++gMeshGeneration;
+    }
+}
 
-    AddUniqueInstance( this );
+MeshAsset& ae3d::Mesh::Impl::Asset() const
+{
+    return *entry->asset;
+}
 
-    fileWatcher.AddFile( meshData.path, MeshReload );
+ae3d::Mesh::Mesh()
+{
+    new(&_storage)Impl();
+    m().entry = GetEmptyEntry();
+}
+
+ae3d::Mesh::~Mesh()
+{
+    reinterpret_cast< Impl* >(&_storage)->~Impl();
+}
+
+ae3d::Mesh::Mesh( const Mesh& other )
+{
+    new(&_storage)Impl();
+    reinterpret_cast<Impl&>(_storage) = reinterpret_cast<Impl const&>(other._storage);
+}
+
+ae3d::Mesh& ae3d::Mesh::operator=( const Mesh& other )
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+
+    reinterpret_cast<Impl&>(_storage) = reinterpret_cast<Impl const&>(other._storage);
+    return *this;
+}
+
+const char* ae3d::Mesh::GetPath() const
+{
+    return m().Asset().path.c_str();
+}
+
+const Vec3& ae3d::Mesh::GetAABBMin() const
+{
+    return m().Asset().aabbMin;
+}
+
+const Vec3& ae3d::Mesh::GetAABBMax() const
+{
+    return m().Asset().aabbMax;
+}
+
+const Vec3& ae3d::Mesh::GetSubMeshAABBMin( unsigned subMeshIndex ) const
+{
+    const auto& subMeshes = m().Asset().subMeshes;
+    return subMeshes[ subMeshIndex < subMeshes.size() ? subMeshIndex : 0 ].aabbMin;
+}
+
+const Vec3& ae3d::Mesh::GetSubMeshAABBMax( unsigned subMeshIndex ) const
+{
+    const auto& subMeshes = m().Asset().subMeshes;
+    return subMeshes[ subMeshIndex < subMeshes.size() ? subMeshIndex : 0 ].aabbMax;
+}
+
+const char* ae3d::Mesh::GetSubMeshName( unsigned index ) const
+{
+    const auto& subMeshes = m().Asset().subMeshes;
+    return subMeshes[ index < subMeshes.size() ? index : 0 ].name.c_str();
+}
+
+const ae3d::SubMesh* ae3d::Mesh::GetSubMeshes( int& outCount ) const
+{
+    outCount = (int)m().Asset().subMeshes.size();
+    return m().Asset().subMeshes.data();
+}
+
+unsigned ae3d::Mesh::GetGeneration() const
+{
+    return m().entry->generation;
+}
+
+void ae3d::Mesh::GetSubMeshFlattenedTriangles( unsigned subMeshIndex, Array< Vec3 >& outTriangles ) const
+{
+    if (subMeshIndex >= m().Asset().subMeshes.size())
+    {
+        System::Print( "Invalid submesh index in GetSubMeshFlattenedTriangles\n" );
+        return;
+    }
+    
+    auto& subMesh = m().Asset().subMeshes[ subMeshIndex ];
+    // GetFaceCount() returns the index count.
+    const int faceCount = subMesh.vertexBuffer.GetFaceCount() / 3;
+    outTriangles.Allocate( faceCount * 3 );
     
-    m().path = meshData.path;
+    if (!FlattenTriangles( subMesh, subMesh.verticesPTNTC, outTriangles ) &&
+        !FlattenTriangles( subMesh, subMesh.verticesPTN, outTriangles ) &&
+        !FlattenTriangles( subMesh, subMesh.verticesPTNTC_Quantized, outTriangles ))
+    {
+        System::Print("Empty vertex data in subMesh!\n");
+    }
+}
+
+unsigned ae3d::Mesh::GetSubMeshCount() const
+{
+    return (unsigned)m().Asset().subMeshes.size();
+}
+
+ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::FileContentsData& meshData )
+{
+    FileSystem::FileView view;
+    view.data = meshData.data.data();
+    view.size = meshData.data.size();
+    return LoadView( view, meshData.path, meshData.isLoaded );
+}
+
+ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::MappedFile& meshFile )
+{
+    return LoadView( meshFile.GetView(), meshFile.GetPath(), meshFile.IsLoaded() );
+}
+
+ae3d::Mesh::LoadResult ae3d::Mesh::LoadView( const FileSystem::FileView& meshData, const std::string& path, bool isLoaded )
+{
+    AE3D_ZONE( "Mesh::Load" );
+
+    const auto cached = gMeshCache.find( path );
+
+    if (cached != gMeshCache.end())
+    {
+        m().entry = cached->second;
+        return LoadResult::Success;
+    }
+    
+    if (!isLoaded)
+    {
+        m().entry = GetDefaultEntry();
+        return LoadResult::FileNotFound;
+    }
+
+    std::shared_ptr< MeshAsset > asset;
+    const LoadResult result = LoadAsset( meshData, path, asset );
+
+    if (result != LoadResult::Success)
+    {
+        return result;
+    }
+
+    m().entry = std::make_shared< MeshCacheEntry >( MeshCacheEntry{ std::move( asset ), ++gMeshGeneration } );
+    gMeshCache[ path ] = m().entry;
+
+    fileWatcher.AddFile( path, MeshReload );
     
     return LoadResult::Success;
 }
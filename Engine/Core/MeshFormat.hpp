@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+  .ae3d v3 mesh layout, shared by Mesh and the converters in Tools. Values are little-endian.
+
+  Header
+  SubMeshEntry[ subMeshCount ], the section table
+  sections, each starting at a multiple of SectionAlignment and referenced by a Section
+
+  A submesh has these sections:
+  name        bytes, not null-terminated
+  vertices    vertexCount vertices of VertexBuffer::VertexPTNTC, VertexPTN, VertexPTNTC_Skinned or VertexPTNTC_Quantized
+  indices     faceCount * 3 indices of indexSize bytes, in the layout of VertexBuffer::Face or VertexBuffer::Face32
+  joints      JointEntry[ jointCount ], only in skinned submeshes
+  meshlets    MeshletEntry[ meshletCount ], optional
+
+  Vertex and index sections can be uploaded to the GPU straight from a mapped file.
+  Meshlets split the indices into consecutive clusters of at most MaxMeshletVertices vertices and MaxMeshletFaces faces,
+  so the faces of visible meshlets can be drawn as ranges of the index buffer.
+  Version 2 files are the same, except that their SubMeshEntry ends before meshlets.
+  Version 1 files start with "a9" and are read by the stream parser in Mesh.cpp.
+*/
+namespace MeshFormat
+{
+    const char Magic[ 4 ] = { 'A', 'E', 'M', 'S' };
+    const std::uint32_t Version = 3;
+    /// Oldest section-based version that can be read.
+    const std::uint32_t MinVersion = 2;
+    const std::uint64_t SectionAlignment = 16;
+    const std::uint32_t MaxMeshletVertices = 64;
+    const std::uint32_t MaxMeshletFaces = 124;
+
+    /// SubMeshEntry::vertexFormat values. The first three are the same as in version 1.
+    /// PTNTC_Quantized positions are normalized to -1..1 inside SubMeshEntry's AABB.
+    enum VertexFormat : std::uint32_t { PTNTC = 0, PTN = 1, PTNTC_Skinned = 2, PTNTC_Quantized = 3 };
+
+    struct Section
+    {
+        /// Offset from the start of the file.
+        std::uint64_t offset;
+        /// Size in bytes.
+        std::uint64_t size;
+    };
+
+    struct Header
+    {
+        char magic[ 4 ];
+        std::uint32_t version;
+        std::uint32_t subMeshCount;
+        std::uint32_t reserved;
+        float aabbMin[ 3 ];
+        float aabbMax[ 3 ];
+        /// Offset of the first SubMeshEntry from the start of the file.
+        std::uint64_t subMeshesOffset;
+    };
+
+    struct SubMeshEntry
+    {
+        float aabbMin[ 3 ];
+        float aabbMax[ 3 ];
+        /// One of VertexFormat.
+        std::uint32_t vertexFormat;
+        /// 2 or 4.
+        std::uint32_t indexSize;
+        std::uint32_t vertexCount;
+        std::uint32_t faceCount;
+        std::uint32_t jointCount;
+        std::uint32_t meshletCount;
+        Section name;
+        Section vertices;
+        Section indices;
+        Section joints;
+        Section meshlets;
+    };
+
+    struct JointEntry
+    {
+        float globalBindposeInverse[ 16 ];
+        std::int32_t parentIndex;
+        std::uint32_t nameLength;
+        /// Animation matrices, 16 floats each.
+        Section animTransforms;
+        char name[ 128 ];
+    };
+
+    /// Bounds of a cluster of consecutive faces, for culling.
+    struct MeshletEntry
+    {
+        float aabbMin[ 3 ];
+        float aabbMax[ 3 ];
+        /// Average of the faces' normals.
+        float coneAxis[ 3 ];
+        /// Sine of the angle between coneAxis and the face normal farthest from it. 1 if the faces can't be backface culled together.
+        float coneCutoff;
+        std::uint32_t firstFace;
+        std::uint32_t faceCount;
+    };
+
+    static_assert( sizeof( Header ) == 48, "Mesh header has padding" );
+    static_assert( sizeof( SubMeshEntry ) == 128, "Mesh submesh entry has padding" );
+    static_assert( sizeof( JointEntry ) == 216, "Mesh joint entry has padding" );
+    static_assert( sizeof( MeshletEntry ) == 48, "Mesh meshlet entry has padding" );
+
+    /// \return Size of a SubMeshEntry in a file of version.
+    inline std::size_t SubMeshEntrySize( std::uint32_t version )
+    {
+        return version == 2 ? offsetof( SubMeshEntry, meshlets ) : sizeof( SubMeshEntry );
+    }
+
+    /// \return True if section is inside a file of fileSize bytes and starts at a multiple of SectionAlignment.
+    inline bool IsValid( const Section& section, std::size_t fileSize )
+    {
+        return section.offset % SectionAlignment == 0 && section.offset <= fileSize && section.size <= fileSize - section.offset;
+    }
+
+    /// \return offset rounded up to the next multiple of SectionAlignment.
+    inline std::uint64_t AlignSection( std::uint64_t offset )
+    {
+        return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+    }
+}
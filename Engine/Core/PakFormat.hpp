@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+  .pak v2 layout, shared by FileSystem and CombineFiles. Values are little-endian.
+
+  Header
+  TocEntry[ entryCount ], sorted by pathHash
+  path bytes, not null-terminated, referenced by TocEntry::pathOffset
+  entry contents, each starting at a multiple of DataAlignment
+
+  A compressed entry's contents are a CompressedHeader, a std::uint32_t stored size for each block and the blocks.
+  Blocks are compressed with Lz4::Compress() independently of each other, so they can be decoded in parallel or one at a time.
+*/
+namespace Pak
+{
+    const char Magic[ 4 ] = { 'A', 'E', 'P', 'K' };
+    const std::uint32_t Version = 2;
+    const std::uint64_t DataAlignment = 16;
+    /// TocEntry::flags bit of compressed entries.
+    const std::uint32_t EntryCompressed = 1;
+    /// Bit of a block's stored size, set if the block is stored uncompressed.
+    const std::uint32_t BlockUncompressed = 0x80000000u;
+
+    struct Header
+    {
+        char magic[ 4 ];
+        std::uint32_t version;
+        std::uint32_t entryCount;
+        std::uint32_t pathBytes;
+        /// Offset of the first TocEntry from the start of the file.
+        std::uint64_t tocOffset;
+        /// Offset of the path bytes from the start of the file.
+        std::uint64_t pathsOffset;
+    };
+
+    struct TocEntry
+    {
+        std::uint64_t pathHash;
+        /// Offset of the contents from the start of the file.
+        std::uint64_t offset;
+        /// Uncompressed size.
+        std::uint64_t size;
+        /// Offset of the path from Header::pathsOffset.
+        std::uint32_t pathOffset;
+        std::uint32_t pathLength;
+        /// Checksum() of the stored contents, including CompressedHeader and block sizes. Verified only if LoadPakFile() is asked to.
+        std::uint32_t checksum;
+        /// EntryCompressed or 0.
+        std::uint32_t flags;
+    };
+
+    struct CompressedHeader
+    {
+        /// Uncompressed size of every block except the last one.
+        std::uint32_t blockSize;
+        std::uint32_t blockCount;
+    };
+
+    static_assert( sizeof( Header ) == 32, "Pak header has padding" );
+    static_assert( sizeof( TocEntry ) == 40, "Pak TOC entry has padding" );
+    static_assert( sizeof( CompressedHeader ) == 8, "Pak compressed header has padding" );
+
+    /// \return 64-bit FNV-1a hash of path.
+    inline std::uint64_t HashPath( const char* path, std::size_t length )
+    {
+        std::uint64_t hash = 14695981039346656037ULL;
+
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            hash ^= (unsigned char)path[ i ];
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    /// \return CRC-32 of data.
+    inline std::uint32_t Checksum( const unsigned char* data, std::size_t size )
+    {
+        struct Table
+        {
+            Table()
+            {
+                for (std::uint32_t i = 0; i < 256; ++i)
+                {
+                    std::uint32_t crc = i;
+
+                    for (int bit = 0; bit < 8; ++bit)
+                    {
+                        crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+                    }
+
+                    values[ i ] = crc;
+                }
+            }
+
+            std::uint32_t values[ 256 ];
+        };
+
+        static const Table table;
+        std::uint32_t crc = 0xFFFFFFFFu;
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            crc = table.values[ (crc ^ data[ i ]) & 0xFF ] ^ (crc >> 8);
+        }
+
+        return crc ^ 0xFFFFFFFFu;
+    }
+}
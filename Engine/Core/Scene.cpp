@@ -2,9 +2,9 @@
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "Scene.hpp"
 #include <algorithm>
+#include <istream>
 #include <locale>
 #include <string>
-#include <sstream>
 #include <vector>
 #include "AudioSourceComponent.hpp"
 #include "AudioSystem.hpp"
@@ -25,6 +25,7 @@
 #include "SpriteRendererComponent.hpp"
 #include "SpotLightComponent.hpp"
 #include "Statistics.hpp"
+#include "ViewStreamBuf.hpp"
 #include "System.hpp"
 #include "TextRendererComponent.hpp"
 #include "TransformComponent.hpp"
@@ -46,7 +47,7 @@ std::string GetSerialized( ae3d::TransformComponent* component );
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
     extern ae3d::LightTiler lightTiler;
 }
 
@@ -72,6 +73,8 @@ namespace SceneGlobal
     bool isShadowCameraCreated = false;
     Matrix44 shadowCameraViewMatrix;
     Matrix44 shadowCameraProjectionMatrix;
+    // Fewer meshes than this per thread are recorded faster on one thread.
+    constexpr int MinMeshesPerRecordingThread = 64;
 }
 
 bool someLightCastsShadow = false;
@@ -198,6 +201,7 @@ void ae3d::Scene::Remove( GameObject* gameObject )
 
 void ae3d::Scene::RenderDepthAndNormalsForAllCameras( std::vector< GameObject* >& cameras )
 {
+    AE3D_ZONE( "Scene::RenderDepthAndNormalsForAllCameras" );
     Statistics::BeginDepthNormalsProfiling();
 
     for (auto camera : cameras)
@@ -278,10 +282,8 @@ void ae3d::Scene::RenderDepthAndNormalsForAllCameras( std::vector< GameObject* >
             }
 
             GfxDeviceGlobal::lightTiler.UpdateLightBuffers();
-            Statistics::BeginLightCullerProfiling();
             GfxDeviceGlobal::lightTiler.CullLights( renderer.builtinShaders.lightCullShader, cameraComponent->GetProjection(),
                                                     view, cameraComponent->GetDepthNormalsTexture() );
-            Statistics::EndLightCullerProfiling();
         }
     }
 
@@ -415,7 +417,7 @@ void ae3d::Scene::RenderShadowMaps( std::vector< GameObject* >& cameras )
                 {
                     SceneGlobal::shadowCamera.GetComponent< CameraComponent >()->SetTargetTexture( &go->GetComponent<DirectionalLightComponent>()->shadowMap );
                     SetupCameraForDirectionalShadowCasting( lightTransform->GetViewDirection(), eyeFrustum, aabbMin, aabbMax, *SceneGlobal::shadowCamera.GetComponent< CameraComponent >(), *SceneGlobal::shadowCamera.GetComponent< TransformComponent >() );
-                    GfxDeviceGlobal::perObjectUboStruct.lightType = PerObjectUboStruct::LightType::Dir;
+                    GfxDevice::EditPassUniforms().lightType = PerObjectUboStruct::LightType::Dir;
                     RenderShadowsWithCamera( &SceneGlobal::shadowCamera, 0 );
                     Material::SetGlobalRenderTexture( &go->GetComponent<DirectionalLightComponent>()->shadowMap );
                 }
@@ -423,14 +425,14 @@ void ae3d::Scene::RenderShadowMaps( std::vector< GameObject* >& cameras )
                 {
                     SceneGlobal::shadowCamera.GetComponent< CameraComponent >()->SetTargetTexture( &go->GetComponent<SpotLightComponent>()->shadowMap );
                     SetupCameraForSpotShadowCasting( lightTransform->GetWorldPosition(), lightTransform->GetViewDirection(), *SceneGlobal::shadowCamera.GetComponent< CameraComponent >(), *SceneGlobal::shadowCamera.GetComponent< TransformComponent >() );
-                    GfxDeviceGlobal::perObjectUboStruct.lightType = PerObjectUboStruct::LightType::Spot;
+                    GfxDevice::EditPassUniforms().lightType = PerObjectUboStruct::LightType::Spot;
                     RenderShadowsWithCamera( &SceneGlobal::shadowCamera, 0 );
                     Material::SetGlobalRenderTexture( &go->GetComponent<SpotLightComponent>()->shadowMap );
                 }
                 else if (pointLight)
                 {
                     SceneGlobal::shadowCamera.GetComponent< CameraComponent >()->SetTargetTexture( &go->GetComponent<PointLightComponent>()->shadowMap );
-                    GfxDeviceGlobal::perObjectUboStruct.lightType = PerObjectUboStruct::LightType::Point;
+                    GfxDevice::EditPassUniforms().lightType = PerObjectUboStruct::LightType::Point;
                     
                     for (int cubeMapFace = 0; cubeMapFace < 6; ++cubeMapFace)
                     {
@@ -467,6 +469,9 @@ void BubbleSort( GameObject** gos, int count )
 
 void ae3d::Scene::Render()
 {
+    Statistics::NextTraceFrame();
+    AE3D_ZONE( "Scene::Render" );
+
 #if RENDERER_VULKAN && !AE3D_OPENVR
     GfxDevice::BeginFrame();
 #endif
@@ -476,6 +481,7 @@ void ae3d::Scene::Render()
 #endif
     Statistics::ResetFrameStatistics();
     TransformComponent::UpdateLocalMatrices();
+    MeshRendererComponent::UpdateSkinPalettes();
     
     std::vector< GameObject* > rtCameras;
     rtCameras.reserve( gameObjects.size() / 4 );
@@ -556,8 +562,54 @@ void ae3d::Scene::EndFrame()
 #endif
 }
 
+struct ae3d::Scene::MeshRenderList
+{
+    GameObject* const* gameObjects;
+    const unsigned* indices;
+    const Matrix44* view;
+    CameraComponent* camera;
+    const Frustum* frustum; // Null if the meshes have already been culled.
+    MeshRendererComponent::RenderType renderType;
+};
+
+void ae3d::Scene::RenderMeshRange( int begin, int end, void* userData )
+{
+    const MeshRenderList& list = *static_cast< const MeshRenderList* >( userData );
+
+    for (int i = begin; i < end; ++i)
+    {
+        GameObject* gameObject = list.gameObjects[ list.indices[ i ] ];
+        auto transform = gameObject->GetComponent< TransformComponent >();
+        auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
+
+        Matrix44 localToView;
+        Matrix44 localToClip;
+        Matrix44::Multiply( meshLocalToWorld, *list.view, localToView );
+        Matrix44::Multiply( localToView, list.camera->GetProjection(), localToClip );
+
+        auto* meshRenderer = gameObject->GetComponent< MeshRendererComponent >();
+
+        if (list.frustum)
+        {
+            meshRenderer->Cull( *list.frustum, meshLocalToWorld );
+        }
+
+        meshRenderer->Render( localToView, localToClip, meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, nullptr, nullptr, list.renderType );
+    }
+}
+
+void ae3d::Scene::RenderMeshes( MeshRenderList& list, int meshCount )
+{
+#if RENDERER_VULKAN
+    GfxDevice::RecordParallel( meshCount, SceneGlobal::MinMeshesPerRecordingThread, RenderMeshRange, &list );
+#else
+    RenderMeshRange( 0, meshCount, &list );
+#endif
+}
+
 void ae3d::Scene::RenderWithCamera( GameObject* cameraGo, int cubeMapFace, const char* debugGroupName )
 {
+    AE3D_ZONE( "Scene::RenderWithCamera" );
     ae3d::System::Assert( 0 <= cubeMapFace && cubeMapFace < 6, "invalid cube map face" );
 
     CameraComponent* camera = cameraGo->GetComponent< CameraComponent >();
@@ -659,9 +711,10 @@ void ae3d::Scene::RenderWithCamera( GameObject* cameraGo, int cubeMapFace, const
     gameObjectsWithMeshRenderer.reserve( gameObjects.size() );
     int gameObjectIndex = -1;
     
-    GfxDeviceGlobal::perObjectUboStruct.lightColor = Vec4( 0, 0, 0, 1 );
-    GfxDeviceGlobal::perObjectUboStruct.minAmbient = ambientColor.x;
-    GfxDeviceGlobal::perObjectUboStruct.lightType = PerObjectUboStruct::LightType::Empty;
+    PerObjectUboStruct& passUniforms = GfxDevice::EditPassUniforms();
+    passUniforms.lightColor = Vec4( 0, 0, 0, 1 );
+    passUniforms.minAmbient = ambientColor.x;
+    passUniforms.lightType = PerObjectUboStruct::LightType::Empty;
     
     for (auto gameObject : gameObjects)
     {
@@ -683,18 +736,18 @@ void ae3d::Scene::RenderWithCamera( GameObject* cameraGo, int cubeMapFace, const
             Vec4 lightDirection = Vec4( lightTransform != nullptr ? lightTransform->GetViewDirection() : Vec3( 1, 0, 0 ), 0 );
             Vec3 lightDirectionVS;
             Matrix44::TransformDirection( Vec3( lightDirection.x, lightDirection.y, lightDirection.z ), camera->GetView(), &lightDirectionVS );
-            GfxDeviceGlobal::perObjectUboStruct.lightColor = Vec4( dirLight->GetColor() );
-            GfxDeviceGlobal::perObjectUboStruct.lightDirection = Vec4( lightDirectionVS.x, lightDirectionVS.y, lightDirectionVS.z, 0 );
+            GfxDevice::EditPassUniforms().lightColor = Vec4( dirLight->GetColor() );
+            GfxDevice::EditPassUniforms().lightDirection = Vec4( lightDirectionVS.x, lightDirectionVS.y, lightDirectionVS.z, 0 );
             
             // FIXME: This is an ugly hack to get shadow shaders to work with different light types.
             if (dirLight->CastsShadow())
             {
-                GfxDeviceGlobal::perObjectUboStruct.lightType = PerObjectUboStruct::LightType::Dir;
+                GfxDevice::EditPassUniforms().lightType = PerObjectUboStruct::LightType::Dir;
             }
         }
         else
         {
-            GfxDeviceGlobal::perObjectUboStruct.lightType = PerObjectUboStruct::LightType::Spot;
+            GfxDevice::EditPassUniforms().lightType = PerObjectUboStruct::LightType::Spot;
         }
         
         if (spriteRenderer)
@@ -728,34 +781,13 @@ void ae3d::Scene::RenderWithCamera( GameObject* cameraGo, int cubeMapFace, const
     };
 
     std::sort( std::begin( gameObjectsWithMeshRenderer ), std::end( gameObjectsWithMeshRenderer ), meshSorterByMesh );
-    
-    for (auto j : gameObjectsWithMeshRenderer)
-    {
-        auto transform = gameObjects[ j ]->GetComponent< TransformComponent >();
-        auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
 
-        Matrix44 localToView;
-        Matrix44 localToClip;
-        Matrix44::Multiply( meshLocalToWorld, view, localToView );
-        Matrix44::Multiply( localToView, camera->GetProjection(), localToClip );
-
-        auto* meshRenderer = gameObjects[ j ]->GetComponent< MeshRendererComponent >();
-        meshRenderer->Cull( frustum, meshLocalToWorld );
-        meshRenderer->Render( localToView, localToClip, meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, nullptr, nullptr, MeshRendererComponent::RenderType::Opaque );
-    }
+    MeshRenderList meshList = { gameObjects.data(), gameObjectsWithMeshRenderer.data(), &view, camera, &frustum, MeshRendererComponent::RenderType::Opaque };
+    RenderMeshes( meshList, (int)gameObjectsWithMeshRenderer.size() );
 
-    for (auto j : gameObjectsWithMeshRenderer)
-    {
-        auto transform = gameObjects[ j ]->GetComponent< TransformComponent >();
-        auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
-        
-        Matrix44 localToView;
-        Matrix44 localToClip;
-        Matrix44::Multiply( meshLocalToWorld, view, localToView );
-        Matrix44::Multiply( localToView, camera->GetProjection(), localToClip );
-        
-        gameObjects[ j ]->GetComponent< MeshRendererComponent >()->Render( localToView, localToClip, meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, nullptr, nullptr, MeshRendererComponent::RenderType::Transparent );
-    }
+    meshList.frustum = nullptr;
+    meshList.renderType = MeshRendererComponent::RenderType::Transparent;
+    RenderMeshes( meshList, (int)gameObjectsWithMeshRenderer.size() );
 
     GfxDevice::PopGroupMarker();
 
@@ -788,7 +820,7 @@ void ae3d::Scene::RenderDepthAndNormals( CameraComponent* camera, const Matrix44
     GfxDevice::SetViewport( camera->GetViewport() );
     GfxDevice::ClearScreen( GfxDevice::ClearFlags::Color | GfxDevice::ClearFlags::Depth );
 #endif
-    GfxDevice::PushGroupMarker( "DepthNormal" );
+    GfxDevice::PushGroupMarker( Statistics::DepthNormalsScopeName );
 
     for (auto j : gameObjectsWithMeshRenderer)
     {
@@ -818,6 +850,7 @@ void ae3d::Scene::RenderDepthAndNormals( CameraComponent* camera, const Matrix44
 
 void ae3d::Scene::RenderShadowsWithCamera( GameObject* cameraGo, int cubeMapFace )
 {
+    AE3D_ZONE( "Scene::RenderShadowsWithCamera" );
     CameraComponent* camera = cameraGo->GetComponent< CameraComponent >();
 
     System::Assert( camera->GetTargetTexture() != nullptr, "cannot render shadows if target texture is missing!" );
@@ -845,7 +878,7 @@ void ae3d::Scene::RenderShadowsWithCamera( GameObject* cameraGo, int cubeMapFace
     GfxDevice::SetViewport( viewport );
 #endif
 
-    GfxDevice::PushGroupMarker( "Shadow maps" );
+    GfxDevice::PushGroupMarker( Statistics::ShadowMapsScopeName );
 
     Matrix44 view;
     auto cameraTransform = cameraGo->GetComponent< TransformComponent >();
@@ -862,12 +895,12 @@ void ae3d::Scene::RenderShadowsWithCamera( GameObject* cameraGo, int cubeMapFace
     if (camera->GetProjectionType() == CameraComponent::ProjectionType::Perspective)
     {
         frustum.SetProjection( camera->GetFovDegrees(), camera->GetAspect(), camera->GetNear(), camera->GetFar() );
-        GfxDeviceGlobal::perObjectUboStruct.lightType = PerObjectUboStruct::LightType::Spot;
+        GfxDevice::EditPassUniforms().lightType = PerObjectUboStruct::LightType::Spot;
     }
     else
     {
         frustum.SetProjection( camera->GetLeft(), camera->GetRight(), camera->GetBottom(), camera->GetTop(), camera->GetNear(), camera->GetFar() );
-        GfxDeviceGlobal::perObjectUboStruct.lightType = PerObjectUboStruct::LightType::Dir;
+        GfxDevice::EditPassUniforms().lightType = PerObjectUboStruct::LightType::Dir;
     }
     
     const Vec3 viewDir = Vec3( view.m[2], view.m[6], view.m[10] ).Normalized();
@@ -986,16 +1019,85 @@ std::string ae3d::Scene::GetSerialized() const
     return outSerialized;
 }
 
+/// Reads a texture2d line's path after its name. Prefers a compressed version if the line lists one.
+static std::string ReadTexture2DPath( std::istream& lineStream )
+{
+    std::string path;
+    lineStream >> path;
+
+    if (!lineStream.eof())
+    {
+        std::string compressedTexturePath;
+        lineStream >> compressedTexturePath;
+        
+#if !TARGET_OS_IPHONE
+        if (compressedTexturePath.find( ".dds" ) != std::string::npos)
+        {
+            path = compressedTexturePath;
+        }
+        else if (!lineStream.eof())
+        {
+            lineStream >> compressedTexturePath;
+            
+            if (compressedTexturePath.find( ".dds" ) != std::string::npos)
+            {
+                path = compressedTexturePath;
+            }
+        }
+#endif
+#if TARGET_OS_IPHONE
+        // FIXME: Temporarily disabled because sponza.scene refers non-existing files.
+        /*if (compressedTexturePath.find( ".astc" ) != std::string::npos)
+        {
+            path = compressedTexturePath;
+        }
+        else if (!lineStream.eof())
+        {
+            lineStream >> compressedTexturePath;
+            
+            if (compressedTexturePath.find( ".astc" ) != std::string::npos)
+            {
+                path = compressedTexturePath;
+            }
+        }*/
+#endif
+    }
+
+    return path;
+}
+
 ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileContentsData& serialized, std::vector< GameObject >& outGameObjects,
                                                         std::map< std::string, Texture2D* >& outTexture2Ds,
                                                         std::map< std::string, Material* >& outMaterials,
                                                         Array< Mesh* >& outMeshes ) const
 {
+    FileSystem::FileView view;
+    view.data = serialized.data.data();
+    view.size = serialized.data.size();
+    return DeserializeView( view, serialized.path, outGameObjects, outTexture2Ds, outMaterials, outMeshes );
+}
+
+ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::MappedFile& serialized, std::vector< GameObject >& outGameObjects,
+                                                        std::map< std::string, Texture2D* >& outTexture2Ds,
+                                                        std::map< std::string, Material* >& outMaterials,
+                                                        Array< Mesh* >& outMeshes ) const
+{
+    return DeserializeView( serialized.GetView(), serialized.GetPath(), outGameObjects, outTexture2Ds, outMaterials, outMeshes );
+}
+
+ae3d::Scene::DeserializeResult ae3d::Scene::DeserializeView( const FileSystem::FileView& serialized, const std::string& serializedPath, std::vector< GameObject >& outGameObjects,
+                                                            std::map< std::string, Texture2D* >& outTexture2Ds,
+                                                            std::map< std::string, Material* >& outMaterials,
+                                                            Array< Mesh* >& outMeshes ) const
+{
+    AE3D_ZONE( "Scene::Deserialize" );
     // TODO: It would be better to store the token strings into somewhere accessible to GetSerialized() to prevent typos etc.
 
     outGameObjects.clear();
 
-    std::stringstream stream( std::string( std::begin( serialized.data ), std::end( serialized.data ) ) );
+    // Parses in place, the contents are not copied into a std::stringstream.
+    FileSystem::ViewStreamBuf streamBuf( serialized.data, serialized.size );
+    std::istream stream( &streamBuf );
     std::string line;
     
     std::string currentMaterialName;
@@ -1015,13 +1117,91 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
     tempMaterial->SetBackFaceCulling( true );
     outMaterials[ "temp material" ] = tempMaterial;
 
+    // Starts reading meshes and textures on I/O threads while the scene file is parsed.
+    struct Prefetch
+    {
+        std::future< FileSystem::FileContentsData > future;
+        FileSystem::FileContentsData contents;
+        /// Lines that use the file. Its contents are released after the last one.
+        int remainingUses = 0;
+        bool isRead = false;
+    };
+
+    std::map< std::string, Prefetch > prefetched;
+
+    while (std::getline( stream, line ))
+    {
+        FileSystem::ViewStreamBuf lineBuf( reinterpret_cast< const unsigned char* >( line.data() ), line.size() );
+        std::istream lineStream( &lineBuf );
+        std::string token;
+        lineStream >> token;
+
+        std::string path;
+
+        if (token == "meshpath")
+        {
+            lineStream >> path;
+        }
+        else if (token == "sprite")
+        {
+            lineStream >> path;
+        }
+        else if (token == "texture2d")
+        {
+            std::string name;
+            lineStream >> name;
+            path = ReadTexture2DPath( lineStream );
+        }
+
+        if (!path.empty() && prefetched[ path ].remainingUses++ == 0)
+        {
+            prefetched[ path ].future = FileSystem::FileContentsAsync( path.c_str() );
+        }
+    }
+
+    stream.clear();
+    stream.seekg( 0 );
+
+    // Contents of a file after its last use, kept until the next file is requested.
+    FileSystem::FileContentsData releasedContents;
+
+    // Returned contents are valid until the next call.
+    auto contentsOf = [&prefetched, &releasedContents]( const std::string& path ) -> const FileSystem::FileContentsData&
+    {
+        auto it = prefetched.find( path );
+
+        if (it == prefetched.end())
+        {
+            releasedContents = FileSystem::FileContents( path.c_str() );
+            return releasedContents;
+        }
+
+        Prefetch& prefetch = it->second;
+
+        if (!prefetch.isRead)
+        {
+            prefetch.contents = prefetch.future.get();
+            prefetch.isRead = true;
+        }
+
+        if (--prefetch.remainingUses > 0)
+        {
+            return prefetch.contents;
+        }
+
+        releasedContents = std::move( prefetch.contents );
+        prefetched.erase( it );
+        return releasedContents;
+    };
+
+    const std::locale c_locale( "C" );
     int textureUnit = 0;
     int lineNo = 0;
     while (!stream.eof())
     {
         std::getline( stream, line );
-        std::stringstream lineStream( line );
-        std::locale c_locale( "C" );
+        FileSystem::ViewStreamBuf lineBuf( reinterpret_cast< const unsigned char* >( line.data() ), line.size() );
+        std::istream lineStream( &lineBuf );
         lineStream.imbue( c_locale );
         std::string token;
         lineStream >> token;
@@ -1042,7 +1222,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found name but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found name but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1054,7 +1234,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found layer but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found layer but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1066,7 +1246,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found layer but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found layer but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1078,7 +1258,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found meshrenderer_enabled but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found meshrenderer_enabled but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1089,7 +1269,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
 
             if (meshRenderer == nullptr)
             {
-                System::Print( "Failed to parse %s at line %d: found meshrenderer_enabled but the game object doesn't have a mesh renderer component.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found meshrenderer_enabled but the game object doesn't have a mesh renderer component.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1099,7 +1279,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found transform_enabled but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found transform_enabled but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1110,7 +1290,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
 
             if (transform == nullptr)
             {
-                System::Print( "Failed to parse %s at line %d: found transform_enabled but the game object doesn't have a transform component.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found transform_enabled but the game object doesn't have a transform component.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1120,7 +1300,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found camera_enabled but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found camera_enabled but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1131,7 +1311,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
 
             if (camera == nullptr)
             {
-                System::Print( "Failed to parse %s at line %d: found camera_enabled but the game object doesn't have a camera component.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found camera_enabled but the game object doesn't have a camera component.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1141,7 +1321,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found dirlight but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found dirlight but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
             
@@ -1158,7 +1338,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found spotlight but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found spotlight but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
             
@@ -1170,7 +1350,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found pointlight but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found pointlight but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
             
@@ -1182,7 +1362,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found shadow but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found shadow but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1206,7 +1386,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found camera but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found camera but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1216,7 +1396,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found ortho but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found ortho but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1228,7 +1408,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found persp but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found persp but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1240,7 +1420,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found projection but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found projection but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1265,7 +1445,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found clearcolor but there are no game objects defined before this line.\n", serialized.path.c_str() , lineNo );
+                System::Print( "Failed to parse %s at line %d: found clearcolor but there are no game objects defined before this line.\n", serializedPath.c_str() , lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1277,7 +1457,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found layermask but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found layermask but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1289,7 +1469,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found viewport but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found viewport but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1301,7 +1481,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found order but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found order but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1313,7 +1493,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found transform but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found transform but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1323,7 +1503,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found meshrenderer_cast_shadow but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found meshrenderer_cast_shadow but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1331,7 +1511,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
 
             if (meshRenderer == nullptr)
             {
-                System::Print( "Failed to parse %s at line %d: found mesh_cast_shadow but the game object doesn't have a mesh renderer component.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found mesh_cast_shadow but the game object doesn't have a mesh renderer component.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1343,7 +1523,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found meshrenderer but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found meshrenderer but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1353,7 +1533,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found meshFile but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found meshFile but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1361,7 +1541,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
 
             if (!meshRenderer)
             {
-                System::Print( "Failed to parse %s at line %d: found meshpath but the game object doesn't have a mesh renderer component.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found meshpath but the game object doesn't have a mesh renderer component.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1371,7 +1551,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
             Mesh* mesh = new Mesh();
             outMeshes.Add( mesh );
 
-            outMeshes[ outMeshes.count - 1 ]->Load( FileSystem::FileContents( meshFile.c_str() ) );
+            outMeshes[ outMeshes.count - 1 ]->Load( contentsOf( meshFile ) );
 			meshRenderer->SetMesh( outMeshes[ outMeshes.count - 1 ] );
 
             meshRenderer->SetMaterial( tempMaterial, 0 );
@@ -1380,7 +1560,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found spriterenderer but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found spriterenderer but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1390,13 +1570,13 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found sprite but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found sprite but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
             if (!outGameObjects.back().GetComponent< SpriteRendererComponent >())
             {
-                System::Print( "Failed to parse %s at line %d: found sprite but the game object doesn't have a sprite renderer component.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found sprite but the game object doesn't have a sprite renderer component.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1405,7 +1585,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
             lineStream >> spritePath >> x >> y >> width >> height;
 
             outTexture2Ds[ spritePath ] = new Texture2D();
-            outTexture2Ds[ spritePath ]->Load( FileSystem::FileContents( spritePath.c_str() ), TextureWrap::Repeat, TextureFilter::Linear, Mipmaps::Generate, ColorSpace::SRGB, Anisotropy::k1 );
+            outTexture2Ds[ spritePath ]->Load( contentsOf( spritePath ), TextureWrap::Repeat, TextureFilter::Linear, Mipmaps::Generate, ColorSpace::SRGB, Anisotropy::k1 );
 
             outGameObjects.back().GetComponent< SpriteRendererComponent >()->SetTexture( outTexture2Ds[ spritePath ], Vec3( x, y, 0 ), Vec3( x, y, 1 ), Vec4( 1, 1, 1, 1 ) );
         }
@@ -1413,13 +1593,13 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found position but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found position but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
             if (!outGameObjects.back().GetComponent< TransformComponent >())
             {
-                System::Print( "Failed to parse %s at line %d: found position but the game object doesn't have a transform component.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found position but the game object doesn't have a transform component.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1431,13 +1611,13 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found rotation but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found rotation but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
             if (!outGameObjects.back().GetComponent< TransformComponent >())
             {
-                System::Print( "Failed to parse %s at line %d: found rotation but the game object doesn't have a transform component.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found rotation but the game object doesn't have a transform component.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1449,13 +1629,13 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found scale but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found scale but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
             
             if (!outGameObjects.back().GetComponent< TransformComponent >())
             {
-                System::Print( "Failed to parse %s at line %d: found scale but the game object doesn't have a transform component.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found scale but the game object doesn't have a transform component.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1466,57 +1646,18 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         else if (token == "texture2d")
         {
             std::string name;
-            std::string path;
-            
-            lineStream >> name >> path;
-            
-            if (!lineStream.eof())
-            {
-                std::string compressedTexturePath;
-                lineStream >> compressedTexturePath;
-                
-#if !TARGET_OS_IPHONE
-                if (compressedTexturePath.find( ".dds" ) != std::string::npos)
-                {
-                    path = compressedTexturePath;
-                }
-                else if (!lineStream.eof())
-                {
-                    lineStream >> compressedTexturePath;
-                    
-                    if (compressedTexturePath.find( ".dds" ) != std::string::npos)
-                    {
-                        path = compressedTexturePath;
-                    }
-                }
-#endif
-#if TARGET_OS_IPHONE
-                // FIXME: Temporarily disabled because sponza.scene refers non-existing files.
-                /*if (compressedTexturePath.find( ".astc" ) != std::string::npos)
-                {
-                    path = compressedTexturePath;
-                }
-                else if (!lineStream.eof())
-                {
-                    lineStream >> compressedTexturePath;
-                    
-                    if (compressedTexturePath.find( ".astc" ) != std::string::npos)
-                    {
-                        path = compressedTexturePath;
-                    }
-                }*/
-#endif
-            }
+            lineStream >> name;
+            const std::string path = ReadTexture2DPath( lineStream );
 
             outTexture2Ds[ name ] = new Texture2D();
 
             if (path.find( "_n." ) != std::string::npos)
             {
-                outTexture2Ds[ name ]->Load( FileSystem::FileContents( path.c_str() ), TextureWrap::Repeat, TextureFilter::Linear, Mipmaps::Generate, ColorSpace::Linear, Anisotropy::k1 );
+                outTexture2Ds[ name ]->Load( contentsOf( path ), TextureWrap::Repeat, TextureFilter::Linear, Mipmaps::Generate, ColorSpace::Linear, Anisotropy::k1 );
             }
             else
             {
-                outTexture2Ds[ name ]->Load( FileSystem::FileContents( path.c_str() ), TextureWrap::Repeat, TextureFilter::Linear, Mipmaps::Generate, ColorSpace::SRGB, Anisotropy::k1 );
+                outTexture2Ds[ name ]->Load( contentsOf( path ), TextureWrap::Repeat, TextureFilter::Linear, Mipmaps::Generate, ColorSpace::SRGB, Anisotropy::k1 );
             }
         }
         else if (token == "material")
@@ -1533,7 +1674,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found mesh_material but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found mesh_material but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
             
@@ -1541,13 +1682,13 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
 
             if (!mr)
             {
-                System::Print( "Failed to parse %s at line %d: found mesh_material but the last defined game object doesn't have a mesh renderer component.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found mesh_material but the last defined game object doesn't have a mesh renderer component.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
             
             if (!mr->GetMesh())
             {
-                System::Print( "Failed to parse %s at line %d: found mesh_material but the last defined game object's mesh renderer doesn't have a mesh.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found mesh_material but the last defined game object's mesh renderer doesn't have a mesh.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
             
@@ -1585,7 +1726,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (outGameObjects.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found audiosource but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found audiosource but there are no game objects defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
 
@@ -1638,7 +1779,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
         {
             if (currentMaterialName.empty())
             {
-                System::Print( "Failed to parse %s at line %d: found 'metal_shaders' but there are no materials defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found 'metal_shaders' but there are no materials defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
             
@@ -1662,7 +1803,7 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
 #if RENDERER_METAL
             if (currentMaterialName == "")
             {
-                System::Print( "Failed to parse %s at line %d: found 'metal_shaders' but there are no materials defined before this line.\n", serialized.path.c_str(), lineNo );
+                System::Print( "Failed to parse %s at line %d: found 'metal_shaders' but there are no materials defined before this line.\n", serializedPath.c_str(), lineNo );
                 return DeserializeResult::ParseError;
             }
             
@@ -1,63 +1,489 @@
 #include "Statistics.hpp"
 #include "GfxDevice.hpp"
+#include "System.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
 
 namespace Statistics
 {
-    int drawCalls = 0;
-    int barrierCalls = 0;
-    int fenceCalls = 0;
-    int shaderBinds = 0;
-    int renderTargetBinds = 0;
-    int createConstantBufferCalls = 0;
-    int allocCalls = 0;
-    int totalAllocCalls = 0;
-    int triangleCount = 0;
-    int psoBindCount = 0;
-    int queueSubmitCalls = 0;
+    // Counters are atomic because draws can be recorded on several threads.
+    std::atomic< int > drawCalls{ 0 };
+    std::atomic< int > barrierCalls{ 0 };
+    std::atomic< int > fenceCalls{ 0 };
+    std::atomic< int > shaderBinds{ 0 };
+    std::atomic< int > renderTargetBinds{ 0 };
+    std::atomic< int > createConstantBufferCalls{ 0 };
+    std::atomic< int > allocCalls{ 0 };
+    std::atomic< int > totalAllocCalls{ 0 };
+    std::atomic< int > triangleCount{ 0 };
+    std::atomic< int > psoBindCount{ 0 };
+    std::atomic< int > queueSubmitCalls{ 0 };
+    std::atomic< int > uniformUploadBytes{ 0 };
+    std::atomic< int > descriptorSetCacheHits{ 0 };
+    std::atomic< int > descriptorSetUpdates{ 0 };
+    std::atomic< int > psoCacheHits{ 0 };
+    std::atomic< int > psoCacheMisses{ 0 };
+    std::atomic< int > uniformRingBytes{ 0 };
+    std::atomic< int > uniformRingStalls{ 0 };
     float depthNormalsTimeMS = 0;
-    float depthNormalsTimeGpuMS = 0;
     float shadowMapTimeMS = 0;
-    float shadowMapTimeGpuMS = 0;
     float frameTimeMS = 0;
     float presentTimeMS = 0;
+    float fenceWaitTimeMS = 0;
     float sceneAABBTimeMS = 0;
-    float lightCullerTimeGpuMS = 0;
+    float firstFrameTimeMS = -1;
     std::chrono::time_point< std::chrono::steady_clock > startFrameTimePoint;
     std::chrono::time_point< std::chrono::steady_clock > startShadowMapTimePoint;
     std::chrono::time_point< std::chrono::steady_clock > startDepthNormalsTimePoint;
     std::chrono::time_point< std::chrono::steady_clock > startPresentTimePoint;
+    std::chrono::time_point< std::chrono::steady_clock > startFenceWaitTimePoint;
     std::chrono::time_point< std::chrono::steady_clock > startSceneAABBPoint;
+
+    /// GPU times of a group marker scope over recent frames.
+    struct GpuScopeHistory
+    {
+        static const int SampleCount = 64;
+        std::string name;
+        int depth = 0;
+        float frameTimeMS = 0; // Sum of this frame's scopes with this name.
+        bool ranThisFrame = false;
+        float lastTimeMS = 0;
+        float samples[ SampleCount ] = {};
+        int sampleCount = 0;
+        int nextSample = 0;
+    };
+
+    // In the order the scopes were first seen. Only touched by the thread that calls Present().
+    std::vector< GpuScopeHistory > gpuScopes;
+
+    /// Newest samples of a metric, one per frame. Written by the thread that renders.
+    struct MetricHistory
+    {
+        static const int SampleCount = 1024;
+        float samples[ SampleCount ] = {};
+        int sampleCount = 0;
+        int nextSample = 0;
+
+        void Add( float sample )
+        {
+            samples[ nextSample ] = sample;
+            nextSample = (nextSample + 1) % SampleCount;
+            sampleCount = sampleCount < SampleCount ? sampleCount + 1 : sampleCount;
+        }
+    };
+
+    struct Hitch
+    {
+        unsigned frame = 0;
+        float frameTimeMS = 0;
+        int drawCalls = 0;
+    };
+
+    MetricHistory metrics[ (int)ae3d::System::Statistics::Metric::Count ];
+    int summaryWindow = 120;
+    float hitchBudgetMS = 0;
+    unsigned frameNumber = 0;
+    // Ring of the newest hitches.
+    const int HitchLogSize = 32;
+    Hitch hitches[ HitchLogSize ];
+    int hitchCount = 0;
+
+    void AddSample( ae3d::System::Statistics::Metric metric, float timeMS )
+    {
+        metrics[ (int)metric ].Add( timeMS );
+    }
+
+    /// Memory of a MemoryTag. Atomics are constant-initialized, so the global operator new can use them during static initialization.
+    struct MemoryCounters
+    {
+        std::atomic< long long > liveBytes{ 0 };
+        std::atomic< long long > peakBytes{ 0 };
+        std::atomic< int > allocCount{ 0 };
+        std::atomic< int > freeCount{ 0 };
+    };
+
+    MemoryCounters memoryCounters[ (int)ae3d::System::Statistics::MemoryTag::Count ];
+    std::atomic< int > frameAllocCount{ 0 };
+    bool assertZeroAllocationFrames = false;
+    const char* const memoryTagNames[] = { "meshVertices", "pakFiles", "audio", "font", "components", "heap" };
+    static_assert( sizeof( memoryTagNames ) / sizeof( memoryTagNames[ 0 ] ) == (int)ae3d::System::Statistics::MemoryTag::Count, "memoryTagNames must match MemoryTag" );
+
+    void AddMemory( ae3d::System::Statistics::MemoryTag tag, long long bytes )
+    {
+        MemoryCounters& counters = memoryCounters[ (int)tag ];
+        const long long live = counters.liveBytes.fetch_add( bytes, std::memory_order_relaxed ) + bytes;
+        long long peak = counters.peakBytes.load( std::memory_order_relaxed );
+
+        while (live > peak && !counters.peakBytes.compare_exchange_weak( peak, live, std::memory_order_relaxed ))
+        {
+        }
+    }
+
+    struct TraceEvent
+    {
+        const char* name;
+        const char* file;
+        int line;
+        std::uint64_t beginNs;
+        std::uint64_t endNs;
+    };
+
+    /// Trace events of one thread. Only the owning thread writes into it, and it publishes events by incrementing count, so
+    /// the buffer can be read without locks. Buffers are never freed, because their threads may exit during a capture.
+    struct TraceBuffer
+    {
+        static const int Capacity = 64 * 1024;
+        TraceEvent events[ Capacity ];
+        std::atomic< int > count{ 0 };
+        unsigned generation = 0; // Capture that count belongs to.
+        int threadId = 0;
+    };
+
+    std::mutex traceBufferMutex; // Guards traceBuffers.
+    std::vector< std::unique_ptr< TraceBuffer > > traceBuffers;
+    thread_local TraceBuffer* threadTraceBuffer = nullptr;
+    std::atomic< bool > isTracing{ false };
+    std::atomic< unsigned > traceGeneration{ 0 };
+    std::string tracePath;
+    int traceFramesLeft = 0;
+    std::uint64_t traceStartNs = 0;
+    std::uint64_t traceFrameStartNs = 0;
+
+    std::uint64_t GetTraceTimeNs()
+    {
+        return (std::uint64_t)std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+    }
+
+    void AddTraceEvent( const char* name, const char* file, int line, std::uint64_t beginNs, std::uint64_t endNs )
+    {
+        if (threadTraceBuffer == nullptr)
+        {
+            std::lock_guard< std::mutex > lock( traceBufferMutex );
+            traceBuffers.push_back( std::unique_ptr< TraceBuffer >( new TraceBuffer() ) );
+            threadTraceBuffer = traceBuffers.back().get();
+            threadTraceBuffer->threadId = (int)traceBuffers.size();
+        }
+
+        TraceBuffer& buffer = *threadTraceBuffer;
+        const unsigned generation = traceGeneration.load( std::memory_order_acquire );
+
+        // The first event of a new capture discards the thread's events of the previous one.
+        if (buffer.generation != generation)
+        {
+            buffer.generation = generation;
+            buffer.count.store( 0, std::memory_order_relaxed );
+        }
+
+        const int index = buffer.count.load( std::memory_order_relaxed );
+
+        if (index < TraceBuffer::Capacity)
+        {
+            buffer.events[ index ] = { name, file, line, beginNs, endNs };
+            buffer.count.store( index + 1, std::memory_order_release );
+        }
+    }
+
+    void WriteJSONString( std::ofstream& ofs, const char* str )
+    {
+        ofs << '"';
+
+        for (const char* c = str; *c != 0; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                ofs << '\\';
+            }
+
+            ofs << *c;
+        }
+
+        ofs << '"';
+    }
+
+    void WriteTrace()
+    {
+        std::ofstream ofs( tracePath );
+
+        if (!ofs)
+        {
+            ae3d::System::Print( "Could not write CPU trace %s\n", tracePath.c_str() );
+            return;
+        }
+
+        ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool isFirst = true;
+        const unsigned generation = traceGeneration.load();
+        std::lock_guard< std::mutex > lock( traceBufferMutex );
+
+        for (const auto& buffer : traceBuffers)
+        {
+            if (buffer->generation != generation)
+            {
+                continue;
+            }
+
+            const int count = buffer->count.load( std::memory_order_acquire );
+
+            for (int i = 0; i < count; ++i)
+            {
+                const TraceEvent& event = buffer->events[ i ];
+                const std::uint64_t beginNs = event.beginNs > traceStartNs ? event.beginNs - traceStartNs : 0;
+
+                ofs << (isFirst ? "" : ",\n") << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"name\":";
+                WriteJSONString( ofs, event.name );
+                ofs << ",\"ts\":" << beginNs / 1000.0 << ",\"dur\":" << (event.endNs - event.beginNs) / 1000.0 << ",\"args\":{\"file\":";
+                WriteJSONString( ofs, event.file );
+                ofs << ",\"line\":" << event.line << "}}";
+                isFirst = false;
+            }
+
+            if (count == TraceBuffer::Capacity)
+            {
+                ae3d::System::Print( "CPU trace buffer of thread %d is full, capture fewer frames\n", buffer->threadId );
+            }
+        }
+
+        ofs << "\n]}\n";
+        ae3d::System::Print( "Wrote CPU trace %s\n", tracePath.c_str() );
+    }
 }
 
-void Statistics::IncTriangleCount( int triangles )
+Statistics::TraceZone::TraceZone( const char* aName, const char* aFile, int aLine )
+    : name( aName )
+    , file( aFile )
+    , line( aLine )
+    , isRecording( isTracing.load( std::memory_order_relaxed ) )
 {
-    triangleCount += triangles;
+    if (isRecording)
+    {
+        beginNs = GetTraceTimeNs();
+    }
 }
 
-int Statistics::GetTriangleCount()
+Statistics::TraceZone::~TraceZone()
 {
-    return triangleCount;
+    if (isRecording)
+    {
+        AddTraceEvent( name, file, line, beginNs, GetTraceTimeNs() );
+    }
 }
 
-float Statistics::GetPresentTimeMS()
+void Statistics::NextTraceFrame()
 {
-    return presentTimeMS;
+    if (!isTracing.load( std::memory_order_relaxed ))
+    {
+        return;
+    }
+
+    const std::uint64_t nowNs = GetTraceTimeNs();
+    AddTraceEvent( "Frame", __FILE__, __LINE__, traceFrameStartNs, nowNs );
+    traceFrameStartNs = nowNs;
+
+    if (--traceFramesLeft <= 0)
+    {
+        isTracing = false;
+        WriteTrace();
+    }
 }
 
-void Statistics::SetDepthNormalsGpuTime( float timeMS )
+void ae3d::System::Statistics::CaptureCpuTrace( const char* path, int frameCount )
 {
-    depthNormalsTimeGpuMS = timeMS;
+#if AE3D_CPU_TRACE
+    ::Statistics::tracePath = path;
+    ::Statistics::traceFramesLeft = frameCount;
+    ::Statistics::traceStartNs = ::Statistics::GetTraceTimeNs();
+    ::Statistics::traceFrameStartNs = ::Statistics::traceStartNs;
+    ++::Statistics::traceGeneration;
+    ::Statistics::isTracing = frameCount > 0;
+#else
+    (void)path;
+    (void)frameCount;
+    Print( "CaptureCpuTrace: the engine was built with AE3D_CPU_TRACE=0\n" );
+#endif
 }
 
-void Statistics::SetShadowMapGpuTime( float timeMS )
+void Statistics::TrackAlloc( ae3d::System::Statistics::MemoryTag tag, std::size_t bytes )
 {
-    shadowMapTimeGpuMS = timeMS;
+    AddMemory( tag, (long long)bytes );
+    memoryCounters[ (int)tag ].allocCount.fetch_add( 1, std::memory_order_relaxed );
+#if !AE3D_TRACK_GLOBAL_NEW
+    // With the global hook the allocation was already counted by operator new.
+    frameAllocCount.fetch_add( 1, std::memory_order_relaxed );
+#endif
 }
 
-void Statistics::SetLightCullerTimeGpuMS( float timeMS )
+void Statistics::TrackFree( ae3d::System::Statistics::MemoryTag tag, std::size_t bytes )
 {
-    lightCullerTimeGpuMS = timeMS;
+    memoryCounters[ (int)tag ].liveBytes.fetch_sub( (long long)bytes, std::memory_order_relaxed );
+    memoryCounters[ (int)tag ].freeCount.fetch_add( 1, std::memory_order_relaxed );
+}
+
+void Statistics::TrackResize( ae3d::System::Statistics::MemoryTag tag, std::size_t oldBytes, std::size_t newBytes )
+{
+    if (oldBytes == newBytes)
+    {
+        return;
+    }
+
+    TrackAlloc( tag, newBytes );
+
+    if (oldBytes > 0)
+    {
+        TrackFree( tag, oldBytes );
+    }
+}
+
+ae3d::System::Statistics::MemoryUsage ae3d::System::Statistics::GetMemoryUsage( MemoryTag tag )
+{
+    const ::Statistics::MemoryCounters& counters = ::Statistics::memoryCounters[ (int)tag ];
+
+    MemoryUsage usage;
+    usage.liveBytes = (unsigned long long)std::max( counters.liveBytes.load( std::memory_order_relaxed ), 0LL );
+    usage.peakBytes = (unsigned long long)counters.peakBytes.load( std::memory_order_relaxed );
+    usage.allocCount = counters.allocCount.load( std::memory_order_relaxed );
+    usage.freeCount = counters.freeCount.load( std::memory_order_relaxed );
+    return usage;
+}
+
+void ae3d::System::Statistics::PrintMemoryReport()
+{
+    Print( "%-14s %12s %12s %8s %8s\n", "memory", "live KiB", "peak KiB", "allocs", "frees" );
+
+    for (int t = 0; t < (int)MemoryTag::Count; ++t)
+    {
+#if !AE3D_TRACK_GLOBAL_NEW
+        if (t == (int)MemoryTag::Heap)
+        {
+            continue;
+        }
+#endif
+        const MemoryUsage usage = GetMemoryUsage( (MemoryTag)t );
+        Print( "%-14s %12llu %12llu %8d %8d\n", ::Statistics::memoryTagNames[ t ], usage.liveBytes / 1024, usage.peakBytes / 1024, usage.allocCount, usage.freeCount );
+    }
+
+    Print( "allocations in the previous frame: %d\n", GetFrameAllocationCount() );
+}
+
+int ae3d::System::Statistics::GetFrameAllocationCount()
+{
+    return ::Statistics::frameAllocCount.load( std::memory_order_relaxed );
+}
+
+void ae3d::System::Statistics::SetAssertZeroAllocationFrames( bool enable )
+{
+    ::Statistics::assertZeroAllocationFrames = enable;
+}
+
+#if AE3D_TRACK_GLOBAL_NEW
+namespace
+{
+    // Allocations are prefixed with their size so delete can subtract it. The header keeps the default new alignment.
+    const std::size_t HeapHeaderSize = 16;
+
+    void* TrackedMalloc( std::size_t bytes )
+    {
+        unsigned char* memory = static_cast< unsigned char* >( std::malloc( bytes + HeapHeaderSize ) );
+
+        if (memory == nullptr)
+        {
+            return nullptr;
+        }
+
+        *reinterpret_cast< std::size_t* >( memory ) = bytes;
+        Statistics::AddMemory( ae3d::System::Statistics::MemoryTag::Heap, (long long)bytes );
+        Statistics::memoryCounters[ (int)ae3d::System::Statistics::MemoryTag::Heap ].allocCount.fetch_add( 1, std::memory_order_relaxed );
+        Statistics::frameAllocCount.fetch_add( 1, std::memory_order_relaxed );
+        return memory + HeapHeaderSize;
+    }
+
+    void TrackedFree( void* ptr )
+    {
+        if (ptr == nullptr)
+        {
+            return;
+        }
+
+        unsigned char* memory = static_cast< unsigned char* >( ptr ) - HeapHeaderSize;
+        Statistics::TrackFree( ae3d::System::Statistics::MemoryTag::Heap, *reinterpret_cast< std::size_t* >( memory ) );
+        std::free( memory );
+    }
+}
+
+void* operator new( std::size_t bytes )
+{
+    void* ptr = TrackedMalloc( bytes );
+
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    return ptr;
+}
+
+void* operator new[]( std::size_t bytes )
+{
+    return operator new( bytes );
+}
+
+void* operator new( std::size_t bytes, const std::nothrow_t& ) noexcept
+{
+    return TrackedMalloc( bytes );
+}
+
+void* operator new[]( std::size_t bytes, const std::nothrow_t& ) noexcept
+{
+    return TrackedMalloc( bytes );
+}
+
+void operator delete( void* ptr ) noexcept
+{
+    TrackedFree( ptr );
+}
+
+void operator delete[]( void* ptr ) noexcept
+{
+    TrackedFree( ptr );
+}
+
+void operator delete( void* ptr, const std::nothrow_t& ) noexcept
+{
+    TrackedFree( ptr );
+}
+
+void operator delete[]( void* ptr, const std::nothrow_t& ) noexcept
+{
+    TrackedFree( ptr );
+}
+#endif
+
+void Statistics::IncTriangleCount( int triangles )
+{
+    triangleCount += triangles;
+}
+
+int Statistics::GetTriangleCount()
+{
+    return triangleCount;
+}
+
+float Statistics::GetPresentTimeMS()
+{
+    return presentTimeMS;
+}
+
+float Statistics::GetFenceWaitTimeMS()
+{
+    return fenceWaitTimeMS;
 }
 
 void Statistics::BeginPresentTimeProfiling()
@@ -70,22 +496,25 @@ void Statistics::EndPresentTimeProfiling()
     auto tEnd = std::chrono::steady_clock::now();
     auto tDiff = std::chrono::duration<double, std::milli>( tEnd - Statistics::startPresentTimePoint ).count();
     Statistics::presentTimeMS = static_cast< float >(tDiff);
+    AddSample( ae3d::System::Statistics::Metric::PresentTime, Statistics::presentTimeMS );
 }
 
-void Statistics::BeginLightCullerProfiling()
+void Statistics::BeginFenceWaitProfiling()
 {
-    ae3d::GfxDevice::BeginLightCullerGpuQuery();
+    Statistics::startFenceWaitTimePoint = std::chrono::steady_clock::now();
 }
 
-void Statistics::EndLightCullerProfiling()
+void Statistics::EndFenceWaitProfiling()
 {
-    ae3d::GfxDevice::EndLightCullerGpuQuery();
+    auto tEnd = std::chrono::steady_clock::now();
+    auto tDiff = std::chrono::duration<double, std::milli>( tEnd - Statistics::startFenceWaitTimePoint ).count();
+    Statistics::fenceWaitTimeMS = static_cast< float >(tDiff);
+    AddSample( ae3d::System::Statistics::Metric::FenceWait, Statistics::fenceWaitTimeMS );
 }
 
 void Statistics::BeginShadowMapProfiling()
 {
     Statistics::startShadowMapTimePoint = std::chrono::steady_clock::now();
-    ae3d::GfxDevice::BeginShadowMapGpuQuery();
 }
 
 void Statistics::EndShadowMapProfiling()
@@ -93,13 +522,12 @@ void Statistics::EndShadowMapProfiling()
     auto tEnd = std::chrono::steady_clock::now();
     auto tDiff = std::chrono::duration<double, std::milli>( tEnd - Statistics::startShadowMapTimePoint ).count();
     Statistics::shadowMapTimeMS = static_cast< float >(tDiff);
-    ae3d::GfxDevice::EndShadowMapGpuQuery();
+    AddSample( ae3d::System::Statistics::Metric::ShadowPass, Statistics::shadowMapTimeMS );
 }
 
 void Statistics::BeginDepthNormalsProfiling()
 {
     Statistics::startDepthNormalsTimePoint = std::chrono::steady_clock::now();
-    ae3d::GfxDevice::BeginDepthNormalsGpuQuery();
 }
 
 void Statistics::EndDepthNormalsProfiling()
@@ -107,7 +535,7 @@ void Statistics::EndDepthNormalsProfiling()
     auto tEnd = std::chrono::steady_clock::now();
     auto tDiff = std::chrono::duration<double, std::milli>( tEnd - Statistics::startDepthNormalsTimePoint ).count();
     Statistics::depthNormalsTimeMS = static_cast< float >(tDiff);
-    ae3d::GfxDevice::EndDepthNormalsGpuQuery();
+    AddSample( ae3d::System::Statistics::Metric::DepthPass, Statistics::depthNormalsTimeMS );
 }
 
 void Statistics::BeginFrameTimeProfiling()
@@ -120,6 +548,30 @@ void Statistics::EndFrameTimeProfiling()
     auto tEnd = std::chrono::steady_clock::now();
     auto tDiff = std::chrono::duration<double, std::milli>( tEnd - Statistics::startFrameTimePoint ).count();
     Statistics::frameTimeMS = static_cast< float >(tDiff);
+    AddSample( ae3d::System::Statistics::Metric::FrameTime, Statistics::frameTimeMS );
+
+    if (Statistics::hitchBudgetMS > 0 && Statistics::frameTimeMS > Statistics::hitchBudgetMS)
+    {
+        Hitch& hitch = Statistics::hitches[ Statistics::hitchCount % HitchLogSize ];
+        hitch.frame = Statistics::frameNumber;
+        hitch.frameTimeMS = Statistics::frameTimeMS;
+        hitch.drawCalls = Statistics::drawCalls;
+        ++Statistics::hitchCount;
+
+        ae3d::System::Print( "Hitch: frame %u took %.2f ms, budget %.2f ms, %d draw calls\n", hitch.frame, (double)hitch.frameTimeMS, (double)Statistics::hitchBudgetMS, hitch.drawCalls );
+    }
+
+    ++Statistics::frameNumber;
+
+    if (Statistics::firstFrameTimeMS < 0)
+    {
+        Statistics::firstFrameTimeMS = Statistics::frameTimeMS;
+    }
+}
+
+float Statistics::GetFirstFrameTimeMS()
+{
+    return Statistics::firstFrameTimeMS < 0 ? 0 : Statistics::firstFrameTimeMS;
 }
 
 void Statistics::IncPSOBindCalls()
@@ -187,6 +639,76 @@ int Statistics::GetQueueSubmitCalls()
     return Statistics::queueSubmitCalls;
 }
 
+void Statistics::IncUniformUploadBytes( int bytes )
+{
+    Statistics::uniformUploadBytes += bytes;
+}
+
+int Statistics::GetUniformUploadBytes()
+{
+    return Statistics::uniformUploadBytes;
+}
+
+void Statistics::IncDescriptorSetCacheHits()
+{
+    ++Statistics::descriptorSetCacheHits;
+}
+
+int Statistics::GetDescriptorSetCacheHits()
+{
+    return Statistics::descriptorSetCacheHits;
+}
+
+void Statistics::IncDescriptorSetUpdates()
+{
+    ++Statistics::descriptorSetUpdates;
+}
+
+int Statistics::GetDescriptorSetUpdates()
+{
+    return Statistics::descriptorSetUpdates;
+}
+
+void Statistics::IncPSOCacheHits()
+{
+    ++Statistics::psoCacheHits;
+}
+
+int Statistics::GetPSOCacheHits()
+{
+    return Statistics::psoCacheHits;
+}
+
+void Statistics::IncPSOCacheMisses()
+{
+    ++Statistics::psoCacheMisses;
+}
+
+int Statistics::GetPSOCacheMisses()
+{
+    return Statistics::psoCacheMisses;
+}
+
+void Statistics::IncUniformRingBytes( int bytes )
+{
+    Statistics::uniformRingBytes += bytes;
+}
+
+int Statistics::GetUniformRingBytes()
+{
+    return Statistics::uniformRingBytes;
+}
+
+void Statistics::IncUniformRingStalls()
+{
+    ++Statistics::uniformRingStalls;
+}
+
+int Statistics::GetUniformRingStalls()
+{
+    return Statistics::uniformRingStalls;
+}
+
 void Statistics::IncRenderTargetBinds()
 {
     ++Statistics::renderTargetBinds;
@@ -217,16 +739,6 @@ float Statistics::GetDepthNormalsTimeMS()
     return Statistics::depthNormalsTimeMS;
 }
 
-float Statistics::GetDepthNormalsTimeGpuMS()
-{
-    return Statistics::depthNormalsTimeGpuMS;
-}
-
-float Statistics::GetShadowMapTimeGpuMS()
-{
-    return Statistics::shadowMapTimeGpuMS;
-}
-
 int Statistics::GetDrawCalls()
 {
     return Statistics::drawCalls;
@@ -249,6 +761,13 @@ void Statistics::IncBarrierCalls()
 
 void Statistics::ResetFrameStatistics()
 {
+    if (assertZeroAllocationFrames && frameAllocCount > 0)
+    {
+        ae3d::System::Print( "Frame %u allocated %d times\n", frameNumber, frameAllocCount.load() );
+        ae3d::System::Assert( false, "Allocation in a frame that should not allocate" );
+    }
+
+    frameAllocCount = 0;
     drawCalls = 0;
     barrierCalls = 0;
     fenceCalls = 0;
@@ -259,13 +778,214 @@ void Statistics::ResetFrameStatistics()
     triangleCount = 0;
     psoBindCount = 0;
     queueSubmitCalls = 0;
+    uniformUploadBytes = 0;
+    descriptorSetCacheHits = 0;
+    descriptorSetUpdates = 0;
+    psoCacheHits = 0;
+    psoCacheMisses = 0;
+    uniformRingBytes = 0;
+    uniformRingStalls = 0;
 
     startFrameTimePoint = std::chrono::steady_clock::now();
 }
 
-float Statistics::GetLightCullerTimeGpuMS()
+void Statistics::AddGpuScopeTime( const char* name, int depth, float timeMS )
+{
+    for (auto& scope : gpuScopes)
+    {
+        if (scope.name == name)
+        {
+            scope.frameTimeMS += timeMS;
+            scope.ranThisFrame = true;
+            return;
+        }
+    }
+
+    gpuScopes.push_back( GpuScopeHistory() );
+    gpuScopes.back().name = name;
+    gpuScopes.back().depth = depth;
+    gpuScopes.back().frameTimeMS = timeMS;
+    gpuScopes.back().ranThisFrame = true;
+}
+
+void Statistics::EndGpuScopeFrame()
+{
+    for (auto& scope : gpuScopes)
+    {
+        scope.lastTimeMS = scope.frameTimeMS;
+
+        if (scope.ranThisFrame)
+        {
+            scope.samples[ scope.nextSample ] = scope.frameTimeMS;
+            scope.nextSample = (scope.nextSample + 1) % GpuScopeHistory::SampleCount;
+            scope.sampleCount = scope.sampleCount < GpuScopeHistory::SampleCount ? scope.sampleCount + 1 : scope.sampleCount;
+        }
+
+        scope.frameTimeMS = 0;
+        scope.ranThisFrame = false;
+    }
+}
+
+float Statistics::GetGpuScopeTimeMS( const char* name )
+{
+    for (const auto& scope : gpuScopes)
+    {
+        if (scope.name == name)
+        {
+            return scope.lastTimeMS;
+        }
+    }
+
+    return 0;
+}
+
+int ae3d::System::Statistics::GetGpuScopeTimes( GpuScopeTime* outScopes, int maxScopes )
+{
+    int count = 0;
+
+    for (const auto& scope : ::Statistics::gpuScopes)
+    {
+        if (count == maxScopes)
+        {
+            break;
+        }
+
+        GpuScopeTime& outScope = outScopes[ count++ ];
+        outScope.name = scope.name.c_str();
+        outScope.depth = scope.depth;
+        outScope.lastMS = scope.lastTimeMS;
+        outScope.averageMS = 0;
+        outScope.maxMS = 0;
+
+        for (int i = 0; i < scope.sampleCount; ++i)
+        {
+            outScope.averageMS += scope.samples[ i ];
+            outScope.maxMS = scope.samples[ i ] > outScope.maxMS ? scope.samples[ i ] : outScope.maxMS;
+        }
+
+        if (scope.sampleCount > 0)
+        {
+            outScope.averageMS /= scope.sampleCount;
+        }
+    }
+
+    return count;
+}
+
+ae3d::System::Statistics::MetricSummary ae3d::System::Statistics::GetMetricSummary( Metric metric, int windowFrames )
+{
+    const ::Statistics::MetricHistory& history = ::Statistics::metrics[ (int)metric ];
+    const int count = std::min( std::max( windowFrames, 0 ), history.sampleCount );
+
+    MetricSummary outSummary;
+    outSummary.sampleCount = count;
+
+    if (count == 0)
+    {
+        return outSummary;
+    }
+
+    float sorted[ ::Statistics::MetricHistory::SampleCount ];
+
+    for (int i = 0; i < count; ++i)
+    {
+        const int sampleIndex = (history.nextSample - 1 - i + ::Statistics::MetricHistory::SampleCount) % ::Statistics::MetricHistory::SampleCount;
+        sorted[ i ] = history.samples[ sampleIndex ];
+        outSummary.mean += sorted[ i ];
+    }
+
+    std::sort( sorted, sorted + count );
+
+    // Nearest-rank percentiles.
+    auto percentile = [ & ]( int p ) { return sorted[ std::max( (count * p + 99) / 100 - 1, 0 ) ]; };
+    outSummary.min = sorted[ 0 ];
+    outSummary.mean /= count;
+    outSummary.p50 = percentile( 50 );
+    outSummary.p95 = percentile( 95 );
+    outSummary.p99 = percentile( 99 );
+    outSummary.max = sorted[ count - 1 ];
+    return outSummary;
+}
+
+void ae3d::System::Statistics::SetSummaryWindow( int windowFrames )
+{
+    ::Statistics::summaryWindow = std::min( std::max( windowFrames, 1 ), (int)::Statistics::MetricHistory::SampleCount );
+}
+
+void ae3d::System::Statistics::SetHitchBudget( float budgetMS )
+{
+    ::Statistics::hitchBudgetMS = budgetMS;
+}
+
+int ae3d::System::Statistics::GetHitchCount()
+{
+    return ::Statistics::hitchCount;
+}
+
+std::string Statistics::GetFrameTimeSummary()
+{
+    const auto summary = ae3d::System::Statistics::GetMetricSummary( ae3d::System::Statistics::Metric::FrameTime, summaryWindow );
+    return "frame time p50/p95/p99/max: " + std::to_string( summary.p50 ) + " / " + std::to_string( summary.p95 ) + " / " + std::to_string( summary.p99 ) + " / " +
+           std::to_string( summary.max ) + " ms over " + std::to_string( summary.sampleCount ) + " frames, " + std::to_string( hitchCount ) + " hitches\n";
+}
+
+bool ae3d::System::Statistics::WriteStatisticsJSON( const char* path )
 {
-    return lightCullerTimeGpuMS;
+    std::ofstream ofs( path );
+
+    if (!ofs)
+    {
+        return false;
+    }
+
+    const char* metricNames[] = { "frameTime", "presentTime", "fenceWait", "shadowPass", "depthPass" };
+    static_assert( sizeof( metricNames ) / sizeof( metricNames[ 0 ] ) == (int)Metric::Count, "metric names don't match Metric" );
+
+    ofs << "{\n  \"frame\": " << ::Statistics::frameNumber << ",\n  \"window\": " << ::Statistics::summaryWindow << ",\n  \"metrics\": {\n";
+
+    for (int m = 0; m < (int)Metric::Count; ++m)
+    {
+        const MetricSummary summary = GetMetricSummary( (Metric)m, ::Statistics::summaryWindow );
+        ofs << "    \"" << metricNames[ m ] << "\": { \"samples\": " << summary.sampleCount << ", \"min\": " << summary.min << ", \"mean\": " << summary.mean
+            << ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " }"
+            << (m + 1 < (int)Metric::Count ? ",\n" : "\n");
+    }
+
+    ofs << "  },\n  \"counters\": { \"drawCalls\": " << ::Statistics::drawCalls << ", \"triangles\": " << ::Statistics::triangleCount << ", \"barrierCalls\": " << ::Statistics::barrierCalls
+        << ", \"fenceCalls\": " << ::Statistics::fenceCalls << ", \"queueSubmitCalls\": " << ::Statistics::queueSubmitCalls << ", \"shaderBinds\": " << ::Statistics::shaderBinds
+        << ", \"renderTargetBinds\": " << ::Statistics::renderTargetBinds << ", \"psoBinds\": " << ::Statistics::psoBindCount << ", \"allocCalls\": " << ::Statistics::allocCalls
+        << ", \"uniformUploadBytes\": " << ::Statistics::uniformUploadBytes << " },\n";
+
+    ofs << "  \"memory\": {";
+
+    for (int t = 0; t < (int)MemoryTag::Count; ++t)
+    {
+        const MemoryUsage usage = GetMemoryUsage( (MemoryTag)t );
+        ofs << (t > 0 ? ", " : " ") << "\"" << ::Statistics::memoryTagNames[ t ] << "\": { \"live\": " << usage.liveBytes << ", \"peak\": " << usage.peakBytes
+            << ", \"allocs\": " << usage.allocCount << ", \"frees\": " << usage.freeCount << " }";
+    }
+
+    ofs << " },\n  \"frameAllocations\": " << ::Statistics::frameAllocCount << ",\n";
+
+    ofs << "  \"hitchBudget\": " << ::Statistics::hitchBudgetMS << ",\n  \"hitchCount\": " << ::Statistics::hitchCount << ",\n  \"hitches\": [";
+    const int firstHitch = std::max( ::Statistics::hitchCount - ::Statistics::HitchLogSize, 0 );
+
+    for (int i = firstHitch; i < ::Statistics::hitchCount; ++i)
+    {
+        const ::Statistics::Hitch& hitch = ::Statistics::hitches[ i % ::Statistics::HitchLogSize ];
+        ofs << (i > firstHitch ? ", " : " ") << "{ \"frame\": " << hitch.frame << ", \"frameTime\": " << hitch.frameTimeMS << ", \"drawCalls\": " << hitch.drawCalls << " }";
+    }
+
+    ofs << " ],\n  \"gpuScopes\": [";
+
+    for (std::size_t i = 0; i < ::Statistics::gpuScopes.size(); ++i)
+    {
+        const ::Statistics::GpuScopeHistory& history = ::Statistics::gpuScopes[ i ];
+        ofs << (i > 0 ? ", " : " ") << "{ \"name\": \"" << history.name << "\", \"depth\": " << history.depth << ", \"last\": " << history.lastTimeMS << " }";
+    }
+
+    ofs << " ]\n}\n";
+    return static_cast< bool >( ofs );
 }
 
 float Statistics::GetSceneAABBTimeMS()
@@ -1,9 +1,56 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "System.hpp"
+
+#ifndef AE3D_CPU_TRACE
+#define AE3D_CPU_TRACE 1
+#endif
+
+#ifndef AE3D_TRACK_GLOBAL_NEW
+#define AE3D_TRACK_GLOBAL_NEW 0
+#endif
+
+#define AE3D_CONCAT_INNER( a, b ) a##b
+#define AE3D_CONCAT( a, b ) AE3D_CONCAT_INNER( a, b )
+
+#if AE3D_CPU_TRACE
+/// Records the enclosing scope into the CPU trace while a capture is running. name must outlive the capture, e.g. a string literal.
+#define AE3D_ZONE( name ) ::Statistics::TraceZone AE3D_CONCAT( traceZone, __LINE__ )( name, __FILE__, __LINE__ )
+#else
+#define AE3D_ZONE( name )
+#endif
+
 namespace Statistics
 {
-    void BeginLightCullerProfiling();
-    void EndLightCullerProfiling();
+    /// Zone of the CPU trace. Use through AE3D_ZONE.
+    class TraceZone
+    {
+    public:
+        TraceZone( const char* name, const char* file, int line );
+        ~TraceZone();
+        TraceZone( const TraceZone& ) = delete;
+        TraceZone& operator=( const TraceZone& ) = delete;
+
+    private:
+        const char* name;
+        const char* file;
+        int line;
+        bool isRecording;
+        std::uint64_t beginNs = 0;
+    };
+
+    /// Ends a frame of the CPU trace capture. Writes the trace when the requested number of frames has been captured.
+    void NextTraceFrame();
+
+    /// Records an allocation of a subsystem. Thread-safe.
+    void TrackAlloc( ae3d::System::Statistics::MemoryTag tag, std::size_t bytes );
+    /// Records a release of memory that was recorded with TrackAlloc(). Thread-safe.
+    void TrackFree( ae3d::System::Statistics::MemoryTag tag, std::size_t bytes );
+    /// Records a container that changed its capacity from oldBytes to newBytes. Does nothing if they are equal.
+    void TrackResize( ae3d::System::Statistics::MemoryTag tag, std::size_t oldBytes, std::size_t newBytes );
 
     void BeginShadowMapProfiling();
     void EndShadowMapProfiling();
@@ -13,11 +60,8 @@ namespace Statistics
 
     float GetFrameTimeMS();
     float GetShadowMapTimeMS();
-    float GetShadowMapTimeGpuMS();
     float GetDepthNormalsTimeMS();
-    float GetDepthNormalsTimeGpuMS();
     float GetSceneAABBTimeMS();
-    float GetLightCullerTimeGpuMS();
 
     void BeginFrameTimeProfiling();
     void EndFrameTimeProfiling();
@@ -28,6 +72,11 @@ namespace Statistics
     void BeginPresentTimeProfiling();
     void EndPresentTimeProfiling();
     float GetPresentTimeMS();
+
+    /// Measures how long the CPU waited for the GPU to finish an earlier frame before recording into its resources.
+    void BeginFenceWaitProfiling();
+    void EndFenceWaitProfiling();
+    float GetFenceWaitTimeMS();
     
     void IncTriangleCount( int triangles );
     int GetTriangleCount();
@@ -52,7 +101,36 @@ namespace Statistics
     int GetPSOBindCalls();
     void IncQueueSubmitCalls();
     int GetQueueSubmitCalls();
-    void SetDepthNormalsGpuTime( float timeMS );
-    void SetShadowMapGpuTime( float timeMS );
-    void SetLightCullerTimeGpuMS( float timeMS );
+    void IncUniformUploadBytes( int bytes );
+    int GetUniformUploadBytes();
+    void IncDescriptorSetCacheHits();
+    int GetDescriptorSetCacheHits();
+    void IncDescriptorSetUpdates();
+    int GetDescriptorSetUpdates();
+    void IncPSOCacheHits();
+    int GetPSOCacheHits();
+    void IncPSOCacheMisses();
+    int GetPSOCacheMisses();
+    void IncUniformRingBytes( int bytes );
+    /// \return Bytes sub-allocated from the uniform ring this frame, including alignment.
+    int GetUniformRingBytes();
+    void IncUniformRingStalls();
+    /// \return Number of times recording waited for the uniform ring to grow this frame.
+    int GetUniformRingStalls();
+    /// \return Time of the first rendered frame in milliseconds, includes pipeline creation that was not prewarmed.
+    float GetFirstFrameTimeMS();
+
+    /// Group marker name of the shadow map pass, GetStatistics() reports its GPU time.
+    constexpr const char* ShadowMapsScopeName = "Shadow maps";
+    /// Group marker name of the depth and normals pass, GetStatistics() reports its GPU time.
+    constexpr const char* DepthNormalsScopeName = "DepthNormal";
+    /// Adds GPU time of a group marker scope to the frame whose timestamps are being read back. Scopes with the same name are summed.
+    /// \param depth Nesting depth, 0 for outermost scopes.
+    void AddGpuScopeTime( const char* name, int depth, float timeMS );
+    /// Appends times added since the previous call into the per-scope history.
+    void EndGpuScopeFrame();
+    /// \return GPU time of a scope in the newest read back frame, 0 if it did not run.
+    float GetGpuScopeTimeMS( const char* name );
+    /// \return Frame time percentiles and hitch count over the summary window, for GetStatistics().
+    std::string GetFrameTimeSummary();
 }
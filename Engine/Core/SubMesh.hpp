@@ -15,6 +15,17 @@ namespace ae3d
         char name[ 128 ];
     };
 
+    /// Cluster of consecutive faces that is culled as a whole. See MeshFormat::MeshletEntry.
+    struct Meshlet
+    {
+        Vec3 aabbMin;
+        Vec3 aabbMax;
+        Vec3 coneAxis;
+        float coneCutoff = 1;
+        int firstFace = 0;
+        int faceCount = 0;
+    };
+
     struct SubMesh
     {
         Vec3 aabbMin;
@@ -24,7 +35,13 @@ namespace ae3d
         std::vector< VertexBuffer::VertexPTNTC > verticesPTNTC;
         std::vector< VertexBuffer::VertexPTNTC_Skinned > verticesPTNTC_Skinned;
         std::vector< VertexBuffer::VertexPTN > verticesPTN;
+        /// Positions are normalized to the AABB.
+        std::vector< VertexBuffer::VertexPTNTC_Quantized > verticesPTNTC_Quantized;
         std::vector< VertexBuffer::Face > indices;
+        /// Used instead of indices if the submesh has more vertices than 16-bit indices can address.
+        std::vector< VertexBuffer::Face32 > indices32;
         std::vector< Joint > joints;
+        /// Empty if the mesh file doesn't have meshlets.
+        std::vector< Meshlet > meshlets;
     };
 }
@@ -25,7 +25,7 @@ extern ae3d::FileWatcher fileWatcher;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 void PlatformInitGamePad();
@@ -100,7 +100,7 @@ void ae3d::System::DrawUI( int scX, int scY, int scWidth, int scHeight, int elem
     renderer.builtinShaders.uiShader.Use();
     renderer.builtinShaders.uiShader.SetTexture( texture, 0 );
     GfxDeviceGlobal::perObjectUboStruct.localToClip.InitFrom( &ortho[ 0 ][ 0 ] );
-    GfxDeviceGlobal::perObjectUboStruct.lightColor = Vec4( 1, 1, 1, 1 );
+    GfxDevice::EditPassUniforms().lightColor = Vec4( 1, 1, 1, 1 );
 
     int viewport[ 4 ];
     viewport[ 0 ] = 0;
@@ -210,7 +210,7 @@ void ae3d::System::Draw( TextureBase* texture, int x, int y, int xSize, int ySiz
     }
     
     GfxDeviceGlobal::perObjectUboStruct.localToClip = mvp;
-    GfxDeviceGlobal::perObjectUboStruct.lightColor = tintColor;
+    GfxDevice::EditPassUniforms().lightColor = tintColor;
     
     int viewport[ 4 ];
     viewport[ 0 ] = 0;
@@ -250,7 +250,7 @@ void ae3d::System::DrawLines( int handle, const Matrix44& view, const Matrix44&
     Matrix44::Multiply( view, projection, viewProjection );
     renderer.builtinShaders.spriteRendererShader.Use();
     renderer.builtinShaders.spriteRendererShader.SetTexture( Texture2D::GetDefaultTexture(), 0 );
-    GfxDeviceGlobal::perObjectUboStruct.lightColor = Vec4( 1, 1, 1, 1 );
+    GfxDevice::EditPassUniforms().lightColor = Vec4( 1, 1, 1, 1 );
     GfxDeviceGlobal::perObjectUboStruct.localToClip = viewProjection;
 
     int viewport[ 4 ];
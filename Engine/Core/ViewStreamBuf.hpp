@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <ios>
+#include <streambuf>
+
+namespace ae3d
+{
+    namespace FileSystem
+    {
+        /// Stream buffer over bytes owned elsewhere, usually a FileView. Lets std::istream parse file contents in place instead of copying them into a std::stringstream.
+        class ViewStreamBuf : public std::streambuf
+        {
+          public:
+            /// \param data First byte. Must stay valid while the stream buffer is used.
+            /// \param size Size in bytes.
+            ViewStreamBuf( const unsigned char* data, std::size_t size )
+            {
+                // The get area is only read from, std::streambuf just doesn't have a const version of it.
+                char* begin = const_cast< char* >( reinterpret_cast< const char* >( data ) );
+                setg( begin, begin, begin + size );
+            }
+
+          protected:
+            pos_type seekoff( off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode which ) override
+            {
+                if (!(which & std::ios_base::in))
+                {
+                    return pos_type( off_type( -1 ) );
+                }
+
+                const off_type size = egptr() - eback();
+                const off_type base = direction == std::ios_base::beg ? 0 : (direction == std::ios_base::cur ? gptr() - eback() : size);
+                const off_type position = base + offset;
+
+                if (position < 0 || position > size)
+                {
+                    return pos_type( off_type( -1 ) );
+                }
+
+                setg( eback(), eback() + position, egptr() );
+                return pos_type( position );
+            }
+
+            pos_type seekpos( pos_type position, std::ios_base::openmode which ) override
+            {
+                return seekoff( off_type( position ), std::ios_base::beg, which );
+            }
+        };
+    }
+}
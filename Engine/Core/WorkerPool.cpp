@@ -0,0 +1,143 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include "WorkerPool.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Statistics.hpp"
+
+namespace
+{
+    /// More workers than this don't help with the per-frame work that is split between them.
+    constexpr unsigned MaxWorkerCount = 15;
+
+    /// Jobs of one Run() call.
+    struct Batch
+    {
+        ae3d::WorkerPool::Job job;
+        void* userData;
+        /// Jobs that have not finished yet. Guarded by the pool's mutex.
+        int pendingCount;
+    };
+
+    struct Task
+    {
+        Batch* batch;
+        int jobIndex;
+    };
+
+    struct Pool
+    {
+        ~Pool()
+        {
+            {
+                std::lock_guard< std::mutex > lock( mutex );
+                isStopping = true;
+            }
+
+            wakeCondition.notify_all();
+
+            for (auto& thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable wakeCondition;
+        std::condition_variable doneCondition;
+        std::deque< Task > tasks;
+        std::vector< std::thread > threads;
+        bool isStopping = false;
+    };
+
+    Pool pool;
+
+    void RunWorker()
+    {
+        for (;;)
+        {
+            Task task;
+            {
+                std::unique_lock< std::mutex > lock( pool.mutex );
+                pool.wakeCondition.wait( lock, []() { return pool.isStopping || !pool.tasks.empty(); } );
+
+                if (pool.isStopping)
+                {
+                    return;
+                }
+
+                task = pool.tasks.front();
+                pool.tasks.pop_front();
+            }
+
+            {
+                AE3D_ZONE( "WorkerPool job" );
+                task.batch->job( task.jobIndex, task.batch->userData );
+            }
+
+            std::lock_guard< std::mutex > lock( pool.mutex );
+
+            if (--task.batch->pendingCount == 0)
+            {
+                pool.doneCondition.notify_all();
+            }
+        }
+    }
+
+    /// Starts the workers if they are not running. pool.mutex must be locked.
+    void StartWorkers()
+    {
+        if (!pool.threads.empty())
+        {
+            return;
+        }
+
+        const unsigned hardwareThreads = std::max( 1u, std::thread::hardware_concurrency() );
+        const unsigned workerCount = std::max( 1u, std::min( MaxWorkerCount, hardwareThreads - 1 ) );
+
+        for (unsigned i = 0; i < workerCount; ++i)
+        {
+            pool.threads.emplace_back( RunWorker );
+        }
+    }
+}
+
+int ae3d::WorkerPool::GetThreadCount()
+{
+    const unsigned hardwareThreads = std::max( 1u, std::thread::hardware_concurrency() );
+    return (int)std::min( MaxWorkerCount + 1, hardwareThreads );
+}
+
+void ae3d::WorkerPool::Run( int jobCount, Job job, void* userData )
+{
+    if (jobCount <= 0)
+    {
+        return;
+    }
+
+    Batch batch = { job, userData, jobCount - 1 };
+
+    if (jobCount > 1)
+    {
+        {
+            std::lock_guard< std::mutex > lock( pool.mutex );
+            StartWorkers();
+
+            for (int i = 1; i < jobCount; ++i)
+            {
+                pool.tasks.push_back( { &batch, i } );
+            }
+        }
+
+        pool.wakeCondition.notify_all();
+    }
+
+    job( 0, userData );
+
+    std::unique_lock< std::mutex > lock( pool.mutex );
+    pool.doneCondition.wait( lock, [&batch]() { return batch.pendingCount == 0; } );
+}
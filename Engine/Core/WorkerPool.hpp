@@ -0,0 +1,26 @@
+#pragma once
+
+namespace ae3d
+{
+    /** Long-lived worker threads for work that is split every frame, so callers don't create and join threads each time.
+        Workers are started on first use and stopped at exit. */
+    namespace WorkerPool
+    {
+        /// Job of Run(). jobIndex is in 0..jobCount-1.
+        typedef void(*Job)( int jobIndex, void* userData );
+
+        /// \return Number of jobs that can run at the same time, including the calling thread.
+        int GetThreadCount();
+
+        /**
+         Runs job for each index in 0..jobCount-1 and returns when all of them have finished. Job 0 runs on the calling thread,
+         the others on workers, so job 0 can use the caller's thread-local state. Can be called from several threads at the same time,
+         but not from inside a job.
+
+         \param jobCount Number of jobs.
+         \param job Job.
+         \param userData Passed to job.
+         */
+        void Run( int jobCount, Job job, void* userData );
+    }
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -23,6 +27,45 @@ namespace ae3d
             bool isLoaded = false;
         };
 
+        /// Read-only view of file contents that are owned elsewhere.
+        struct FileView
+        {
+            /// First byte, null if the file was not found.
+            const unsigned char* data = nullptr;
+            /// Size in bytes.
+            std::size_t size = 0;
+        };
+
+        /// File contents mapped into memory. Loose files and uncompressed .pak entries are not copied, compressed .pak entries are decompressed into memory owned by this object.
+        class MappedFile
+        {
+          public:
+            /// \param path Path. Searched first in loaded .pak files like in FileContents().
+            explicit MappedFile( const char* path );
+
+            MappedFile( const MappedFile& ) = delete;
+            MappedFile& operator=( const MappedFile& ) = delete;
+
+            /// \return Contents. Valid until this object is destroyed, even if the .pak file containing them is unloaded.
+            const FileView& GetView() const { return view; }
+
+            /// \return Path.
+            const std::string& GetPath() const { return path; }
+
+            /// \return True if the file was found.
+            bool IsLoaded() const { return isLoaded; }
+
+          private:
+            FileView view;
+            std::string path;
+            /// Mapping or buffer that owns view's bytes.
+            std::shared_ptr< const void > owner;
+            bool isLoaded = false;
+        };
+
+        /// Order of asynchronous reads. Queued reads of higher priority are started first.
+        enum class ReadPriority { Low, Normal, High };
+
         /**
         Reads file contents.
 
@@ -30,8 +73,50 @@ namespace ae3d
         */
         FileContentsData FileContents( const char* path );
 
+        /**
+        Reads file contents on an I/O thread.
+
+        \param path Path.
+        \param priority Priority.
+        \param callback Called on an I/O thread when the file has been read, or from CancelFileContentsAsync() with isLoaded false.
+        \return Request id for CancelFileContentsAsync().
+        */
+        unsigned FileContentsAsync( const char* path, ReadPriority priority, const std::function< void( FileContentsData& ) >& callback );
+
+        /**
+        Reads file contents on an I/O thread.
+
+        \param path Path.
+        \param priority Priority.
+        \return Contents, isLoaded is false if the file could not be read.
+        */
+        std::future< FileContentsData > FileContentsAsync( const char* path, ReadPriority priority = ReadPriority::Normal );
+
+        /// Cancels a FileContentsAsync() request that has not been started yet.
+        /// \param requestId Id returned by FileContentsAsync().
+        /// \return True if the request was cancelled.
+        bool CancelFileContentsAsync( unsigned requestId );
+
+        /// Blocks until all FileContentsAsync() requests have completed. Must not be called from a FileContentsAsync() callback.
+        void WaitForFileContentsAsync();
+
+        /// \param path Path of a file inside a loaded .pak file.
+        /// \return View into the memory-mapped .pak file. Valid until the .pak file is unloaded. data is null if no loaded .pak file contains path.
+        ///         If the file is compressed in the .pak file, data is null and size is its uncompressed size, use ReadPakFileRange() to read it.
+        FileView PakFileView( const char* path );
+
+        /// Reads a part of a file inside a loaded .pak file. Only the compressed blocks that overlap the range are decompressed, straight into outData.
+        /// \param path Path of a file inside a loaded .pak file.
+        /// \param offset Offset of the first byte to read.
+        /// \param size Number of bytes to read.
+        /// \param outData Receives size bytes.
+        /// \return True if the file was found and the range is inside it.
+        bool ReadPakFileRange( const char* path, std::size_t offset, std::size_t size, unsigned char* outData );
+
         /// \param path .pak file path. After this call FileContents() searches first in all loaded .pak files and if the file is not found, it's loaded without .pak file.
-        void LoadPakFile( const char* path );
+        /// \param verifyChecksums If true, checksums of all files are verified and a corrupted .pak file is not loaded. This reads the whole .pak file,
+        ///        so by default files are read only when they are accessed and their checksums are not verified.
+        void LoadPakFile( const char* path, bool verifyChecksums = false );
 
         /// \param path .pak file. If it was loaded, it's unloaded and FileContents() does not search files inside it.
         void UnloadPakFile( const char* path );
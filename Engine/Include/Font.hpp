@@ -1,10 +1,14 @@
 #pragma once
 
+#include <string>
+
 namespace ae3d
 {
     namespace FileSystem
     {
         struct FileContentsData;
+        struct FileView;
+        class MappedFile;
     }
     
     /// Contains glyphs loaded from AngelCode BMFont files. For Mac there is a compatible program called BMGlyph.
@@ -19,6 +23,12 @@ namespace ae3d
           \param metaData BMFont metadata. Must be text or binary.
          */
         void LoadBMFont( class Texture2D* fontTex, const FileSystem::FileContentsData& metaData );
+
+        /**
+          \param fontTex Font texture. No outline support.
+          \param metaData BMFont metadata file. Must be text or binary. Parsed without copying.
+         */
+        void LoadBMFont( class Texture2D* fontTex, const FileSystem::MappedFile& metaData );
         
         /** \return Font texture. */
         Texture2D* GetTexture() { return texture; }
@@ -44,11 +54,21 @@ namespace ae3d
          */
         void CreateVertexBuffer( const char* text, const struct Vec4& color, class VertexBuffer& outVertexBuffer ) const;
 
+        /**
+          \param fontTex Font texture.
+          \param metaData BMFont metadata.
+          \param path Metadata path for error messages.
+         */
+        void LoadBMFont( Texture2D* fontTex, const FileSystem::FileView& metaData, const std::string& path );
+
         /** \param metaData BMFont text metadata. */
-        void LoadBMFontMetaText(const FileSystem::FileContentsData& metaData);
+        void LoadBMFontMetaText( const FileSystem::FileView& metaData );
         
-        /** \param metaData BMFont binary metadata. */
-        void LoadBMFontMetaBinary(const FileSystem::FileContentsData& metaData);
+        /**
+          \param metaData BMFont binary metadata.
+          \param path Metadata path for error messages.
+         */
+        void LoadBMFontMetaBinary( const FileSystem::FileView& metaData, const std::string& path );
         
         /** The spacing for each character (horizontal, vertical). */
         int spacing[ 2 ];
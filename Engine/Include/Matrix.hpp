@@ -164,6 +164,9 @@ namespace ae3d
         
         /* \param v Translation. */
         void Translate( const Vec3& v );
+
+        /// \return True if the axes are scaled by the same amount and stay perpendicular, so angles between directions are kept.
+        bool HasUniformScale() const;
         
         /* Member data, row-major. */
         float m[16];
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <type_traits>
 #include "Array.hpp"
 
@@ -8,12 +9,14 @@ namespace ae3d
     namespace FileSystem
     {
         struct FileContentsData;
+        struct FileView;
+        class MappedFile;
     }
 
     struct SubMesh;
     struct Vec3;
     
-    /// Contains a mesh. Can contain submeshes.
+    /// Contains a mesh. Can contain submeshes. Meshes loaded from the same path share their data, so copying a Mesh is cheap.
     class Mesh
     {
       public:
@@ -38,6 +41,11 @@ namespace ae3d
         /// \param meshData Data from .ae3d mesh file.
         /// \return Load result.
         LoadResult Load( const FileSystem::FileContentsData& meshData );
+
+        /// Loads the mesh from a mapped file without copying the whole file. Version 2 sections are copied as they are, without parsing.
+        /// \param meshFile .ae3d mesh file.
+        /// \return Load result.
+        LoadResult Load( const FileSystem::MappedFile& meshFile );
         
         /// \return Axis-aligned bounding box minimum in local coordinates.
         const Vec3& GetAABBMin() const;
@@ -72,11 +80,17 @@ namespace ae3d
         Impl& m() { return reinterpret_cast<Impl&>(_storage); }
         Impl const& m() const { return reinterpret_cast<Impl const&>(_storage); }
         
-        static const std::size_t StorageSize = 1384;
+        static const std::size_t StorageSize = 16;
         static const std::size_t StorageAlign = 16;
         
         std::aligned_storage<StorageSize, StorageAlign>::type _storage = {};
         
-        SubMesh* GetSubMeshes( int& outCount );
+        const SubMesh* GetSubMeshes( int& outCount ) const;
+
+        /// \return Changes when the submeshes are replaced, e.g. when the file is reloaded.
+        unsigned GetGeneration() const;
+
+        /// Implements both versions of Load().
+        LoadResult LoadView( const FileSystem::FileView& meshData, const std::string& path, bool isLoaded );
     };
 }
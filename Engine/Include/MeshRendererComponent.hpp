@@ -57,6 +57,13 @@ namespace ae3d
         friend class Scene;
         
         enum class RenderType { Opaque, Transparent };
+
+        /// Faces [begin, end) of a submesh that are drawn with one draw call.
+        struct FaceRange
+        {
+            int begin;
+            int end;
+        };
         
         /// \return Component's type code. Must be unique for each component type.
         static int Type() { return 5; }
@@ -67,13 +74,30 @@ namespace ae3d
         /// \return Component at index or null if index is invalid.
         static MeshRendererComponent* Get( unsigned index );
         
-        /// Applies skin
+        /// Evaluates bone palettes of all enabled skinned meshes. Called once per frame before rendering.
+        static void UpdateSkinPalettes();
+
+        /// Points the per-object uniforms to the submesh's bone palette evaluated in UpdateSkinPalettes().
         /// \param subMeshIndex Submesh index
-        void ApplySkin( unsigned subMeshIndex );
+        /// \return False if the submesh is skinned but has no palette this frame, e.g. because it was enabled after UpdateSkinPalettes(). It's not drawn then.
+        bool ApplySkin( unsigned subMeshIndex );
         
+        /// Sizes the per-submesh arrays again if the mesh's submeshes have been replaced since they were sized, e.g. by a reload.
+        void UpdateSubMeshArrays();
+
+        /// Sizes the per-submesh arrays for the mesh's submeshes.
+        void AllocateSubMeshArrays();
+
         /// \param cameraFrustum cameraFrustum
         /// \param localToWorld Local-to-World matrix
         void Cull( const class Frustum& cameraFrustum, const struct Matrix44& localToWorld );
+
+        /// Culls a submesh's meshlets and stores the face ranges of the visible ones starting at faceRanges[ subMeshFirstFaceRange[ subMeshIndex ] ].
+        /// \param subMesh Submesh that has meshlets.
+        /// \param subMeshIndex Submesh index.
+        /// \param localFrustum Camera frustum in the mesh's local space.
+        /// \param cullBackFaces True, if meshlets whose faces all face away from the camera can be culled.
+        void CullMeshlets( const struct SubMesh& subMesh, unsigned subMeshIndex, const Frustum& localFrustum, bool cullBackFaces );
         
         /// \param localToView Model-view matrix.
         /// \param localToClip Model-view-projection matrix.
@@ -90,6 +114,14 @@ namespace ae3d
         Mesh* mesh = nullptr;
         Array< Material* > materials;
         Array< bool > isSubMeshCulled;
+        Array< FaceRange > faceRanges;
+        /// Index of each submesh's first range in faceRanges.
+        Array< unsigned > subMeshFirstFaceRange;
+        /// 0 if the submesh is drawn whole.
+        Array< unsigned > subMeshFaceRangeCount;
+        Array< int > subMeshPaletteOffsets;
+        /// Mesh::GetGeneration() of the submeshes that the arrays are sized for.
+        unsigned meshGeneration = 0;
         GameObject* gameObject = nullptr;
         int animFrame = 0;
         bool isCulled = false;
@@ -54,6 +54,12 @@ namespace ae3d
         /// \return Color image.
         VkImage GetColorImage() { return color.image; }
 
+        /// \return Color format.
+        VkFormat GetColorFormat() const { return colorFormat; }
+
+        /// \return Sample count.
+        int GetSampleCount() const { return sampleCount; }
+
         /// \return Color image layout.
         VkImageLayout GetColorImageLayout() const { return layout; }
 
@@ -71,7 +77,7 @@ namespace ae3d
         struct FrameBufferAttachment
         {
             VkImage image;
-            VkDeviceMemory mem;
+            VulkanAllocation* mem;
             VkImageView view;
         };
 
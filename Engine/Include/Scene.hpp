@@ -11,6 +11,8 @@ namespace ae3d
     namespace FileSystem
     {
         struct FileContentsData;
+        struct FileView;
+        class MappedFile;
     }
     
     /// Contains game objects in a transform hierarchy.
@@ -52,8 +54,24 @@ namespace ae3d
                                        std::map< std::string, class Texture2D* >& outTexture2Ds,
                                        std::map< std::string, class Material* >& outMaterials,
                                        Array< class Mesh* >& outMeshes ) const;
+
+        /// Deserializes a scene additively from a mapped file without copying its contents. Must be called after renderer is initialized.
+        /// \param serialized Serialized scene file.
+        /// \param outGameObjects Returns game objects that were created from serialized scene contents.
+        /// \param outTexture2Ds Returns texture 2Ds that were created from serialized scene contents. Caller is responsible for freeing the memory.
+        /// \param outMaterials Returns materials that were created. Caller is responsible for freeing the memory.
+        /// \param outMeshes Returns meshes that were created. Caller is responsible for freeing the memory.
+        /// \return Result. Parsing stops on first error and successfully loaded game objects are returned.
+        DeserializeResult Deserialize( const FileSystem::MappedFile& serialized, std::vector< GameObject >& outGameObjects,
+                                       std::map< std::string, class Texture2D* >& outTexture2Ds,
+                                       std::map< std::string, class Material* >& outMaterials,
+                                       Array< class Mesh* >& outMeshes ) const;
         
     private:
+        DeserializeResult DeserializeView( const FileSystem::FileView& serialized, const std::string& serializedPath, std::vector< GameObject >& outGameObjects,
+                                           std::map< std::string, class Texture2D* >& outTexture2Ds,
+                                           std::map< std::string, class Material* >& outMaterials,
+                                           Array< class Mesh* >& outMeshes ) const;
         void RenderWithCamera( GameObject* cameraGo, int cubeMapFace, const char* debugGroupName );
         void RenderShadowsWithCamera( GameObject* cameraGo, int cubeMapFace );
         void RenderShadowMaps( std::vector< GameObject* >& cameras );
@@ -63,6 +81,12 @@ namespace ae3d
                                     int cubeMapFace, const class Frustum& frustum );
         void GenerateAABB();
 
+        /// Meshes of a camera pass that are recorded in ranges by RenderMeshRange().
+        struct MeshRenderList;
+        /// Records meshes [begin, end) of a MeshRenderList. Called on several threads by the Vulkan renderer.
+        static void RenderMeshRange( int begin, int end, void* userData );
+        static void RenderMeshes( MeshRenderList& list, int meshCount );
+
         std::vector< GameObject* > gameObjects;
         unsigned nextFreeGameObject = 0;
         TextureCube* skybox = nullptr;
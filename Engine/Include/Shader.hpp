@@ -70,12 +70,19 @@ namespace ae3d
         /// \return Vertex shader path.
         const std::string& GetVertexShaderPath() const { return vertexPath; }
 
+        /// \return Fragment shader path.
+        const std::string& GetFragmentShaderPath() const { return fragmentPath; }
+
 #if RENDERER_D3D12
         bool IsValid() const { return blobShaderVertex != nullptr; }
         ID3DBlob* blobShaderVertex = nullptr;
         ID3DBlob* blobShaderPixel = nullptr;
 #endif
 
+#if RENDERER_NULL
+        bool IsValid() const { return true; }
+#endif
+
 #if RENDERER_METAL
         void LoadFromLibrary( const char* vertexShaderName, const char* fragmentShaderName );
         bool IsValid() const { return vertexProgram != nullptr; }
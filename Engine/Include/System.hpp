@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 #if RENDERER_METAL
 #import <MetalKit/MetalKit.h>
 #endif
@@ -78,6 +80,8 @@
    Aether3D internals almost never read raw files, all file access is abstracted by FileSystem to allow file contents to come from various sources.
    CombineFiles creates .pak files that contain contents of multiple files. You run it with command <code>CombineFiles inputFile outputFile</code> where
    inputFile is just a text file containing a list of file paths, each on their own line.
+   FileSystem::LoadPakFile() memory-maps the .pak file, so its contents are read from disk only when they are accessed.
+   Files are compressed in blocks by default, <code>CombineFiles -l level</code> sets the compression level from 0 (store) to 9.
 
    \subsection SDF_Generator
 
@@ -190,7 +194,7 @@ namespace ae3d
         */
         void Print( const char* format, ... );
 
-        /// Reloads assets that have been changed on disk. Relatively slow operation, so avoid calling too often.
+        /// Reloads assets that have been changed on disk. Cheap when nothing has changed, so it can be called every frame.
         void ReloadChangedAssets();
 
         /// Tests internal functionality.
@@ -198,13 +202,116 @@ namespace ae3d
 
         namespace Statistics
         {
-			/// \param outStr Caller must allocate at least X bytes for the output.
-            void GetStatistics( char* outStr );
+            /// Writes a summary of the frame's statistics. Truncates the summary if it does not fit into outStr.
+            /// \param outStr Receives the null-terminated summary.
+            /// \param outStrSize Capacity of outStr in bytes, including the terminator.
+            void GetStatistics( char* outStr, std::size_t outStrSize );
             int GetDrawCallCount();
             int GetShaderBindCount();
             int GetRenderTargetBindCount();
             int GetBarrierCallCount();
             int GetFenceCallCount();
+
+            /// GPU time of a GfxDevice::PushGroupMarker()/PopGroupMarker() scope.
+            struct GpuScopeTime
+            {
+                const char* name; ///< Valid until the next Present().
+                int depth;        ///< Nesting depth, 0 for outermost scopes.
+                float lastMS;     ///< Time in the newest frame whose results have been read back, 0 if the scope did not run.
+                float averageMS;  ///< Average over the last 64 frames in which the scope ran.
+                float maxMS;      ///< Maximum over the last 64 frames in which the scope ran.
+            };
+
+            /// Gets GPU times of group marker scopes in the order they were first seen. Scopes with the same name are summed.
+            /// Timestamps are read back when the frame's fence has signaled, so results are a few frames old. Implemented on Vulkan and D3D12.
+            /// \param outScopes Receives the scopes.
+            /// \param maxScopes Capacity of outScopes.
+            /// \return Number of written scopes.
+            int GetGpuScopeTimes( GpuScopeTime* outScopes, int maxScopes );
+
+            /// Timing that is recorded once per frame into a history of the last 1024 samples.
+            enum class Metric
+            {
+                FrameTime,
+                PresentTime,
+                FenceWait,
+                ShadowPass,
+                DepthPass,
+                Count
+            };
+
+            /// Distribution of a metric's samples, in milliseconds.
+            struct MetricSummary
+            {
+                float min = 0;
+                float mean = 0;
+                float p50 = 0;
+                float p95 = 0;
+                float p99 = 0;
+                float max = 0;
+                int sampleCount = 0;
+            };
+
+            /// \param metric Metric.
+            /// \param windowFrames Number of newest samples to summarize, clamped to the history size.
+            /// \return Summary of the metric's newest samples.
+            MetricSummary GetMetricSummary( Metric metric, int windowFrames );
+
+            /// Sets the window that GetStatistics() and WriteStatisticsJSON() summarize. Defaults to 120 frames.
+            void SetSummaryWindow( int windowFrames );
+
+            /// Frames that take longer than the budget are logged with System::Print() and kept in a hitch log.
+            /// \param budgetMS Frame time budget in milliseconds, 0 disables hitch detection. Defaults to 0.
+            void SetHitchBudget( float budgetMS );
+
+            /// \return Number of frames that have exceeded the hitch budget.
+            int GetHitchCount();
+
+            /// Writes metric summaries, the newest hitches, this frame's counters and GPU scope times into a JSON file.
+            /// \param path File path.
+            /// \return False if the file could not be written.
+            bool WriteStatisticsJSON( const char* path );
+
+            /// Captures CPU zones of all threads for frameCount frames and writes them into a Chrome trace JSON file that can be
+            /// opened in chrome://tracing or Perfetto. Zones are placed with AE3D_ZONE in engine code. Call from the thread that renders.
+            /// \param path Trace file path.
+            /// \param frameCount Number of frames to capture.
+            void CaptureCpuTrace( const char* path, int frameCount );
+
+            /// Subsystem that owns CPU memory.
+            enum class MemoryTag
+            {
+                MeshVertices, ///< CPU-side vertex, index and joint arrays of loaded meshes.
+                PakFiles,     ///< Contents of loaded .pak files.
+                Audio,        ///< Decoded audio before it is handed to the audio API.
+                Font,         ///< Text vertices generated by Font.
+                Components,   ///< Component pools that grow on demand.
+                Heap,         ///< All operator new allocations, including tagged ones. Only tracked when built with AE3D_TRACK_GLOBAL_NEW=1.
+                Count
+            };
+
+            /// CPU memory of a subsystem.
+            struct MemoryUsage
+            {
+                unsigned long long liveBytes = 0;
+                unsigned long long peakBytes = 0; ///< High-water mark of liveBytes.
+                int allocCount = 0;
+                int freeCount = 0;
+            };
+
+            /// \param tag Subsystem.
+            /// \return Memory usage of the subsystem.
+            MemoryUsage GetMemoryUsage( MemoryTag tag );
+
+            /// Prints live and peak bytes and allocation counts of every subsystem using System::Print().
+            void PrintMemoryReport();
+
+            /// \return Number of tracked allocations since the previous Scene::Render(). With AE3D_TRACK_GLOBAL_NEW=1 counts every operator new.
+            int GetFrameAllocationCount();
+
+            /// Asserts at the start of Scene::Render() if the previous frame allocated. Enable once the scene has reached steady state.
+            /// \param enable True to assert on allocating frames. Defaults to false.
+            void SetAssertZeroAllocationFrames( bool enable );
             void GetGpuMemoryUsage( unsigned& outUsedMBytes, unsigned& outBudgetMBytes );
         }
     }
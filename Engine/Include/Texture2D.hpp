@@ -12,6 +12,8 @@ namespace ae3d
     namespace FileSystem
     {
         struct FileContentsData;
+        struct FileView;
+        class MappedFile;
     }
 
     enum class TextureLayout
@@ -53,9 +55,19 @@ namespace ae3d
         /// \param colorSpace Color space.
         /// \param anisotropy Anisotropy. Value range is 1-16 depending on support. On Metal the value is bucketed into 1, 2, 4, 8 and 16.
         void LoadFromAtlas( const FileSystem::FileContentsData& atlasTextureData, const FileSystem::FileContentsData& atlasMetaData, const char* textureName, TextureWrap wrap, TextureFilter filter, ColorSpace colorSpace, Anisotropy anisotropy );
+
+        /// \param atlasTextureData Atlas texture image data. File format must be dds, png, tga, jpg, bmp or bmp.
+        /// \param atlasMetaData Atlas metadata file, parsed without copying. Format is Ogre/CEGUI. Example atlas tool: Texture Packer.
+        /// \param textureName Name of the texture in atlas.
+        /// \param wrap Wrap mode.
+        /// \param filter Filter mode.
+        /// \param colorSpace Color space.
+        /// \param anisotropy Anisotropy. Value range is 1-16 depending on support. On Metal the value is bucketed into 1, 2, 4, 8 and 16.
+        void LoadFromAtlas( const FileSystem::FileContentsData& atlasTextureData, const FileSystem::MappedFile& atlasMetaData, const char* textureName, TextureWrap wrap, TextureFilter filter, ColorSpace colorSpace, Anisotropy anisotropy );
         
 #if RENDERER_VULKAN
-        VkImageView& GetView() { return view; }
+        /// \return View of the default texture until the upload has finished, then the texture's own view.
+        VkImageView GetView() const;
         VkImage& GetImage() { return image; }
         void LoadFromData( const void* imageData, int width, int height, int channels, const char* debugName, VkImageUsageFlags usageFlags );
         VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL;
@@ -80,6 +92,15 @@ namespace ae3d
           \param textureData Texture data.
           */
         void LoadSTB( const FileSystem::FileContentsData& textureData );
+
+        /**
+          Reads textureName's scale and offset from atlas metadata.
+
+          \param metaData Atlas metadata.
+          \param metaPath Atlas metadata path.
+          \param textureName Name of the texture in atlas.
+          */
+        void LoadAtlasMetaData( const FileSystem::FileView& metaData, const char* metaPath, const char* textureName );
 #if RENDERER_METAL
         void LoadPVRv2( const char* path );
         void LoadPVRv3( const char* path );
@@ -89,7 +110,9 @@ namespace ae3d
         void CreateVulkanObjects( void* data, int bytesPerPixel, VkFormat format, VkImageUsageFlags usageFlags );
         VkImage image = VK_NULL_HANDLE;
         VkImageView view = VK_NULL_HANDLE;
-        VkDeviceMemory deviceMemory = VK_NULL_HANDLE;
+        VulkanAllocation* deviceMemory = nullptr;
+        /// VulkanUploader batch that uploads the contents.
+        std::uint64_t uploadBatch = 0;
 #endif
     };
 }
@@ -24,6 +24,10 @@ struct GpuResource
 
 namespace ae3d
 {
+#if RENDERER_VULKAN
+    struct VulkanAllocation;
+#endif
+
     /// Texture wrap controls behavior when coordinates are outside range 0-1. Repeat should not be used for atlased textures.
     enum class TextureWrap
     {
@@ -62,7 +62,7 @@ namespace ae3d
 #if RENDERER_VULKAN
         VkImage image = VK_NULL_HANDLE;
         VkImageView view = VK_NULL_HANDLE;
-        VkDeviceMemory deviceMemory = VK_NULL_HANDLE;
+        VulkanAllocation* deviceMemory = nullptr;
 #endif
     };
 }
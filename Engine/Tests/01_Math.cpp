@@ -270,6 +270,26 @@ bool TestMatrixInverse()
     return true;
 }
 
+bool TestMatrixUniformScale()
+{
+    Matrix44 rotated( 30, 45, 60 );
+    Matrix44 uniform = rotated;
+    uniform.Scale( 3, 3, 3 );
+    uniform.Translate( Vec3( 5, -2, 7 ) );
+    Matrix44 nonUniform = rotated;
+    nonUniform.Scale( 3, 1, 3 );
+    Matrix44 sheared;
+    sheared.m[ 4 ] = 0.5f;
+
+    if (!Matrix44::identity.HasUniformScale() || !uniform.HasUniformScale() || nonUniform.HasUniformScale() || sheared.HasUniformScale())
+    {
+        std::cerr << "Matrix uniform scale test failed!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
 static bool TestQuatConstructor()
 {
     const float tx =  1.0f;
@@ -407,6 +427,7 @@ int main()
     result &= TestMatrixTranspose();
     result &= TestMatrixMultiply();
     result &= TestMatrixInverse();
+    result &= TestMatrixUniformScale();
     result &= TestQuaternion();
     result &= TestArray1();
     result &= TestArray2();
@@ -0,0 +1,791 @@
+// CPU benchmark of engine hot paths. Runs on the null renderer, so it needs no window or GPU.
+// Usage: 05_Benchmark [--objects count] [--iterations count] [--out results.json] [--baseline baseline.json] [--threshold percent]
+// With --baseline, exits with 1 if a case's median is more than threshold percent slower than in the baseline.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "Array.hpp"
+#include "CameraComponent.hpp"
+#include "FileSystem.hpp"
+#include "Font.hpp"
+#include "GameObject.hpp"
+#include "GfxDevice.hpp"
+#include "Material.hpp"
+#include "Matrix.hpp"
+#include "Mesh.hpp"
+#include "MeshFormat.hpp"
+#include "MeshRendererComponent.hpp"
+#include "Scene.hpp"
+#include "Shader.hpp"
+#include "SpriteRendererComponent.hpp"
+#include "Statistics.hpp"
+#include "System.hpp"
+#include "TextRendererComponent.hpp"
+#include "Texture2D.hpp"
+#include "TransformComponent.hpp"
+#include "Vec3.hpp"
+#include "VertexBuffer.hpp"
+#include "Window.hpp"
+
+#if !RENDERER_NULL
+#error The benchmark must be built with RENDERER_NULL
+#endif
+
+using namespace ae3d;
+
+namespace
+{
+    const char* MeshPath = "benchmark_mesh.ae3d";
+    const char* FilePath = "benchmark_file.bin";
+    /// Quads per side of the tiles that meshlets are made of. Their 8 * 8 vertices fit in a meshlet.
+    const int MeshletTileSize = 7;
+
+    struct Options
+    {
+        int objectCount = 2000;
+        int iterations = 50;
+        const char* outPath = nullptr;
+        const char* baselinePath = nullptr;
+        double thresholdPercent = 10;
+    };
+
+    struct Result
+    {
+        std::string name;
+        int iterations = 0;
+        double minMS = 0;
+        double medianMS = 0;
+        double meanMS = 0;
+        double maxMS = 0;
+    };
+
+    std::vector< Result > results;
+
+    /// \param timesMS Time of each iteration.
+    void AddResult( const char* name, std::vector< double > timesMS )
+    {
+        std::sort( timesMS.begin(), timesMS.end() );
+
+        Result result;
+        result.name = name;
+        result.iterations = (int)timesMS.size();
+        result.minMS = timesMS.front();
+        result.medianMS = timesMS[ timesMS.size() / 2 ];
+        result.maxMS = timesMS.back();
+
+        for (double timeMS : timesMS)
+        {
+            result.meanMS += timeMS / timesMS.size();
+        }
+
+        results.push_back( result );
+        System::Print( "%-22s median %9.3f ms  min %9.3f ms  max %9.3f ms\n", result.name.c_str(), result.medianMS, result.minMS, result.maxMS );
+    }
+
+    template< typename F > void Run( const char* name, int iterations, F func )
+    {
+        // Warms up caches and first-use allocations.
+        func( 0 );
+
+        std::vector< double > timesMS( iterations );
+
+        for (int i = 0; i < iterations; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            func( i + 1 );
+            timesMS[ i ] = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+        }
+
+        AddResult( name, timesMS );
+    }
+
+    template< typename T > void Write( std::vector< unsigned char >& out, const T& value )
+    {
+        const unsigned char* bytes = reinterpret_cast< const unsigned char* >( &value );
+        out.insert( out.end(), bytes, bytes + sizeof( T ) );
+    }
+
+    template< typename T > void WriteArray( std::vector< unsigned char >& out, const std::vector< T >& values )
+    {
+        const unsigned char* bytes = reinterpret_cast< const unsigned char* >( values.data() );
+        out.insert( out.end(), bytes, bytes + values.size() * sizeof( T ) );
+    }
+
+    /// \return gridSize * gridSize vertices of a grid whose heights alternate, offset by subMesh.
+    std::vector< VertexBuffer::VertexPTN > MakeGridVertices( int subMesh, int gridSize )
+    {
+        std::vector< VertexBuffer::VertexPTN > vertices;
+
+        for (int z = 0; z < gridSize; ++z)
+        {
+            for (int x = 0; x < gridSize; ++x)
+            {
+                VertexBuffer::VertexPTN vertex;
+                vertex.position = Vec3( (float)x, (float)((x + z + subMesh) % 2), (float)z );
+                vertex.u = x / (float)gridSize;
+                vertex.v = z / (float)gridSize;
+                vertex.normal = Vec3( 0, 1, 0 );
+                vertices.push_back( vertex );
+            }
+        }
+
+        return vertices;
+    }
+
+    /// \return Faces of a grid of gridSize * gridSize vertices.
+    std::vector< VertexBuffer::Face > MakeGridFaces( int gridSize )
+    {
+        std::vector< VertexBuffer::Face > faces;
+        const int quadsPerRow = gridSize - 1;
+
+        for (int z = 0; z < quadsPerRow; ++z)
+        {
+            for (int x = 0; x < quadsPerRow; ++x)
+            {
+                const unsigned short i0 = (unsigned short)(z * gridSize + x);
+                const unsigned short i1 = (unsigned short)(i0 + gridSize);
+                faces.push_back( VertexBuffer::Face( i0, i1, (unsigned short)(i0 + 1) ) );
+                faces.push_back( VertexBuffer::Face( (unsigned short)(i0 + 1), i1, (unsigned short)(i1 + 1) ) );
+            }
+        }
+
+        return faces;
+    }
+
+    /// \return Faces of MakeGridFaces() in tiles of MeshletTileSize * MeshletTileSize quads. A meshlet of each tile is added to outMeshlets.
+    std::vector< VertexBuffer::Face > MakeMeshletGridFaces( const std::vector< VertexBuffer::VertexPTN >& vertices, int gridSize,
+                                                            std::vector< MeshFormat::MeshletEntry >& outMeshlets )
+    {
+        std::vector< VertexBuffer::Face > faces;
+        const int quadsPerRow = gridSize - 1;
+
+        for (int tileZ = 0; tileZ < quadsPerRow; tileZ += MeshletTileSize)
+        {
+            for (int tileX = 0; tileX < quadsPerRow; tileX += MeshletTileSize)
+            {
+                const std::size_t firstFace = faces.size();
+                Vec3 aabbMin = vertices[ tileZ * gridSize + tileX ].position;
+                Vec3 aabbMax = aabbMin;
+                std::vector< Vec3 > normals;
+                Vec3 normalSum;
+
+                for (int z = tileZ; z < std::min( tileZ + MeshletTileSize, quadsPerRow ); ++z)
+                {
+                    for (int x = tileX; x < std::min( tileX + MeshletTileSize, quadsPerRow ); ++x)
+                    {
+                        const unsigned short i0 = (unsigned short)(z * gridSize + x);
+                        const unsigned short i1 = (unsigned short)(i0 + gridSize);
+                        const VertexBuffer::Face quad[ 2 ] = { VertexBuffer::Face( i0, i1, (unsigned short)(i0 + 1) ),
+                                                               VertexBuffer::Face( (unsigned short)(i0 + 1), i1, (unsigned short)(i1 + 1) ) };
+
+                        for (const VertexBuffer::Face& face : quad)
+                        {
+                            const Vec3& a = vertices[ face.a ].position;
+                            const Vec3& b = vertices[ face.b ].position;
+                            const Vec3& c = vertices[ face.c ].position;
+                            aabbMin = Vec3::Min2( aabbMin, Vec3::Min2( a, Vec3::Min2( b, c ) ) );
+                            aabbMax = Vec3::Max2( aabbMax, Vec3::Max2( a, Vec3::Max2( b, c ) ) );
+                            normals.push_back( Vec3::Cross( b - a, c - a ).Normalized() );
+                            normalSum += normals.back();
+                            faces.push_back( face );
+                        }
+                    }
+                }
+
+                const Vec3 axis = normalSum.Normalized();
+                float minDot = 1;
+
+                for (const Vec3& normal : normals)
+                {
+                    minDot = std::min( minDot, Vec3::Dot( axis, normal ) );
+                }
+
+                MeshFormat::MeshletEntry meshlet;
+                std::memcpy( meshlet.aabbMin, &aabbMin.x, sizeof( meshlet.aabbMin ) );
+                std::memcpy( meshlet.aabbMax, &aabbMax.x, sizeof( meshlet.aabbMax ) );
+                std::memcpy( meshlet.coneAxis, &axis.x, sizeof( meshlet.coneAxis ) );
+                meshlet.coneCutoff = minDot <= 0.1f ? 1.0f : std::sqrt( 1.0f - minDot * minDot );
+                meshlet.firstFace = (std::uint32_t)firstFace;
+                meshlet.faceCount = (std::uint32_t)(faces.size() - firstFace);
+                outMeshlets.push_back( meshlet );
+            }
+        }
+
+        return faces;
+    }
+
+    /// \return Version 1 .ae3d file of subMeshCount grids of gridSize * gridSize PTN vertices.
+    std::vector< unsigned char > MakeMeshFile( int subMeshCount, int gridSize )
+    {
+        std::vector< unsigned char > out;
+        out.push_back( 'a' );
+        out.push_back( '9' );
+        Write( out, Vec3( 0, 0, 0 ) );
+        Write( out, Vec3( (float)gridSize, 1, (float)gridSize ) );
+        Write( out, (std::uint16_t)subMeshCount );
+
+        for (int s = 0; s < subMeshCount; ++s)
+        {
+            Write( out, Vec3( 0, 0, 0 ) );
+            Write( out, Vec3( (float)gridSize, 1, (float)gridSize ) );
+
+            const std::string name = "grid" + std::to_string( s );
+            Write( out, (std::uint16_t)name.size() );
+            out.insert( out.end(), name.begin(), name.end() );
+
+            const std::vector< VertexBuffer::VertexPTN > vertices = MakeGridVertices( s, gridSize );
+            Write( out, (std::uint16_t)vertices.size() );
+            Write( out, (std::uint8_t)1 ); // PTN
+            WriteArray( out, vertices );
+
+            const std::vector< VertexBuffer::Face > faces = MakeGridFaces( gridSize );
+            Write( out, (std::uint16_t)faces.size() );
+            WriteArray( out, faces );
+        }
+
+        Write( out, (std::uint8_t)100 );
+        return out;
+    }
+
+    /**
+     \return Section-based .ae3d file of the current version with the same contents as MakeMeshFile().
+     \param hasMeshlets If true, the grids are side by side along x instead of on top of each other, and their faces are split into meshlets,
+                        so parts of the mesh can be culled.
+     */
+    std::vector< unsigned char > MakeMeshFileVersion2( int subMeshCount, int gridSize, bool hasMeshlets )
+    {
+        std::vector< unsigned char > out( sizeof( MeshFormat::Header ) + subMeshCount * sizeof( MeshFormat::SubMeshEntry ) );
+        std::vector< MeshFormat::SubMeshEntry > entries( subMeshCount );
+
+        auto appendSection = [&out]( const void* data, std::size_t size ) -> MeshFormat::Section
+        {
+            MeshFormat::Section section;
+            section.offset = MeshFormat::AlignSection( out.size() );
+            section.size = size;
+            out.resize( section.offset + size );
+            std::memcpy( &out[ section.offset ], data, size );
+            return section;
+        };
+
+        const float subMeshOffset = hasMeshlets ? (float)(gridSize - 1) : 0;
+
+        for (int s = 0; s < subMeshCount; ++s)
+        {
+            MeshFormat::SubMeshEntry& entry = entries[ s ];
+            std::memset( &entry, 0, sizeof( entry ) );
+            entry.aabbMin[ 0 ] = s * subMeshOffset;
+            entry.aabbMax[ 0 ] = s * subMeshOffset + gridSize;
+            entry.aabbMax[ 1 ] = 1;
+            entry.aabbMax[ 2 ] = (float)gridSize;
+            entry.vertexFormat = MeshFormat::PTN;
+            entry.indexSize = 2;
+
+            const std::string name = "grid" + std::to_string( s );
+            entry.name = appendSection( name.data(), name.size() );
+
+            std::vector< VertexBuffer::VertexPTN > vertices = MakeGridVertices( s, gridSize );
+
+            // Flatter grids have narrower normal cones, so their meshlets can be culled when they face away from the camera.
+            for (VertexBuffer::VertexPTN& vertex : vertices)
+            {
+                vertex.position.x += s * subMeshOffset;
+                vertex.position.y *= hasMeshlets ? 0.1f : 1.0f;
+            }
+
+            entry.vertexCount = (std::uint32_t)vertices.size();
+            entry.vertices = appendSection( vertices.data(), vertices.size() * sizeof( VertexBuffer::VertexPTN ) );
+
+            std::vector< MeshFormat::MeshletEntry > meshlets;
+            const std::vector< VertexBuffer::Face > faces = hasMeshlets ? MakeMeshletGridFaces( vertices, gridSize, meshlets ) : MakeGridFaces( gridSize );
+            entry.faceCount = (std::uint32_t)faces.size();
+            entry.indices = appendSection( faces.data(), faces.size() * sizeof( VertexBuffer::Face ) );
+
+            if (hasMeshlets)
+            {
+                entry.meshletCount = (std::uint32_t)meshlets.size();
+                entry.meshlets = appendSection( meshlets.data(), meshlets.size() * sizeof( MeshFormat::MeshletEntry ) );
+            }
+        }
+
+        MeshFormat::Header header;
+        std::memset( &header, 0, sizeof( header ) );
+        std::memcpy( header.magic, MeshFormat::Magic, sizeof( header.magic ) );
+        header.version = MeshFormat::Version;
+        header.subMeshCount = (std::uint32_t)subMeshCount;
+        header.aabbMax[ 0 ] = (subMeshCount - 1) * subMeshOffset + gridSize;
+        header.aabbMax[ 1 ] = 1;
+        header.aabbMax[ 2 ] = (float)gridSize;
+        header.subMeshesOffset = sizeof( MeshFormat::Header );
+
+        std::memcpy( &out[ 0 ], &header, sizeof( header ) );
+        std::memcpy( &out[ sizeof( header ) ], entries.data(), entries.size() * sizeof( MeshFormat::SubMeshEntry ) );
+        return out;
+    }
+
+    /// \return BMFont text metadata of printable ASCII glyphs in a 16x6 grid.
+    FileSystem::FileContentsData MakeFontFile()
+    {
+        std::string text = "info face=\"benchmark\" size=16 padding=0,0,0,0 spacing=1,1\n"
+                           "common lineHeight=18 base=14 scaleW=256 scaleH=128 pages=1\n"
+                           "page id=0 file=\"benchmark.png\"\n"
+                           "chars count=95\n";
+
+        for (int id = 32; id < 127; ++id)
+        {
+            const int cell = id - 32;
+            text += "char id=" + std::to_string( id ) + " x=" + std::to_string( (cell % 16) * 16 ) + " y=" + std::to_string( (cell / 16) * 18 ) +
+                    " width=12 height=16 xoffset=0 yoffset=2 xadvance=13 page=0 chnl=0\n";
+        }
+
+        FileSystem::FileContentsData contents;
+        contents.data.assign( text.begin(), text.end() );
+        contents.path = "benchmark.fnt";
+        contents.isLoaded = true;
+        return contents;
+    }
+
+    bool WriteFile( const char* path, const std::vector< unsigned char >& data )
+    {
+        std::ofstream ofs( path, std::ios::binary );
+        ofs.write( (const char*)data.data(), data.size() );
+        return ofs.good();
+    }
+
+    bool WriteResults( const char* path, const Options& options )
+    {
+        std::ofstream ofs( path );
+
+        if (!ofs)
+        {
+            return false;
+        }
+
+        ofs << "{\n  \"objects\": " << options.objectCount << ",\n  \"results\": [\n";
+
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const Result& result = results[ i ];
+            ofs << "    { \"name\": \"" << result.name << "\", \"iterations\": " << result.iterations << ", \"minMS\": " << result.minMS
+                << ", \"medianMS\": " << result.medianMS << ", \"meanMS\": " << result.meanMS << ", \"maxMS\": " << result.maxMS << " }"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+
+        ofs << "  ]\n}\n";
+        return true;
+    }
+
+    /// Reads medians from a file written by WriteResults().
+    std::map< std::string, double > ReadBaseline( const char* path )
+    {
+        std::map< std::string, double > medians;
+        std::ifstream ifs( path );
+        std::string line;
+
+        while (std::getline( ifs, line ))
+        {
+            const std::size_t namePos = line.find( "\"name\": \"" );
+            const std::size_t medianPos = line.find( "\"medianMS\": " );
+
+            if (namePos == std::string::npos || medianPos == std::string::npos)
+            {
+                continue;
+            }
+
+            const std::size_t nameBegin = namePos + std::strlen( "\"name\": \"" );
+            const std::string name = line.substr( nameBegin, line.find( '"', nameBegin ) - nameBegin );
+            medians[ name ] = std::atof( line.c_str() + medianPos + std::strlen( "\"medianMS\": " ) );
+        }
+
+        return medians;
+    }
+
+    /// \return Number of cases that regressed by more than the threshold.
+    int CompareToBaseline( const Options& options )
+    {
+        const std::map< std::string, double > baseline = ReadBaseline( options.baselinePath );
+
+        if (baseline.empty())
+        {
+            System::Print( "Could not read baseline %s\n", options.baselinePath );
+            return 0;
+        }
+
+        int regressionCount = 0;
+        System::Print( "\n%-22s %12s %12s %9s\n", "case", "baseline ms", "current ms", "change" );
+
+        for (const Result& result : results)
+        {
+            const auto it = baseline.find( result.name );
+
+            if (it == baseline.end() || it->second <= 0)
+            {
+                System::Print( "%-22s %12s %12.3f\n", result.name.c_str(), "-", result.medianMS );
+                continue;
+            }
+
+            const double changePercent = (result.medianMS - it->second) / it->second * 100;
+            const bool isRegression = changePercent > options.thresholdPercent;
+            regressionCount += isRegression ? 1 : 0;
+            System::Print( "%-22s %12.3f %12.3f %+8.1f%%%s\n", result.name.c_str(), it->second, result.medianMS, changePercent, isRegression ? "  REGRESSION" : "" );
+        }
+
+        return regressionCount;
+    }
+
+    bool ParseOptions( int argc, char* argv[], Options& outOptions )
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const bool hasValue = i + 1 < argc;
+
+            if (std::strcmp( argv[ i ], "--objects" ) == 0 && hasValue)
+            {
+                outOptions.objectCount = std::max( 1, std::atoi( argv[ ++i ] ) );
+            }
+            else if (std::strcmp( argv[ i ], "--iterations" ) == 0 && hasValue)
+            {
+                outOptions.iterations = std::max( 1, std::atoi( argv[ ++i ] ) );
+            }
+            else if (std::strcmp( argv[ i ], "--out" ) == 0 && hasValue)
+            {
+                outOptions.outPath = argv[ ++i ];
+            }
+            else if (std::strcmp( argv[ i ], "--baseline" ) == 0 && hasValue)
+            {
+                outOptions.baselinePath = argv[ ++i ];
+            }
+            else if (std::strcmp( argv[ i ], "--threshold" ) == 0 && hasValue)
+            {
+                outOptions.thresholdPercent = std::atof( argv[ ++i ] );
+            }
+            else
+            {
+                System::Print( "Usage: %s [--objects count] [--iterations count] [--out results.json] [--baseline baseline.json] [--threshold percent]\n", argv[ 0 ] );
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+int main( int argc, char* argv[] )
+{
+    Options options;
+
+    if (!ParseOptions( argc, argv, options ))
+    {
+        return 1;
+    }
+
+    Window::Create( 1280, 720, WindowCreateFlags::Empty );
+    System::LoadBuiltinAssets();
+
+    if (!WriteFile( MeshPath, MakeMeshFile( 4, 64 ) ))
+    {
+        System::Print( "Could not write %s\n", MeshPath );
+        return 1;
+    }
+
+    Mesh mesh;
+    mesh.Load( FileSystem::FileContents( MeshPath ) );
+
+    Shader shader;
+    Material material;
+    material.SetShader( &shader );
+
+    // Objects are in a grid that extends along -z from the origin. Every fourth object starts a chain of children.
+    const int objectCount = options.objectCount;
+    std::vector< GameObject > objects( objectCount );
+    Scene scene;
+
+    for (int i = 0; i < objectCount; ++i)
+    {
+        GameObject& go = objects[ i ];
+        go.SetName( "object" );
+        go.AddComponent< TransformComponent >();
+        go.GetComponent< TransformComponent >()->SetLocalPosition( Vec3( (float)(i % 64) * 80 - 2560, 0, -(float)(i / 64) * 80 ) );
+        go.GetComponent< TransformComponent >()->SetLocalScale( 0.5f );
+        go.AddComponent< MeshRendererComponent >();
+        go.GetComponent< MeshRendererComponent >()->SetMesh( &mesh );
+
+        for (unsigned s = 0; s < mesh.GetSubMeshCount(); ++s)
+        {
+            go.GetComponent< MeshRendererComponent >()->SetMaterial( &material, s );
+        }
+
+        if (i % 4 != 0)
+        {
+            go.GetComponent< TransformComponent >()->SetParent( objects[ i - 1 ].GetComponent< TransformComponent >() );
+        }
+
+        scene.Add( &go );
+    }
+
+    // Without a camera Render() only updates transforms and the scene AABB.
+    // Scene::GenerateAABB() is timed inside Render(), so its times are collected from each scene_update iteration.
+    std::vector< double > aabbTimesMS;
+    Run( "scene_update", options.iterations, [&]( int iteration )
+    {
+        objects[ 0 ].GetComponent< TransformComponent >()->SetLocalPosition( Vec3( (float)iteration, 0, 0 ) );
+        scene.Render();
+        Window::SwapBuffers();
+
+        if (iteration > 0)
+        {
+            aabbTimesMS.push_back( Statistics::GetSceneAABBTimeMS() );
+        }
+    } );
+    AddResult( "scene_aabb", aabbTimesMS );
+
+    GameObject camera;
+    camera.AddComponent< CameraComponent >();
+    camera.GetComponent< CameraComponent >()->SetProjectionType( CameraComponent::ProjectionType::Perspective );
+    camera.GetComponent< CameraComponent >()->SetProjection( 45, 1280 / 720.0f, 1, 5000 );
+    camera.AddComponent< TransformComponent >();
+    scene.Add( &camera );
+
+    // MeshRendererComponent::Cull() is internal to Scene, so it's timed through a frame where every object is behind the camera.
+    // LookAt() points the camera's view direction from center towards eye.
+    camera.GetComponent< TransformComponent >()->LookAt( Vec3( 0, 200, 200 ), Vec3( 0, 200, -1000 ), Vec3( 0, 1, 0 ) );
+    Run( "render_all_culled", options.iterations, [&]( int )
+    {
+        scene.Render();
+        Window::SwapBuffers();
+    } );
+
+    // Looks down at the grid, so objects far from the center are culled.
+    camera.GetComponent< TransformComponent >()->LookAt( Vec3( 0, 200, 200 ), Vec3( 0, 260, 400 ), Vec3( 0, 1, 0 ) );
+    GfxDevice::SetPlaybackCounting( true );
+    Run( "render_frame", options.iterations, [&]( int )
+    {
+        scene.Render();
+        Window::SwapBuffers();
+    } );
+    System::Print( "  %d draws per frame\n", GfxDevice::GetLastFrameCounts().commands[ (int)GfxDevice::CommandType::Draw ] );
+    scene.Remove( &camera );
+
+    // Rows of meshes whose submeshes are side by side, on the ground and above the camera. Only the middle submeshes of near objects
+    // are in view, the frustum cuts through their meshlets, and the meshlets above the camera face away from it.
+    FileSystem::FileContentsData meshletMeshContents;
+    meshletMeshContents.data = MakeMeshFileVersion2( 4, 64, true );
+    meshletMeshContents.path = "benchmark_meshlets.ae3d";
+    meshletMeshContents.isLoaded = true;
+    Mesh meshletMesh;
+    meshletMesh.Load( meshletMeshContents );
+
+    const float meshletMeshWidth = meshletMesh.GetAABBMax().x - meshletMesh.GetAABBMin().x;
+    std::vector< GameObject > meshletObjects( 12 );
+    Scene meshletScene;
+
+    for (std::size_t i = 0; i < meshletObjects.size(); ++i)
+    {
+        GameObject& go = meshletObjects[ i ];
+        go.AddComponent< TransformComponent >();
+        go.GetComponent< TransformComponent >()->SetLocalPosition( Vec3( -meshletMeshWidth / 2, (i % 2 == 0) ? 0.0f : 80.0f, (float)(i / 2) * 64 ) );
+        go.AddComponent< MeshRendererComponent >();
+        go.GetComponent< MeshRendererComponent >()->SetMesh( &meshletMesh );
+
+        for (unsigned s = 0; s < meshletMesh.GetSubMeshCount(); ++s)
+        {
+            go.GetComponent< MeshRendererComponent >()->SetMaterial( &material, s );
+        }
+
+        meshletScene.Add( &go );
+    }
+
+    camera.GetComponent< TransformComponent >()->LookAt( Vec3( 0, 20, -30 ), Vec3( 0, 30, -160 ), Vec3( 0, 1, 0 ) );
+    meshletScene.Add( &camera );
+    Run( "render_partly_culled", options.iterations, [&]( int )
+    {
+        meshletScene.Render();
+        Window::SwapBuffers();
+    } );
+    System::Print( "  %d draws, %d of %d triangles per frame\n", GfxDevice::GetLastFrameCounts().commands[ (int)GfxDevice::CommandType::Draw ],
+                   Statistics::GetTriangleCount(), (int)(meshletObjects.size() * meshletMesh.GetSubMeshCount() * 2 * 63 * 63) );
+    GfxDevice::SetPlaybackCounting( false );
+    meshletScene.Remove( &camera );
+
+    std::string serialized;
+    Run( "scene_serialize", options.iterations, [&]( int )
+    {
+        serialized = scene.GetSerialized();
+    } );
+
+    // Materials are not serialized, so they're added here to give every submesh one.
+    std::string serializedWithMaterials = "material benchmark\n";
+    std::size_t lineBegin = 0;
+
+    while (lineBegin < serialized.size())
+    {
+        const std::size_t lineEnd = std::min( serialized.find( '\n', lineBegin ), serialized.size() );
+        serializedWithMaterials.append( serialized, lineBegin, lineEnd - lineBegin );
+        serializedWithMaterials += '\n';
+
+        if (serialized.compare( lineBegin, std::strlen( "meshpath" ), "meshpath" ) == 0)
+        {
+            for (unsigned s = 0; s < mesh.GetSubMeshCount(); ++s)
+            {
+                serializedWithMaterials += std::string( "mesh_material " ) + mesh.GetSubMeshName( s ) + " benchmark\n";
+            }
+        }
+
+        lineBegin = lineEnd + 1;
+    }
+
+    FileSystem::FileContentsData serializedContents;
+    serializedContents.data.assign( serializedWithMaterials.begin(), serializedWithMaterials.end() );
+    serializedContents.path = "benchmark.scene";
+    serializedContents.isLoaded = true;
+
+    // Components are never freed, so deserialization runs fewer iterations.
+    std::vector< Mesh* > retiredMeshes;
+    Run( "scene_deserialize", std::max( 1, options.iterations / 10 ), [&]( int )
+    {
+        std::vector< GameObject > gameObjects;
+        std::map< std::string, Material* > materials;
+        std::map< std::string, Texture2D* > textures;
+        Array< Mesh* > meshes;
+        Scene deserializedScene;
+        deserializedScene.Deserialize( serializedContents, gameObjects, textures, materials, meshes );
+
+        // Copying a game object leaves its old components in the pools, still pointing to the meshes,
+        // so the meshes are emptied now and deleted after the last Render().
+        for (unsigned m = 0; m < meshes.count; ++m)
+        {
+            *meshes[ m ] = Mesh();
+            retiredMeshes.push_back( meshes[ m ] );
+        }
+
+        for (auto& nameAndMaterial : materials)
+        {
+            delete nameAndMaterial.second;
+        }
+
+        for (auto& nameAndTexture : textures)
+        {
+            delete nameAndTexture.second;
+        }
+    } );
+
+    // Loads under a new path each time to bypass the mesh cache.
+    FileSystem::FileContentsData meshContents = FileSystem::FileContents( MeshPath );
+    Run( "mesh_load", options.iterations, [&]( int iteration )
+    {
+        meshContents.path = std::string( "benchmark_mesh_" ) + std::to_string( iteration ) + ".ae3d";
+        Mesh loadedMesh;
+        loadedMesh.Load( meshContents );
+    } );
+
+    FileSystem::FileContentsData meshContentsVersion2;
+    meshContentsVersion2.data = MakeMeshFileVersion2( 4, 64, false );
+    meshContentsVersion2.isLoaded = true;
+    Run( "mesh_load_v2", options.iterations, [&]( int iteration )
+    {
+        meshContentsVersion2.path = std::string( "benchmark_mesh_v2_" ) + std::to_string( iteration ) + ".ae3d";
+        Mesh loadedMesh;
+        loadedMesh.Load( meshContentsVersion2 );
+    } );
+
+    std::vector< unsigned char > fileData( 16 * 1024 * 1024 );
+
+    for (std::size_t i = 0; i < fileData.size(); ++i)
+    {
+        fileData[ i ] = (unsigned char)i;
+    }
+
+    WriteFile( FilePath, fileData );
+    Run( "file_contents_16MB", options.iterations, [&]( int )
+    {
+        const FileSystem::FileContentsData contents = FileSystem::FileContents( FilePath );
+        System::Assert( contents.data.size() == fileData.size(), "benchmark file has wrong size" );
+    } );
+
+    std::vector< unsigned char > textureData( 256 * 128 * 4 );
+    Texture2D texture;
+    texture.LoadFromData( textureData.data(), 256, 128, 4, "benchmark texture" );
+
+    // UI scenes render with an orthographic camera.
+    Scene uiScene;
+    GameObject uiCamera;
+    uiCamera.AddComponent< CameraComponent >();
+    uiCamera.GetComponent< CameraComponent >()->SetProjectionType( CameraComponent::ProjectionType::Orthographic );
+    uiCamera.GetComponent< CameraComponent >()->SetProjection( 0, 1280, 720, 0, 0, 1 );
+    uiCamera.AddComponent< TransformComponent >();
+    uiScene.Add( &uiCamera );
+
+    Font font;
+    font.LoadBMFont( &texture, MakeFontFile() );
+
+    GameObject text;
+    text.AddComponent< TextRendererComponent >();
+    text.GetComponent< TextRendererComponent >()->SetFont( &font );
+    text.AddComponent< TransformComponent >();
+    uiScene.Add( &text );
+
+    std::string longText;
+
+    for (int line = 0; line < 40; ++line)
+    {
+        longText += "The quick brown fox jumps over the lazy dog 0123456789\n";
+    }
+
+    // Changing the text rebuilds its vertex buffer in the next Render().
+    Run( "text_vertex_buffer", options.iterations, [&]( int iteration )
+    {
+        longText[ 0 ] = (char)('A' + iteration % 26);
+        text.GetComponent< TextRendererComponent >()->SetText( longText.c_str() );
+        uiScene.Render();
+        Window::SwapBuffers();
+    } );
+    uiScene.Remove( &text );
+
+    GameObject sprites;
+    sprites.AddComponent< SpriteRendererComponent >();
+    sprites.AddComponent< TransformComponent >();
+    uiScene.Add( &sprites );
+
+    // Re-adding the sprites rebuilds the batch in the next Render().
+    Run( "sprite_batch", options.iterations, [&]( int )
+    {
+        SpriteRendererComponent* spriteRenderer = sprites.GetComponent< SpriteRendererComponent >();
+        spriteRenderer->Clear();
+
+        for (int i = 0; i < objectCount; ++i)
+        {
+            spriteRenderer->SetTexture( &texture, Vec3( (float)(i % 64) * 20, (float)(i / 64 % 36) * 20, 0 ), Vec3( 16, 16, 1 ), Vec4( 1, 1, 1, i % 3 == 0 ? 0.5f : 1 ) );
+        }
+
+        uiScene.Render();
+        Window::SwapBuffers();
+    } );
+
+    for (Mesh* retiredMesh : retiredMeshes)
+    {
+        delete retiredMesh;
+    }
+
+    std::remove( MeshPath );
+    std::remove( FilePath );
+
+    if (options.outPath != nullptr && !WriteResults( options.outPath, options ))
+    {
+        System::Print( "Could not write %s\n", options.outPath );
+        return 1;
+    }
+
+    if (options.baselinePath != nullptr && CompareToBaseline( options ) > 0)
+    {
+        return 1;
+    }
+
+    return 0;
+}
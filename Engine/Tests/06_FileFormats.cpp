@@ -0,0 +1,1053 @@
+// Round-trip tests of the engine's file formats. Runs on the null renderer, so it needs no window or GPU.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <vector>
+#include "Array.hpp"
+#include "FileSystem.hpp"
+#include "Frustum.hpp"
+#include "Lz4.hpp"
+#include "Matrix.hpp"
+#include "Mesh.hpp"
+#include "PakFormat.hpp"
+#include "Vec3.hpp"
+#include "../../Tools/common.hpp"
+
+using namespace ae3d;
+
+namespace
+{
+    const char* PakPath = "test_formats.pak";
+    // Positions of grid vertices are keyed by their x and z, which are integers.
+    const int GridKeyStride = 1024;
+
+    /// xorshift32, so test data is the same on every run.
+    std::uint32_t NextRandom( std::uint32_t& state )
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    std::vector< unsigned char > RandomBytes( std::size_t size, std::uint32_t seed )
+    {
+        std::vector< unsigned char > bytes( size );
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            bytes[ i ] = (unsigned char)NextRandom( seed );
+        }
+
+        return bytes;
+    }
+
+    /// \return Text-like bytes with many repeats.
+    std::vector< unsigned char > CompressibleBytes( std::size_t size, std::uint32_t seed )
+    {
+        const char* words[] = { "mesh ", "texture ", "shader ", "scene ", "light ", "camera ", "material ", "\n" };
+        std::vector< unsigned char > bytes;
+
+        while (bytes.size() < size)
+        {
+            const char* word = words[ NextRandom( seed ) % 8 ];
+            bytes.insert( bytes.end(), word, word + std::strlen( word ) );
+        }
+
+        bytes.resize( size );
+        return bytes;
+    }
+
+    bool TestLz4RoundTrip( const char* name, const std::vector< unsigned char >& data, int level )
+    {
+        std::vector< unsigned char > compressed( Lz4::CompressBound( data.size() ) );
+        const std::size_t compressedSize = Lz4::Compress( data.data(), data.size(), compressed.data(), level );
+
+        if (compressedSize == 0 || compressedSize > compressed.size())
+        {
+            std::cerr << "Lz4::Compress of " << name << " returned " << compressedSize << " bytes, bound is " << compressed.size() << std::endl;
+            return false;
+        }
+
+        std::vector< unsigned char > decompressed( data.size() );
+
+        if (!Lz4::Decompress( compressed.data(), compressedSize, decompressed.data(), decompressed.size() ) || decompressed != data)
+        {
+            std::cerr << "Lz4 round trip of " << name << " at level " << level << " failed!" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool TestLz4()
+    {
+        bool result = true;
+
+        for (int level = 1; level <= 9; level += 8)
+        {
+            result &= TestLz4RoundTrip( "empty data", std::vector< unsigned char >(), level );
+            result &= TestLz4RoundTrip( "one byte", std::vector< unsigned char >( 1, 42 ), level );
+            result &= TestLz4RoundTrip( "data shorter than the last literals", CompressibleBytes( 11, 1 ), level );
+            // Runs longer than 255 bytes need several length bytes.
+            result &= TestLz4RoundTrip( "zeros", std::vector< unsigned char >( 300000, 0 ), level );
+            result &= TestLz4RoundTrip( "text", CompressibleBytes( 200000, 2 ), level );
+            result &= TestLz4RoundTrip( "incompressible data", RandomBytes( 100000, 3 ), level );
+        }
+
+        const std::vector< unsigned char > text = CompressibleBytes( 10000, 4 );
+        std::vector< unsigned char > compressed( Lz4::CompressBound( text.size() ) );
+        const std::size_t compressedSize = Lz4::Compress( text.data(), text.size(), compressed.data(), 1 );
+
+        if (compressedSize >= text.size() / 2)
+        {
+            std::cerr << "Lz4::Compress didn't compress text: " << compressedSize << " bytes from " << text.size() << std::endl;
+            result = false;
+        }
+
+        std::vector< unsigned char > decompressed( text.size() );
+
+        if (Lz4::Decompress( compressed.data(), compressedSize / 2, decompressed.data(), decompressed.size() ))
+        {
+            std::cerr << "Lz4::Decompress accepted truncated data!" << std::endl;
+            result = false;
+        }
+
+        if (Lz4::Decompress( compressed.data(), compressedSize, decompressed.data(), decompressed.size() - 1 ))
+        {
+            std::cerr << "Lz4::Decompress accepted a too small output!" << std::endl;
+            result = false;
+        }
+
+        return result;
+    }
+
+    struct PakInput
+    {
+        std::string path;
+        std::vector< unsigned char > data;
+        bool isCompressed;
+    };
+
+    /// \return Stored contents of data compressed in blocks of blockSize. Blocks that don't compress are stored as they are.
+    std::vector< unsigned char > CompressPakEntry( const std::vector< unsigned char >& data, std::uint32_t blockSize )
+    {
+        Pak::CompressedHeader header;
+        header.blockSize = blockSize;
+        header.blockCount = (std::uint32_t)((data.size() + blockSize - 1) / blockSize);
+
+        std::vector< unsigned char > stored( sizeof( header ) + header.blockCount * sizeof( std::uint32_t ) );
+        std::memcpy( stored.data(), &header, sizeof( header ) );
+        std::vector< unsigned char > compressed( Lz4::CompressBound( blockSize ) );
+
+        for (std::uint32_t b = 0; b < header.blockCount; ++b)
+        {
+            const unsigned char* block = data.data() + (std::size_t)b * blockSize;
+            const std::size_t blockLength = std::min( (std::size_t)blockSize, data.size() - (std::size_t)b * blockSize );
+            const std::size_t compressedLength = Lz4::Compress( block, blockLength, compressed.data(), 1 );
+            std::uint32_t storedSize;
+
+            if (compressedLength >= blockLength)
+            {
+                storedSize = (std::uint32_t)blockLength | Pak::BlockUncompressed;
+                stored.insert( stored.end(), block, block + blockLength );
+            }
+            else
+            {
+                storedSize = (std::uint32_t)compressedLength;
+                stored.insert( stored.end(), compressed.begin(), compressed.begin() + (std::ptrdiff_t)compressedLength );
+            }
+
+            std::memcpy( stored.data() + sizeof( header ) + b * sizeof( std::uint32_t ), &storedSize, sizeof( storedSize ) );
+        }
+
+        return stored;
+    }
+
+    /// Writes inputs into a .pak file like CombineFiles does.
+    void WritePak( const char* path, const std::vector< PakInput >& inputs, std::uint32_t blockSize )
+    {
+        std::vector< Pak::TocEntry > toc( inputs.size() );
+        std::string paths;
+        std::vector< std::vector< unsigned char > > stored( inputs.size() );
+
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+        {
+            std::memset( &toc[ i ], 0, sizeof( toc[ i ] ) );
+            toc[ i ].pathHash = Pak::HashPath( inputs[ i ].path.data(), inputs[ i ].path.size() );
+            toc[ i ].size = inputs[ i ].data.size();
+            toc[ i ].pathOffset = (std::uint32_t)paths.size();
+            toc[ i ].pathLength = (std::uint32_t)inputs[ i ].path.size();
+            toc[ i ].flags = inputs[ i ].isCompressed ? Pak::EntryCompressed : 0;
+            stored[ i ] = inputs[ i ].isCompressed ? CompressPakEntry( inputs[ i ].data, blockSize ) : inputs[ i ].data;
+            toc[ i ].checksum = Pak::Checksum( stored[ i ].data(), stored[ i ].size() );
+            paths += inputs[ i ].path;
+        }
+
+        Pak::Header header;
+        std::memcpy( header.magic, Pak::Magic, sizeof( header.magic ) );
+        header.version = Pak::Version;
+        header.entryCount = (std::uint32_t)inputs.size();
+        header.pathBytes = (std::uint32_t)paths.size();
+        header.tocOffset = sizeof( header );
+        header.pathsOffset = header.tocOffset + toc.size() * sizeof( Pak::TocEntry );
+
+        std::vector< unsigned char > bytes( header.pathsOffset + paths.size() );
+
+        for (std::size_t i = 0; i < inputs.size(); ++i)
+        {
+            toc[ i ].offset = (bytes.size() + Pak::DataAlignment - 1) / Pak::DataAlignment * Pak::DataAlignment;
+            bytes.resize( toc[ i ].offset );
+            bytes.insert( bytes.end(), stored[ i ].begin(), stored[ i ].end() );
+        }
+
+        std::sort( toc.begin(), toc.end(), []( const Pak::TocEntry& a, const Pak::TocEntry& b ) { return a.pathHash < b.pathHash; } );
+        std::memcpy( bytes.data(), &header, sizeof( header ) );
+        std::memcpy( bytes.data() + header.tocOffset, toc.data(), toc.size() * sizeof( Pak::TocEntry ) );
+        std::memcpy( bytes.data() + header.pathsOffset, paths.data(), paths.size() );
+
+        std::ofstream ofs( path, std::ios::binary );
+        ofs.write( (const char*)bytes.data(), (std::streamsize)bytes.size() );
+    }
+
+    bool TestPakRange( const PakInput& input, std::size_t offset, std::size_t size )
+    {
+        std::vector< unsigned char > range( size + 1, 0xCD );
+
+        if (!FileSystem::ReadPakFileRange( input.path.c_str(), offset, size, range.data() ) ||
+            !std::equal( range.begin(), range.begin() + (std::ptrdiff_t)size, input.data.begin() + (std::ptrdiff_t)offset ) || range[ size ] != 0xCD)
+        {
+            std::cerr << "ReadPakFileRange of " << input.path << " bytes " << offset << ".." << offset + size << " failed!" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    /// Tests LoadPakFile() with checksum verification. inputs must have been written to PakPath and it must not be loaded.
+    bool TestPakChecksums( const std::vector< PakInput >& inputs )
+    {
+        bool result = true;
+
+        FileSystem::LoadPakFile( PakPath, true );
+
+        if (!FileSystem::FileContents( inputs[ 0 ].path.c_str() ).isLoaded)
+        {
+            std::cerr << "LoadPakFile with checksum verification rejected a valid .pak file!" << std::endl;
+            result = false;
+        }
+
+        FileSystem::UnloadPakFile( PakPath );
+
+        // Corrupts a byte of the first input that is stored uncompressed.
+        const PakInput& stored = *std::find_if( inputs.begin(), inputs.end(), []( const PakInput& input ) { return !input.isCompressed && !input.data.empty(); } );
+        std::vector< unsigned char > bytes;
+        {
+            std::ifstream ifs( PakPath, std::ios::binary );
+            bytes.assign( std::istreambuf_iterator< char >( ifs ), std::istreambuf_iterator< char >() );
+        }
+
+        const auto storedBytes = std::search( bytes.begin(), bytes.end(), stored.data.begin(), stored.data.end() );
+
+        if (storedBytes == bytes.end())
+        {
+            std::cerr << "Could not find " << stored.path << " in the .pak file!" << std::endl;
+            return false;
+        }
+
+        storedBytes[ (std::ptrdiff_t)stored.data.size() / 2 ] ^= 0xFF;
+        {
+            std::ofstream ofs( PakPath, std::ios::binary );
+            ofs.write( (const char*)bytes.data(), (std::streamsize)bytes.size() );
+        }
+
+        FileSystem::LoadPakFile( PakPath, true );
+
+        if (FileSystem::FileContents( inputs[ 0 ].path.c_str() ).isLoaded)
+        {
+            std::cerr << "LoadPakFile with checksum verification loaded a corrupted .pak file!" << std::endl;
+            FileSystem::UnloadPakFile( PakPath );
+            result = false;
+        }
+
+        // Without verification, lookups don't checksum entries, so intact entries are still readable.
+        FileSystem::LoadPakFile( PakPath );
+        result &= TestPakRange( inputs[ 0 ], 0, inputs[ 0 ].data.size() );
+        FileSystem::UnloadPakFile( PakPath );
+
+        return result;
+    }
+
+    bool TestPak()
+    {
+        const std::uint32_t blockSize = 4096;
+
+        // Alternating text and random blocks are stored partly compressed and partly uncompressed.
+        std::vector< unsigned char > mixed;
+
+        for (std::uint32_t b = 0; b < 12; ++b)
+        {
+            const std::vector< unsigned char > block = (b % 2) ? RandomBytes( blockSize, b + 10 ) : CompressibleBytes( blockSize, b + 10 );
+            mixed.insert( mixed.end(), block.begin(), block.end() );
+        }
+
+        mixed.resize( mixed.size() - 1000 );
+
+        std::vector< PakInput > inputs;
+        inputs.push_back( { "formats/text.txt", CompressibleBytes( 20 * blockSize + 123, 5 ), true } );
+        inputs.push_back( { "formats/mixed.bin", mixed, true } );
+        inputs.push_back( { "formats/random.bin", RandomBytes( 3 * blockSize + 7, 6 ), true } );
+        inputs.push_back( { "formats/stored.bin", RandomBytes( 5000, 7 ), false } );
+        inputs.push_back( { "formats/small.txt", CompressibleBytes( 100, 8 ), true } );
+        inputs.push_back( { "formats/empty.txt", std::vector< unsigned char >(), false } );
+
+        WritePak( PakPath, inputs, blockSize );
+        FileSystem::LoadPakFile( PakPath );
+
+        bool result = true;
+
+        for (const PakInput& input : inputs)
+        {
+            const FileSystem::FileContentsData contents = FileSystem::FileContents( input.path.c_str() );
+
+            if (!contents.isLoaded || contents.data != input.data)
+            {
+                std::cerr << "FileContents of " << input.path << " in a .pak file failed!" << std::endl;
+                result = false;
+            }
+
+            const FileSystem::MappedFile mapped( input.path.c_str() );
+
+            if (!mapped.IsLoaded() || mapped.GetView().size != input.data.size() ||
+                (input.data.size() > 0 && std::memcmp( mapped.GetView().data, input.data.data(), input.data.size() ) != 0))
+            {
+                std::cerr << "MappedFile of " << input.path << " in a .pak file failed!" << std::endl;
+                result = false;
+            }
+
+            const std::size_t size = input.data.size();
+            result &= TestPakRange( input, 0, size );
+            result &= TestPakRange( input, size, 0 );
+
+            if (size > 2 * blockSize)
+            {
+                // Starts and ends in the middle of blocks.
+                result &= TestPakRange( input, blockSize / 2, size - blockSize );
+                // Starts and ends inside the same block.
+                result &= TestPakRange( input, blockSize + 10, blockSize - 20 );
+                // Starts at a block boundary and ends in the middle of the next block.
+                result &= TestPakRange( input, blockSize, blockSize + 1 );
+                // Ends at the end of the last, partial block.
+                result &= TestPakRange( input, size - blockSize - 3, blockSize + 3 );
+            }
+
+            unsigned char byte;
+
+            if (FileSystem::ReadPakFileRange( input.path.c_str(), size, 1, &byte ))
+            {
+                std::cerr << "ReadPakFileRange of " << input.path << " accepted a range past its end!" << std::endl;
+                result = false;
+            }
+        }
+
+        FileSystem::UnloadPakFile( PakPath );
+        result &= TestPakChecksums( inputs );
+        std::remove( PakPath );
+        return result;
+    }
+
+    /// Adds a grid of gridSize * gridSize vertices with uneven heights to the converters' gMeshes.
+    void AddGridMesh( const char* name, int gridSize, float height )
+    {
+        gMeshes.push_back( ::Mesh() );
+        ::Mesh& mesh = gMeshes.back();
+        mesh.name = name;
+
+        for (int z = 0; z < gridSize; ++z)
+        {
+            for (int x = 0; x < gridSize; ++x)
+            {
+                mesh.vertex.push_back( Vec3( (float)x, height * (float)((x * 7 + z * 3) % 5), (float)z ) );
+                mesh.vnormal.push_back( Vec3( 0, 1, 0 ) );
+                mesh.tcoord.push_back( TexCoord( x / (float)gridSize, z / (float)gridSize ) );
+            }
+        }
+
+        for (int z = 0; z < gridSize - 1; ++z)
+        {
+            for (int x = 0; x < gridSize - 1; ++x)
+            {
+                const unsigned i0 = (unsigned)(z * gridSize + x);
+                const unsigned i1 = i0 + (unsigned)gridSize;
+                const unsigned quad[ 2 ][ 3 ] = { { i0, i1, i0 + 1 }, { i0 + 1, i1, i1 + 1 } };
+
+                for (int f = 0; f < 2; ++f)
+                {
+                    Face face;
+
+                    for (int v = 0; v < 3; ++v)
+                    {
+                        face.vInd[ v ] = face.vnInd[ v ] = face.uvInd[ v ] = quad[ f ][ v ];
+                    }
+
+                    mesh.face.push_back( face );
+                }
+            }
+        }
+    }
+
+    /// \return Vertex positions of mesh's faces, 3 for each face.
+    std::vector< Vec3 > GetTriangles( const ::Mesh& mesh )
+    {
+        std::vector< Vec3 > triangles;
+
+        for (const Face& face : mesh.face)
+        {
+            for (int v = 0; v < 3; ++v)
+            {
+                triangles.push_back( mesh.vertex[ face.vInd[ v ] ] );
+            }
+        }
+
+        return triangles;
+    }
+
+    struct GridTriangle
+    {
+        int keys[ 3 ];
+        Vec3 positions[ 3 ];
+
+        bool operator<( const GridTriangle& other ) const
+        {
+            return std::lexicographical_compare( keys, keys + 3, other.keys, other.keys + 3 );
+        }
+    };
+
+    /// \return Triangles of grid vertices, rotated to start from their smallest key and sorted, so they can be compared
+    ///         regardless of the face order chosen by the writer. Rotating keeps the winding.
+    std::vector< GridTriangle > SortGridTriangles( const Vec3* positions, std::size_t triangleCount )
+    {
+        std::vector< GridTriangle > triangles( triangleCount );
+
+        for (std::size_t t = 0; t < triangleCount; ++t)
+        {
+            int keys[ 3 ];
+
+            for (int v = 0; v < 3; ++v)
+            {
+                const Vec3& position = positions[ t * 3 + v ];
+                keys[ v ] = (int)std::lround( position.z ) * GridKeyStride + (int)std::lround( position.x );
+            }
+
+            const int first = (int)(std::min_element( keys, keys + 3 ) - keys);
+
+            for (int v = 0; v < 3; ++v)
+            {
+                triangles[ t ].keys[ v ] = keys[ (first + v) % 3 ];
+                triangles[ t ].positions[ v ] = positions[ t * 3 + (first + v) % 3 ];
+            }
+        }
+
+        std::sort( triangles.begin(), triangles.end() );
+        return triangles;
+    }
+
+    /// \return True if loaded has the triangles of expected in any order and their positions differ at most by tolerance.
+    bool CompareTriangles( const std::string& name, const std::vector< Vec3 >& expected, const Array< Vec3 >& loaded, const Vec3& tolerance )
+    {
+        if (loaded.count != expected.size())
+        {
+            std::cerr << name << " has " << loaded.count / 3 << " triangles instead of " << expected.size() / 3 << "!" << std::endl;
+            return false;
+        }
+
+        const std::vector< GridTriangle > expectedTriangles = SortGridTriangles( expected.data(), expected.size() / 3 );
+        const std::vector< GridTriangle > loadedTriangles = SortGridTriangles( loaded.elements, loaded.count / 3 );
+
+        for (std::size_t t = 0; t < expectedTriangles.size(); ++t)
+        {
+            for (int v = 0; v < 3; ++v)
+            {
+                const Vec3 error = expectedTriangles[ t ].positions[ v ] - loadedTriangles[ t ].positions[ v ];
+
+                if (expectedTriangles[ t ].keys[ v ] != loadedTriangles[ t ].keys[ v ] ||
+                    std::fabs( error.x ) > tolerance.x || std::fabs( error.y ) > tolerance.y || std::fabs( error.z ) > tolerance.z)
+                {
+                    std::cerr << name << " triangle " << t << " differs from the written one!" << std::endl;
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /// \return file converted to version 2 by rewriting the section table without meshlets. Sections stay where they are, because their offsets are absolute.
+    std::vector< unsigned char > ToVersion2( const std::vector< unsigned char >& file )
+    {
+        std::vector< unsigned char > out = file;
+        MeshFormat::Header header;
+        std::memcpy( &header, file.data(), sizeof( header ) );
+
+        for (std::uint32_t s = 0; s < header.subMeshCount; ++s)
+        {
+            MeshFormat::SubMeshEntry entry;
+            std::memcpy( &entry, &file[ header.subMeshesOffset + s * sizeof( entry ) ], sizeof( entry ) );
+            // Was reserved and written as 0 in version 2.
+            entry.meshletCount = 0;
+            std::memcpy( &out[ header.subMeshesOffset + s * MeshFormat::SubMeshEntrySize( 2 ) ], &entry, MeshFormat::SubMeshEntrySize( 2 ) );
+        }
+
+        header.version = 2;
+        std::memcpy( out.data(), &header, sizeof( header ) );
+        return out;
+    }
+
+    /// \return Largest error of positions quantized by WriteAe3d(). They are rounded to 16 bits inside the AABB of triangles.
+    Vec3 GetQuantizationTolerance( const std::vector< Vec3 >& triangles )
+    {
+        Vec3 aabbMin = triangles[ 0 ];
+        Vec3 aabbMax = triangles[ 0 ];
+
+        for (const Vec3& position : triangles)
+        {
+            aabbMin = Vec3::Min2( aabbMin, position );
+            aabbMax = Vec3::Max2( aabbMax, position );
+        }
+
+        // Rounding to the nearest step and float rounding when dequantizing.
+        const float floatError = 1e-5f;
+        return (aabbMax - aabbMin) * (0.5f * 0.5f / 32767.0f) + Vec3( floatError, floatError, floatError );
+    }
+
+    /// \return True if the meshlets that WriteAe3d() wrote to file for the converters' gMeshes keep MeshFormat's limits,
+    ///         cover each face exactly once and bound their faces' vertices and normals.
+    bool TestMeshlets( const std::string& path, const std::vector< unsigned char >& file )
+    {
+        MeshFormat::Header header;
+        std::memcpy( &header, file.data(), sizeof( header ) );
+        for (std::uint32_t s = 0; s < header.subMeshCount; ++s)
+        {
+            const ::Mesh& mesh = gMeshes[ s ];
+            const std::string name = path + " submesh " + mesh.name;
+            MeshFormat::SubMeshEntry entry;
+            std::memcpy( &entry, &file[ header.subMeshesOffset + s * sizeof( entry ) ], sizeof( entry ) );
+
+            if (mesh.meshlets.empty() || entry.meshletCount != mesh.meshlets.size() || entry.meshlets.size != mesh.meshlets.size() * sizeof( MeshFormat::MeshletEntry ) ||
+                std::memcmp( &file[ entry.meshlets.offset ], mesh.meshlets.data(), entry.meshlets.size ) != 0)
+            {
+                std::cerr << name << " has " << entry.meshletCount << " meshlets instead of the " << mesh.meshlets.size() << " that were built!" << std::endl;
+                return false;
+            }
+
+            std::uint32_t nextFace = 0;
+
+            for (std::size_t m = 0; m < mesh.meshlets.size(); ++m)
+            {
+                const MeshFormat::MeshletEntry& meshlet = mesh.meshlets[ m ];
+
+                if (meshlet.firstFace != nextFace || meshlet.faceCount == 0 || meshlet.faceCount > MeshFormat::MaxMeshletFaces ||
+                    meshlet.firstFace + meshlet.faceCount > mesh.indices.size())
+                {
+                    std::cerr << name << " meshlet " << m << " has faces " << meshlet.firstFace << " to " << meshlet.firstFace + meshlet.faceCount
+                              << " after face " << nextFace << "!" << std::endl;
+                    return false;
+                }
+
+                nextFace = meshlet.firstFace + meshlet.faceCount;
+
+                const Vec3 aabbMin( meshlet.aabbMin[ 0 ], meshlet.aabbMin[ 1 ], meshlet.aabbMin[ 2 ] );
+                const Vec3 aabbMax( meshlet.aabbMax[ 0 ], meshlet.aabbMax[ 1 ], meshlet.aabbMax[ 2 ] );
+                const Vec3 coneAxis( meshlet.coneAxis[ 0 ], meshlet.coneAxis[ 1 ], meshlet.coneAxis[ 2 ] );
+                // Cosine of the cone's half angle. Cones with cutoff 1 are not tested by the engine.
+                const float minDot = std::sqrt( std::max( 0.0f, 1.0f - meshlet.coneCutoff * meshlet.coneCutoff ) );
+                std::vector< unsigned > vertices;
+
+                for (std::uint32_t f = meshlet.firstFace; f < nextFace; ++f)
+                {
+                    const unsigned indices[ 3 ] = { mesh.indices[ f ].a, mesh.indices[ f ].b, mesh.indices[ f ].c };
+
+                    for (int v = 0; v < 3; ++v)
+                    {
+                        const Vec3& position = mesh.interleavedVertices[ indices[ v ] ].position;
+
+                        if (position.x < aabbMin.x || position.y < aabbMin.y || position.z < aabbMin.z ||
+                            position.x > aabbMax.x || position.y > aabbMax.y || position.z > aabbMax.z)
+                        {
+                            std::cerr << name << " meshlet " << m << " doesn't contain vertex " << indices[ v ] << " of face " << f << "!" << std::endl;
+                            return false;
+                        }
+
+                        vertices.push_back( indices[ v ] );
+                    }
+
+                    if (meshlet.coneCutoff < 1 && mesh.fnormal[ f ].Length() > 0.5f && Vec3::Dot( coneAxis, mesh.fnormal[ f ] ) < minDot - 0.0001f)
+                    {
+                        std::cerr << name << " meshlet " << m << " cone doesn't contain the normal of face " << f << "!" << std::endl;
+                        return false;
+                    }
+                }
+
+                std::sort( vertices.begin(), vertices.end() );
+                const std::size_t vertexCount = (std::size_t)(std::unique( vertices.begin(), vertices.end() ) - vertices.begin());
+
+                if (vertexCount > MeshFormat::MaxMeshletVertices)
+                {
+                    std::cerr << name << " meshlet " << m << " has " << vertexCount << " vertices!" << std::endl;
+                    return false;
+                }
+            }
+
+            if (nextFace != mesh.indices.size() || entry.faceCount != mesh.indices.size())
+            {
+                std::cerr << name << " meshlets cover " << nextFace << " of " << entry.faceCount << " faces!" << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// Loads path and compares it to the meshes that were written there.
+    bool TestMeshFile( const FileSystem::FileContentsData& contents, VertexFormat format, const std::vector< std::string >& names,
+                       const std::vector< std::vector< Vec3 > >& triangles )
+    {
+        ae3d::Mesh mesh;
+
+        if (mesh.Load( contents ) != ae3d::Mesh::LoadResult::Success || mesh.GetSubMeshCount() != names.size())
+        {
+            std::cerr << "Could not load " << contents.path << "!" << std::endl;
+            return false;
+        }
+
+        bool result = true;
+
+        for (unsigned s = 0; s < mesh.GetSubMeshCount(); ++s)
+        {
+            if (names[ s ] != mesh.GetSubMeshName( s ))
+            {
+                std::cerr << contents.path << " submesh " << s << " is named " << mesh.GetSubMeshName( s ) << " instead of " << names[ s ] << "!" << std::endl;
+                result = false;
+            }
+
+            Array< Vec3 > loaded;
+            mesh.GetSubMeshFlattenedTriangles( s, loaded );
+            const Vec3 tolerance = format == VertexFormat::PTNTC_Quantized ? GetQuantizationTolerance( triangles[ s ] ) : Vec3( 0, 0, 0 );
+            result &= CompareTriangles( contents.path + " submesh " + names[ s ], triangles[ s ], loaded, tolerance );
+        }
+
+        return result;
+    }
+
+    /// Writes grids with the converters' WriteAe3d() and reads them back as they are and converted to version 2.
+    bool TestMeshRoundTrip( const std::string& path, VertexFormat format )
+    {
+        gMeshes.clear();
+        AddGridMesh( "flat", 20, 0 );
+        AddGridMesh( "bumpy", 33, 0.5f );
+
+        std::vector< std::string > names;
+        std::vector< std::vector< Vec3 > > triangles;
+
+        for (const ::Mesh& mesh : gMeshes)
+        {
+            names.push_back( mesh.name );
+            triangles.push_back( GetTriangles( mesh ) );
+        }
+
+        WriteAe3d( path, format );
+
+        FileSystem::FileContentsData contents = FileSystem::FileContents( path.c_str() );
+        std::remove( path.c_str() );
+
+        MeshFormat::Header header;
+
+        if (!contents.isLoaded || contents.data.size() < sizeof( header ))
+        {
+            std::cerr << "WriteAe3d didn't write " << path << "!" << std::endl;
+            return false;
+        }
+
+        std::memcpy( &header, contents.data.data(), sizeof( header ) );
+
+        if (header.version != MeshFormat::Version)
+        {
+            std::cerr << path << " has version " << header.version << " instead of " << MeshFormat::Version << "!" << std::endl;
+            return false;
+        }
+
+        bool result = TestMeshlets( path, contents.data );
+        result &= TestMeshFile( contents, format, names, triangles );
+
+        // Meshes are cached by path.
+        contents.data = ToVersion2( contents.data );
+        contents.path += ".v2";
+        result &= TestMeshFile( contents, format, names, triangles );
+
+        return result;
+    }
+
+    bool TestMeshes()
+    {
+        bool result = true;
+        result &= TestMeshRoundTrip( "test_formats_ptn.ae3d", VertexFormat::PTN );
+        result &= TestMeshRoundTrip( "test_formats_ptntc.ae3d", VertexFormat::PTNTC );
+        result &= TestMeshRoundTrip( "test_formats_quantized.ae3d", VertexFormat::PTNTC_Quantized );
+        return result;
+    }
+
+    /// Adds a sphere of rings * segments quads with outward-facing faces to the converters' gMeshes.
+    void AddSphereMesh( const char* name, int rings, int segments )
+    {
+        gMeshes.push_back( ::Mesh() );
+        ::Mesh& mesh = gMeshes.back();
+        mesh.name = name;
+
+        const float pi = 3.14159265f;
+
+        for (int r = 0; r <= rings; ++r)
+        {
+            for (int s = 0; s <= segments; ++s)
+            {
+                const float theta = pi * r / rings;
+                const float phi = 2 * pi * s / segments;
+                const Vec3 position( std::sin( theta ) * std::cos( phi ), std::cos( theta ), std::sin( theta ) * std::sin( phi ) );
+                mesh.vertex.push_back( position );
+                mesh.vnormal.push_back( position );
+                mesh.tcoord.push_back( TexCoord( s / (float)segments, r / (float)rings ) );
+            }
+        }
+
+        for (int r = 0; r < rings; ++r)
+        {
+            for (int s = 0; s < segments; ++s)
+            {
+                const unsigned i0 = (unsigned)(r * (segments + 1) + s);
+                const unsigned i1 = i0 + (unsigned)segments + 1;
+                const unsigned quad[ 2 ][ 3 ] = { { i0, i1, i0 + 1 }, { i0 + 1, i1, i1 + 1 } };
+
+                for (int f = 0; f < 2; ++f)
+                {
+                    const Vec3& a = mesh.vertex[ quad[ f ][ 0 ] ];
+                    const Vec3 normal = Vec3::Cross( mesh.vertex[ quad[ f ][ 1 ] ] - a, mesh.vertex[ quad[ f ][ 2 ] ] - a );
+
+                    // Quads at the poles have one degenerate face.
+                    if (normal.Length() < 1e-6f)
+                    {
+                        continue;
+                    }
+
+                    const bool isFlipped = Vec3::Dot( normal, a ) < 0;
+                    Face face;
+
+                    for (int v = 0; v < 3; ++v)
+                    {
+                        const unsigned index = quad[ f ][ (isFlipped && v > 0) ? 3 - v : v ];
+                        face.vInd[ v ] = face.vnInd[ v ] = face.uvInd[ v ] = index;
+                    }
+
+                    mesh.face.push_back( face );
+                }
+            }
+        }
+    }
+
+    /// Writes a mesh that has more faces than a meshlet can hold but fewer vertices, so its meshlets are limited by their face count.
+    bool TestMeshletFaceLimit()
+    {
+        const char* path = "test_formats_dense.ae3d";
+        gMeshes.clear();
+        gMeshes.push_back( ::Mesh() );
+        ::Mesh& mesh = gMeshes.back();
+        mesh.name = "dense";
+
+        const unsigned vertexCount = 20;
+
+        for (unsigned v = 0; v < vertexCount; ++v)
+        {
+            // A helix, so no 3 vertices are on the same line.
+            mesh.vertex.push_back( Vec3( std::cos( (float)v ), 0.3f * v, std::sin( (float)v ) ) );
+            mesh.vnormal.push_back( Vec3( 0, 1, 0 ) );
+            mesh.tcoord.push_back( TexCoord( v / (float)vertexCount, (float)(v % 2) ) );
+        }
+
+        // Each vertex makes faces with its next vertex and 8 others after them. WriteAe3d() splits the vertices into 60, which still fit in a meshlet.
+        for (unsigned v = 0; v < vertexCount; ++v)
+        {
+            for (unsigned step = 2; step < 10; ++step)
+            {
+                const unsigned indices[ 3 ] = { v, (v + 1) % vertexCount, (v + step) % vertexCount };
+                Face face;
+
+                for (int i = 0; i < 3; ++i)
+                {
+                    face.vInd[ i ] = face.vnInd[ i ] = face.uvInd[ i ] = indices[ i ];
+                }
+
+                mesh.face.push_back( face );
+            }
+        }
+
+        WriteAe3d( path, VertexFormat::PTN );
+        const FileSystem::FileContentsData contents = FileSystem::FileContents( path );
+        std::remove( path );
+
+        return contents.isLoaded && TestMeshlets( path, contents.data );
+    }
+
+    /**
+     Culls the meshlets of a sphere like MeshRendererComponent::Cull() does and checks that meshlets that have visible faces are kept.
+     A face is visible if one of its vertices is in the frustum and it faces the camera after the sphere is transformed to world space.
+     */
+    bool TestMeshletCulling()
+    {
+        const char* path = "test_formats_culling.ae3d";
+        gMeshes.clear();
+        AddSphereMesh( "sphere", 24, 48 );
+        WriteAe3d( path, VertexFormat::PTN );
+        const FileSystem::FileContentsData contents = FileSystem::FileContents( path );
+        std::remove( path );
+
+        if (!contents.isLoaded || !TestMeshlets( path, contents.data ))
+        {
+            return false;
+        }
+
+        const ::Mesh& mesh = gMeshes[ 0 ];
+        const Vec3 eye( 0, 0, -6 );
+        Frustum frustum;
+        frustum.SetProjection( 45, 16.0f / 9.0f, 1, 100 );
+        // Looks towards +z. Update() takes the view matrix's z axis like Scene passes it, which points away from the view.
+        frustum.Update( eye, Vec3( 0, 0, -1 ) );
+
+        struct Transform
+        {
+            const char* name;
+            Vec3 scale;
+            bool isUniform;
+        };
+
+        // Off-center, so the sphere is only partly in the frustum.
+        const Transform transforms[] = { { "uniform", Vec3( 2, 2, 2 ), true }, { "non-uniform", Vec3( 4, 0.25f, 1.5f ), false }, { "flattened", Vec3( 3, 3, 0.1f ), false } };
+        bool result = true;
+
+        for (const Transform& transform : transforms)
+        {
+            Matrix44 localToWorld( 20, 35, 50 );
+            localToWorld.Scale( transform.scale.x, transform.scale.y, transform.scale.z );
+            localToWorld.Translate( Vec3( 2.5f, 0.5f, 0 ) );
+
+            if (localToWorld.HasUniformScale() != transform.isUniform)
+            {
+                std::cerr << "HasUniformScale() of the " << transform.name << " sphere is wrong!" << std::endl;
+                result = false;
+                continue;
+            }
+
+            Frustum localFrustum;
+            frustum.GetLocalFrustum( localToWorld, localFrustum );
+            int coneCulledCount = 0;
+
+            for (const MeshFormat::MeshletEntry& meshlet : mesh.meshlets)
+            {
+                const Vec3 aabbMin( meshlet.aabbMin[ 0 ], meshlet.aabbMin[ 1 ], meshlet.aabbMin[ 2 ] );
+                const Vec3 aabbMax( meshlet.aabbMax[ 0 ], meshlet.aabbMax[ 1 ], meshlet.aabbMax[ 2 ] );
+                const Vec3 center = (aabbMin + aabbMax) * 0.5f;
+                const float radius = (aabbMax - aabbMin).Length() * 0.5f;
+                const Vec3 coneAxis( meshlet.coneAxis[ 0 ], meshlet.coneAxis[ 1 ], meshlet.coneAxis[ 2 ] );
+
+                const bool isConeCulled = localToWorld.HasUniformScale() && localFrustum.ConeFacesAway( center, radius, coneAxis, meshlet.coneCutoff );
+                const bool isCulled = !localFrustum.BoxInFrustum( aabbMin, aabbMax ) || isConeCulled;
+                coneCulledCount += isConeCulled ? 1 : 0;
+
+                for (std::uint32_t f = meshlet.firstFace; f < meshlet.firstFace + meshlet.faceCount && isCulled; ++f)
+                {
+                    const unsigned indices[ 3 ] = { mesh.indices[ f ].a, mesh.indices[ f ].b, mesh.indices[ f ].c };
+                    Vec3 positions[ 3 ];
+                    bool isInFrustum = false;
+
+                    for (int v = 0; v < 3; ++v)
+                    {
+                        Matrix44::TransformPoint( mesh.interleavedVertices[ indices[ v ] ].position, localToWorld, &positions[ v ] );
+                        isInFrustum |= frustum.BoxInFrustum( positions[ v ], positions[ v ] );
+                    }
+
+                    const Vec3 normal = Vec3::Cross( positions[ 1 ] - positions[ 0 ], positions[ 2 ] - positions[ 0 ] ).Normalized();
+                    // Faces seen almost edge-on can be on either side because of rounding.
+                    const bool isFacingCamera = Vec3::Dot( normal, (positions[ 0 ] - eye).Normalized() ) < -0.001f;
+
+                    if (isInFrustum && isFacingCamera)
+                    {
+                        std::cerr << "Meshlet culling of the " << transform.name << " sphere culled visible face " << f << "!" << std::endl;
+                        result = false;
+                        break;
+                    }
+                }
+            }
+
+            // Otherwise the test would pass without testing cones.
+            if (transform.isUniform && coneCulledCount == 0)
+            {
+                std::cerr << "Meshlet culling of the " << transform.name << " sphere didn't cull back faces!" << std::endl;
+                result = false;
+            }
+        }
+
+        return result;
+    }
+
+    /// \return half-float h as a float.
+    float HalfToFloat( std::uint16_t h )
+    {
+        const float sign = (h & 0x8000) ? -1.0f : 1.0f;
+        const int exponent = (h >> 10) & 0x1F;
+        const int mantissa = h & 0x3FF;
+
+        if (exponent == 0)
+        {
+            return sign * std::ldexp( (float)mantissa, -24 );
+        }
+
+        if (exponent == 31)
+        {
+            return mantissa == 0 ? sign * std::numeric_limits< float >::infinity() : std::numeric_limits< float >::quiet_NaN();
+        }
+
+        return sign * std::ldexp( (float)(mantissa | 0x400), exponent - 25 );
+    }
+
+    /// \return e decoded like DecodeOctahedral() in the shaders.
+    Vec3 DecodeOctahedral( const std::int16_t e[ 2 ] )
+    {
+        Vec3 v( std::max( e[ 0 ] / 32767.0f, -1.0f ), std::max( e[ 1 ] / 32767.0f, -1.0f ), 0 );
+        v.z = 1.0f - std::fabs( v.x ) - std::fabs( v.y );
+
+        if (v.z < 0)
+        {
+            const float x = v.x;
+            v.x = (1.0f - std::fabs( v.y )) * (x >= 0 ? 1.0f : -1.0f);
+            v.y = (1.0f - std::fabs( x )) * (v.y >= 0 ? 1.0f : -1.0f);
+        }
+
+        return v.Normalized();
+    }
+
+    bool TestQuantization()
+    {
+        bool result = true;
+        std::uint32_t seed = 11;
+
+        for (int i = 0; i < 100000; ++i)
+        {
+            const float f = (NextRandom( seed ) % 2000001) / 1000000.0f - 1.0f;
+
+            if (std::fabs( QuantizeSnorm16( f ) / 32767.0f - f ) > 0.5f / 32767.0f + 1e-7f)
+            {
+                std::cerr << "QuantizeSnorm16( " << f << " ) is off by more than half a step!" << std::endl;
+                result = false;
+                break;
+            }
+        }
+
+        if (QuantizeSnorm16( 1.5f ) != 32767 || QuantizeSnorm16( -1.5f ) != -32767 || QuantizeSnorm16( 0 ) != 0)
+        {
+            std::cerr << "QuantizeSnorm16 doesn't clamp to -1..1!" << std::endl;
+            result = false;
+        }
+
+        if (QuantizeUnorm8( 0.5f ) != 128 || QuantizeUnorm8( 2 ) != 255 || QuantizeUnorm8( -1 ) != 0)
+        {
+            std::cerr << "QuantizeUnorm8 doesn't round or clamp to 0..1!" << std::endl;
+            result = false;
+        }
+
+        // Normal half-floats have 11 significant bits, so rounding is off by at most 2^-11 relative.
+        for (int i = 0; i < 100000; ++i)
+        {
+            const float f = std::ldexp( 1.0f + (NextRandom( seed ) % 1000000) / 1000000.0f, (int)(NextRandom( seed ) % 30) - 14 ) * ((i % 2) ? -1.0f : 1.0f);
+
+            if (std::fabs( f ) > 65504.0f)
+            {
+                continue;
+            }
+
+            if (std::fabs( HalfToFloat( FloatToHalf( f ) ) - f ) > std::fabs( f ) * std::ldexp( 1.0f, -11 ))
+            {
+                std::cerr << "FloatToHalf( " << f << " ) is off by more than half a step!" << std::endl;
+                result = false;
+                break;
+            }
+        }
+
+        const float exactValues[] = { 0.0f, 1.0f, -1.0f, 0.5f, 0.25f, 2048.0f, 65504.0f };
+
+        for (float f : exactValues)
+        {
+            if (HalfToFloat( FloatToHalf( f ) ) != f)
+            {
+                std::cerr << "FloatToHalf( " << f << " ) is not exact!" << std::endl;
+                result = false;
+            }
+        }
+
+        if (FloatToHalf( 1e-8f ) != 0 || FloatToHalf( 1e6f ) != 0x7C00 || FloatToHalf( -1e6f ) != 0xFC00)
+        {
+            std::cerr << "FloatToHalf doesn't flush tiny values to zero or overflow to infinity!" << std::endl;
+            result = false;
+        }
+
+        // 16-bit octahedral vectors are within about 0.005 degrees of the encoded vector.
+        const float maxSinError = 1e-4f;
+        std::vector< Vec3 > directions = { Vec3( 1, 0, 0 ), Vec3( -1, 0, 0 ), Vec3( 0, 1, 0 ), Vec3( 0, -1, 0 ), Vec3( 0, 0, 1 ), Vec3( 0, 0, -1 ),
+                                           Vec3( 1, 1, 1 ).Normalized(), Vec3( -1, -1, -1 ).Normalized(), Vec3( 1, -1, -1 ).Normalized() };
+
+        while (directions.size() < 100000)
+        {
+            const Vec3 v( (NextRandom( seed ) % 2001) / 1000.0f - 1.0f, (NextRandom( seed ) % 2001) / 1000.0f - 1.0f, (NextRandom( seed ) % 2001) / 1000.0f - 1.0f );
+
+            if (v.Length() > 0.01f)
+            {
+                directions.push_back( v.Normalized() );
+            }
+        }
+
+        for (const Vec3& direction : directions)
+        {
+            std::int16_t encoded[ 2 ];
+            EncodeOctahedral( direction, encoded );
+            const Vec3 decoded = DecodeOctahedral( encoded );
+
+            if (Vec3::Cross( direction, decoded ).Length() > maxSinError || Vec3::Dot( direction, decoded ) < 0)
+            {
+                std::cerr << "EncodeOctahedral( " << direction.x << ", " << direction.y << ", " << direction.z << " ) decodes to "
+                          << decoded.x << ", " << decoded.y << ", " << decoded.z << "!" << std::endl;
+                result = false;
+                break;
+            }
+        }
+
+        return result;
+    }
+}
+
+int main()
+{
+    bool result = true;
+
+    result &= TestLz4();
+    result &= TestPak();
+    result &= TestMeshes();
+    result &= TestMeshletFaceLimit();
+    result &= TestMeshletCulling();
+    result &= TestQuantization();
+
+    std::cout << (result ? "File format tests passed." : "File format tests failed!") << std::endl;
+    return result ? 0 : 1;
+}
@@ -22,7 +22,7 @@ namespace GfxDeviceGlobal
     extern ID3D12DescriptorHeap* computeCbvSrvUavHeaps[ 3 ];
     extern D3D12_UNORDERED_ACCESS_VIEW_DESC uav1Desc;
     extern ID3D12PipelineState* cachedPSO;
-	extern PerObjectUboStruct perObjectUboStruct;
+	extern thread_local PerObjectUboStruct perObjectUboStruct;
     extern ID3D12Resource* uav1;
 }
 
@@ -57,8 +57,8 @@ void ae3d::ComputeShader::SetUniform( UniformName uniform, float x, float y )
 {
     if( uniform == UniformName::TilesZW )
     {
-        GfxDeviceGlobal::perObjectUboStruct.tilesXY.z = x;
-        GfxDeviceGlobal::perObjectUboStruct.tilesXY.w = y;
+        GfxDevice::EditPassUniforms().tilesXY.z = x;
+        GfxDevice::EditPassUniforms().tilesXY.w = y;
     }
 }
 
@@ -9,6 +9,7 @@
 #include <string>
 #include <sstream>
 #include <cmath>
+#include <cstdio>
 #include "ComputeShader.hpp"
 #include "DescriptorHeapManager.hpp"
 #include "Macros.hpp"
@@ -45,21 +46,22 @@ namespace ae3d
     {
         namespace Statistics
         {
-            void GetStatistics( char* outStr )
+            void GetStatistics( char* outStr, std::size_t outStrSize )
             {
                 std::stringstream stm;
                 stm << "frame time: " << ::Statistics::GetFrameTimeMS() << "ms\n";
+                stm << ::Statistics::GetFrameTimeSummary();
                 stm << "shadow pass time CPU: " << ::Statistics::GetShadowMapTimeMS() << "ms\n";
-                stm << "shadow pass time GPU: " << ::Statistics::GetShadowMapTimeGpuMS() << "ms\n";
+                stm << "shadow pass time GPU: " << ::Statistics::GetGpuScopeTimeMS( ::Statistics::ShadowMapsScopeName ) << "ms\n";
                 stm << "depth pass time CPU: " << ::Statistics::GetDepthNormalsTimeMS() << "ms\n";
-                stm << "depth pass time GPU: " << ::Statistics::GetDepthNormalsTimeGpuMS() << "ms\n";
-                stm << "light culler time GPU: " << ::Statistics::GetLightCullerTimeGpuMS() << "ms\n";
+                stm << "depth pass time GPU: " << ::Statistics::GetGpuScopeTimeMS( ::Statistics::DepthNormalsScopeName ) << "ms\n";
                 stm << "draw calls: " << ::Statistics::GetDrawCalls() << "\n";
                 stm << "barrier calls: " << ::Statistics::GetBarrierCalls() << "\n";
                 stm << "triangles: " << ::Statistics::GetTriangleCount() << "\n";
                 stm << "PSO binds: " << ::Statistics::GetPSOBindCalls() << "\n";
+                stm << "uniform upload: " << ::Statistics::GetUniformUploadBytes() / 1024 << " KiB\n";
 
-				std::strcpy( outStr, stm.str().c_str() );
+                std::snprintf( outStr, outStrSize, "%s", stm.str().c_str() );
 	    }
         }
     }
@@ -97,35 +99,25 @@ int GetSamplerIndexByAnisotropy( ae3d::Anisotropy anisotropy )
     return SamplerIndexByAnisotropy::One;
 }
 
-struct ProfileData
+/// Timestamps of a GfxDevice::PushGroupMarker() scope.
+struct GpuProfilerScope
 {
-    const char* name = nullptr;
-    std::uint64_t startTime = 0;
-    std::uint64_t endTime = 0;
-    bool isActive = false;
-    bool queryStarted = false;
-    bool queryEnded = false;
-    static const std::uint64_t filterSize = 64;
-    double timeSamples[ filterSize ] = {};
-    std::uint64_t currSample = 0;
+    std::string name;
+    int depth = 0;
+    bool isEnded = false;
 };
 
+/// GPU profiler for group marker scopes. Present() waits for the GPU, so the scopes of the presented frame are read back there.
 struct TimerQuery
 {
-    static const int MaxNumTimers = 64;
-    static const int RenderLatency = 2;
-
-    std::uint64_t Start( const char* name );
-    void End( std::uint64_t index );
-    void UpdateProfile( std::uint64_t index, std::uint64_t* queryData );
+    static const int MaxScopes = 128;
 
     ID3D12QueryHeap* queryHeap = nullptr;
     ID3D12Resource* queryBuffer = nullptr;
-    ProfileData profiles[ MaxNumTimers ];
-    int profileCount = 0;
-    std::uint64_t depthNormalsProfilerIndex = 0;
-    std::uint64_t shadowMapProfilerIndex = 0;
-    std::uint64_t lightCullerProfilerIndex = 0;
+    /// Scopes of the frame being recorded. Scope i uses timestamps i * 2 and i * 2 + 1.
+    std::vector< GpuProfilerScope > scopes;
+    /// Indices of the open scopes, -1 for scopes that did not fit into MaxScopes.
+    std::vector< int > scopeStack;
     std::uint64_t frequency = 0;
 };
 
@@ -197,7 +189,10 @@ namespace GfxDeviceGlobal
     D3D12_CPU_DESCRIPTOR_HANDLE msaaDepthHandle = {};
     ID3D12DescriptorHeap* computeCbvSrvUavHeaps[ 3 ] = {};
     TimerQuery timerQuery;
-    PerObjectUboStruct perObjectUboStruct;
+    thread_local PerObjectUboStruct perObjectUboStruct;
+    const ae3d::Matrix44* bonePalette = nullptr;
+    int bonePaletteCount = 0;
+    bool isBoneLimitWarned = false;
     ae3d::VertexBuffer uiVertexBuffer;
     std::vector< ae3d::VertexBuffer::VertexPTC > uiVertices( 512 * 1024 );
     std::vector< ae3d::VertexBuffer::Face > uiFaces( 512 * 1024 );
@@ -209,107 +204,42 @@ void ClearPSOCache()
     GfxDeviceGlobal::psoCache.clear();
 }
 
-std::uint64_t TimerQuery::Start( const char* name )
-{
-    std::uint64_t index = (std::uint64_t)-1;
-
-    for (std::uint64_t i = 0; i < MaxNumTimers; ++i)
-    {
-        if (profiles[ i ].name == name)
-        {
-            index = i;
-            break;
-        }
-    }
-
-    if (index == (std::uint64_t)-1)
-    {
-        ae3d::System::Assert( profileCount < MaxNumTimers, "Too many profiles" );
-        index = profileCount++;
-        profiles[ index ].name = name;
-    }
-
-    auto& profileData = profiles[ index ];
-    //ae3d::System::Assert( !profileData.queryStarted, "Query must not be started" );
-    //ae3d::System::Assert( !profileData.queryEnded, "Query must not be ended" );
-	if( profileData.queryStarted )
-	{
-		return 0;
-	}
-	if( profileData.queryEnded )
-	{
-		return 0;
-	}
-
-    profileData.isActive = true;
-    const UINT startQueryIndex = UINT( index * 2 );
-    GfxDeviceGlobal::graphicsCommandList->EndQuery( GfxDeviceGlobal::timerQuery.queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, startQueryIndex );
-    profileData.queryStarted = true;
-
-    return index;
-}
-
-void TimerQuery::End( std::uint64_t index )
+namespace ae3d
 {
-    ae3d::System::Assert( index < MaxNumTimers, "Too high profiler index" );
-    
-    auto& profileData = profiles[ index ];
-    //ae3d::System::Assert( profileData.queryStarted, "Query must be started" );
-    //ae3d::System::Assert( !profileData.queryEnded, "Query must not be ended" );
-	if( !profileData.queryStarted )
-	{
-		return;
-	}
-	if( profileData.queryEnded )
-	{
-		return;
-	}
-
-    const UINT startQueryIdx = UINT( index * 2 );
-    const UINT endQueryIdx = startQueryIdx + 1;
-    GfxDeviceGlobal::graphicsCommandList->EndQuery( queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, endQueryIdx );
-
-    const std::uint64_t dstOffset = (((GfxDeviceGlobal::frameIndex % GfxDeviceGlobal::timerQuery.RenderLatency) * MaxNumTimers * 2) + startQueryIdx) * sizeof( std::uint64_t );
-    GfxDeviceGlobal::graphicsCommandList->ResolveQueryData( queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, startQueryIdx, 2, GfxDeviceGlobal::timerQuery.queryBuffer, dstOffset );
-
-    profileData.queryStarted = false;
-    profileData.queryEnded = true;
+    void CreateRenderer( int samples );
 }
 
-void TimerQuery::UpdateProfile( std::uint64_t index, std::uint64_t* queryData )
+void UploadPerObjectUbo()
 {
-    ae3d::System::Assert( index < MaxNumTimers, "Too high query index" );
+    char* mapped = (char*)ae3d::GfxDevice::GetCurrentMappedConstantBuffer();
+    memcpy_s( mapped, AE3D_CB_SIZE, &GfxDeviceGlobal::perObjectUboStruct, sizeof( GfxDeviceGlobal::perObjectUboStruct ) );
+    int uploadBytes = sizeof( GfxDeviceGlobal::perObjectUboStruct );
 
-    profiles[ index ].queryEnded = false;
-    double time = 0;
+    // HLSL indexes bones relative to the draw on D3D12, so copy the draw's window of the palette.
+    const int boneOffset = GfxDeviceGlobal::perObjectUboStruct.boneOffset;
+    int boneCount = GfxDeviceGlobal::perObjectUboStruct.boneCount;
 
-    if ( queryData )
+    if (boneCount > MaxBonesInUbo)
     {
-        std::uint64_t startTime = queryData[ index * 2 + 0 ];
-        std::uint64_t endTime = queryData[ index * 2 + 1 ];
-
-        if (endTime > startTime)
+        if (!GfxDeviceGlobal::isBoneLimitWarned)
         {
-            const std::uint64_t delta = endTime - startTime;
-            double freq = double( frequency );
-            time = (delta / freq) * 1000.0;
+            ae3d::System::Print( "Skinned mesh has %d bones but D3D12 supports %d, it will not render correctly.\n", boneCount, MaxBonesInUbo );
+            GfxDeviceGlobal::isBoneLimitWarned = true;
         }
-    }
 
-    profiles[ index ].timeSamples[ profiles[ index ].currSample ] = time;
-    profiles[ index ].currSample = (profiles[ index ].currSample + 1) % ProfileData::filterSize;
+        boneCount = MaxBonesInUbo;
+    }
 
-    profiles[ index ].isActive = false;
-}
+    boneCount = boneCount < GfxDeviceGlobal::bonePaletteCount - boneOffset ? boneCount : GfxDeviceGlobal::bonePaletteCount - boneOffset;
 
-namespace ae3d
-{
-    void CreateRenderer( int samples );
-}
+    if (GfxDeviceGlobal::bonePalette != nullptr && boneCount > 0)
+    {
+        memcpy_s( mapped + sizeof( GfxDeviceGlobal::perObjectUboStruct ), AE3D_CB_SIZE - sizeof( GfxDeviceGlobal::perObjectUboStruct ),
+                  GfxDeviceGlobal::bonePalette + boneOffset, boneCount * sizeof( ae3d::Matrix44 ) );
+        uploadBytes += boneCount * sizeof( ae3d::Matrix44 );
+    }
 
-void UploadPerObjectUbo()
-{
-    memcpy_s( (char*)ae3d::GfxDevice::GetCurrentMappedConstantBuffer(), AE3D_CB_SIZE, &GfxDeviceGlobal::perObjectUboStruct, sizeof( GfxDeviceGlobal::perObjectUboStruct ) );
+    Statistics::IncUniformUploadBytes( uploadBytes );
 }
 
 void WaitForPreviousFrame()
@@ -364,7 +294,7 @@ void CreateTimerQuery()
     D3D12_RESOURCE_DESC bufferDesc;
     bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
     bufferDesc.Alignment = 0;
-    bufferDesc.Width = sizeof( std::uint64_t ) * GfxDeviceGlobal::timerQuery.MaxNumTimers * 2 * GfxDeviceGlobal::timerQuery.RenderLatency;
+    bufferDesc.Width = sizeof( std::uint64_t ) * TimerQuery::MaxScopes * 2;
     bufferDesc.Height = 1;
     bufferDesc.DepthOrArraySize = 1;
     bufferDesc.MipLevels = 1;
@@ -381,7 +311,7 @@ void CreateTimerQuery()
     GfxDeviceGlobal::timerQuery.queryBuffer->SetName( L"Query Buffer" );
 
     D3D12_QUERY_HEAP_DESC QueryHeapDesc;
-    QueryHeapDesc.Count = GfxDeviceGlobal::timerQuery.MaxNumTimers * 2;
+    QueryHeapDesc.Count = TimerQuery::MaxScopes * 2;
     QueryHeapDesc.NodeMask = 0;
     QueryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
     hr = GfxDeviceGlobal::device->CreateQueryHeap( &QueryHeapDesc, IID_PPV_ARGS( &GfxDeviceGlobal::timerQuery.queryHeap ) );
@@ -726,6 +656,15 @@ void CreatePSO( ae3d::VertexBuffer::VertexFormat vertexFormat, ae3d::Shader& sha
         { "BONES", 0, DXGI_FORMAT_R32G32B32A32_UINT, 0, 80, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
     };
 
+    D3D12_INPUT_ELEMENT_DESC layoutPTNTC_Quantized[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
+
     UINT numElements = 0;
     D3D12_INPUT_ELEMENT_DESC* layout = nullptr;
     if (vertexFormat == ae3d::VertexBuffer::VertexFormat::PTC)
@@ -748,6 +687,11 @@ void CreatePSO( ae3d::VertexBuffer::VertexFormat vertexFormat, ae3d::Shader& sha
         layout = layoutPTNTC_Skinned;
         numElements = 7;
     }
+    else if (vertexFormat == ae3d::VertexBuffer::VertexFormat::PTNTC_Quantized)
+    {
+        layout = layoutPTNTC_Quantized;
+        numElements = 5;
+    }
     else
     {
         ae3d::System::Assert( false, "unhandled vertex format" );
@@ -1077,51 +1021,23 @@ void ae3d::GfxDevice::UnmapUIVertexBuffer()
     GfxDeviceGlobal::uiVertexBuffer.Generate( GfxDeviceGlobal::uiFaces.data(), int( GfxDeviceGlobal::uiFaces.size() ), GfxDeviceGlobal::uiVertices.data(), int( GfxDeviceGlobal::uiVertices.size() ), VertexBuffer::Storage::CPU );
 }
 
-void ae3d::GfxDevice::BeginDepthNormalsGpuQuery()
-{
-    GfxDeviceGlobal::timerQuery.depthNormalsProfilerIndex = GfxDeviceGlobal::timerQuery.Start( "DepthNormals" );
-}
-
-void ae3d::GfxDevice::EndDepthNormalsGpuQuery()
-{
-    GfxDeviceGlobal::timerQuery.End( GfxDeviceGlobal::timerQuery.depthNormalsProfilerIndex );
-    const float timeMS = (float)GfxDeviceGlobal::timerQuery.profiles[ GfxDeviceGlobal::timerQuery.depthNormalsProfilerIndex ].timeSamples[ GfxDeviceGlobal::timerQuery.profiles[ GfxDeviceGlobal::timerQuery.depthNormalsProfilerIndex ].currSample ];
-
-    Statistics::SetDepthNormalsGpuTime( timeMS );
-}
-
-void ae3d::GfxDevice::BeginLightCullerGpuQuery()
-{
-    GfxDeviceGlobal::timerQuery.lightCullerProfilerIndex = GfxDeviceGlobal::timerQuery.Start( "LightCuller" );
-}
-
-void ae3d::GfxDevice::EndLightCullerGpuQuery()
+void ae3d::GfxDevice::SetPolygonOffset( bool enable, float, float )
 {
-    GfxDeviceGlobal::timerQuery.End( GfxDeviceGlobal::timerQuery.lightCullerProfilerIndex );
-    const float timeMS = (float)GfxDeviceGlobal::timerQuery.profiles[ GfxDeviceGlobal::timerQuery.lightCullerProfilerIndex ].timeSamples[ GfxDeviceGlobal::timerQuery.profiles[ GfxDeviceGlobal::timerQuery.lightCullerProfilerIndex ].currSample ];
-
-    Statistics::SetLightCullerTimeGpuMS( timeMS );
+    if (enable)
+    {
+        ae3d::System::Print( "SetPolygonOffset is unimplemented on D3D12 renderer\n" );
+    }
 }
 
-void ae3d::GfxDevice::BeginShadowMapGpuQuery()
+void ae3d::GfxDevice::SetBonePalette( const Matrix44* matrices, int count )
 {
-    GfxDeviceGlobal::timerQuery.shadowMapProfilerIndex = GfxDeviceGlobal::timerQuery.Start( "ShadowMaps" );
+    GfxDeviceGlobal::bonePalette = matrices;
+    GfxDeviceGlobal::bonePaletteCount = count;
 }
 
-void ae3d::GfxDevice::EndShadowMapGpuQuery()
+PerObjectUboStruct& ae3d::GfxDevice::EditPassUniforms()
 {
-    GfxDeviceGlobal::timerQuery.End( GfxDeviceGlobal::timerQuery.shadowMapProfilerIndex );
-    const float timeMS = (float)GfxDeviceGlobal::timerQuery.profiles[ GfxDeviceGlobal::timerQuery.shadowMapProfilerIndex ].timeSamples[ GfxDeviceGlobal::timerQuery.profiles[ GfxDeviceGlobal::timerQuery.shadowMapProfilerIndex ].currSample ];
-
-    Statistics::SetShadowMapGpuTime( timeMS );
-}
-
-void ae3d::GfxDevice::SetPolygonOffset( bool enable, float, float )
-{
-    if (enable)
-    {
-        ae3d::System::Print( "SetPolygonOffset is unimplemented on D3D12 renderer\n" );
-    }
+    return GfxDeviceGlobal::perObjectUboStruct;
 }
 
 void ae3d::GfxDevice::GetNewUniformBuffer()
@@ -1142,11 +1058,45 @@ void* ae3d::GfxDevice::GetCurrentConstantBuffer()
 void ae3d::GfxDevice::PushGroupMarker( const char* name )
 {
 	PIXBeginEvent( GfxDeviceGlobal::graphicsCommandList, 0, name );
+
+    TimerQuery& timerQuery = GfxDeviceGlobal::timerQuery;
+
+    if (timerQuery.scopes.size() < TimerQuery::MaxScopes)
+    {
+        timerQuery.scopeStack.push_back( (int)timerQuery.scopes.size() );
+        GfxDeviceGlobal::graphicsCommandList->EndQuery( timerQuery.queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, (UINT)timerQuery.scopes.size() * 2 );
+
+        timerQuery.scopes.push_back( GpuProfilerScope() );
+        timerQuery.scopes.back().name = name;
+        timerQuery.scopes.back().depth = (int)timerQuery.scopeStack.size() - 1;
+    }
+    else
+    {
+        timerQuery.scopeStack.push_back( -1 );
+    }
 }
 
 void ae3d::GfxDevice::PopGroupMarker()
 {
 	PIXEndEvent( GfxDeviceGlobal::graphicsCommandList );
+
+    TimerQuery& timerQuery = GfxDeviceGlobal::timerQuery;
+
+    if (timerQuery.scopeStack.empty())
+    {
+        return;
+    }
+
+    const int scopeIndex = timerQuery.scopeStack.back();
+    timerQuery.scopeStack.pop_back();
+
+    if (scopeIndex >= 0)
+    {
+        const UINT beginQuery = (UINT)scopeIndex * 2;
+        GfxDeviceGlobal::graphicsCommandList->EndQuery( timerQuery.queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, beginQuery + 1 );
+        GfxDeviceGlobal::graphicsCommandList->ResolveQueryData( timerQuery.queryHeap, D3D12_QUERY_TYPE_TIMESTAMP, beginQuery, 2, timerQuery.queryBuffer, beginQuery * sizeof( std::uint64_t ) );
+        timerQuery.scopes[ scopeIndex ].isEnded = true;
+    }
 }
 
 void ae3d::GfxDevice::DrawLines( int handle, Shader& shader )
@@ -1159,7 +1109,7 @@ void ae3d::GfxDevice::DrawLines( int handle, Shader& shader )
     Draw( GfxDeviceGlobal::lineBuffers[ handle ], 0, GfxDeviceGlobal::lineBuffers[ handle ].GetFaceCount(), shader, BlendMode::Off, DepthFunc::NoneWriteOff, CullMode::Off, FillMode::Solid, GfxDevice::PrimitiveTopology::Lines );
 }
 
-void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startFace, int endFace, Shader& shader, BlendMode blendMode, DepthFunc depthFunc,
+void ae3d::GfxDevice::Draw( const VertexBuffer& vertexBuffer, int startFace, int endFace, Shader& shader, BlendMode blendMode, DepthFunc depthFunc,
                             CullMode cullMode, FillMode fillMode, PrimitiveTopology topology )
 {
     DXGI_FORMAT rtvFormat = GfxDeviceGlobal::currentRenderTarget ? GfxDeviceGlobal::currentRenderTarget->GetDXGIFormat() : DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
@@ -1234,10 +1184,11 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startFace, int endFa
         const unsigned activeSpotLights = GfxDeviceGlobal::lightTiler.GetSpotLightCount();
         const unsigned numLights = ((activeSpotLights & 0xFFFFu) << 16) | (activePointLights & 0xFFFFu);
 
-        GfxDeviceGlobal::perObjectUboStruct.windowWidth = GfxDeviceGlobal::backBufferWidth;
-        GfxDeviceGlobal::perObjectUboStruct.windowHeight = GfxDeviceGlobal::backBufferHeight;
-        GfxDeviceGlobal::perObjectUboStruct.numLights = numLights;
-        GfxDeviceGlobal::perObjectUboStruct.maxNumLightsPerTile = GfxDeviceGlobal::lightTiler.GetMaxNumLightsPerTile();
+        PerObjectUboStruct& passUniforms = GfxDevice::EditPassUniforms();
+        passUniforms.windowWidth = GfxDeviceGlobal::backBufferWidth;
+        passUniforms.windowHeight = GfxDeviceGlobal::backBufferHeight;
+        passUniforms.numLights = numLights;
+        passUniforms.maxNumLightsPerTile = GfxDeviceGlobal::lightTiler.GetMaxNumLightsPerTile();
     }
     else
     {
@@ -1292,6 +1243,9 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startFace, int endFa
     GfxDeviceGlobal::graphicsCommandList->IASetIndexBuffer( topology == PrimitiveTopology::Lines ? nullptr : vertexBuffer.GetIndexView() );
     GfxDeviceGlobal::graphicsCommandList->IASetPrimitiveTopology( topology == PrimitiveTopology::Lines ? D3D_PRIMITIVE_TOPOLOGY_LINELIST : D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST );
 
+    GfxDeviceGlobal::perObjectUboStruct.positionScale = Vec4( vertexBuffer.GetPositionScale(), vertexBuffer.GetVertexFormat() == VertexBuffer::VertexFormat::PTNTC_Quantized ? 1.0f : 0.0f );
+    GfxDeviceGlobal::perObjectUboStruct.positionOffset = Vec4( vertexBuffer.GetPositionOffset(), 0 );
+
     UploadPerObjectUbo();
 
     if (topology == PrimitiveTopology::Triangles)
@@ -1520,6 +1474,7 @@ void ae3d::GfxDevice::Present()
     }
 
     WaitForPreviousFrame();
+    VertexBuffer::FreePendingBuffers();
 
     hr = GfxDeviceGlobal::commandListAllocator->Reset();
     AE3D_CHECK_D3D( hr, "commandListAllocator Reset" );
@@ -1531,23 +1486,34 @@ void ae3d::GfxDevice::Present()
     hr = GfxDeviceGlobal::commandQueue->GetTimestampFrequency( &GfxDeviceGlobal::timerQuery.frequency );
     AE3D_CHECK_D3D( hr, "Failed to get timer query frequency" );
 
+    TimerQuery& timerQuery = GfxDeviceGlobal::timerQuery;
     std::uint64_t* queryData = nullptr;
-    D3D12_RANGE range = { 0, GfxDeviceGlobal::timerQuery.MaxNumTimers };
-    hr = GfxDeviceGlobal::timerQuery.queryBuffer->Map( 0, &range, (void**)&queryData );
-    
-    if (FAILED( hr ))
+    const D3D12_RANGE range = { 0, timerQuery.scopes.size() * 2 * sizeof( std::uint64_t ) };
+    hr = timerQuery.queryBuffer->Map( 0, &range, (void**)&queryData );
+
+    if (SUCCEEDED( hr ))
     {
-        return;
-    }
+        const double msPerTick = 1000.0 / (double)timerQuery.frequency;
 
-    std::uint64_t* frameQueryData = queryData + ((GfxDeviceGlobal::frameIndex % 2) * GfxDeviceGlobal::timerQuery.MaxNumTimers * 2);
+        for (std::size_t i = 0; i < timerQuery.scopes.size(); ++i)
+        {
+            const std::uint64_t begin = queryData[ i * 2 ];
+            const std::uint64_t end = queryData[ i * 2 + 1 ];
 
-    for (std::uint64_t profileIdx = 0; profileIdx < GfxDeviceGlobal::timerQuery.profileCount; ++profileIdx)
-    {
-        GfxDeviceGlobal::timerQuery.UpdateProfile( profileIdx, frameQueryData );
+            if (timerQuery.scopes[ i ].isEnded && end >= begin)
+            {
+                Statistics::AddGpuScopeTime( timerQuery.scopes[ i ].name.c_str(), timerQuery.scopes[ i ].depth, (float)((end - begin) * msPerTick) );
+            }
+        }
+
+        Statistics::EndGpuScopeFrame();
+
+        const D3D12_RANGE writtenRange = { 0, 0 };
+        timerQuery.queryBuffer->Unmap( 0, &writtenRange );
     }
 
-    GfxDeviceGlobal::timerQuery.queryBuffer->Unmap( 0, nullptr );
+    timerQuery.scopes.clear();
+    timerQuery.scopeStack.clear();
 }
 
 void ae3d::GfxDevice::SetClearColor( float red, float green, float blue )
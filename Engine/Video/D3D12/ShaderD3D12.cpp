@@ -24,7 +24,7 @@ namespace GfxDeviceGlobal
     extern ae3d::TextureBase* texture0;
     extern ae3d::TextureBase* texture1;
     extern ae3d::TextureBase* textureCube;
-	extern PerObjectUboStruct perObjectUboStruct;
+	extern thread_local PerObjectUboStruct perObjectUboStruct;
     extern ae3d::RenderTexture* currentRenderTarget;
 }
 
@@ -1,6 +1,7 @@
 // This is an independent project of an individual developer. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "VertexBuffer.hpp"
+#include <algorithm>
 #include <vector>
 #include <d3d12.h>
 #include "GfxDevice.hpp"
@@ -18,19 +19,47 @@ namespace GfxDeviceGlobal
 namespace Global
 {
     std::vector< ID3D12Resource* > vbs;
+    std::vector< ID3D12Resource* > vbsToFreeAfterFrame;
 }
 
 void ae3d::VertexBuffer::DestroyBuffers()
 {
+    FreePendingBuffers();
+
     for (std::size_t i = 0; i < Global::vbs.size(); ++i)
     {
         AE3D_SAFE_RELEASE( Global::vbs[ i ] );
     }
 }
 
+void ae3d::VertexBuffer::FreePendingBuffers()
+{
+    for (std::size_t i = 0; i < Global::vbsToFreeAfterFrame.size(); ++i)
+    {
+        AE3D_SAFE_RELEASE( Global::vbsToFreeAfterFrame[ i ] );
+    }
+
+    Global::vbsToFreeAfterFrame.clear();
+}
+
+void ae3d::VertexBuffer::Release()
+{
+    if (vb != nullptr)
+    {
+        Global::vbs.erase( std::remove( std::begin( Global::vbs ), std::end( Global::vbs ), vb ), std::end( Global::vbs ) );
+        Global::vbsToFreeAfterFrame.push_back( vb );
+        vb = nullptr;
+    }
+
+    vertexBufferView = {};
+    indexBufferView = {};
+    mappedDynamic = nullptr;
+    elementCount = 0;
+}
+
 unsigned ae3d::VertexBuffer::GetIBSize() const
 {
-    return elementCount * 2;
+    return elementCount * GetIndexSize();
 }
 
 unsigned ae3d::VertexBuffer::GetStride() const
@@ -51,6 +80,10 @@ unsigned ae3d::VertexBuffer::GetStride() const
     {
         return sizeof( VertexPTNTC_Skinned );
     }
+    else if (vertexFormat == VertexFormat::PTNTC_Quantized)
+    {
+        return sizeof( VertexPTNTC_Quantized );
+    }
     else
     {
         System::Assert( false, "unhandled vertex format!" );
@@ -126,12 +159,13 @@ void ae3d::VertexBuffer::UploadVB( void* faces, void* vertices, unsigned ibSize
 
     indexBufferView.BufferLocation = vb->GetGPUVirtualAddress() + GetIBOffset();
     indexBufferView.SizeInBytes = GetIBSize();
-    indexBufferView.Format = DXGI_FORMAT_R16_UINT;
+    indexBufferView.Format = indexFormat == IndexFormat::UInt32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
 }
 
 void ae3d::VertexBuffer::GenerateDynamic( int faceCount, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC;
+    indexFormat = IndexFormat::UInt16;
     elementCount = faceCount * 3;
 
     const int ibSize = elementCount * 2;
@@ -216,6 +250,7 @@ void ae3d::VertexBuffer::UpdateDynamic( const Face* faces, int /*faceCount*/, co
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTC* vertices, int vertexCount, Storage /*storage*/ )
 {
     vertexFormat = VertexFormat::PTNTC;
+    indexFormat = IndexFormat::UInt16;
     elementCount = faceCount * 3;
 
     const int ibSize = elementCount * 2;
@@ -237,11 +272,56 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
 }
 
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTN* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTN* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount, const Vec3& aPositionScale, const Vec3& aPositionOffset )
+{
+    positionScale = aPositionScale;
+    positionOffset = aPositionOffset;
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount, const Vec3& aPositionScale, const Vec3& aPositionOffset )
+{
+    positionScale = aPositionScale;
+    positionOffset = aPositionOffset;
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTN* vertices, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC;
+    indexFormat = aIndexFormat;
     elementCount = faceCount * 3;
 
-    const int ibSize = elementCount * 2;
+    const int ibSize = elementCount * GetIndexSize();
     ibOffset = sizeof( VertexPTNTC ) * vertexCount;
 
     std::vector< VertexPTNTC > verticesPTNTC( vertexCount );
@@ -259,28 +339,42 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     UploadVB( (void*)faces, verticesPTNTC.data(), ibSize );
 }
 
-void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC* vertices, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC;
+    indexFormat = aIndexFormat;
     elementCount = faceCount * 3;
 
-    const int ibSize = elementCount * 2;
+    const int ibSize = elementCount * GetIndexSize();
     ibOffset = sizeof( VertexPTNTC ) * vertexCount;
 
     UploadVB( (void*)faces, (void*)vertices, ibSize );
 }
 
-void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC_Skinned;
+    indexFormat = aIndexFormat;
     elementCount = faceCount * 3;
 
-    const int ibSize = elementCount * 2;
+    const int ibSize = elementCount * GetIndexSize();
     ibOffset = sizeof( VertexPTNTC_Skinned ) * vertexCount;
 
     UploadVB( (void*)faces, (void*)vertices, ibSize );
 }
 
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount )
+{
+    vertexFormat = VertexFormat::PTNTC_Quantized;
+    indexFormat = aIndexFormat;
+    elementCount = faceCount * 3;
+
+    const int ibSize = elementCount * GetIndexSize();
+    ibOffset = sizeof( VertexPTNTC_Quantized ) * vertexCount;
+
+    UploadVB( (void*)faces, (void*)vertices, ibSize );
+}
+
 void ae3d::VertexBuffer::Bind() const
 {
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #if RENDERER_METAL
 #import <MetalKit/MetalKit.h>
@@ -7,14 +8,27 @@
 #include "Matrix.hpp"
 #include "Vec3.hpp"
 
+/// Shader constants, ordered by update frequency. The per-draw block comes first, followed by
+/// the per-pass block (camera, light and tile data) that is written through GfxDevice::EditPassUniforms()
+/// and uploaded only after it has been edited. Bone palettes live in a separate buffer set by GfxDevice::SetBonePalette().
 struct PerObjectUboStruct
 {
     enum LightType : int { Empty, Spot, Dir, Point };
     
+    // Per-draw block.
     ae3d::Matrix44 localToClip;
     ae3d::Matrix44 localToView;
     ae3d::Matrix44 localToWorld;
     ae3d::Matrix44 localToShadowClip;
+    ae3d::Vec4 tex0scaleOffset = ae3d::Vec4( 1, 1, 0, 0 );
+    int boneOffset = 0; // Index of the draw's first bone in the bone palette.
+    int isVR = 0;
+    float f0 = 0.8f;
+    int boneCount = 0; // Bone count of the draw, 0 if not skinned.
+    ae3d::Vec4 positionScale = ae3d::Vec4( 1, 1, 1, 0 ); // Dequantizes positions of the drawn vertex buffer. w is 1 if its normals and tangents are octahedral-encoded.
+    ae3d::Vec4 positionOffset = ae3d::Vec4( 0, 0, 0, 0 );
+
+    // Per-pass block.
     ae3d::Matrix44 clipToView;
     ae3d::Vec4 lightPosition;
     ae3d::Vec4 lightDirection;
@@ -26,13 +40,20 @@ struct PerObjectUboStruct
     unsigned windowWidth = 1;
     unsigned windowHeight = 1;
     unsigned numLights = 0; // 16 bits for point light count, 16 for spot light count
-    float f0 = 0.8f;
-    ae3d::Vec4 tex0scaleOffset = ae3d::Vec4( 1, 1, 0, 0 );
+    unsigned padding1 = 0;
     ae3d::Vec4 tilesXY = ae3d::Vec4( 0, 0, 0, 0 );
-    ae3d::Matrix44 boneMatrices[ 80 ];
-    int isVR = 0;
 };
 
+/// Size of the per-draw block at the beginning of PerObjectUboStruct.
+constexpr std::size_t PerDrawUboBlockSize = offsetof( PerObjectUboStruct, clipToView );
+/// Size of the per-pass block that follows the per-draw block.
+constexpr std::size_t PerPassUboBlockSize = sizeof( PerObjectUboStruct ) - PerDrawUboBlockSize;
+/// Bone count that backends without a bone storage buffer (D3D12, Metal) copy after the constants.
+/// Bones past this limit are not uploaded on those backends.
+constexpr int MaxBonesInUbo = 80;
+
+static_assert( PerDrawUboBlockSize % 16 == 0, "per-pass block must start at a 16-byte boundary" );
+
 namespace ae3d
 {
     class RenderTexture;
@@ -90,13 +111,21 @@ namespace ae3d
         int CreateLineBuffer( const Vec3* lines, int lineCount, const Vec3& color );
         void UpdateLineBuffer( int lineHandle, const Vec3* lines, int lineCount, const Vec3& color );
         void GetNewUniformBuffer();
+        /// \return The calling thread's shader constants for writing per-pass fields. Marks the per-pass block to be uploaded before the next draw.
+        PerObjectUboStruct& EditPassUniforms();
+
+        /// Sets the bone palette that skinned draws index with PerObjectUboStruct::boneOffset. Called once per frame.
+        /// D3D12 and Metal upload at most MaxBonesInUbo bones per draw and print a warning for larger skeletons.
+        /// \param matrices Bone matrices of all skinned meshes.
+        /// \param count Matrix count.
+        void SetBonePalette( const Matrix44* matrices, int count );
 #if RENDERER_D3D12
         void ResetCommandList();
         void* GetCurrentMappedConstantBuffer();
         void* GetCurrentConstantBuffer();
 #endif
 #if RENDERER_METAL
-        static const int UNIFORM_BUFFER_SIZE = sizeof( PerObjectUboStruct ) + 16 * 4;
+        static const int UNIFORM_BUFFER_SIZE = sizeof( PerObjectUboStruct ) + MaxBonesInUbo * sizeof( Matrix44 ) + 16 * 4;
         void InitMetal( id <MTLDevice> metalDevice, MTKView* view, int sampleCount, int uiVBSize, int uiIBSize );
         void SetCurrentDrawableMetal( MTKView* view );
         void DrawVertexBuffer( id<MTLBuffer> vertexBuffer, id<MTLBuffer> indexBuffer, int elementCount, int indexOffset );
@@ -110,6 +139,38 @@ namespace ae3d
 #endif
 #if RENDERER_VULKAN
         void ResetPSOCache();
+
+        /// Sets the file that holds the driver's pipeline cache. It's loaded when the window is created and saved in ReleaseGPUObjects(),
+        /// so call this before creating the window. Defaults to "pipelinecache.bin", empty path disables the file.
+        void SetPipelineCachePath( const char* path );
+
+        /// Sets how many frames the CPU can record ahead of the GPU. Each frame in flight has its own command buffers, uniform memory
+        /// and deletion queue, which are recycled when the frame's fence signals. Call before creating the window.
+        /// \param count 2 or 3. Defaults to 2.
+        void SetFramesInFlight( int count );
+
+        /// Writes the pipeline states that have been used so far into a manifest that PrewarmPSOs() can load in a later run.
+        /// \param path Manifest path.
+        /// \return False if the file could not be written.
+        bool SavePSOManifest( const char* path );
+
+        /// Creates pipelines listed in a manifest on worker threads, so they are not created in the middle of a frame. Call while loading,
+        /// after the manifest's shaders have been loaded. Pipelines of shaders that are not loaded are skipped.
+        /// \param manifestPath Manifest written by SavePSOManifest().
+        /// \return Number of created pipelines.
+        int PrewarmPSOs( const char* manifestPath );
+
+        /// Records a range of items. Called on several threads by RecordParallel().
+        typedef void (*RecordCallback)( int begin, int end, void* userData );
+
+        /// Splits items into contiguous ranges and records them on worker threads into secondary command buffers that are
+        /// executed in item order. Each worker starts with the calling thread's bound resources, constants and dynamic state.
+        /// Records on the calling thread if the current render pass was not begun by GfxDevice or there are too few items.
+        /// \param itemCount Item count.
+        /// \param minItemsPerThread Minimum number of items that is worth a thread.
+        /// \param recordItems Records items [begin, end). Must only use thread-safe GfxDevice calls, like Draw().
+        /// \param userData Passed to recordItems.
+        void RecordParallel( int itemCount, int minItemsPerThread, RecordCallback recordItems, void* userData );
         void CreateUniformBuffers();
         std::uint8_t* GetCurrentUbo();
         void BeginRenderPassAndCommandBuffer();
@@ -118,18 +179,82 @@ namespace ae3d
         void EndRenderPass();
         void EndCommandBuffer();
         void BeginFrame();
+#endif
+#if RENDERER_NULL
+        /// Command recorded by the null renderer. In the command stream each CommandHeader is followed by its payload.
+        enum class CommandType : std::uint8_t
+        {
+            Draw,               // DrawCommand
+            SetRenderTarget,    // RenderTexture* target, unsigned cubeMapFace
+            SetViewport,        // int[ 4 ]
+            SetScissor,         // int[ 4 ]
+            SetClearColor,      // float[ 3 ]
+            ClearScreen,        // unsigned clearFlags
+            UseShader,          // Shader*
+            SetTexture,         // int textureUnit, const void* texture
+            UploadPerDrawUbo,   // PerDrawUboBlockSize bytes
+            UploadPerPassUbo,   // PerPassUboBlockSize bytes
+            UploadBonePalette,  // Matrix44[ n ]
+            UploadLightBuffers, // int pointLightCount, int spotLightCount
+            Dispatch,           // unsigned[ 3 ]
+            PushGroupMarker,    // Marker name without terminator
+            PopGroupMarker,     // No payload
+            Present,            // No payload
+            Count
+        };
+
+        struct CommandHeader
+        {
+            CommandType type;
+            std::uint32_t payloadBytes;
+        };
+
+        /// Payload of CommandType::Draw.
+        struct DrawCommand
+        {
+            const VertexBuffer* vertexBuffer;
+            const Shader* shader;
+            int startIndex;
+            int endIndex;
+            BlendMode blendMode;
+            DepthFunc depthFunc;
+            CullMode cullMode;
+            FillMode fillMode;
+            PrimitiveTopology topology;
+        };
+
+        /// Totals gathered by walking a command stream.
+        struct CommandCounts
+        {
+            int commands[ (int)CommandType::Count ] = {};
+            int triangles = 0;
+            int uboBytes = 0;
+        };
+
+        /// Appends a command to the stream that is being recorded.
+        void RecordCommand( CommandType type, const void* payload, std::uint32_t payloadBytes );
+
+        /// \param outByteCount Size of the returned stream in bytes.
+        /// \return Commands of the last presented frame. Valid until the next Present().
+        const std::uint8_t* GetRecordedCommands( std::size_t& outByteCount );
+
+        /// Walks a command stream and counts its commands.
+        /// \param commands Command stream from GetRecordedCommands().
+        /// \param byteCount Stream size in bytes.
+        /// \param outCounts Receives the counts.
+        /// \return False if the stream is truncated or contains an unknown command.
+        bool PlaybackCommands( const std::uint8_t* commands, std::size_t byteCount, CommandCounts& outCounts );
+
+        /// \param enable If true, Present() plays back each recorded frame into GetLastFrameCounts().
+        void SetPlaybackCounting( bool enable );
+
+        /// \return Counts of the last presented frame, if playback counting is enabled.
+        const CommandCounts& GetLastFrameCounts();
 #endif
         void ClearScreen( unsigned clearFlags );
-        void Draw( VertexBuffer& vertexBuffer, int startIndex, int endIndex, Shader& shader, BlendMode blendMode, DepthFunc depthFunc, CullMode cullMode, FillMode fillMode, PrimitiveTopology topology );
+        void Draw( const VertexBuffer& vertexBuffer, int startIndex, int endIndex, Shader& shader, BlendMode blendMode, DepthFunc depthFunc, CullMode cullMode, FillMode fillMode, PrimitiveTopology topology );
         void DrawLines( int handle, Shader& shader );
 
-        void BeginDepthNormalsGpuQuery();
-        void EndDepthNormalsGpuQuery();
-        void BeginShadowMapGpuQuery();
-        void EndShadowMapGpuQuery();
-        void BeginLightCullerGpuQuery();
-        void EndLightCullerGpuQuery();
-
         void SetClearColor( float red, float green, float blue );
         void SetRenderTarget( RenderTexture* target, unsigned cubeMapFace );
         void SetViewport( int viewport[ 4 ] );
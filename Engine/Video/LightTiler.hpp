@@ -12,6 +12,10 @@ struct ID3D12Resource;
 
 namespace ae3d
 {
+#if RENDERER_VULKAN
+    struct VulkanAllocation;
+#endif
+
     /// Implements Forward+ light culler
     class LightTiler
     {
@@ -79,32 +83,32 @@ namespace ae3d
 #endif
 #if RENDERER_VULKAN
         VkBuffer pointLightCenterAndRadiusBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory pointLightCenterAndRadiusMemory = VK_NULL_HANDLE;
+        VulkanAllocation* pointLightCenterAndRadiusMemory = nullptr;
         void* mappedPointLightCenterAndRadiusMemory = nullptr;
         VkBufferView pointLightBufferView = VK_NULL_HANDLE;
         
         VkBuffer pointLightColorBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory pointLightColorMemory = VK_NULL_HANDLE;
+        VulkanAllocation* pointLightColorMemory = nullptr;
         void* mappedPointLightColorMemory = nullptr;
         VkBufferView pointLightColorView = VK_NULL_HANDLE;
 
         VkBuffer spotLightColorBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory spotLightColorMemory = VK_NULL_HANDLE;
+        VulkanAllocation* spotLightColorMemory = nullptr;
         void* mappedSpotLightColorMemory = nullptr;
         VkBufferView spotLightColorView = VK_NULL_HANDLE;
 
         VkBuffer spotLightCenterAndRadiusBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory spotLightCenterAndRadiusMemory = VK_NULL_HANDLE;
+        VulkanAllocation* spotLightCenterAndRadiusMemory = nullptr;
         void* mappedSpotLightCenterAndRadiusMemory = nullptr;
         VkBufferView spotLightBufferView = VK_NULL_HANDLE;
 
         VkBuffer spotLightParamsBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory spotLightParamsMemory = VK_NULL_HANDLE;
+        VulkanAllocation* spotLightParamsMemory = nullptr;
         void* mappedSpotLightParamsMemory = nullptr;
         VkBufferView spotLightParamsView = VK_NULL_HANDLE;
         
         VkBuffer perTileLightIndexBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory perTileLightIndexBufferMemory = VK_NULL_HANDLE;
+        VulkanAllocation* perTileLightIndexBufferMemory = nullptr;
         VkBufferView perTileLightIndexBufferView = VK_NULL_HANDLE;
 #endif
         static const int TileRes = 16;
@@ -10,7 +10,7 @@ ae3d::RenderTexture* ae3d::Material::sTexRT;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 bool ae3d::Material::IsValidShader() const
@@ -11,7 +11,7 @@ extern id <MTLCommandQueue> commandQueue;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 void ae3d::ComputeShader::Load( const char* source )
@@ -67,8 +67,8 @@ void ae3d::ComputeShader::SetUniform( UniformName uniform, float x, float y )
 {
     if( uniform == UniformName::TilesZW )
     {
-        GfxDeviceGlobal::perObjectUboStruct.tilesXY.z = x;
-        GfxDeviceGlobal::perObjectUboStruct.tilesXY.w = y;
+        GfxDevice::EditPassUniforms().tilesXY.z = x;
+        GfxDevice::EditPassUniforms().tilesXY.w = y;
     }
 }
 
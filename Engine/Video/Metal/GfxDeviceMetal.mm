@@ -1,5 +1,6 @@
 #import <Foundation/Foundation.h>
 #import <MetalKit/MetalKit.h>
+#include <stdio.h>
 #include <string.h>
 #include <unordered_map>
 #include <vector>
@@ -90,7 +91,10 @@ namespace GfxDeviceGlobal
     MTLScissorRect scissor;
     unsigned frameIndex = 0;
     ae3d::VertexBuffer uiBuffer;
-    PerObjectUboStruct perObjectUboStruct;
+    thread_local PerObjectUboStruct perObjectUboStruct;
+    const ae3d::Matrix44* bonePalette = nullptr;
+    int bonePaletteCount = 0;
+    bool isBoneLimitWarned = false;
     id <MTLRenderPipelineState> cachedPSO;
     
     struct Samplers
@@ -191,8 +195,34 @@ void UploadPerObjectUbo()
     uint8_t* bufferPointer = (uint8_t *)[uniformBuffer contents];
 
     memcpy( bufferPointer, &GfxDeviceGlobal::perObjectUboStruct, sizeof( GfxDeviceGlobal::perObjectUboStruct ) );
+    int uploadBytes = sizeof( GfxDeviceGlobal::perObjectUboStruct );
+
+    // Metal shaders index bones relative to the draw, so copy the draw's window of the palette.
+    const int boneOffset = GfxDeviceGlobal::perObjectUboStruct.boneOffset;
+    int boneCount = GfxDeviceGlobal::perObjectUboStruct.boneCount;
+
+    if (boneCount > MaxBonesInUbo)
+    {
+        if (!GfxDeviceGlobal::isBoneLimitWarned)
+        {
+            ae3d::System::Print( "Skinned mesh has %d bones but Metal supports %d, it will not render correctly.\n", boneCount, MaxBonesInUbo );
+            GfxDeviceGlobal::isBoneLimitWarned = true;
+        }
+
+        boneCount = MaxBonesInUbo;
+    }
+
+    boneCount = boneCount < GfxDeviceGlobal::bonePaletteCount - boneOffset ? boneCount : GfxDeviceGlobal::bonePaletteCount - boneOffset;
+
+    if (GfxDeviceGlobal::bonePalette != nullptr && boneCount > 0)
+    {
+        memcpy( bufferPointer + sizeof( GfxDeviceGlobal::perObjectUboStruct ), GfxDeviceGlobal::bonePalette + boneOffset, boneCount * sizeof( ae3d::Matrix44 ) );
+        uploadBytes += boneCount * sizeof( ae3d::Matrix44 );
+    }
+
+    Statistics::IncUniformUploadBytes( uploadBytes );
 #if !TARGET_OS_IPHONE
-    [uniformBuffer didModifyRange:NSMakeRange( 0, sizeof( GfxDeviceGlobal::perObjectUboStruct ) )];
+    [uniformBuffer didModifyRange:NSMakeRange( 0, uploadBytes )];
 #endif
 }
 
@@ -202,11 +232,12 @@ namespace ae3d
     {
         namespace Statistics
         {
-            void GetStatistics( char* outStr )
+            void GetStatistics( char* outStr, std::size_t outStrSize )
             {
                 std::string str( "frame time: " );
                 str += std::to_string( ::Statistics::GetFrameTimeMS() );
                 str += "\n";
+                str += ::Statistics::GetFrameTimeSummary();
                 str += "shadow map time: ";
                 str += std::to_string( ::Statistics::GetShadowMapTimeMS() );
                 str += "\n";
@@ -216,6 +247,9 @@ namespace ae3d
                 str += "draw calls: ";
                 str += std::to_string( ::Statistics::GetDrawCalls() );
                 str += "\n";
+                str += "uniform upload: ";
+                str += std::to_string( ::Statistics::GetUniformUploadBytes() / 1024 );
+                str += " KiB\n";
                 str += "scene AABB: ";
                 str += std::to_string( ::Statistics::GetSceneAABBTimeMS() );
                 str += "\nmemory: ";
@@ -224,7 +258,7 @@ namespace ae3d
                 str += "textures: ";
                 str += std::to_string(tex2dMemoryUsage / (1024 * 1024));
                 str += " MiB\n";
-                std::strcpy( outStr, str.c_str() );
+                std::snprintf( outStr, outStrSize, "%s", str.c_str() );
             }
         }
     }
@@ -240,6 +274,17 @@ void ae3d::GfxDevice::GetNewUniformBuffer()
     GfxDeviceGlobal::currentUboIndex = (GfxDeviceGlobal::currentUboIndex + 1) % UboCount;
 }
 
+void ae3d::GfxDevice::SetBonePalette( const Matrix44* matrices, int count )
+{
+    GfxDeviceGlobal::bonePalette = matrices;
+    GfxDeviceGlobal::bonePaletteCount = count;
+}
+
+PerObjectUboStruct& ae3d::GfxDevice::EditPassUniforms()
+{
+    return GfxDeviceGlobal::perObjectUboStruct;
+}
+
 id <MTLBuffer> ae3d::GfxDevice::GetCurrentUniformBuffer()
 {
     return GfxDeviceGlobal::uniformBuffers[ GfxDeviceGlobal::currentUboIndex ];
@@ -265,26 +310,6 @@ void ae3d::GfxDevice::UnmapUIVertexBuffer()
 {
 }
 
-void ae3d::GfxDevice::BeginDepthNormalsGpuQuery()
-{
-    // TODO: Implement
-}
-
-void ae3d::GfxDevice::EndDepthNormalsGpuQuery()
-{
-    // TODO: Implement
-}
-
-void ae3d::GfxDevice::BeginShadowMapGpuQuery()
-{
-    // TODO: Implement
-}
-
-void ae3d::GfxDevice::EndShadowMapGpuQuery()
-{
-    // TODO: Implement
-}
-
 void ae3d::GfxDevice::SetPolygonOffset( bool enable, float factor, float units )
 {
 }
@@ -565,6 +590,38 @@ id <MTLRenderPipelineState> GetPSO( ae3d::Shader& shader, ae3d::GfxDevice::Blend
             vertexDesc.layouts[0].stride = sizeof( ae3d::VertexBuffer::VertexPTNTC_Skinned );
             vertexDesc.layouts[0].stepFunction = MTLVertexStepFunctionPerVertex;
         }
+        else if (vertexFormat == ae3d::VertexBuffer::VertexFormat::PTNTC_Quantized)
+        {
+            pipelineStateDescriptor.label = @"pipeline PTNTC_Quantized";
+
+            // Position, tangent handedness in w
+            vertexDesc.attributes[0].format = MTLVertexFormatShort4Normalized;
+            vertexDesc.attributes[0].bufferIndex = 0;
+            vertexDesc.attributes[0].offset = 0;
+
+            // Texcoord
+            vertexDesc.attributes[1].format = MTLVertexFormatHalf2;
+            vertexDesc.attributes[1].bufferIndex = 0;
+            vertexDesc.attributes[1].offset = 8;
+
+            // Normal, octahedral
+            vertexDesc.attributes[3].format = MTLVertexFormatShort2Normalized;
+            vertexDesc.attributes[3].bufferIndex = 0;
+            vertexDesc.attributes[3].offset = 12;
+
+            // Tangent, octahedral
+            vertexDesc.attributes[4].format = MTLVertexFormatShort2Normalized;
+            vertexDesc.attributes[4].bufferIndex = 0;
+            vertexDesc.attributes[4].offset = 16;
+
+            // Color
+            vertexDesc.attributes[2].format = MTLVertexFormatUChar4Normalized;
+            vertexDesc.attributes[2].bufferIndex = 0;
+            vertexDesc.attributes[2].offset = 20;
+
+            vertexDesc.layouts[0].stride = sizeof( ae3d::VertexBuffer::VertexPTNTC_Quantized );
+            vertexDesc.layouts[0].stepFunction = MTLVertexStepFunctionPerVertex;
+        }
         else if (vertexFormat == ae3d::VertexBuffer::VertexFormat::PTN)
         {
             pipelineStateDescriptor.label = @"pipeline PTN";
@@ -660,7 +717,7 @@ void ae3d::GfxDevice::DrawLines( int handle, Shader& shader )
     Draw( GfxDeviceGlobal::lineBuffers[ handle ], 0, GfxDeviceGlobal::lineBuffers[ handle ].GetFaceCount(), shader, BlendMode::Off, DepthFunc::NoneWriteOff, CullMode::Off, FillMode::Solid, GfxDevice::PrimitiveTopology::Lines );
 }
 
-void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endIndex, Shader& shader, BlendMode blendMode, DepthFunc depthFunc, CullMode cullMode, FillMode fillMode, PrimitiveTopology topology )
+void ae3d::GfxDevice::Draw( const VertexBuffer& vertexBuffer, int startIndex, int endIndex, Shader& shader, BlendMode blendMode, DepthFunc depthFunc, CullMode cullMode, FillMode fillMode, PrimitiveTopology topology )
 {
     Statistics::IncDrawCalls();
 
@@ -760,6 +817,11 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
         // No need to set extra buffers as vertexBuffer contains all attributes.
         [renderEncoder setVertexBuffer:nil offset:0 atIndex:1];
     }
+    else if (vertexBuffer.GetVertexFormat() == VertexBuffer::VertexFormat::PTNTC_Quantized)
+    {
+        // No need to set extra buffers as vertexBuffer contains all attributes.
+        [renderEncoder setVertexBuffer:nil offset:0 atIndex:1];
+    }
     else if (vertexBuffer.GetVertexFormat() == VertexBuffer::VertexFormat::PTN)
     {
         [renderEncoder setVertexBuffer:vertexBuffer.colorBuffer offset:0 atIndex:1];
@@ -773,15 +835,18 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
         System::Assert( false, "Unhandled vertex format" );
     }
     
+    GfxDeviceGlobal::perObjectUboStruct.positionScale = Vec4( vertexBuffer.GetPositionScale(), vertexBuffer.GetVertexFormat() == VertexBuffer::VertexFormat::PTNTC_Quantized ? 1.0f : 0.0f );
+    GfxDeviceGlobal::perObjectUboStruct.positionOffset = Vec4( vertexBuffer.GetPositionOffset(), 0 );
+
     UploadPerObjectUbo();
     
     if (topology == PrimitiveTopology::Triangles)
     {
         [renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeTriangle
                                   indexCount:(endIndex - startIndex) * 3
-                               indexType:MTLIndexTypeUInt16
+                               indexType:vertexBuffer.GetIndexFormat() == VertexBuffer::IndexFormat::UInt32 ? MTLIndexTypeUInt32 : MTLIndexTypeUInt16
                              indexBuffer:vertexBuffer.GetIndexBuffer()
-                       indexBufferOffset:startIndex * 2 * 3];
+                       indexBufferOffset:startIndex * vertexBuffer.GetIndexSize() * 3];
     }
     else // MTLPrimitiveTypeLine
     {
@@ -789,14 +854,6 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
     }
 }
 
-void ae3d::GfxDevice::BeginLightCullerGpuQuery()
-{
-}
-
-void ae3d::GfxDevice::EndLightCullerGpuQuery()
-{
-}
-
 void ae3d::GfxDevice::BeginFrame()
 {
     GfxDeviceGlobal::cachedPSO = nil;
@@ -10,7 +10,7 @@ namespace GfxDeviceGlobal
 {
     extern int backBufferWidth;
     extern int backBufferHeight;
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 using namespace ae3d;
@@ -64,15 +64,16 @@ void ae3d::LightTiler::CullLights( ComputeShader& shader, const Matrix44& viewTo
 {
     shader.SetRenderTexture( 0, &depthNormalTarget );
 
-    Matrix44::Invert( viewToClip, GfxDeviceGlobal::perObjectUboStruct.clipToView );
+    PerObjectUboStruct& passUniforms = GfxDevice::EditPassUniforms();
+    Matrix44::Invert( viewToClip, passUniforms.clipToView );
 
     GfxDeviceGlobal::perObjectUboStruct.localToView = worldToView;
-    GfxDeviceGlobal::perObjectUboStruct.windowWidth = depthNormalTarget.GetWidth();
-    GfxDeviceGlobal::perObjectUboStruct.windowHeight = depthNormalTarget.GetHeight();
-    GfxDeviceGlobal::perObjectUboStruct.numLights = (((unsigned)activeSpotLights & 0xFFFFu) << 16) | ((unsigned)activePointLights & 0xFFFFu);
-    GfxDeviceGlobal::perObjectUboStruct.maxNumLightsPerTile = GetMaxNumLightsPerTile();
-    GfxDeviceGlobal::perObjectUboStruct.tilesXY.x = GetNumTilesX();
-    GfxDeviceGlobal::perObjectUboStruct.tilesXY.y = GetNumTilesY();
+    passUniforms.windowWidth = depthNormalTarget.GetWidth();
+    passUniforms.windowHeight = depthNormalTarget.GetHeight();
+    passUniforms.numLights = (((unsigned)activeSpotLights & 0xFFFFu) << 16) | ((unsigned)activePointLights & 0xFFFFu);
+    passUniforms.maxNumLightsPerTile = GetMaxNumLightsPerTile();
+    passUniforms.tilesXY.x = GetNumTilesX();
+    passUniforms.tilesXY.y = GetNumTilesY();
 
     shader.SetUniformBuffer( 1, pointLightCenterAndRadiusBuffer );
     shader.SetUniformBuffer( 2, perTileLightIndexBuffer);
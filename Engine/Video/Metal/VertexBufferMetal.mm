@@ -15,6 +15,23 @@ void ae3d::VertexBuffer::SetDebugName( const char* name )
     vertexBuffer.label = [NSString stringWithUTF8String:name];
 }
 
+void ae3d::VertexBuffer::Release()
+{
+    // Command buffers retain the buffers they use until they have completed.
+    vertexBuffer = nil;
+    indexBuffer = nil;
+    positionBuffer = nil;
+    texcoordBuffer = nil;
+    colorBuffer = nil;
+    normalBuffer = nil;
+    tangentBuffer = nil;
+    boneBuffer = nil;
+    weightBuffer = nil;
+    positionCount = 0;
+    triangleCount = 0;
+    elementCount = 0;
+}
+
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTC* vertices, int vertexCount, Storage storage )
 {
     if (faceCount == 0)
@@ -23,6 +40,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     }
     
     vertexFormat = VertexFormat::PTC;
+    indexFormat = IndexFormat::UInt16;
     
     if (storage == Storage::GPU)
     {
@@ -217,6 +235,50 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
 }
 
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTN* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTN* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount, const Vec3& aPositionScale, const Vec3& aPositionOffset )
+{
+    positionScale = aPositionScale;
+    positionOffset = aPositionOffset;
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount, const Vec3& aPositionScale, const Vec3& aPositionOffset )
+{
+    positionScale = aPositionScale;
+    positionOffset = aPositionOffset;
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTN* vertices, int vertexCount )
 {
     if (faceCount == 0)
     {
@@ -224,6 +286,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     }
     
     vertexFormat = VertexFormat::PTN;
+    indexFormat = aIndexFormat;
     vertexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:vertices
                        length:sizeof( VertexPTN ) * vertexCount
                       options:MTLResourceCPUCacheModeDefaultCache];
@@ -303,7 +366,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     weightBuffer.label = @"Weight buffer";
     
     indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:faces
-                      length:sizeof( Face ) * faceCount
+                      length:GetIndexSize() * 3 * faceCount
                      options:MTLResourceCPUCacheModeDefaultCache];
     indexBuffer.label = @"Index buffer";
     
@@ -319,7 +382,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     vertexBufferMemoryUsage += [colorBuffer allocatedSize];
 }
 
-void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC* vertices, int vertexCount )
 {
     if (faceCount == 0)
     {
@@ -327,6 +390,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     }
 
     vertexFormat = VertexFormat::PTNTC;
+    indexFormat = aIndexFormat;
     vertexBuffer = [GfxDevice::GetMetalDevice() newBufferWithLength:sizeof( VertexPTNTC ) * vertexCount
                       options:MTLResourceStorageModePrivate];
     vertexBuffer.label = @"Vertex buffer PTNTC";
@@ -434,7 +498,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     weightBuffer.label = @"Weight buffer";
     
     indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:faces
-                      length:sizeof( Face ) * faceCount
+                      length:GetIndexSize() * 3 * faceCount
                      options:MTLResourceCPUCacheModeDefaultCache];
     indexBuffer.label = @"Index buffer";
     
@@ -450,7 +514,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     vertexBufferMemoryUsage += [colorBuffer allocatedSize];
 }
 
-void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
 {
     if (faceCount == 0)
     {
@@ -458,6 +522,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     }
 
     vertexFormat = VertexFormat::PTNTC_Skinned;
+    indexFormat = aIndexFormat;
     vertexBuffer = [GfxDevice::GetMetalDevice() newBufferWithLength:sizeof( VertexPTNTC_Skinned ) * vertexCount
                       options:MTLResourceStorageModePrivate];
     vertexBuffer.label = @"Vertex buffer PTNTC_Skinned";
@@ -581,7 +646,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     boneBuffer.label = @"Bone buffer";
     
     indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:faces
-                      length:sizeof( Face ) * faceCount
+                      length:GetIndexSize() * 3 * faceCount
                      options:MTLResourceCPUCacheModeDefaultCache];
     indexBuffer.label = @"Index buffer";
     
@@ -597,9 +662,52 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     vertexBufferMemoryUsage += [colorBuffer allocatedSize];
 }
 
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount )
+{
+    if (faceCount == 0)
+    {
+        return;
+    }
+
+    vertexFormat = VertexFormat::PTNTC_Quantized;
+    indexFormat = aIndexFormat;
+    vertexBuffer = [GfxDevice::GetMetalDevice() newBufferWithLength:sizeof( VertexPTNTC_Quantized ) * vertexCount
+                      options:MTLResourceStorageModePrivate];
+    vertexBuffer.label = @"Vertex buffer PTNTC_Quantized";
+
+    id<MTLBuffer> blitBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:vertices
+                      length:sizeof( VertexPTNTC_Quantized ) * vertexCount
+                      options:MTLResourceCPUCacheModeDefaultCache];
+    blitBuffer.label = @"BlitBuffer";
+
+    id <MTLCommandBuffer> cmd_buffer = [commandQueue commandBuffer];
+    cmd_buffer.label = @"BlitCommandBuffer";
+    id <MTLBlitCommandEncoder> blit_encoder = [cmd_buffer blitCommandEncoder];
+    [blit_encoder copyFromBuffer:blitBuffer
+                    sourceOffset:0
+                        toBuffer:vertexBuffer
+               destinationOffset:0
+                            size:sizeof( VertexPTNTC_Quantized ) * vertexCount];
+    [blit_encoder endEncoding];
+    [cmd_buffer commit];
+    [cmd_buffer waitUntilCompleted];
+
+    // All attributes are in vertexBuffer, so the separate attribute buffers of other formats are not created.
+    indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:faces
+                      length:GetIndexSize() * 3 * faceCount
+                     options:MTLResourceCPUCacheModeDefaultCache];
+    indexBuffer.label = @"Index buffer";
+
+    elementCount = faceCount * 3;
+
+    vertexBufferMemoryUsage += [vertexBuffer allocatedSize];
+    vertexBufferMemoryUsage += [indexBuffer allocatedSize];
+}
+
 void ae3d::VertexBuffer::GenerateDynamic( int faceCount, int vertexCount )
 {
     vertexFormat = VertexFormat::PTC;
+    indexFormat = IndexFormat::UInt16;
     elementCount = faceCount * 3;
 
     vertexBuffer = [GfxDevice::GetMetalDevice() newBufferWithLength:sizeof( VertexFormat::PTC ) * vertexCount
@@ -0,0 +1,344 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include "GfxDevice.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ComputeShader.hpp"
+#include "LightTiler.hpp"
+#include "RenderTexture.hpp"
+#include "Renderer.hpp"
+#include "Shader.hpp"
+#include "Statistics.hpp"
+#include "System.hpp"
+#include "Texture2D.hpp"
+#include "TextureCube.hpp"
+#include "VertexBuffer.hpp"
+
+extern ae3d::Renderer renderer;
+
+constexpr unsigned UI_VERTICE_COUNT = 512 * 1024;
+constexpr unsigned UI_FACE_COUNT = 128 * 1024;
+
+namespace GfxDeviceGlobal
+{
+    unsigned backBufferWidth = 0;
+    unsigned backBufferHeight = 0;
+    ae3d::LightTiler lightTiler;
+    thread_local PerObjectUboStruct perObjectUboStruct;
+    ae3d::VertexBuffer uiVertexBuffer;
+    ae3d::VertexBuffer::VertexPTC uiVertices[ UI_VERTICE_COUNT ];
+    ae3d::VertexBuffer::Face uiFaces[ UI_FACE_COUNT ];
+    std::vector< ae3d::VertexBuffer > lineBuffers;
+    ae3d::RenderTexture* renderTexture0 = nullptr;
+
+    // Commands are recorded into the first stream and swapped into the second one in Present().
+    std::vector< std::uint8_t > recordingCommands;
+    std::vector< std::uint8_t > presentedCommands;
+    bool isPassUboDirty = true;
+    bool isPlaybackCountingEnabled = false;
+    ae3d::GfxDevice::CommandCounts lastFrameCounts;
+}
+
+namespace ae3d
+{
+    namespace System
+    {
+        namespace Statistics
+        {
+            void GetStatistics( char* outStr, std::size_t outStrSize )
+            {
+                std::string str;
+                str = "frame time: " + std::to_string( ::Statistics::GetFrameTimeMS() ) + " ms\n";
+                str += ::Statistics::GetFrameTimeSummary();
+                str += "present time CPU: " + std::to_string( ::Statistics::GetPresentTimeMS() ) + " ms\n";
+                str += "shadow pass time CPU: " + std::to_string( ::Statistics::GetShadowMapTimeMS() ) + " ms\n";
+                str += "depth pass time CPU: " + std::to_string( ::Statistics::GetDepthNormalsTimeMS() ) + " ms\n";
+                str += "draw calls: " + std::to_string( ::Statistics::GetDrawCalls() ) + "\n";
+                str += "triangles: " + std::to_string( ::Statistics::GetTriangleCount() ) + "\n";
+                str += "uniform upload: " + std::to_string( ::Statistics::GetUniformUploadBytes() / 1024 ) + " KiB\n";
+                str += "recorded commands: " + std::to_string( GfxDeviceGlobal::presentedCommands.size() / 1024 ) + " KiB\n";
+
+                std::snprintf( outStr, outStrSize, "%s", str.c_str() );
+            }
+        }
+    }
+}
+
+void ae3d::GfxDevice::RecordCommand( CommandType type, const void* payload, std::uint32_t payloadBytes )
+{
+    CommandHeader header;
+    header.type = type;
+    header.payloadBytes = payloadBytes;
+
+    const std::uint8_t* headerBytes = reinterpret_cast< const std::uint8_t* >( &header );
+    GfxDeviceGlobal::recordingCommands.insert( std::end( GfxDeviceGlobal::recordingCommands ), headerBytes, headerBytes + sizeof( CommandHeader ) );
+
+    if (payloadBytes > 0)
+    {
+        const std::uint8_t* payloadData = static_cast< const std::uint8_t* >( payload );
+        GfxDeviceGlobal::recordingCommands.insert( std::end( GfxDeviceGlobal::recordingCommands ), payloadData, payloadData + payloadBytes );
+    }
+}
+
+const std::uint8_t* ae3d::GfxDevice::GetRecordedCommands( std::size_t& outByteCount )
+{
+    outByteCount = GfxDeviceGlobal::presentedCommands.size();
+    return GfxDeviceGlobal::presentedCommands.data();
+}
+
+bool ae3d::GfxDevice::PlaybackCommands( const std::uint8_t* commands, std::size_t byteCount, CommandCounts& outCounts )
+{
+    outCounts = CommandCounts();
+    std::size_t offset = 0;
+
+    while (offset < byteCount)
+    {
+        if (byteCount - offset < sizeof( CommandHeader ))
+        {
+            return false;
+        }
+
+        CommandHeader header;
+        std::memcpy( &header, commands + offset, sizeof( CommandHeader ) );
+        offset += sizeof( CommandHeader );
+
+        if (header.type >= CommandType::Count || byteCount - offset < header.payloadBytes)
+        {
+            return false;
+        }
+
+        ++outCounts.commands[ (int)header.type ];
+
+        if (header.type == CommandType::Draw && header.payloadBytes == sizeof( DrawCommand ))
+        {
+            DrawCommand draw;
+            std::memcpy( &draw, commands + offset, sizeof( DrawCommand ) );
+            outCounts.triangles += draw.endIndex - draw.startIndex;
+        }
+        else if (header.type == CommandType::UploadPerDrawUbo || header.type == CommandType::UploadPerPassUbo || header.type == CommandType::UploadBonePalette)
+        {
+            outCounts.uboBytes += (int)header.payloadBytes;
+        }
+
+        offset += header.payloadBytes;
+    }
+
+    return true;
+}
+
+void ae3d::GfxDevice::SetPlaybackCounting( bool enable )
+{
+    GfxDeviceGlobal::isPlaybackCountingEnabled = enable;
+}
+
+const ae3d::GfxDevice::CommandCounts& ae3d::GfxDevice::GetLastFrameCounts()
+{
+    return GfxDeviceGlobal::lastFrameCounts;
+}
+
+void UploadPerObjectUbo()
+{
+    ae3d::GfxDevice::RecordCommand( ae3d::GfxDevice::CommandType::UploadPerDrawUbo, &GfxDeviceGlobal::perObjectUboStruct, (std::uint32_t)PerDrawUboBlockSize );
+    Statistics::IncUniformUploadBytes( (int)PerDrawUboBlockSize );
+
+    // Mirrors the Vulkan renderer: the per-pass block is recorded only after it has been edited.
+    if (!GfxDeviceGlobal::isPassUboDirty)
+    {
+        return;
+    }
+
+    GfxDeviceGlobal::isPassUboDirty = false;
+    const std::uint8_t* passBlock = reinterpret_cast< const std::uint8_t* >( &GfxDeviceGlobal::perObjectUboStruct ) + PerDrawUboBlockSize;
+    ae3d::GfxDevice::RecordCommand( ae3d::GfxDevice::CommandType::UploadPerPassUbo, passBlock, (std::uint32_t)PerPassUboBlockSize );
+    Statistics::IncUniformUploadBytes( (int)PerPassUboBlockSize );
+}
+
+void ae3d::GfxDevice::Init( int width, int height )
+{
+    GfxDeviceGlobal::backBufferWidth = width;
+    GfxDeviceGlobal::backBufferHeight = height;
+    GfxDeviceGlobal::uiVertexBuffer.GenerateDynamic( UI_FACE_COUNT, UI_VERTICE_COUNT );
+    GfxDeviceGlobal::lightTiler.Init();
+}
+
+void ae3d::GfxDevice::DrawUI( int scX, int scY, int scWidth, int scHeight, int elemCount, int offset )
+{
+    int scissor[ 4 ] = {};
+    scissor[ 0 ] = scX < 0 ? 0 : scX;
+    scissor[ 1 ] = scY < 0 ? 0 : scY;
+    scissor[ 2 ] = scWidth > 8191 ? 8191 : scWidth;
+    scissor[ 3 ] = scHeight > 8191 ? 8191 : scHeight;
+    SetScissor( scissor );
+
+    Draw( GfxDeviceGlobal::uiVertexBuffer, offset, offset + elemCount, renderer.builtinShaders.uiShader, BlendMode::AlphaBlend, DepthFunc::NoneWriteOff, CullMode::Off, FillMode::Solid, GfxDevice::PrimitiveTopology::Triangles );
+}
+
+void ae3d::GfxDevice::MapUIVertexBuffer( int /*vertexSize*/, int /*indexSize*/, void** outMappedVertices, void** outMappedIndices )
+{
+    *outMappedVertices = GfxDeviceGlobal::uiVertices;
+    *outMappedIndices = GfxDeviceGlobal::uiFaces;
+}
+
+void ae3d::GfxDevice::UnmapUIVertexBuffer()
+{
+    GfxDeviceGlobal::uiVertexBuffer.UpdateDynamic( GfxDeviceGlobal::uiFaces, UI_FACE_COUNT, GfxDeviceGlobal::uiVertices, UI_VERTICE_COUNT );
+}
+
+void ae3d::GfxDevice::SetPolygonOffset( bool, float, float )
+{
+}
+
+void ae3d::GfxDevice::PushGroupMarker( const char* name )
+{
+    RecordCommand( CommandType::PushGroupMarker, name, (std::uint32_t)std::strlen( name ) );
+}
+
+void ae3d::GfxDevice::PopGroupMarker()
+{
+    RecordCommand( CommandType::PopGroupMarker, nullptr, 0 );
+}
+
+void ae3d::GfxDevice::SetClearColor( float red, float green, float blue )
+{
+    const float color[ 3 ] = { red, green, blue };
+    RecordCommand( CommandType::SetClearColor, color, sizeof( color ) );
+}
+
+void ae3d::GfxDevice::GetGpuMemoryUsage( unsigned& outUsedMBytes, unsigned& outBudgetMBytes )
+{
+    outUsedMBytes = 0;
+    outBudgetMBytes = 0;
+}
+
+void ae3d::GfxDevice::ClearScreen( unsigned clearFlags )
+{
+    RecordCommand( CommandType::ClearScreen, &clearFlags, sizeof( clearFlags ) );
+}
+
+void ae3d::GfxDevice::DrawLines( int handle, Shader& shader )
+{
+    if (handle < 0)
+    {
+        return;
+    }
+
+    Draw( GfxDeviceGlobal::lineBuffers[ handle ], 0, GfxDeviceGlobal::lineBuffers[ handle ].GetFaceCount() / 3, shader, BlendMode::Off, DepthFunc::NoneWriteOff, CullMode::Off, FillMode::Solid, GfxDevice::PrimitiveTopology::Lines );
+}
+
+void ae3d::GfxDevice::SetViewport( int aViewport[ 4 ] )
+{
+    RecordCommand( CommandType::SetViewport, aViewport, 4 * sizeof( int ) );
+}
+
+void ae3d::GfxDevice::SetScissor( int aScissor[ 4 ] )
+{
+    RecordCommand( CommandType::SetScissor, aScissor, 4 * sizeof( int ) );
+}
+
+void ae3d::GfxDevice::Draw( const VertexBuffer& vertexBuffer, int startIndex, int endIndex, Shader& shader, BlendMode blendMode, DepthFunc depthFunc,
+                            CullMode cullMode, FillMode fillMode, PrimitiveTopology topology )
+{
+    System::Assert( startIndex > -1 && startIndex <= vertexBuffer.GetFaceCount() / 3, "Invalid vertex buffer draw range in startIndex" );
+    System::Assert( endIndex > -1 && endIndex >= startIndex && endIndex <= vertexBuffer.GetFaceCount() / 3, "Invalid vertex buffer draw range in endIndex" );
+
+    const unsigned activePointLights = GfxDeviceGlobal::lightTiler.GetPointLightCount();
+    const unsigned activeSpotLights = GfxDeviceGlobal::lightTiler.GetSpotLightCount();
+    const unsigned lightCount = ((activeSpotLights & 0xFFFFu) << 16) | (activePointLights & 0xFFFFu);
+
+    PerObjectUboStruct& passUniforms = GfxDevice::EditPassUniforms();
+    passUniforms.windowWidth = GfxDeviceGlobal::backBufferWidth;
+    passUniforms.windowHeight = GfxDeviceGlobal::backBufferHeight;
+    passUniforms.numLights = lightCount;
+    passUniforms.maxNumLightsPerTile = GfxDeviceGlobal::lightTiler.GetMaxNumLightsPerTile();
+    passUniforms.tilesXY.x = (float)GfxDeviceGlobal::lightTiler.GetNumTilesX();
+    passUniforms.tilesXY.y = (float)GfxDeviceGlobal::lightTiler.GetNumTilesY();
+    GfxDeviceGlobal::perObjectUboStruct.positionScale = Vec4( vertexBuffer.GetPositionScale(), vertexBuffer.GetVertexFormat() == VertexBuffer::VertexFormat::PTNTC_Quantized ? 1.0f : 0.0f );
+    GfxDeviceGlobal::perObjectUboStruct.positionOffset = Vec4( vertexBuffer.GetPositionOffset(), 0 );
+
+    UploadPerObjectUbo();
+
+    DrawCommand draw;
+    draw.vertexBuffer = &vertexBuffer;
+    draw.shader = &shader;
+    draw.startIndex = startIndex;
+    draw.endIndex = endIndex;
+    draw.blendMode = blendMode;
+    draw.depthFunc = depthFunc;
+    draw.cullMode = cullMode;
+    draw.fillMode = fillMode;
+    draw.topology = topology;
+    RecordCommand( CommandType::Draw, &draw, sizeof( draw ) );
+
+    Statistics::IncTriangleCount( endIndex - startIndex );
+    Statistics::IncDrawCalls();
+}
+
+void ae3d::GfxDevice::GetNewUniformBuffer()
+{
+}
+
+void ae3d::GfxDevice::SetBonePalette( const Matrix44* matrices, int count )
+{
+    if (count > 0)
+    {
+        RecordCommand( CommandType::UploadBonePalette, matrices, (std::uint32_t)(count * sizeof( Matrix44 )) );
+        Statistics::IncUniformUploadBytes( count * (int)sizeof( Matrix44 ) );
+    }
+}
+
+PerObjectUboStruct& ae3d::GfxDevice::EditPassUniforms()
+{
+    GfxDeviceGlobal::isPassUboDirty = true;
+    return GfxDeviceGlobal::perObjectUboStruct;
+}
+
+void ae3d::GfxDevice::Present()
+{
+    AE3D_ZONE( "GfxDevice::Present" );
+    Statistics::BeginPresentTimeProfiling();
+
+    RecordCommand( CommandType::Present, nullptr, 0 );
+
+    // Swapping keeps both streams' capacity, so steady-state frames don't allocate.
+    GfxDeviceGlobal::presentedCommands.swap( GfxDeviceGlobal::recordingCommands );
+    GfxDeviceGlobal::recordingCommands.clear();
+    GfxDeviceGlobal::isPassUboDirty = true;
+
+    if (GfxDeviceGlobal::isPlaybackCountingEnabled)
+    {
+        const bool isValid = PlaybackCommands( GfxDeviceGlobal::presentedCommands.data(), GfxDeviceGlobal::presentedCommands.size(), GfxDeviceGlobal::lastFrameCounts );
+        System::Assert( isValid, "recorded command stream is malformed" );
+    }
+
+    Statistics::EndPresentTimeProfiling();
+}
+
+void ae3d::GfxDevice::ReleaseGPUObjects()
+{
+    Shader::DestroyShaders();
+    Texture2D::DestroyTextures();
+    TextureCube::DestroyTextures();
+    RenderTexture::DestroyTextures();
+    VertexBuffer::DestroyBuffers();
+    GfxDeviceGlobal::lightTiler.DestroyBuffers();
+
+    GfxDeviceGlobal::recordingCommands.clear();
+    GfxDeviceGlobal::presentedCommands.clear();
+}
+
+void ae3d::GfxDevice::SetRenderTarget( RenderTexture* target, unsigned cubeMapFace )
+{
+    GfxDeviceGlobal::renderTexture0 = target;
+
+    struct
+    {
+        RenderTexture* target;
+        unsigned cubeMapFace;
+    } payload = { target, cubeMapFace };
+
+    RecordCommand( CommandType::SetRenderTarget, &payload, sizeof( payload ) );
+    Statistics::IncRenderTargetBinds();
+}
@@ -0,0 +1,57 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include "LightTiler.hpp"
+#include "ComputeShader.hpp"
+#include "GfxDevice.hpp"
+#include "Matrix.hpp"
+#include "RenderTexture.hpp"
+
+namespace GfxDeviceGlobal
+{
+    extern unsigned backBufferWidth;
+    extern unsigned backBufferHeight;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
+}
+
+void ae3d::LightTiler::Init()
+{
+}
+
+void ae3d::LightTiler::DestroyBuffers()
+{
+}
+
+void ae3d::LightTiler::UpdateLightBuffers()
+{
+    const int lightCounts[ 2 ] = { activePointLights, activeSpotLights };
+    GfxDevice::RecordCommand( GfxDevice::CommandType::UploadLightBuffers, lightCounts, sizeof( lightCounts ) );
+}
+
+unsigned ae3d::LightTiler::GetNumTilesX() const
+{
+    return (unsigned)((GfxDeviceGlobal::backBufferWidth + TileRes - 1) / (float)TileRes);
+}
+
+unsigned ae3d::LightTiler::GetNumTilesY() const
+{
+    return (unsigned)((GfxDeviceGlobal::backBufferHeight + TileRes - 1) / (float)TileRes);
+}
+
+void ae3d::LightTiler::CullLights( ComputeShader& shader, const Matrix44& projection, const Matrix44& localToView, RenderTexture& depthNormalTarget )
+{
+    PerObjectUboStruct& passUniforms = GfxDevice::EditPassUniforms();
+    Matrix44::Invert( projection, passUniforms.clipToView );
+
+    GfxDeviceGlobal::perObjectUboStruct.localToView = localToView;
+    passUniforms.windowWidth = depthNormalTarget.GetWidth();
+    passUniforms.windowHeight = depthNormalTarget.GetHeight();
+    passUniforms.numLights = (((unsigned)activeSpotLights & 0xFFFFu) << 16) | ((unsigned)activePointLights & 0xFFFFu);
+    passUniforms.maxNumLightsPerTile = GetMaxNumLightsPerTile();
+    passUniforms.tilesXY.x = (float)GetNumTilesX();
+    passUniforms.tilesXY.y = (float)GetNumTilesY();
+
+    shader.Begin();
+    shader.SetRenderTexture( 0, &depthNormalTarget );
+    shader.Dispatch( GetNumTilesX(), GetNumTilesY(), 1 );
+    shader.End();
+}
@@ -0,0 +1,24 @@
+#include "Renderer.hpp"
+#include "FileSystem.hpp"
+
+ae3d::Renderer renderer;
+
+// The null renderer doesn't compile shaders, so only their paths are needed.
+static ae3d::FileSystem::FileContentsData ShaderPath( const char* path )
+{
+    ae3d::FileSystem::FileContentsData contents;
+    contents.path = path;
+    return contents;
+}
+
+void ae3d::BuiltinShaders::Load()
+{
+    const FileSystem::FileContentsData empty;
+    spriteRendererShader.Load( "sprite_vertex", "sprite_fragment", empty, empty, ShaderPath( "sprite_vert.spv" ), ShaderPath( "sprite_frag.spv" ) );
+    sdfShader.Load( "sprite_vertex", "sdf_fragment", empty, empty, ShaderPath( "sprite_vert.spv" ), ShaderPath( "sprite_frag.spv" ) );
+    skyboxShader.Load( "skybox_vertex", "skybox_fragment", empty, empty, ShaderPath( "skybox_vert.spv" ), ShaderPath( "skybox_frag.spv" ) );
+    momentsShader.Load( "moments_vertex", "moments_fragment", empty, empty, ShaderPath( "moments_vert.spv" ), ShaderPath( "moments_frag.spv" ) );
+    momentsSkinShader.Load( "moments_skin_vertex", "moments_fragment", empty, empty, ShaderPath( "moments_skin_vert.spv" ), ShaderPath( "moments_frag.spv" ) );
+    depthNormalsShader.Load( "depthnormals_vertex", "depthnormals_fragment", empty, empty, ShaderPath( "depthnormals_vert.spv" ), ShaderPath( "depthnormals_frag.spv" ) );
+    uiShader.Load( "sprite_vertex", "sprite_fragment", empty, empty, ShaderPath( "sprite_vert.spv" ), ShaderPath( "sprite_frag.spv" ) );
+}
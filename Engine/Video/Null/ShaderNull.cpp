@@ -0,0 +1,92 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include "Shader.hpp"
+#include "FileSystem.hpp"
+#include "GfxDevice.hpp"
+#include "RenderTexture.hpp"
+#include "Statistics.hpp"
+#include "System.hpp"
+#include "Texture2D.hpp"
+#include "TextureCube.hpp"
+
+namespace GfxDeviceGlobal
+{
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
+    extern ae3d::RenderTexture* renderTexture0;
+}
+
+static void RecordTexture( int textureUnit, const void* texture )
+{
+    struct
+    {
+        int textureUnit;
+        const void* texture;
+    } payload = { textureUnit, texture };
+
+    ae3d::GfxDevice::RecordCommand( ae3d::GfxDevice::CommandType::SetTexture, &payload, sizeof( payload ) );
+}
+
+void ae3d::Shader::DestroyShaders()
+{
+}
+
+void ae3d::Shader::Load( const char* /*vertexSource*/, const char* /*fragmentSource*/ )
+{
+}
+
+void ae3d::Shader::Load( const char* /*metalVertexShaderName*/, const char* /*metalFragmentShaderName*/,
+    const FileSystem::FileContentsData& /*vertexHLSL*/, const FileSystem::FileContentsData& /*fragmentHLSL*/,
+    const FileSystem::FileContentsData& vertexDataSPIRV, const FileSystem::FileContentsData& fragmentDataSPIRV )
+{
+    vertexPath = vertexDataSPIRV.path;
+    fragmentPath = fragmentDataSPIRV.path;
+}
+
+void ae3d::Shader::Use()
+{
+    System::Assert( IsValid(), "no valid shader" );
+
+    const Shader* shader = this;
+    GfxDevice::RecordCommand( GfxDevice::CommandType::UseShader, &shader, sizeof( shader ) );
+    Statistics::IncShaderBinds();
+}
+
+void ae3d::Shader::SetUniform( int /*offset*/, void* /*data*/, int /*dataBytes*/ )
+{
+}
+
+void ae3d::Shader::SetTexture( Texture2D* texture, int textureUnit )
+{
+    if (texture == nullptr)
+    {
+        return;
+    }
+
+    if (textureUnit == 0)
+    {
+        GfxDeviceGlobal::perObjectUboStruct.tex0scaleOffset = texture->GetScaleOffset();
+    }
+
+    RecordTexture( textureUnit, texture );
+}
+
+void ae3d::Shader::SetTexture( TextureCube* texture, int textureUnit )
+{
+    if (texture == nullptr)
+    {
+        return;
+    }
+
+    RecordTexture( textureUnit, texture );
+}
+
+void ae3d::Shader::SetRenderTexture( RenderTexture* texture, int textureUnit )
+{
+    // Prevents feedback.
+    if (texture == nullptr || texture == GfxDeviceGlobal::renderTexture0)
+    {
+        return;
+    }
+
+    RecordTexture( textureUnit, texture );
+}
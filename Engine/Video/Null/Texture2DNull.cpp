@@ -0,0 +1,153 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include "Texture2D.hpp"
+#include <map>
+#include <string>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.c"
+#include "DDSLoader.hpp"
+#include "FileSystem.hpp"
+#include "Statistics.hpp"
+#include "System.hpp"
+
+bool HasStbExtension( const std::string& path ); // Defined in TextureCommon.cpp
+
+namespace MathUtil
+{
+    int GetMipmapCount( int width, int height );
+}
+
+namespace Texture2DGlobal
+{
+    extern std::map< std::string, ae3d::Texture2D > hashToCachedTexture;
+
+    ae3d::Texture2D defaultTexture;
+    ae3d::Texture2D defaultTextureUAV;
+    unsigned nextHandle = 1;
+}
+
+// The null renderer decodes images to get their dimensions and discards the pixels.
+
+void ae3d::Texture2D::DestroyTextures()
+{
+    Texture2DGlobal::hashToCachedTexture.clear();
+}
+
+void ae3d::Texture2D::SetLayout( TextureLayout /*layout*/ )
+{
+}
+
+void ae3d::Texture2D::CreateUAV( int aWidth, int aHeight, const char* /*debugName*/ )
+{
+    width = aWidth;
+    height = aHeight;
+    wrap = TextureWrap::Repeat;
+    filter = TextureFilter::Nearest;
+    handle = Texture2DGlobal::nextHandle++;
+}
+
+void ae3d::Texture2D::LoadFromData( const void* /*imageData*/, int aWidth, int aHeight, int channels, const char* /*debugName*/ )
+{
+    width = aWidth;
+    height = aHeight;
+    wrap = TextureWrap::Repeat;
+    filter = TextureFilter::Linear;
+    opaque = channels == 3;
+    handle = Texture2DGlobal::nextHandle++;
+}
+
+void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, TextureWrap aWrap, TextureFilter aFilter, Mipmaps aMipmaps, ColorSpace aColorSpace, Anisotropy aAnisotropy )
+{
+    AE3D_ZONE( "Texture2D::Load" );
+    filter = aFilter;
+    wrap = aWrap;
+    mipmaps = aMipmaps;
+    anisotropy = aAnisotropy;
+    colorSpace = aColorSpace;
+    path = fileContents.path;
+
+    if (!fileContents.isLoaded)
+    {
+        *this = *Texture2D::GetDefaultTexture();
+        return;
+    }
+
+    const std::string cacheHash = GetCacheHash( fileContents.path, aWrap, aFilter, aMipmaps, aColorSpace, aAnisotropy );
+    const auto cached = Texture2DGlobal::hashToCachedTexture.find( cacheHash );
+
+    if (cached != std::end( Texture2DGlobal::hashToCachedTexture ) && handle == 0)
+    {
+        *this = cached->second;
+        return;
+    }
+
+    const bool isDDS = fileContents.path.find( ".dds" ) != std::string::npos || fileContents.path.find( ".DDS" ) != std::string::npos;
+
+    if (HasStbExtension( fileContents.path ))
+    {
+        LoadSTB( fileContents );
+    }
+    else if (isDDS)
+    {
+        LoadDDS( fileContents.path.c_str() );
+    }
+    else
+    {
+        System::Print( "Unknown/unsupported texture file extension: %s\n", fileContents.path.c_str() );
+    }
+
+    mipLevelCount = (mipmaps == Mipmaps::Generate && mipLevelCount == 1) ? MathUtil::GetMipmapCount( width, height ) : mipLevelCount;
+    handle = Texture2DGlobal::nextHandle++;
+    Texture2DGlobal::hashToCachedTexture[ cacheHash ] = *this;
+}
+
+void ae3d::Texture2D::LoadDDS( const char* aPath )
+{
+    DDSLoader::Output ddsOutput;
+    auto fileContents = FileSystem::FileContents( aPath );
+    const DDSLoader::LoadResult loadResult = DDSLoader::Load( fileContents, width, height, opaque, ddsOutput );
+
+    if (loadResult != DDSLoader::LoadResult::Success)
+    {
+        System::Print( "DDS Loader could not load %s", aPath );
+        return;
+    }
+
+    mipLevelCount = mipmaps == Mipmaps::Generate ? ddsOutput.dataOffsets.count : 1;
+}
+
+void ae3d::Texture2D::LoadSTB( const FileSystem::FileContentsData& fileContents )
+{
+    int components;
+    unsigned char* data = stbi_load_from_memory( fileContents.data.data(), static_cast<int>(fileContents.data.size()), &width, &height, &components, 4 );
+
+    if (data == nullptr)
+    {
+        const std::string reason( stbi_failure_reason() );
+        System::Print( "%s failed to load. stb_image's reason: %s\n", fileContents.path.c_str(), reason.c_str() );
+        return;
+    }
+
+    opaque = (components == 3 || components == 1);
+    stbi_image_free( data );
+}
+
+ae3d::Texture2D* ae3d::Texture2D::GetDefaultTexture()
+{
+    if (Texture2DGlobal::defaultTexture.handle == 0)
+    {
+        Texture2DGlobal::defaultTexture.LoadFromData( nullptr, 32, 32, 4, "default texture 2d" );
+    }
+
+    return &Texture2DGlobal::defaultTexture;
+}
+
+ae3d::Texture2D* ae3d::Texture2D::GetDefaultTextureUAV()
+{
+    if (Texture2DGlobal::defaultTextureUAV.handle == 0)
+    {
+        Texture2DGlobal::defaultTextureUAV.CreateUAV( 32, 32, "default texture 2d UAV" );
+    }
+
+    return &Texture2DGlobal::defaultTextureUAV;
+}
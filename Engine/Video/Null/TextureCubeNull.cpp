@@ -0,0 +1,98 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include "TextureCube.hpp"
+#include <string>
+#include "stb_image.c"
+#include "DDSLoader.hpp"
+#include "FileSystem.hpp"
+#include "System.hpp"
+
+bool HasStbExtension( const std::string& path ); // Defined in TextureCommon.cpp
+
+namespace Texture2DGlobal
+{
+    extern unsigned nextHandle;
+}
+
+namespace TextureCubeGlobal
+{
+    ae3d::TextureCube defaultTexture;
+}
+
+void ae3d::TextureCube::DestroyTextures()
+{
+}
+
+ae3d::TextureCube* ae3d::TextureCube::GetDefaultTexture()
+{
+    if (TextureCubeGlobal::defaultTexture.handle == 0)
+    {
+        TextureCubeGlobal::defaultTexture.width = 32;
+        TextureCubeGlobal::defaultTexture.height = 32;
+        TextureCubeGlobal::defaultTexture.isCube = true;
+        TextureCubeGlobal::defaultTexture.handle = Texture2DGlobal::nextHandle++;
+    }
+
+    return &TextureCubeGlobal::defaultTexture;
+}
+
+void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const FileSystem::FileContentsData& posX,
+                              const FileSystem::FileContentsData& negY, const FileSystem::FileContentsData& posY,
+                              const FileSystem::FileContentsData& negZ, const FileSystem::FileContentsData& posZ,
+                              TextureWrap aWrap, TextureFilter aFilter, Mipmaps aMipmaps, ColorSpace aColorSpace )
+{
+    filter = aFilter;
+    wrap = aWrap;
+    mipmaps = aMipmaps;
+    colorSpace = aColorSpace;
+    isCube = true;
+
+    posXpath = posX.path;
+    posYpath = posY.path;
+    posZpath = posZ.path;
+    negXpath = negX.path;
+    negYpath = negY.path;
+    negZpath = negZ.path;
+
+    const FileSystem::FileContentsData* faces[] = { &posX, &negX, &negY, &posY, &negZ, &posZ };
+
+    // Faces are decoded to validate them and to get the dimensions, pixels are discarded.
+    for (int face = 0; face < 6; ++face)
+    {
+        const std::string& facePath = faces[ face ]->path;
+        const bool isDDS = facePath.find( ".dds" ) != std::string::npos || facePath.find( ".DDS" ) != std::string::npos;
+
+        if (HasStbExtension( facePath ))
+        {
+            int components;
+            unsigned char* data = stbi_load_from_memory( faces[ face ]->data.data(), static_cast<int>(faces[ face ]->data.size()), &width, &height, &components, 4 );
+
+            if (data == nullptr)
+            {
+                const std::string reason( stbi_failure_reason() );
+                System::Print( "%s failed to load. stb_image's reason: %s\n", facePath.c_str(), reason.c_str() );
+                return;
+            }
+
+            opaque = (components == 3 || components == 1);
+            stbi_image_free( data );
+        }
+        else if (isDDS)
+        {
+            DDSLoader::Output ddsOutput;
+            const DDSLoader::LoadResult loadResult = DDSLoader::Load( *faces[ face ], width, height, opaque, ddsOutput );
+
+            if (loadResult != DDSLoader::LoadResult::Success)
+            {
+                System::Print( "DDS Loader could not load %s", facePath.c_str() );
+                return;
+            }
+        }
+        else
+        {
+            System::Print( "Unknown/unsupported texture file extension: %s\n", facePath.c_str() );
+        }
+    }
+
+    handle = Texture2DGlobal::nextHandle++;
+}
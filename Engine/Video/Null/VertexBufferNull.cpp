@@ -0,0 +1,114 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include "VertexBuffer.hpp"
+#include "System.hpp"
+
+// The null renderer doesn't keep geometry, it only tracks what draws need for validation.
+
+void ae3d::VertexBuffer::DestroyBuffers()
+{
+}
+
+void ae3d::VertexBuffer::SetDebugName( const char* /*name*/ )
+{
+}
+
+void ae3d::VertexBuffer::Release()
+{
+    elementCount = 0;
+}
+
+void ae3d::VertexBuffer::Bind() const
+{
+}
+
+void ae3d::VertexBuffer::GenerateDynamic( int faceCount, int /*vertexCount*/ )
+{
+    vertexFormat = VertexFormat::PTNTC;
+    indexFormat = IndexFormat::UInt16;
+    elementCount = faceCount * 3;
+}
+
+void ae3d::VertexBuffer::UpdateDynamic( const Face* /*faces*/, int faceCount, const VertexPTC* /*vertices*/, int /*vertexCount*/ )
+{
+    System::Assert( faceCount * 3 <= elementCount, "Index buffer too small!" );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* /*faces*/, int faceCount, const VertexPTC* /*vertices*/, int /*vertexCount*/, Storage /*storage*/ )
+{
+    vertexFormat = VertexFormat::PTNTC;
+    indexFormat = IndexFormat::UInt16;
+    elementCount = faceCount * 3;
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTN* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTN* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount, const Vec3& aPositionScale, const Vec3& aPositionOffset )
+{
+    positionScale = aPositionScale;
+    positionOffset = aPositionOffset;
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount, const Vec3& aPositionScale, const Vec3& aPositionOffset )
+{
+    positionScale = aPositionScale;
+    positionOffset = aPositionOffset;
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::GenerateIndexed( const void* /*faces*/, IndexFormat aIndexFormat, int faceCount, const VertexPTN* /*vertices*/, int /*vertexCount*/ )
+{
+    vertexFormat = VertexFormat::PTNTC;
+    indexFormat = aIndexFormat;
+    elementCount = faceCount * 3;
+}
+
+void ae3d::VertexBuffer::GenerateIndexed( const void* /*faces*/, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC* /*vertices*/, int /*vertexCount*/ )
+{
+    vertexFormat = VertexFormat::PTNTC;
+    indexFormat = aIndexFormat;
+    elementCount = faceCount * 3;
+}
+
+void ae3d::VertexBuffer::GenerateIndexed( const void* /*faces*/, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC_Skinned* /*vertices*/, int /*vertexCount*/ )
+{
+    vertexFormat = VertexFormat::PTNTC_Skinned;
+    indexFormat = aIndexFormat;
+    elementCount = faceCount * 3;
+}
+
+void ae3d::VertexBuffer::GenerateIndexed( const void* /*faces*/, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC_Quantized* /*vertices*/, int /*vertexCount*/ )
+{
+    vertexFormat = VertexFormat::PTNTC_Quantized;
+    indexFormat = aIndexFormat;
+    elementCount = faceCount * 3;
+}
@@ -3,12 +3,14 @@
 #include <string>
 #include <map>
 #include <vector>
-#include <sstream>
+#include <istream>
 #include "Texture2D.hpp"
 #include "System.hpp"
 #include "FileSystem.hpp"
+#include "Statistics.hpp"
+#include "ViewStreamBuf.hpp"
 
-#if defined( RENDERER_METAL ) || defined( RENDERER_VULKAN )
+#if defined( RENDERER_METAL ) || defined( RENDERER_VULKAN ) || defined( RENDERER_NULL )
 namespace Texture2DGlobal
 {
     std::map< std::string, ae3d::Texture2D > hashToCachedTexture;
@@ -176,17 +178,35 @@ void TexReload( const std::string& path )
 
 void ae3d::Texture2D::LoadFromAtlas( const FileSystem::FileContentsData& atlasTextureData, const FileSystem::FileContentsData& atlasMetaData, const char* textureName, TextureWrap aWrap, TextureFilter aFilter, ColorSpace aColorSpace, Anisotropy aAnisotropy )
 {
+    AE3D_ZONE( "Texture2D::LoadFromAtlas" );
     Load( atlasTextureData, aWrap, aFilter, mipmaps, aColorSpace, aAnisotropy );
 
-    const std::string metaStr = std::string( std::begin( atlasMetaData.data ), std::end( atlasMetaData.data ) );
-    std::stringstream metaStream( metaStr );
+    FileSystem::FileView metaView;
+    metaView.data = atlasMetaData.data.data();
+    metaView.size = atlasMetaData.data.size();
+    LoadAtlasMetaData( metaView, atlasMetaData.path.c_str(), textureName );
+}
+
+void ae3d::Texture2D::LoadFromAtlas( const FileSystem::FileContentsData& atlasTextureData, const FileSystem::MappedFile& atlasMetaData, const char* textureName, TextureWrap aWrap, TextureFilter aFilter, ColorSpace aColorSpace, Anisotropy aAnisotropy )
+{
+    AE3D_ZONE( "Texture2D::LoadFromAtlas" );
+    Load( atlasTextureData, aWrap, aFilter, mipmaps, aColorSpace, aAnisotropy );
+    LoadAtlasMetaData( atlasMetaData.GetView(), atlasMetaData.GetPath().c_str(), textureName );
+}
+
+void ae3d::Texture2D::LoadAtlasMetaData( const FileSystem::FileView& metaData, const char* metaPath, const char* textureName )
+{
+    const std::string pathString( metaPath );
 
-    if (atlasMetaData.path.find( ".xml" ) == std::string::npos && atlasMetaData.path.find( ".XML" ) == std::string::npos)
+    if (pathString.find( ".xml" ) == std::string::npos && pathString.find( ".XML" ) == std::string::npos)
     {
-        System::Print( "Atlas meta data path %s extension is not .xml!", atlasMetaData.path.c_str() );
+        System::Print( "Atlas meta data path %s extension is not .xml!", metaPath );
         return;
     }
 
+    FileSystem::ViewStreamBuf metaBuf( metaData.data, metaData.size );
+    std::istream metaStream( &metaBuf );
+
     std::string line;
 
     while (std::getline( metaStream, line ))
@@ -14,12 +14,17 @@
 
 namespace ae3d
 {
-    /// Contains a vertex and index buffer. Indices are 16-bit.
+#if RENDERER_VULKAN
+    struct VulkanAllocation;
+#endif
+
+    /// Contains a vertex and index buffer. Indices are 16-bit, or 32-bit if generated from Face32.
     class VertexBuffer
     {
     public:
         enum class Storage { CPU, GPU };
-        enum class VertexFormat { PTC, PTN, PTNTC, PTNTC_Skinned, Empty };
+        enum class VertexFormat { PTC, PTN, PTNTC, PTNTC_Skinned, PTNTC_Quantized, Empty };
+        enum class IndexFormat { UInt16, UInt32 };
 
         /// Triangle of 3 vertices.
         struct Face
@@ -35,6 +40,20 @@ namespace ae3d
             unsigned short a, b, c;
         };
 
+        /// Triangle of 3 vertices, for meshes that have more vertices than 16-bit indices can address.
+        struct Face32
+        {
+            Face32() noexcept : a(0), b(0), c(0) {}
+
+            Face32( unsigned fa, unsigned fb, unsigned fc )
+            : a( fa )
+            , b( fb )
+            , c( fc )
+            {}
+
+            unsigned a, b, c;
+        };
+
         /// Vertex with position, texture coordinate and color.
         struct VertexPTC
         {
@@ -80,6 +99,17 @@ namespace ae3d
             Vec3 normal;
         };
 
+        /// VertexPTNTC in 24 bytes. Position xyz is 16-bit normalized and dequantized in shaders with GetPositionScale() and GetPositionOffset(),
+        /// position w is the tangent handedness. Normal and tangent are octahedral-encoded, texcoord is half-float and color is 8-bit normalized.
+        struct VertexPTNTC_Quantized
+        {
+            short position[ 4 ];
+            unsigned short uv[ 2 ];
+            short normal[ 2 ];
+            short tangent[ 2 ];
+            unsigned char color[ 4 ];
+        };
+
 #if RENDERER_VULKAN
 		VertexBuffer() noexcept : bindingDescriptions(), attributeDescriptions() {}
 #endif
@@ -102,6 +132,9 @@ namespace ae3d
 
         /// \return IB view
         const D3D12_INDEX_BUFFER_VIEW* GetIndexView() const { return &indexBufferView; }
+
+        /// Frees buffers passed to Release(). Must be called after the GPU has finished the frames that used them.
+        static void FreePendingBuffers();
 #endif
 
         /// Binds the buffer. Must be called before GfxDevice::Draw.
@@ -112,6 +145,18 @@ namespace ae3d
 
         VertexFormat GetVertexFormat() const { return vertexFormat; }
 
+        /// \return Index format.
+        IndexFormat GetIndexFormat() const { return indexFormat; }
+
+        /// \return Index size in bytes.
+        int GetIndexSize() const { return indexFormat == IndexFormat::UInt32 ? 4 : 2; }
+
+        /// \return Scale that shaders apply to vertex positions. Only quantized vertices are scaled.
+        Vec3 GetPositionScale() const { return vertexFormat == VertexFormat::PTNTC_Quantized ? positionScale : Vec3( 1, 1, 1 ); }
+
+        /// \return Offset that shaders add to scaled vertex positions. Only quantized vertices are offset.
+        Vec3 GetPositionOffset() const { return vertexFormat == VertexFormat::PTNTC_Quantized ? positionOffset : Vec3( 0, 0, 0 ); }
+
         /// \return True if the buffer contains geometry ready for rendering.
         bool IsGenerated() const { return elementCount != 0; }
 
@@ -156,6 +201,45 @@ namespace ae3d
         /// \param vertexCount Vertex count.
         void Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount );
 
+        /// Generates the buffer from supplied geometry with 32-bit indices.
+        /// \param faces Faces.
+        /// \param faceCount Face count.
+        /// \param vertices Vertices.
+        /// \param vertexCount Vertex count.
+        void Generate( const Face32* faces, int faceCount, const VertexPTN* vertices, int vertexCount );
+
+        /// Generates the buffer from supplied geometry with 32-bit indices.
+        /// \param faces Faces.
+        /// \param faceCount Face count.
+        /// \param vertices Vertices.
+        /// \param vertexCount Vertex count.
+        void Generate( const Face32* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount );
+
+        /// Generates the buffer from supplied geometry with 32-bit indices.
+        /// \param faces Faces.
+        /// \param faceCount Face count.
+        /// \param vertices Vertices.
+        /// \param vertexCount Vertex count.
+        void Generate( const Face32* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount );
+
+        /// Generates the buffer from supplied geometry with quantized vertices.
+        /// \param faces Faces.
+        /// \param faceCount Face count.
+        /// \param vertices Vertices.
+        /// \param vertexCount Vertex count.
+        /// \param aPositionScale Scale of normalized positions.
+        /// \param aPositionOffset Offset added to scaled positions.
+        void Generate( const Face* faces, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount, const Vec3& aPositionScale, const Vec3& aPositionOffset );
+
+        /// Generates the buffer from supplied geometry with quantized vertices and 32-bit indices.
+        /// \param faces Faces.
+        /// \param faceCount Face count.
+        /// \param vertices Vertices.
+        /// \param vertexCount Vertex count.
+        /// \param aPositionScale Scale of normalized positions.
+        /// \param aPositionOffset Offset added to scaled positions.
+        void Generate( const Face32* faces, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount, const Vec3& aPositionScale, const Vec3& aPositionOffset );
+
         /// Sets a graphics API debug name for the buffer, visible in debugging tools. Must be called after Generate().
         /// \param name Name
         void SetDebugName( const char* name );
@@ -177,14 +261,21 @@ namespace ae3d
 #if RENDERER_VULKAN
         static const unsigned VERTEX_BUFFER_BIND_ID = 0;
 
-        VkPipelineVertexInputStateCreateInfo* GetInputState() { return &inputStateCreateInfo; }
-        VkBuffer* GetVertexBuffer() { return &vertexBuffer; }
-        VkBuffer* GetIndexBuffer() { return &indexBuffer; }
+        const VkPipelineVertexInputStateCreateInfo* GetInputState() const { return &inputStateCreateInfo; }
+
+        /// Sets up only the vertex input state of a format, without buffers. Used to create pipelines before a mesh with the format is loaded.
+        void CreateInputStateForFormat( VertexFormat format );
+
+        const VkBuffer* GetVertexBuffer() const { return &vertexBuffer; }
+        const VkBuffer* GetIndexBuffer() const { return &indexBuffer; }
 
 #endif
         /// Destroys graphics API objects.
         static void DestroyBuffers();
 
+        /// Releases the graphics API buffers after the frames that can still draw them have finished. The buffer can be generated again after this.
+        void Release();
+
         static const int posChannel = 0;
         static const int uvChannel = 1;
         static const int colorChannel = 2;
@@ -194,6 +285,11 @@ namespace ae3d
         static const int weightChannel = 6;
 
     private:
+        /// Implements the Face and Face32 versions of Generate(). faces contains faceCount * 3 indices of indexFormat.
+        void GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTN* vertices, int vertexCount );
+        void GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC* vertices, int vertexCount );
+        void GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount );
+        void GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount );
 
 #if RENDERER_D3D12
         void UploadVB( void* faces, void* vertices, unsigned ibSize );
@@ -207,6 +303,9 @@ namespace ae3d
 #endif
         int elementCount = 0;
         VertexFormat vertexFormat = VertexFormat::PTC;
+        IndexFormat indexFormat = IndexFormat::UInt16;
+        Vec3 positionScale = Vec3( 1, 1, 1 );
+        Vec3 positionOffset = Vec3( 0, 0, 0 );
 #if RENDERER_METAL
         id<MTLBuffer> vertexBuffer;
         id<MTLBuffer> indexBuffer;
@@ -216,18 +315,18 @@ namespace ae3d
         void CreateInputState( int vertexStride );
 
         VkBuffer vertexBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory vertexMem = VK_NULL_HANDLE;
+        VulkanAllocation* vertexMem = nullptr;
         VkPipelineVertexInputStateCreateInfo inputStateCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO, nullptr, 0, 0, nullptr, 0, nullptr };
         VkVertexInputBindingDescription bindingDescriptions;
         VkVertexInputAttributeDescription attributeDescriptions[ 7 ];
 
         VkBuffer indexBuffer = VK_NULL_HANDLE;
-        VkDeviceMemory indexMem = VK_NULL_HANDLE;
+        VulkanAllocation* indexMem = nullptr;
 
         struct Buffer
         {
             int size = 0;
-            VkDeviceMemory memory;
+            VulkanAllocation* memory = nullptr;
             VkBuffer buffer;
             void* mappedData = nullptr;
         };
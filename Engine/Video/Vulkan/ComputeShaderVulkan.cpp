@@ -24,8 +24,8 @@ namespace GfxDeviceGlobal
     extern VkCommandBuffer computeCmdBuffer;
     extern VkPipelineLayout pipelineLayout;
     extern VkPipelineCache pipelineCache;
-    extern PerObjectUboStruct perObjectUboStruct;
-    extern VkImageView boundViews[ 13 ];
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
+    extern thread_local VkImageView boundViews[ 13 ];
 }
 
 namespace ComputeShaderGlobal
@@ -132,8 +132,8 @@ void ae3d::ComputeShader::SetUniform( UniformName uniform, float x, float y )
 {
     if( uniform == UniformName::TilesZW )
     {
-        GfxDeviceGlobal::perObjectUboStruct.tilesXY.z = x;
-        GfxDeviceGlobal::perObjectUboStruct.tilesXY.w = y;
+        GfxDevice::EditPassUniforms().tilesXY.z = x;
+        GfxDevice::EditPassUniforms().tilesXY.w = y;
     }
 }
 
@@ -201,8 +201,8 @@ void ae3d::ComputeShader::Dispatch( unsigned groupCountX, unsigned groupCountY,
 {
     System::Assert( GfxDeviceGlobal::computeCmdBuffer != VK_NULL_HANDLE, "Uninitialized compute command buffer" );
 
-    BindComputeDescriptorSet();
     UploadPerObjectUbo();
+    BindComputeDescriptorSet();
 
     vkCmdBindPipeline( GfxDeviceGlobal::computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pso );
     vkCmdDispatch( GfxDeviceGlobal::computeCmdBuffer, groupCountX, groupCountY, groupCountZ );
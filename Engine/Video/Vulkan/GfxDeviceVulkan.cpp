@@ -2,8 +2,15 @@
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "GfxDevice.hpp"
 #include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <vector> 
 #include <string>
 #include <vulkan/vulkan.h>
@@ -19,13 +26,17 @@
 #include "Texture2D.hpp"
 #include "TextureCube.hpp"
 #include "VertexBuffer.hpp"
+#include "VulkanAllocator.hpp"
+#include "VulkanUploader.hpp"
 #include "VulkanUtils.hpp"
 #include "VR.hpp"
+#include "WorkerPool.hpp"
 #if VK_USE_PLATFORM_XCB_KHR
 #include <X11/Xlib-xcb.h>
 #endif
 
 extern ae3d::Renderer renderer;
+ae3d::Shader* FindLoadedShader( const std::string& vertexPath, const std::string& fragmentPath );
 #if VK_USE_PLATFORM_ANDROID_KHR
 ANativeWindow* nativeWindow;
 #endif
@@ -46,11 +57,128 @@ constexpr unsigned UI_FACE_COUNT = 128 * 1024;
 struct Ubo
 {
     VkBuffer ubo = VK_NULL_HANDLE;
-    VkDeviceMemory uboMemory = VK_NULL_HANDLE;
+    ae3d::VulkanAllocation* uboMemory = nullptr;
     VkDescriptorBufferInfo uboDesc = {};
     std::uint8_t* uboData = nullptr;
 };
 
+/// Range of a uniform ring buffer that is bound with a dynamic offset.
+struct UniformAllocation
+{
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    std::uint8_t* data = nullptr;
+};
+
+/// Buffer of a uniform ring. Sub-allocated linearly by bumping head.
+struct UniformRingBuffer
+{
+    Ubo ubo;
+    std::atomic< VkDeviceSize > head{ 0 };
+};
+
+/// Persistently mapped uniform memory of one frame in flight. Rewound when the frame has finished on the GPU. If it runs out
+/// in the middle of a frame, a buffer of twice the size is added, and at the next rewind only the largest buffer is kept.
+struct UniformRing
+{
+    std::vector< std::unique_ptr< UniformRingBuffer > > buffers;
+    std::atomic< UniformRingBuffer* > current{ nullptr };
+    std::mutex growMutex;
+};
+
+constexpr VkDeviceSize UniformRingInitialSize = 1024 * 1024;
+
+/// Resources referenced by a descriptor set. Uniform buffers are bound with dynamic offsets,
+/// so switching to another slot of the same buffer does not need a new set.
+struct DescriptorSetKey
+{
+    VkBuffer ubo = VK_NULL_HANDLE;
+    VkBuffer passUbo = VK_NULL_HANDLE;
+    VkBuffer bonePalette = VK_NULL_HANDLE;
+    VkImageView views[ 4 ] = {}; // Bindings 1/5, 11 and 12.
+    VkSampler samplers[ 2 ] = {};
+};
+
+struct CachedDescriptorSet
+{
+    DescriptorSetKey key;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    unsigned lastUsedFrame = 0;
+};
+
+/// Dynamic state and debug markers of the command buffer a thread is recording. Secondary command buffers don't inherit them
+/// from the primary, so they are set again whenever a thread starts recording into a new command buffer.
+struct RecordingContext
+{
+    VkViewport viewport = {};
+    VkRect2D scissor = {};
+    bool hasViewport = false;
+    bool hasScissor = false;
+    std::vector< std::string > markers;
+};
+
+/// Command pool owned by one recording thread. Secondary command buffers are reused after the pool is reset in Present().
+struct RecordingPool
+{
+    VkCommandPool pool = VK_NULL_HANDLE;
+    std::vector< VkCommandBuffer > cmdBuffers;
+    std::size_t usedCount = 0;
+};
+
+constexpr int MaxRecordingThreads = 8;
+constexpr int MaxFramesInFlight = 3;
+constexpr int MaxGpuScopesPerFrame = 128;
+
+/// Group marker scope that is timed with a pair of timestamp queries.
+struct GpuProfilerScope
+{
+    std::string name;
+    int depth = 0;
+    bool isEnded = false;
+};
+
+/// Resources of one frame in flight. They are recycled when the frame's fence has signaled, so the CPU can record the next
+/// frame while the GPU is still executing earlier ones.
+struct FrameResources
+{
+    VkFence fence = VK_NULL_HANDLE; // Signaled by the frame's last submit.
+    bool isSubmitted = false;
+    VkSemaphore presentCompleteSemaphore = VK_NULL_HANDLE;
+    VkSemaphore renderCompleteSemaphore = VK_NULL_HANDLE;
+    VkCommandPool cmdPool = VK_NULL_HANDLE;
+    VkCommandBuffer drawCmdBuffer = VK_NULL_HANDLE;
+    VkCommandBuffer prePresentCmdBuffer = VK_NULL_HANDLE;
+    VkCommandBuffer postPresentCmdBuffer = VK_NULL_HANDLE;
+    std::vector< VkCommandBuffer > offscreenCmdBuffers;
+    std::size_t usedOffscreenCmdBuffers = 0;
+    // Scope i writes timestamp queries 2 * i and 2 * i + 1 in the frame's range of the query pool.
+    std::vector< GpuProfilerScope > gpuScopes;
+    RecordingPool recordingPools[ MaxRecordingThreads ];
+    UniformRing uniformRing;
+    Ubo bonePalette;
+    ae3d::VertexBuffer uiVertexBuffer;
+    // Deletion queue. Freed when the frame has finished on the GPU.
+    Array< VkBuffer > pendingFreeBuffers;
+    Array< ae3d::VulkanAllocation* > pendingFreeAllocations;
+};
+
+constexpr const char* PSOManifestHeader = "ae3d_pso_manifest 1";
+
+/// Pipeline state without object addresses, so it can be written into a PSO manifest and recreated in a later run.
+struct PSODescription
+{
+    std::string vertexShaderPath;
+    std::string fragmentShaderPath;
+    ae3d::VertexBuffer::VertexFormat vertexFormat = ae3d::VertexBuffer::VertexFormat::PTNTC;
+    ae3d::GfxDevice::BlendMode blendMode = ae3d::GfxDevice::BlendMode::Off;
+    ae3d::GfxDevice::DepthFunc depthFunc = ae3d::GfxDevice::DepthFunc::LessOrEqualWriteOn;
+    ae3d::GfxDevice::CullMode cullMode = ae3d::GfxDevice::CullMode::Back;
+    ae3d::GfxDevice::FillMode fillMode = ae3d::GfxDevice::FillMode::Solid;
+    ae3d::GfxDevice::PrimitiveTopology topology = ae3d::GfxDevice::PrimitiveTopology::Triangles;
+    VkFormat colorFormat = VK_FORMAT_UNDEFINED; // Undefined means the backbuffer.
+    int sampleCount = 1;
+};
+
 namespace GfxDeviceGlobal
 {
     struct SwapchainBuffer
@@ -62,7 +190,7 @@ namespace GfxDeviceGlobal
     struct DepthStencil
     {
         VkImage image = VK_NULL_HANDLE;
-        VkDeviceMemory mem = VK_NULL_HANDLE;
+        ae3d::VulkanAllocation* mem = nullptr;
         VkImageView view = VK_NULL_HANDLE;
     } depthStencil;
     
@@ -70,11 +198,11 @@ namespace GfxDeviceGlobal
     {
         VkImage colorImage = VK_NULL_HANDLE;
         VkImageView colorView = VK_NULL_HANDLE;
-        VkDeviceMemory colorMem = VK_NULL_HANDLE;
+        ae3d::VulkanAllocation* colorMem = nullptr;
 
         VkImage depthImage = VK_NULL_HANDLE;
         VkImageView depthView = VK_NULL_HANDLE;
-        VkDeviceMemory depthMem = VK_NULL_HANDLE;
+        ae3d::VulkanAllocation* depthMem = nullptr;
     } msaaTarget;
 
     VkInstance instance = VK_NULL_HANDLE;
@@ -83,60 +211,94 @@ namespace GfxDeviceGlobal
     VkPhysicalDeviceProperties properties;
     VkClearColorValue clearColor;
     
-    VkCommandBuffer drawCmdBuffers[ 4 ];
     VkCommandBuffer setupCmdBuffer = VK_NULL_HANDLE;
-    VkCommandBuffer prePresentCmdBuffer = VK_NULL_HANDLE;
-    VkCommandBuffer postPresentCmdBuffer = VK_NULL_HANDLE;
     VkCommandBuffer computeCmdBuffer = VK_NULL_HANDLE;
-    VkCommandBuffer offscreenCmdBuffer = VK_NULL_HANDLE;
-    VkCommandBuffer currentCmdBuffer = VK_NULL_HANDLE;
+    VkCommandBuffer offscreenCmdBuffer = VK_NULL_HANDLE; // Taken from the current frame's pool in BeginOffscreen().
+    thread_local VkCommandBuffer currentCmdBuffer = VK_NULL_HANDLE;
     VkCommandBuffer texCmdBuffer = VK_NULL_HANDLE;
     
     VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     VkSurfaceKHR surface = VK_NULL_HANDLE;
     VkRenderPass renderPass = VK_NULL_HANDLE;
     VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    std::string pipelineCachePath = "pipelinecache.bin";
     VkFormat colorFormat;
     VkFormat depthFormat;
     VkColorSpaceKHR colorSpace;
     VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
     VkQueue graphicsQueue = VK_NULL_HANDLE;
     VkQueue computeQueue = VK_NULL_HANDLE;
+    VkQueue transferQueue = VK_NULL_HANDLE;
     std::uint32_t graphicsQueueIndex = 0;
+    std::uint32_t transferQueueIndex = 0;
     Array< SwapchainBuffer > swapchainBuffers;
     Array< VkFramebuffer > frameBuffers;
     VkPhysicalDeviceFeatures deviceFeatures;
-    VkSemaphore presentCompleteSemaphore = VK_NULL_HANDLE;
-    VkSemaphore renderCompleteSemaphore = VK_NULL_HANDLE;
     VkSemaphore offscreenSemaphore = VK_NULL_HANDLE;
     VkCommandPool cmdPool = VK_NULL_HANDLE;
-    VkQueryPool queryPool = VK_NULL_HANDLE;
-    float timings[ 3 ];
+    VkQueryPool queryPool = VK_NULL_HANDLE; // MaxGpuScopesPerFrame * 2 timestamps for each frame in flight.
+    std::vector< int > gpuScopeStack; // Open scopes of the current frame, -1 if the frame ran out of queries.
+    std::vector< std::uint64_t > gpuTimestamps;
     VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
     std::map< std::uint64_t, VkPipeline > psoCache;
+    std::map< std::uint64_t, PSODescription > psoManifest;
+    std::map< std::uint64_t, VkRenderPass > prewarmRenderPasses;
+    std::mutex psoMutex; // Guards psoCache and psoManifest.
     VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
-    Array< VkDescriptorSet > descriptorSets;
-    unsigned descriptorSetIndex = 0;
+    Array< VkDescriptorSet > freeDescriptorSets;
+    unsigned freeDescriptorSetCount = 0;
+    std::map< std::uint64_t, CachedDescriptorSet > descriptorSetCache;
+    std::mutex descriptorSetMutex; // Guards descriptorSetCache and freeDescriptorSets.
+    unsigned frameIndex = 0;
     std::uint32_t queueNodeIndex = UINT32_MAX;
     std::uint32_t currentBuffer = 0;
     ae3d::RenderTexture* renderTexture0 = nullptr;
     VkFramebuffer frameBuffer0 = VK_NULL_HANDLE;
-    VkImageView boundViews[ 13 ];
-    VkSampler boundSamplers[ 2 ];
-    Array< VkBuffer > pendingFreeVBs;
-    Array< Ubo > ubos;
-	unsigned currentUbo = 0;
+    thread_local VkImageView boundViews[ 13 ];
+    thread_local VkSampler boundSamplers[ 2 ];
+    thread_local UniformAllocation drawUniforms;
+    thread_local UniformAllocation passUniforms;
+    thread_local bool isPassUboDirty = true;
     VkSampleCountFlagBits msaaSampleBits = VK_SAMPLE_COUNT_1_BIT;
 	unsigned backBufferWidth;
 	unsigned backBufferHeight;
     ae3d::LightTiler lightTiler;
-    PerObjectUboStruct perObjectUboStruct;
-    ae3d::VertexBuffer uiVertexBuffer;
+    thread_local PerObjectUboStruct perObjectUboStruct;
     ae3d::VertexBuffer::VertexPTC uiVertices[ UI_VERTICE_COUNT ];
     ae3d::VertexBuffer::Face uiFaces[ UI_FACE_COUNT ];
     std::vector< ae3d::VertexBuffer > lineBuffers;
-    bool usedOffscreen = false;
+    thread_local RecordingContext recordingContext;
+    int framesInFlight = 2;
+    FrameResources frames[ MaxFramesInFlight ];
+    // Render pass whose contents are recorded into secondary command buffers.
+    VkCommandBuffer passPrimaryCmdBuffer = VK_NULL_HANDLE;
+    VkRenderPass passRenderPass = VK_NULL_HANDLE;
+    VkFramebuffer passFrameBuffer = VK_NULL_HANDLE;
+    std::vector< VkCommandBuffer > passSecondaryCmdBuffers;
+    VkCommandBuffer cmdBufferAfterPass = VK_NULL_HANDLE; // Set by SetRenderTarget() while a pass is being recorded.
+}
+
+static int GetCurrentFrameSlot()
+{
+    return (int)(GfxDeviceGlobal::frameIndex % (unsigned)GfxDeviceGlobal::framesInFlight);
+}
+
+/// \return Resources of the frame that is being recorded.
+static FrameResources& GetCurrentFrame()
+{
+    return GfxDeviceGlobal::frames[ GetCurrentFrameSlot() ];
+}
+
+static std::uint32_t GetFirstGpuScopeQuery( int frameSlot )
+{
+    return (std::uint32_t)(frameSlot * MaxGpuScopesPerFrame * 2);
+}
+
+/// \return True if a frame that may still be executing on the GPU was recorded on frame.
+static bool IsUsedByFrameInFlight( unsigned frame )
+{
+    return GfxDeviceGlobal::frameIndex - frame < (unsigned)GfxDeviceGlobal::framesInFlight;
 }
 
 namespace ae3d
@@ -145,23 +307,34 @@ namespace ae3d
     {
         namespace Statistics
         {
-            void GetStatistics( char* outStr )
+            void GetStatistics( char* outStr, std::size_t outStrSize )
             {
                 std::string str;
                 str = "frame time: " + std::to_string( ::Statistics::GetFrameTimeMS() ) + " ms\n";
-                str += "present time CPU: " + std::to_string( ::Statistics::GetPresentTimeMS() ) + " ms\n";                
+                str += ::Statistics::GetFrameTimeSummary();
+                str += "present time CPU: " + std::to_string( ::Statistics::GetPresentTimeMS() ) + " ms\n";
+                str += "fence wait CPU: " + std::to_string( ::Statistics::GetFenceWaitTimeMS() ) + " ms\n";
                 str += "shadow pass time CPU: " + std::to_string( ::Statistics::GetShadowMapTimeMS() ) + " ms\n";
-                str += "shadow pass time GPU: unimplemented\n";//std::to_string( ::Statistics::GetShadowMapTimeGpuMS() ) + " ms\n";
+                str += "shadow pass time GPU: " + std::to_string( ::Statistics::GetGpuScopeTimeMS( ::Statistics::ShadowMapsScopeName ) ) + " ms\n";
                 str += "depth pass time CPU: " + std::to_string( ::Statistics::GetDepthNormalsTimeMS() ) + " ms\n";
-                str += "depth pass time GPU: " + std::to_string( ::Statistics::GetDepthNormalsTimeGpuMS() ) + " ms\n";
+                str += "depth pass time GPU: " + std::to_string( ::Statistics::GetGpuScopeTimeMS( ::Statistics::DepthNormalsScopeName ) ) + " ms\n";
                 str += "draw calls: " + std::to_string( ::Statistics::GetDrawCalls() ) + "\n";
                 str += "barrier calls: " + std::to_string( ::Statistics::GetBarrierCalls() ) + "\n";
                 str += "fence calls: " + std::to_string( ::Statistics::GetFenceCalls() ) + "\n";
                 str += "queue submit calls: " + std::to_string( ::Statistics::GetQueueSubmitCalls() ) + "\n";
                 str += "mem alloc calls: " + std::to_string( ::Statistics::GetAllocCalls() ) + " (frame), " + std::to_string( ::Statistics::GetTotalAllocCalls() ) + " (total)\n";
                 str += "triangles: " + std::to_string( ::Statistics::GetTriangleCount() ) + "\n";
+                str += "uniform upload: " + std::to_string( ::Statistics::GetUniformUploadBytes() / 1024 ) + " KiB\n";
+                str += "uniform ring: " + std::to_string( ::Statistics::GetUniformRingBytes() / 1024 ) + " KiB used, " + std::to_string( ::Statistics::GetUniformRingStalls() ) + " stalls\n";
+                str += "descriptor sets: " + std::to_string( ::Statistics::GetDescriptorSetCacheHits() ) + " cache hits, " + std::to_string( ::Statistics::GetDescriptorSetUpdates() ) + " updates\n";
+                str += "PSOs: " + std::to_string( ::Statistics::GetPSOCacheHits() ) + " cache hits, " + std::to_string( ::Statistics::GetPSOCacheMisses() ) + " created\n";
+                str += "first frame time: " + std::to_string( ::Statistics::GetFirstFrameTimeMS() ) + " ms\n";
 
-				std::strcpy( outStr, str.c_str() );
+                const ae3d::VulkanAllocator::Stats memoryStats = ae3d::VulkanAllocator::GetStats();
+                str += "GPU memory: " + std::to_string( memoryStats.usedBytes / (1024 * 1024) ) + " MiB used, " + std::to_string( memoryStats.reservedBytes / (1024 * 1024) ) + " MiB in " +
+                       std::to_string( memoryStats.blockCount ) + " blocks, " + std::to_string( memoryStats.allocationCount ) + " allocations\n";
+
+                std::snprintf( outStr, outStrSize, "%s", str.c_str() );
             }
         }
     }
@@ -219,20 +392,7 @@ namespace ae3d
         AE3D_CHECK_VULKAN( err, "Create MSAA color" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::msaaTarget.colorImage, VK_OBJECT_TYPE_IMAGE, "MSAA color" );
 
-        VkMemoryRequirements memReqs;
-        vkGetImageMemoryRequirements( GfxDeviceGlobal::device, GfxDeviceGlobal::msaaTarget.colorImage, &memReqs );
-        VkMemoryAllocateInfo memAlloc = {};
-        memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memAlloc.allocationSize = memReqs.size;
-        memAlloc.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-        
-        err = vkAllocateMemory( GfxDeviceGlobal::device, &memAlloc, nullptr, &GfxDeviceGlobal::msaaTarget.colorMem );
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::msaaTarget.colorMem, VK_OBJECT_TYPE_DEVICE_MEMORY, "msaaTarget colorMemory" );
-
-        Statistics::IncTotalAllocCalls();
-        AE3D_CHECK_VULKAN( err, "Create MSAA color" );
-
-        vkBindImageMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::msaaTarget.colorImage, GfxDeviceGlobal::msaaTarget.colorMem, 0 );
+        GfxDeviceGlobal::msaaTarget.colorMem = VulkanAllocator::AllocateImage( GfxDeviceGlobal::msaaTarget.colorImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "msaaTarget colorMemory" );
 
         VkImageViewCreateInfo viewInfo = {};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -272,19 +432,7 @@ namespace ae3d
         AE3D_CHECK_VULKAN( err, "MSAA depth image" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::msaaTarget.depthImage, VK_OBJECT_TYPE_IMAGE, "MSAA depth" );
 
-        VkMemoryRequirements memReqs;
-        vkGetImageMemoryRequirements( GfxDeviceGlobal::device, GfxDeviceGlobal::msaaTarget.depthImage, &memReqs );
-        VkMemoryAllocateInfo memAlloc = {};
-        memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        memAlloc.allocationSize = memReqs.size;
-        memAlloc.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-
-        err = vkAllocateMemory( GfxDeviceGlobal::device, &memAlloc, nullptr, &GfxDeviceGlobal::msaaTarget.depthMem );
-        Statistics::IncTotalAllocCalls();
-        AE3D_CHECK_VULKAN( err, "MSAA depth memory" );
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::msaaTarget.depthMem, VK_OBJECT_TYPE_DEVICE_MEMORY, "msaaTarget depthMemory" );
-
-        vkBindImageMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::msaaTarget.depthImage, GfxDeviceGlobal::msaaTarget.depthMem, 0 );
+        GfxDeviceGlobal::msaaTarget.depthMem = VulkanAllocator::AllocateImage( GfxDeviceGlobal::msaaTarget.depthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "msaaTarget depthMemory" );
 
         // Create image view for the MSAA target
         VkImageViewCreateInfo viewInfo = {};
@@ -304,8 +452,11 @@ namespace ae3d
         AE3D_CHECK_VULKAN( err, "MSAA depth view" );
     }
 
-    void CreatePSO( VertexBuffer& vertexBuffer, ae3d::Shader& shader, ae3d::GfxDevice::BlendMode blendMode, ae3d::GfxDevice::DepthFunc depthFunc,
-                    ae3d::GfxDevice::CullMode cullMode, ae3d::GfxDevice::FillMode fillMode, VkRenderPass renderPass, ae3d::GfxDevice::PrimitiveTopology topology, std::uint64_t hash )
+    VkRenderPass CreateRenderTextureRenderPass( VkFormat colorFormat, VkSampleCountFlagBits sampleCount );
+
+    /// Creates a pipeline. Can be called from worker threads, the pipeline cache is internally synchronized.
+    VkPipeline CreatePSO( const VkPipelineVertexInputStateCreateInfo* inputState, ae3d::Shader& shader, ae3d::GfxDevice::BlendMode blendMode, ae3d::GfxDevice::DepthFunc depthFunc,
+                          ae3d::GfxDevice::CullMode cullMode, ae3d::GfxDevice::FillMode fillMode, VkRenderPass renderPass, VkSampleCountFlagBits sampleCount, ae3d::GfxDevice::PrimitiveTopology topology )
     {
         VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
         inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -398,7 +549,7 @@ namespace ae3d
         VkPipelineMultisampleStateCreateInfo multisampleState = {};
         multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
         multisampleState.pSampleMask = nullptr;
-        multisampleState.rasterizationSamples = GfxDeviceGlobal::msaaSampleBits;
+        multisampleState.rasterizationSamples = sampleCount;
 
         VkPipelineShaderStageCreateInfo shaderStages[ 2 ] = { shader.GetVertexInfo(), shader.GetFragmentInfo() };
 
@@ -412,7 +563,7 @@ namespace ae3d
         pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
         pipelineCreateInfo.layout = GfxDeviceGlobal::pipelineLayout;
         pipelineCreateInfo.renderPass = renderPass != VK_NULL_HANDLE ? renderPass : GfxDeviceGlobal::renderPass;
-        pipelineCreateInfo.pVertexInputState = vertexBuffer.GetInputState();
+        pipelineCreateInfo.pVertexInputState = inputState;
         pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
         pipelineCreateInfo.pRasterizationState = &rasterizationState;
         pipelineCreateInfo.pColorBlendState = &colorBlendState;
@@ -429,42 +580,116 @@ namespace ae3d
                                                   nullptr, &pso );
         AE3D_CHECK_VULKAN( err, "vkCreateGraphicsPipelines" );
 
-        GfxDeviceGlobal::psoCache[ hash ] = pso;
+        return pso;
     }
 
-    void AllocateCommandBuffers()
+    /// Pipeline cache header written by the driver, see vkGetPipelineCacheData.
+    struct PipelineCacheHeader
     {
-        System::Assert( GfxDeviceGlobal::cmdPool != VK_NULL_HANDLE, "command pool not initialized" );
-        System::Assert( GfxDeviceGlobal::device != VK_NULL_HANDLE, "device not initialized" );
-        System::Assert( GfxDeviceGlobal::swapchainBuffers.count > 0, "imageCount is 0" );
+        std::uint32_t headerSize;
+        std::uint32_t headerVersion;
+        std::uint32_t vendorID;
+        std::uint32_t deviceID;
+        std::uint8_t pipelineCacheUUID[ VK_UUID_SIZE ];
+    };
+
+    /// \return True if the cache data was written by this driver and device. Some drivers crash on data from another version.
+    bool IsPipelineCacheCompatible( const std::vector< unsigned char >& data )
+    {
+        if (data.size() < sizeof( PipelineCacheHeader ))
+        {
+            return false;
+        }
 
-        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
-        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        commandBufferAllocateInfo.commandPool = GfxDeviceGlobal::cmdPool;
-        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        commandBufferAllocateInfo.commandBufferCount = GfxDeviceGlobal::swapchainBuffers.count;
+        PipelineCacheHeader header;
+        std::memcpy( &header, data.data(), sizeof( PipelineCacheHeader ) );
 
-        VkResult err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &commandBufferAllocateInfo, GfxDeviceGlobal::drawCmdBuffers );
-        AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers" );
+        return header.headerSize >= sizeof( PipelineCacheHeader ) &&
+               header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+               header.vendorID == GfxDeviceGlobal::properties.vendorID &&
+               header.deviceID == GfxDeviceGlobal::properties.deviceID &&
+               std::memcmp( header.pipelineCacheUUID, GfxDeviceGlobal::properties.pipelineCacheUUID, VK_UUID_SIZE ) == 0;
+    }
 
-        for (unsigned i = 0; i < GfxDeviceGlobal::swapchainBuffers.count; ++i)
+    void CreatePipelineCache()
+    {
+        VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+        pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+        // Not read with FileSystem::FileContents() because the file is missing on the first run and it's never inside a .pak.
+        std::vector< unsigned char > cacheData;
+        std::ifstream cacheFile( GfxDeviceGlobal::pipelineCachePath.c_str(), std::ifstream::ate | std::ifstream::binary );
+
+        if (cacheFile.is_open())
         {
-            debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::drawCmdBuffers[ i ], VK_OBJECT_TYPE_COMMAND_BUFFER, "drawCmdBuffer" );
+            cacheData.resize( (std::size_t)cacheFile.tellg() );
+            cacheFile.seekg( std::ifstream::beg );
+            cacheFile.read( (char*)cacheData.data(), cacheData.size() );
         }
-        
-        commandBufferAllocateInfo.commandBufferCount = 1;
 
-        err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &commandBufferAllocateInfo, &GfxDeviceGlobal::postPresentCmdBuffer );
-        AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers" );
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::postPresentCmdBuffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "postPresentCmdBuffer" );
+        if (IsPipelineCacheCompatible( cacheData ))
+        {
+            pipelineCacheCreateInfo.initialDataSize = cacheData.size();
+            pipelineCacheCreateInfo.pInitialData = cacheData.data();
+        }
+        else if (!cacheData.empty())
+        {
+            System::Print( "Ignoring pipeline cache %s, it was created by another device or driver.\n", GfxDeviceGlobal::pipelineCachePath.c_str() );
+        }
 
-        err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &commandBufferAllocateInfo, &GfxDeviceGlobal::prePresentCmdBuffer );
-        AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers" );
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::prePresentCmdBuffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "prePresentCmdBuffer" );
+        VkResult err = vkCreatePipelineCache( GfxDeviceGlobal::device, &pipelineCacheCreateInfo, nullptr, &GfxDeviceGlobal::pipelineCache );
+        AE3D_CHECK_VULKAN( err, "vkCreatePipelineCache" );
+    }
 
-        err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &commandBufferAllocateInfo, &GfxDeviceGlobal::offscreenCmdBuffer );
-        AE3D_CHECK_VULKAN( err, "Offscreen command buffer" );
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::offscreenCmdBuffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "offscreenCmdBuffer" );
+    void SavePipelineCache()
+    {
+        if (GfxDeviceGlobal::pipelineCachePath.empty() || GfxDeviceGlobal::pipelineCache == VK_NULL_HANDLE)
+        {
+            return;
+        }
+
+        std::size_t dataSize = 0;
+        VkResult err = vkGetPipelineCacheData( GfxDeviceGlobal::device, GfxDeviceGlobal::pipelineCache, &dataSize, nullptr );
+        AE3D_CHECK_VULKAN( err, "vkGetPipelineCacheData" );
+
+        std::vector< unsigned char > data( dataSize );
+        err = vkGetPipelineCacheData( GfxDeviceGlobal::device, GfxDeviceGlobal::pipelineCache, &dataSize, data.data() );
+        AE3D_CHECK_VULKAN( err, "vkGetPipelineCacheData" );
+
+        std::ofstream cacheFile( GfxDeviceGlobal::pipelineCachePath.c_str(), std::ofstream::binary | std::ofstream::trunc );
+
+        if (!cacheFile.is_open())
+        {
+            System::Print( "Could not write pipeline cache %s\n", GfxDeviceGlobal::pipelineCachePath.c_str() );
+            return;
+        }
+
+        cacheFile.write( (const char*)data.data(), dataSize );
+    }
+
+    /// \return Render pass that is compatible with the description's render target.
+    VkRenderPass GetCompatibleRenderPass( const PSODescription& description )
+    {
+        if (description.colorFormat == VK_FORMAT_UNDEFINED)
+        {
+            return GfxDeviceGlobal::renderPass;
+        }
+
+        const std::uint64_t key = ((std::uint64_t)description.colorFormat << 8) | (std::uint64_t)description.sampleCount;
+        auto it = GfxDeviceGlobal::prewarmRenderPasses.find( key );
+
+        if (it == std::end( GfxDeviceGlobal::prewarmRenderPasses ))
+        {
+            it = GfxDeviceGlobal::prewarmRenderPasses.insert( std::make_pair( key, CreateRenderTextureRenderPass( description.colorFormat, (VkSampleCountFlagBits)description.sampleCount ) ) ).first;
+        }
+
+        return it->second;
+    }
+
+    void AllocateCommandBuffers()
+    {
+        System::Assert( GfxDeviceGlobal::cmdPool != VK_NULL_HANDLE, "command pool not initialized" );
+        System::Assert( GfxDeviceGlobal::device != VK_NULL_HANDLE, "device not initialized" );
 
         VkCommandBufferAllocateInfo computeBufAllocateInfo = {};
         computeBufAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -472,17 +697,18 @@ namespace ae3d
         computeBufAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
         computeBufAllocateInfo.commandBufferCount = 1;
 
-        err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &computeBufAllocateInfo, &GfxDeviceGlobal::computeCmdBuffer );
+        VkResult err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &computeBufAllocateInfo, &GfxDeviceGlobal::computeCmdBuffer );
         AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::computeCmdBuffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "computeCmdBuffer" );
     }
 
-    void SubmitPrePresentBarrier()
+    /// \param fence Signaled when the frame's commands, which were submitted before this, have completed.
+    void SubmitPrePresentBarrier( VkCommandBuffer prePresentCmdBuffer, VkFence fence )
     {
         VkCommandBufferBeginInfo cmdBufInfo = {};
         cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-        VkResult err = vkBeginCommandBuffer( GfxDeviceGlobal::prePresentCmdBuffer, &cmdBufInfo );
+        VkResult err = vkBeginCommandBuffer( prePresentCmdBuffer, &cmdBufInfo );
         AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer" );
 
         VkImageMemoryBarrier prePresentBarrier = {};
@@ -497,7 +723,7 @@ namespace ae3d
         prePresentBarrier.image = GfxDeviceGlobal::swapchainBuffers[ GfxDeviceGlobal::currentBuffer ].image;
 
         vkCmdPipelineBarrier(
-            GfxDeviceGlobal::prePresentCmdBuffer,
+            prePresentCmdBuffer,
             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
             0,
@@ -506,27 +732,32 @@ namespace ae3d
             1, &prePresentBarrier );
         Statistics::IncBarrierCalls();
 
-        err = vkEndCommandBuffer( GfxDeviceGlobal::prePresentCmdBuffer );
+        err = vkEndCommandBuffer( prePresentCmdBuffer );
         AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer" );
 
         VkSubmitInfo submitInfo = {};
         submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &GfxDeviceGlobal::prePresentCmdBuffer;
+        submitInfo.pCommandBuffers = &prePresentCmdBuffer;
 
-        err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
+        err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, fence );
         AE3D_CHECK_VULKAN( err, "vkQueueSubmit" );
         Statistics::IncQueueSubmitCalls();
     }
 
     void SubmitPostPresentBarrier()
     {
+        VkCommandBuffer postPresentCmdBuffer = GetCurrentFrame().postPresentCmdBuffer;
+
         VkCommandBufferBeginInfo cmdBufInfo = {};
         cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-        VkResult err = vkBeginCommandBuffer( GfxDeviceGlobal::postPresentCmdBuffer, &cmdBufInfo );
+        VkResult err = vkBeginCommandBuffer( postPresentCmdBuffer, &cmdBufInfo );
         AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer" );
 
+        // This is the frame's first submit, so GPU profiler scopes can use the frame's queries after it.
+        vkCmdResetQueryPool( postPresentCmdBuffer, GfxDeviceGlobal::queryPool, GetFirstGpuScopeQuery( GetCurrentFrameSlot() ), MaxGpuScopesPerFrame * 2 );
+
         VkImageMemoryBarrier postPresentBarrier = {};
         postPresentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
         postPresentBarrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
@@ -539,7 +770,7 @@ namespace ae3d
         postPresentBarrier.image = GfxDeviceGlobal::swapchainBuffers[ GfxDeviceGlobal::currentBuffer ].image;
 
         vkCmdPipelineBarrier(
-            GfxDeviceGlobal::postPresentCmdBuffer,
+            postPresentCmdBuffer,
             VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
             VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
             0,
@@ -548,13 +779,13 @@ namespace ae3d
             1, &postPresentBarrier );
         Statistics::IncBarrierCalls();
 
-        err = vkEndCommandBuffer( GfxDeviceGlobal::postPresentCmdBuffer );
+        err = vkEndCommandBuffer( postPresentCmdBuffer );
         AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer" );
 
         VkSubmitInfo submitPostInfo = {};
         submitPostInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
         submitPostInfo.commandBufferCount = 1;
-        submitPostInfo.pCommandBuffers = &GfxDeviceGlobal::postPresentCmdBuffer;
+        submitPostInfo.pCommandBuffers = &postPresentCmdBuffer;
 
         err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitPostInfo, VK_NULL_HANDLE );
         AE3D_CHECK_VULKAN( err, "vkQueueSubmit" );
@@ -942,12 +1173,32 @@ namespace ae3d
         System::Assert( graphicsQueueIndex < queueCount, "graphicsQueueIndex" );
         GfxDeviceGlobal::graphicsQueueIndex = graphicsQueueIndex;
 
+        // Uploads use a transfer-only queue if the device has one that can copy single texels, so mip tails don't need padding.
+        std::uint32_t transferQueueIndex = graphicsQueueIndex;
+
+        for (std::uint32_t q = 0; q < queueCount; ++q)
+        {
+            const VkQueueFlags flags = queueProps[ q ].queueFlags;
+            const VkExtent3D& granularity = queueProps[ q ].minImageTransferGranularity;
+
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+                granularity.width == 1 && granularity.height == 1 && granularity.depth == 1)
+            {
+                transferQueueIndex = q;
+                break;
+            }
+        }
+
+        GfxDeviceGlobal::transferQueueIndex = transferQueueIndex;
+
         float queuePriorities = 0;
-        VkDeviceQueueCreateInfo queueCreateInfo = {};
-        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queueCreateInfo.queueFamilyIndex = graphicsQueueIndex;
-        queueCreateInfo.queueCount = 1;
-        queueCreateInfo.pQueuePriorities = &queuePriorities;
+        VkDeviceQueueCreateInfo queueCreateInfos[ 2 ] = {};
+        queueCreateInfos[ 0 ].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfos[ 0 ].queueFamilyIndex = graphicsQueueIndex;
+        queueCreateInfos[ 0 ].queueCount = 1;
+        queueCreateInfos[ 0 ].pQueuePriorities = &queuePriorities;
+        queueCreateInfos[ 1 ] = queueCreateInfos[ 0 ];
+        queueCreateInfos[ 1 ].queueFamilyIndex = transferQueueIndex;
 
         std::vector< const char* > deviceExtensions;
         deviceExtensions.push_back( VK_KHR_SWAPCHAIN_EXTENSION_NAME );
@@ -981,8 +1232,8 @@ namespace ae3d
         
         VkDeviceCreateInfo deviceCreateInfo = {};
         deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-        deviceCreateInfo.queueCreateInfoCount = 1;
-        deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+        deviceCreateInfo.queueCreateInfoCount = transferQueueIndex != graphicsQueueIndex ? 2 : 1;
+        deviceCreateInfo.pQueueCreateInfos = queueCreateInfos;
         deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
         deviceCreateInfo.enabledExtensionCount = static_cast< std::uint32_t >( deviceExtensions.size() );
         deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
@@ -991,7 +1242,10 @@ namespace ae3d
         AE3D_CHECK_VULKAN( result, "device" );
 
         vkGetPhysicalDeviceMemoryProperties( GfxDeviceGlobal::physicalDevice, &GfxDeviceGlobal::deviceMemoryProperties );
+        VulkanAllocator::Init( GfxDeviceGlobal::device, GfxDeviceGlobal::physicalDevice );
         vkGetDeviceQueue( GfxDeviceGlobal::device, graphicsQueueIndex, 0, &GfxDeviceGlobal::graphicsQueue );
+        vkGetDeviceQueue( GfxDeviceGlobal::device, transferQueueIndex, 0, &GfxDeviceGlobal::transferQueue );
+        VulkanUploader::Init( GfxDeviceGlobal::device, GfxDeviceGlobal::transferQueue, transferQueueIndex, GfxDeviceGlobal::graphicsQueue, graphicsQueueIndex );
 
         const VkFormat depthFormats[ 4 ] = { VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM_S8_UINT, VK_FORMAT_D16_UNORM };
         bool depthFormatFound = false;
@@ -1228,11 +1482,6 @@ namespace ae3d
         image.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
         image.flags = 0;
 
-        VkMemoryAllocateInfo mem_alloc = {};
-        mem_alloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        mem_alloc.allocationSize = 0;
-        mem_alloc.memoryTypeIndex = 0;
-
         VkImageViewCreateInfo depthStencilView = {};
         depthStencilView.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         depthStencilView.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -1249,16 +1498,7 @@ namespace ae3d
         AE3D_CHECK_VULKAN( err, "depth stencil" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::depthStencil.image, VK_OBJECT_TYPE_IMAGE, "depthstencil" );
 
-        VkMemoryRequirements memReqs;
-        vkGetImageMemoryRequirements( GfxDeviceGlobal::device, GfxDeviceGlobal::depthStencil.image, &memReqs );
-        mem_alloc.allocationSize = memReqs.size;
-        mem_alloc.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-        err = vkAllocateMemory( GfxDeviceGlobal::device, &mem_alloc, nullptr, &GfxDeviceGlobal::depthStencil.mem );
-        Statistics::IncTotalAllocCalls();
-        AE3D_CHECK_VULKAN( err, "depth stencil memory" );
-
-        err = vkBindImageMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::depthStencil.image, GfxDeviceGlobal::depthStencil.mem, 0 );
-        AE3D_CHECK_VULKAN( err, "depth stencil memory" );
+        GfxDeviceGlobal::depthStencil.mem = VulkanAllocator::AllocateImage( GfxDeviceGlobal::depthStencil.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "depthstencil memory" );
         SetImageLayout( GfxDeviceGlobal::setupCmdBuffer, GfxDeviceGlobal::depthStencil.image, VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
                         VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1, 0, 1 );
 
@@ -1299,10 +1539,10 @@ namespace ae3d
     {
         const int AE3D_DESCRIPTOR_SETS_COUNT = 1550;
 
-        const std::uint32_t typeCount = 13;
+        const std::uint32_t typeCount = 15;
         const VkDescriptorPoolSize typeCounts[ typeCount ] =
         {
-            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, AE3D_DESCRIPTOR_SETS_COUNT },
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, AE3D_DESCRIPTOR_SETS_COUNT },
             { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, AE3D_DESCRIPTOR_SETS_COUNT },
             { VK_DESCRIPTOR_TYPE_SAMPLER, AE3D_DESCRIPTOR_SETS_COUNT },
             { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, AE3D_DESCRIPTOR_SETS_COUNT },
@@ -1314,7 +1554,9 @@ namespace ae3d
             { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, AE3D_DESCRIPTOR_SETS_COUNT },
             { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, AE3D_DESCRIPTOR_SETS_COUNT },
             { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, AE3D_DESCRIPTOR_SETS_COUNT },
-            { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, AE3D_DESCRIPTOR_SETS_COUNT }
+            { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, AE3D_DESCRIPTOR_SETS_COUNT },
+            { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, AE3D_DESCRIPTOR_SETS_COUNT },
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, AE3D_DESCRIPTOR_SETS_COUNT }
         };
 
         VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
@@ -1327,9 +1569,10 @@ namespace ae3d
         VkResult err = vkCreateDescriptorPool( GfxDeviceGlobal::device, &descriptorPoolInfo, nullptr, &GfxDeviceGlobal::descriptorPool );
         AE3D_CHECK_VULKAN( err, "vkCreateDescriptorPool" );
 
-        GfxDeviceGlobal::descriptorSets.Allocate( AE3D_DESCRIPTOR_SETS_COUNT );
+        GfxDeviceGlobal::freeDescriptorSets.Allocate( AE3D_DESCRIPTOR_SETS_COUNT );
+        GfxDeviceGlobal::freeDescriptorSetCount = GfxDeviceGlobal::freeDescriptorSets.count;
 
-        for (unsigned i = 0; i < GfxDeviceGlobal::descriptorSets.count; ++i)
+        for (unsigned i = 0; i < GfxDeviceGlobal::freeDescriptorSets.count; ++i)
         {
             VkDescriptorSetAllocateInfo allocInfo = {};
             allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -1337,28 +1580,29 @@ namespace ae3d
             allocInfo.descriptorSetCount = 1;
             allocInfo.pSetLayouts = &GfxDeviceGlobal::descriptorSetLayout;
 
-            err = vkAllocateDescriptorSets( GfxDeviceGlobal::device, &allocInfo, &GfxDeviceGlobal::descriptorSets[ i ] );
+            err = vkAllocateDescriptorSets( GfxDeviceGlobal::device, &allocInfo, &GfxDeviceGlobal::freeDescriptorSets[ i ] );
             AE3D_CHECK_VULKAN( err, "vkAllocateDescriptorSets" );
         }
     }
 
-    VkDescriptorSet AllocateDescriptorSet( const VkDescriptorBufferInfo& uboDesc, const VkImageView& view0, VkSampler sampler0, const VkImageView& view1, VkSampler sampler1, const VkImageView& view11, const VkImageView& view12 )
+    void WriteDescriptorSet( VkDescriptorSet outDescriptorSet, const DescriptorSetKey& key )
     {
-        VkDescriptorSet outDescriptorSet = GfxDeviceGlobal::descriptorSets[ GfxDeviceGlobal::descriptorSetIndex ];
-        GfxDeviceGlobal::descriptorSetIndex = (GfxDeviceGlobal::descriptorSetIndex + 1) % GfxDeviceGlobal::descriptorSets.count;
-
         // Binding 0 : Uniform buffer
+        VkDescriptorBufferInfo uboDesc = {};
+        uboDesc.buffer = key.ubo;
+        uboDesc.range = PerDrawUboBlockSize;
+
         VkWriteDescriptorSet uboSet = {};
         uboSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
         uboSet.dstSet = outDescriptorSet;
         uboSet.descriptorCount = 1;
-        uboSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        uboSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         uboSet.pBufferInfo = &uboDesc;
         uboSet.dstBinding = 0;
 
         VkDescriptorImageInfo sampler0Desc = {};
-        sampler0Desc.sampler = sampler0;
-        sampler0Desc.imageView = view0;
+        sampler0Desc.sampler = key.samplers[ 0 ];
+        sampler0Desc.imageView = key.views[ 0 ];
         sampler0Desc.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
         // Binding 1 : Image
@@ -1371,8 +1615,8 @@ namespace ae3d
         imageSet.dstBinding = 1;
 
         VkDescriptorImageInfo sampler1Desc = {};
-        sampler1Desc.sampler = sampler1;
-        sampler1Desc.imageView = view1;
+        sampler1Desc.sampler = key.samplers[ 1 ];
+        sampler1Desc.imageView = key.views[ 1 ];
         sampler1Desc.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
         // Binding 2 : Sampler
@@ -1457,8 +1701,8 @@ namespace ae3d
 		bufferSet5.dstBinding = 10;
 
         VkDescriptorImageInfo sampler11Desc = {};
-        sampler11Desc.sampler = sampler1;
-        sampler11Desc.imageView = view11;
+        sampler11Desc.sampler = key.samplers[ 1 ];
+        sampler11Desc.imageView = key.views[ 2 ];
         sampler11Desc.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
         // Binding 11 : Writable texture
@@ -1472,8 +1716,8 @@ namespace ae3d
 
         // Binding 12 : Image
         VkDescriptorImageInfo sampler3Desc = {};
-        sampler3Desc.sampler = sampler1;
-        sampler3Desc.imageView = view12;
+        sampler3Desc.sampler = key.samplers[ 1 ];
+        sampler3Desc.imageView = key.views[ 3 ];
         sampler3Desc.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
         VkWriteDescriptorSet imageSet3 = {};
@@ -1484,11 +1728,112 @@ namespace ae3d
         imageSet3.pImageInfo = &sampler3Desc;
         imageSet3.dstBinding = 12;
 
-        const int setCount = 13;
-        VkWriteDescriptorSet sets[ setCount ] = { uboSet, samplerSet, imageSet, bufferSet, bufferSetUAV, imageSet2, samplerSet2, bufferSet2, bufferSet3, bufferSet4, bufferSet5, rwImageSet, imageSet3 };
+        // Binding 13 : Per-pass uniform buffer
+        VkDescriptorBufferInfo passUboDesc = {};
+        passUboDesc.buffer = key.passUbo;
+        passUboDesc.range = PerPassUboBlockSize;
+
+        VkWriteDescriptorSet passUboSet = {};
+        passUboSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        passUboSet.dstSet = outDescriptorSet;
+        passUboSet.descriptorCount = 1;
+        passUboSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        passUboSet.pBufferInfo = &passUboDesc;
+        passUboSet.dstBinding = 13;
+
+        // Binding 14 : Bone palette
+        VkWriteDescriptorSet bonePaletteSet = {};
+        bonePaletteSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        bonePaletteSet.dstSet = outDescriptorSet;
+        bonePaletteSet.descriptorCount = 1;
+        bonePaletteSet.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bonePaletteSet.pBufferInfo = &GetCurrentFrame().bonePalette.uboDesc;
+        bonePaletteSet.dstBinding = 14;
+
+        const int setCount = 15;
+        VkWriteDescriptorSet sets[ setCount ] = { uboSet, samplerSet, imageSet, bufferSet, bufferSetUAV, imageSet2, samplerSet2, bufferSet2, bufferSet3, bufferSet4, bufferSet5, rwImageSet, imageSet3, passUboSet, bonePaletteSet };
         vkUpdateDescriptorSets( GfxDeviceGlobal::device, setCount, sets, 0, nullptr );
+        Statistics::IncDescriptorSetUpdates();
+    }
+
+    std::uint64_t GetDescriptorSetKeyHash( const DescriptorSetKey& key )
+    {
+        // FNV-1a
+        const std::uint8_t* bytes = reinterpret_cast< const std::uint8_t* >( &key );
+        std::uint64_t outHash = 14695981039346656037ull;
+
+        for (std::size_t i = 0; i < sizeof( DescriptorSetKey ); ++i)
+        {
+            outHash = (outHash ^ bytes[ i ]) * 1099511628211ull;
+        }
+
+        return outHash;
+    }
+
+    /// Returns cached sets that are not referenced by command buffers of frames in flight to the free list.
+    void EvictDescriptorSets()
+    {
+        for (auto it = std::begin( GfxDeviceGlobal::descriptorSetCache ); it != std::end( GfxDeviceGlobal::descriptorSetCache );)
+        {
+            if (!IsUsedByFrameInFlight( it->second.lastUsedFrame ))
+            {
+                GfxDeviceGlobal::freeDescriptorSets[ GfxDeviceGlobal::freeDescriptorSetCount++ ] = it->second.set;
+                it = GfxDeviceGlobal::descriptorSetCache.erase( it );
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    /// \return Descriptor set that references key's resources, or VK_NULL_HANDLE if all sets are used by frames in flight.
+    VkDescriptorSet GetDescriptorSet( const DescriptorSetKey& key )
+    {
+        const std::uint64_t hash = GetDescriptorSetKeyHash( key );
+        auto cached = GfxDeviceGlobal::descriptorSetCache.find( hash );
 
-        return outDescriptorSet;
+        if (cached != std::end( GfxDeviceGlobal::descriptorSetCache ))
+        {
+            CachedDescriptorSet& entry = cached->second;
+
+            if (std::memcmp( &entry.key, &key, sizeof( DescriptorSetKey ) ) == 0)
+            {
+                entry.lastUsedFrame = GfxDeviceGlobal::frameIndex;
+                Statistics::IncDescriptorSetCacheHits();
+                return entry.set;
+            }
+
+            // Hash collision. The set can only be rewritten if no frame in flight has bound it.
+            if (IsUsedByFrameInFlight( entry.lastUsedFrame ))
+            {
+                return VK_NULL_HANDLE;
+            }
+
+            entry.key = key;
+            entry.lastUsedFrame = GfxDeviceGlobal::frameIndex;
+            WriteDescriptorSet( entry.set, key );
+            return entry.set;
+        }
+
+        if (GfxDeviceGlobal::freeDescriptorSetCount == 0)
+        {
+            EvictDescriptorSets();
+
+            if (GfxDeviceGlobal::freeDescriptorSetCount == 0)
+            {
+                return VK_NULL_HANDLE;
+            }
+        }
+
+        CachedDescriptorSet entry;
+        entry.key = key;
+        entry.set = GfxDeviceGlobal::freeDescriptorSets[ --GfxDeviceGlobal::freeDescriptorSetCount ];
+        entry.lastUsedFrame = GfxDeviceGlobal::frameIndex;
+        WriteDescriptorSet( entry.set, key );
+        GfxDeviceGlobal::descriptorSetCache[ hash ] = entry;
+
+        return entry.set;
     }
 
     void CreateDescriptorSetLayout()
@@ -1496,7 +1841,7 @@ namespace ae3d
         // Binding 0 : Uniform buffer
         VkDescriptorSetLayoutBinding layoutBindingUBO = {};
         layoutBindingUBO.binding = 0;
-        layoutBindingUBO.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        layoutBindingUBO.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
         layoutBindingUBO.descriptorCount = 1;
         layoutBindingUBO.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
@@ -1584,10 +1929,25 @@ namespace ae3d
         layoutBindingImage3.descriptorCount = 1;
         layoutBindingImage3.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 
-        constexpr int bindingCount = 13;
+        // Binding 13 : Per-pass uniform buffer
+        VkDescriptorSetLayoutBinding layoutBindingPassUBO = {};
+        layoutBindingPassUBO.binding = 13;
+        layoutBindingPassUBO.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        layoutBindingPassUBO.descriptorCount = 1;
+        layoutBindingPassUBO.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+
+        // Binding 14 : Bone palette
+        VkDescriptorSetLayoutBinding layoutBindingBonePalette = {};
+        layoutBindingBonePalette.binding = 14;
+        layoutBindingBonePalette.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindingBonePalette.descriptorCount = 1;
+        layoutBindingBonePalette.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+        constexpr int bindingCount = 15;
         const VkDescriptorSetLayoutBinding bindings[ bindingCount ] = { layoutBindingUBO, layoutBindingImage, layoutBindingSampler, layoutBindingBuffer,
                                                                         layoutBindingBufferUAV, layoutBindingImage2, layoutBindingSampler2, layoutBindingBuffer2,
-                                                                        layoutBindingBuffer3, layoutBindingBuffer4, layoutBindingBuffer5, layoutBindingUAV, layoutBindingImage3 };
+                                                                        layoutBindingBuffer3, layoutBindingBuffer4, layoutBindingBuffer5, layoutBindingUAV, layoutBindingImage3,
+                                                                        layoutBindingPassUBO, layoutBindingBonePalette };
 
         VkDescriptorSetLayoutCreateInfo descriptorLayout = {};
         descriptorLayout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -1611,16 +1971,65 @@ namespace ae3d
         VkSemaphoreCreateInfo semaphoreCreateInfo = {};
         semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        VkResult err = vkCreateSemaphore( GfxDeviceGlobal::device, &semaphoreCreateInfo, nullptr, &GfxDeviceGlobal::presentCompleteSemaphore );
+        VkResult err = vkCreateSemaphore( GfxDeviceGlobal::device, &semaphoreCreateInfo, nullptr, &GfxDeviceGlobal::offscreenSemaphore );
         AE3D_CHECK_VULKAN( err, "vkCreateSemaphore" );
+    }
+    
+    void CreateFrameResources()
+    {
+        VkCommandPoolCreateInfo cmdPoolInfo = {};
+        cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cmdPoolInfo.queueFamilyIndex = GfxDeviceGlobal::queueNodeIndex;
+        cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
-        err = vkCreateSemaphore( GfxDeviceGlobal::device, &semaphoreCreateInfo, nullptr, &GfxDeviceGlobal::renderCompleteSemaphore );
-        AE3D_CHECK_VULKAN( err, "vkCreateSemaphore" );
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+        semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        err = vkCreateSemaphore( GfxDeviceGlobal::device, &semaphoreCreateInfo, nullptr, &GfxDeviceGlobal::offscreenSemaphore );
-        AE3D_CHECK_VULKAN( err, "vkCreateSemaphore" );
+        VkFenceCreateInfo fenceCreateInfo = {};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        for (int f = 0; f < GfxDeviceGlobal::framesInFlight; ++f)
+        {
+            FrameResources& frame = GfxDeviceGlobal::frames[ f ];
+
+            VkResult err = vkCreateCommandPool( GfxDeviceGlobal::device, &cmdPoolInfo, nullptr, &frame.cmdPool );
+            AE3D_CHECK_VULKAN( err, "vkCreateCommandPool" );
+
+            VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+            commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            commandBufferAllocateInfo.commandPool = frame.cmdPool;
+            commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            commandBufferAllocateInfo.commandBufferCount = 1;
+
+            err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &commandBufferAllocateInfo, &frame.drawCmdBuffer );
+            AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers" );
+            debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)frame.drawCmdBuffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "drawCmdBuffer" );
+
+            err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &commandBufferAllocateInfo, &frame.postPresentCmdBuffer );
+            AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers" );
+            debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)frame.postPresentCmdBuffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "postPresentCmdBuffer" );
+
+            err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &commandBufferAllocateInfo, &frame.prePresentCmdBuffer );
+            AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers" );
+            debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)frame.prePresentCmdBuffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "prePresentCmdBuffer" );
+
+            err = vkCreateSemaphore( GfxDeviceGlobal::device, &semaphoreCreateInfo, nullptr, &frame.presentCompleteSemaphore );
+            AE3D_CHECK_VULKAN( err, "vkCreateSemaphore" );
+
+            err = vkCreateSemaphore( GfxDeviceGlobal::device, &semaphoreCreateInfo, nullptr, &frame.renderCompleteSemaphore );
+            AE3D_CHECK_VULKAN( err, "vkCreateSemaphore" );
+
+            err = vkCreateFence( GfxDeviceGlobal::device, &fenceCreateInfo, nullptr, &frame.fence );
+            AE3D_CHECK_VULKAN( err, "vkCreateFence" );
+
+            for (int i = 0; i < MaxRecordingThreads; ++i)
+            {
+                err = vkCreateCommandPool( GfxDeviceGlobal::device, &cmdPoolInfo, nullptr, &frame.recordingPools[ i ].pool );
+                AE3D_CHECK_VULKAN( err, "vkCreateCommandPool" );
+            }
+        }
     }
-    
+
     void CreateRenderer( int samples )
     {
         GfxDeviceGlobal::msaaSampleBits = GetSampleBits( samples );
@@ -1643,6 +2052,7 @@ namespace ae3d
         AllocateSetupCommandBuffer();
         SetupSwapChain();
         AllocateCommandBuffers();
+        CreateFrameResources();
         CreateDepthStencil();
 
         if (samples > 1)
@@ -1663,11 +2073,7 @@ namespace ae3d
             CreateFramebufferNonMSAA();
         }
 
-        VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
-        pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-        VkResult err = vkCreatePipelineCache( GfxDeviceGlobal::device, &pipelineCacheCreateInfo, nullptr, &GfxDeviceGlobal::pipelineCache );
-        AE3D_CHECK_VULKAN( err, "vkCreatePipelineCache" );
-
+        CreatePipelineCache();
         FlushSetupCommandBuffer();
         CreateDescriptorSetLayout();
         CreateDescriptorPool();
@@ -1679,12 +2085,15 @@ namespace ae3d
         VkQueryPoolCreateInfo queryPoolInfo = {};
         queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
         queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
-        queryPoolInfo.queryCount = 2;
+        queryPoolInfo.queryCount = MaxGpuScopesPerFrame * 2 * MaxFramesInFlight;
 
-        err = vkCreateQueryPool( GfxDeviceGlobal::device, &queryPoolInfo, nullptr, &GfxDeviceGlobal::queryPool );
+        VkResult err = vkCreateQueryPool( GfxDeviceGlobal::device, &queryPoolInfo, nullptr, &GfxDeviceGlobal::queryPool );
         AE3D_CHECK_VULKAN( err, "vkCreateQueryPool" );
 
-        GfxDeviceGlobal::uiVertexBuffer.GenerateDynamic( UI_FACE_COUNT, UI_VERTICE_COUNT );
+        for (int f = 0; f < GfxDeviceGlobal::framesInFlight; ++f)
+        {
+            GfxDeviceGlobal::frames[ f ].uiVertexBuffer.GenerateDynamic( UI_FACE_COUNT, UI_VERTICE_COUNT );
+        }
 
         renderer.builtinShaders.lightCullShader.LoadSPIRV( FileSystem::FileContents( "LightCuller.spv" ) );
 
@@ -1702,76 +2111,659 @@ namespace ae3d
     }
 }
 
-void BindComputeDescriptorSet()
+static void CreateMappedBuffer( Ubo& outUbo, VkDeviceSize size, VkBufferUsageFlags usage, const char* debugName )
 {
-    VkDescriptorSet descriptorSet = ae3d::AllocateDescriptorSet( GfxDeviceGlobal::ubos[ GfxDeviceGlobal::currentUbo ].uboDesc, GfxDeviceGlobal::boundViews[ 0 ], GfxDeviceGlobal::boundSamplers[ 0 ],
-                                                                 GfxDeviceGlobal::boundViews[ 1 ], GfxDeviceGlobal::boundSamplers[ 1 ], GfxDeviceGlobal::boundViews[ 11 ], GfxDeviceGlobal::boundViews[ 12 ] );
-
-    vkCmdBindDescriptorSets( GfxDeviceGlobal::computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                             GfxDeviceGlobal::pipelineLayout, 0, 1, &descriptorSet, 0, nullptr );
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+
+    VkResult err = vkCreateBuffer( GfxDeviceGlobal::device, &bufferInfo, nullptr, &outUbo.ubo );
+    AE3D_CHECK_VULKAN( err, "vkCreateBuffer UBO" );
+    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)outUbo.ubo, VK_OBJECT_TYPE_BUFFER, debugName );
+
+    outUbo.uboMemory = ae3d::VulkanAllocator::AllocateBuffer( outUbo.ubo, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                            ae3d::VulkanAllocator::Strategy::FreeList, debugName );
+
+    outUbo.uboDesc.buffer = outUbo.ubo;
+    outUbo.uboDesc.offset = 0;
+    outUbo.uboDesc.range = size;
+    outUbo.uboData = outUbo.uboMemory->mappedData;
 }
 
-void UploadPerObjectUbo()
+static void DestroyMappedBuffer( Ubo& ubo )
 {
-    std::memcpy( &ae3d::GfxDevice::GetCurrentUbo()[ 0 ], &GfxDeviceGlobal::perObjectUboStruct, sizeof( GfxDeviceGlobal::perObjectUboStruct ) );
+    ae3d::VulkanAllocator::Free( ubo.uboMemory );
+    vkDestroyBuffer( GfxDeviceGlobal::device, ubo.ubo, nullptr );
+    ubo = Ubo();
 }
 
-void ae3d::GfxDevice::Init( int width, int height )
+static void AddUniformRingBuffer( UniformRing& ring, VkDeviceSize size )
 {
-    GfxDeviceGlobal::backBufferWidth = width;
-    GfxDeviceGlobal::backBufferHeight = height;
+    std::unique_ptr< UniformRingBuffer > buffer( new UniformRingBuffer() );
+    CreateMappedBuffer( buffer->ubo, size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, "uniform ring" );
+    ring.current = buffer.get();
+    ring.buffers.push_back( std::move( buffer ) );
 }
 
-void ae3d::GfxDevice::DrawUI( int scX, int scY, int scWidth, int scHeight, int elemCount, int offset )
+/// Sub-allocates uniform memory for the current frame. Thread-safe.
+static UniformAllocation AllocateUniforms( VkDeviceSize size )
 {
-    int scissor[ 4 ] = {};
-    scissor[ 0 ] = scX < 0 ? 0 : scX;
-    scissor[ 1 ] = scY < 0 ? 0 : scY;
-    scissor[ 2 ] = scWidth > 8191 ? 8191 : scWidth;
-    scissor[ 3 ] = scHeight > 8191 ? 8191 : scHeight;
-    SetScissor( scissor );
-    
-    Draw( GfxDeviceGlobal::uiVertexBuffer, offset, offset + elemCount, renderer.builtinShaders.uiShader, BlendMode::AlphaBlend, DepthFunc::NoneWriteOff, CullMode::Off, FillMode::Solid, GfxDevice::PrimitiveTopology::Triangles );
-}
+    const VkDeviceSize alignment = GfxDeviceGlobal::properties.limits.minUniformBufferOffsetAlignment;
+    const VkDeviceSize alignedSize = (size + alignment - 1) & ~(alignment - 1);
+    UniformRing& ring = GetCurrentFrame().uniformRing;
 
-void ae3d::GfxDevice::ResetPSOCache()
-{
-    GfxDeviceGlobal::psoCache.clear();
-}
+    for (;;)
+    {
+        UniformRingBuffer* buffer = ring.current;
+        const VkDeviceSize offset = buffer->head.fetch_add( alignedSize );
 
-void ae3d::GfxDevice::MapUIVertexBuffer( int /*vertexSize*/, int /*indexSize*/, void** outMappedVertices, void** outMappedIndices )
-{
-    *outMappedVertices = GfxDeviceGlobal::uiVertices;
-    *outMappedIndices = GfxDeviceGlobal::uiFaces;
-}
+        if (offset + alignedSize <= buffer->ubo.uboDesc.range)
+        {
+            Statistics::IncUniformRingBytes( (int)alignedSize );
 
-void ae3d::GfxDevice::UnmapUIVertexBuffer()
-{
-    GfxDeviceGlobal::uiVertexBuffer.UpdateDynamic( GfxDeviceGlobal::uiFaces, UI_FACE_COUNT, GfxDeviceGlobal::uiVertices, UI_VERTICE_COUNT );
-}
+            UniformAllocation allocation;
+            allocation.buffer = buffer->ubo.ubo;
+            allocation.offset = offset;
+            allocation.data = buffer->ubo.uboData + offset;
+            return allocation;
+        }
 
-void ae3d::GfxDevice::BeginDepthNormalsGpuQuery()
-{
-}
+        // Out of space. Buffers of this frame can't be freed yet, so another one is added. The thread that gets
+        // the lock first grows the ring, others retry from the new buffer.
+        std::lock_guard< std::mutex > lock( ring.growMutex );
 
-void ae3d::GfxDevice::EndDepthNormalsGpuQuery()
-{
+        if (ring.current == buffer)
+        {
+            Statistics::IncUniformRingStalls();
+            AddUniformRingBuffer( ring, buffer->ubo.uboDesc.range * 2 );
+        }
+    }
 }
 
-void ae3d::GfxDevice::BeginShadowMapGpuQuery()
+/// Rewinds the uniform ring of the current frame. The GPU must have finished the frame that used it last.
+static void RewindUniformRing()
 {
-}
+    UniformRing& ring = GetCurrentFrame().uniformRing;
 
-void ae3d::GfxDevice::EndShadowMapGpuQuery()
-{
-}
+    if (ring.buffers.size() > 1)
+    {
+        // Keeps the largest buffer, so the next frame with the same uniform usage fits into it.
+        for (std::size_t i = 0; i + 1 < ring.buffers.size(); ++i)
+        {
+            DestroyMappedBuffer( ring.buffers[ i ]->ubo );
+        }
 
-void ae3d::GfxDevice::BeginLightCullerGpuQuery()
-{
-}
+        ring.buffers.erase( ring.buffers.begin(), ring.buffers.end() - 1 );
+        // Cached sets reference the destroyed buffers, and their handle values may be reused.
+        ae3d::EvictDescriptorSets();
+    }
 
-void ae3d::GfxDevice::EndLightCullerGpuQuery()
-{
+    ring.current.load()->head = 0;
+    GfxDeviceGlobal::drawUniforms = UniformAllocation();
+    GfxDeviceGlobal::passUniforms = UniformAllocation();
+}
+
+/// Binds a descriptor set for the currently bound resources and uniform allocations.
+/// \return False if no descriptor set was available.
+static bool BindDescriptorSet( VkCommandBuffer cmdBuffer, VkPipelineBindPoint bindPoint )
+{
+    if (GfxDeviceGlobal::drawUniforms.buffer == VK_NULL_HANDLE)
+    {
+        GfxDeviceGlobal::drawUniforms = AllocateUniforms( PerDrawUboBlockSize );
+    }
+
+    if (GfxDeviceGlobal::passUniforms.buffer == VK_NULL_HANDLE)
+    {
+        GfxDeviceGlobal::passUniforms = AllocateUniforms( PerPassUboBlockSize );
+    }
+
+    DescriptorSetKey key;
+    key.ubo = GfxDeviceGlobal::drawUniforms.buffer;
+    key.passUbo = GfxDeviceGlobal::passUniforms.buffer;
+    key.bonePalette = GetCurrentFrame().bonePalette.ubo;
+    key.views[ 0 ] = GfxDeviceGlobal::boundViews[ 0 ];
+    key.views[ 1 ] = GfxDeviceGlobal::boundViews[ 1 ];
+    key.views[ 2 ] = GfxDeviceGlobal::boundViews[ 11 ];
+    key.views[ 3 ] = GfxDeviceGlobal::boundViews[ 12 ];
+    key.samplers[ 0 ] = GfxDeviceGlobal::boundSamplers[ 0 ];
+    key.samplers[ 1 ] = GfxDeviceGlobal::boundSamplers[ 1 ];
+
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    {
+        std::lock_guard< std::mutex > lock( GfxDeviceGlobal::descriptorSetMutex );
+        descriptorSet = ae3d::GetDescriptorSet( key );
+    }
+
+    if (descriptorSet == VK_NULL_HANDLE)
+    {
+        return false;
+    }
+
+    // Ordered by binding number: per-draw UBO (0), per-pass UBO (13).
+    const std::uint32_t dynamicOffsets[ 2 ] = { (std::uint32_t)GfxDeviceGlobal::drawUniforms.offset, (std::uint32_t)GfxDeviceGlobal::passUniforms.offset };
+
+    vkCmdBindDescriptorSets( cmdBuffer, bindPoint, GfxDeviceGlobal::pipelineLayout, 0, 1, &descriptorSet, 2, dynamicOffsets );
+    return true;
+}
+
+void BindComputeDescriptorSet()
+{
+    if (!BindDescriptorSet( GfxDeviceGlobal::computeCmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE ))
+    {
+        ae3d::System::Print( "Could not bind a compute descriptor set because all sets are in use\n" );
+    }
+}
+
+void UploadPerObjectUbo()
+{
+    std::memcpy( &ae3d::GfxDevice::GetCurrentUbo()[ 0 ], &GfxDeviceGlobal::perObjectUboStruct, PerDrawUboBlockSize );
+    Statistics::IncUniformUploadBytes( (int)PerDrawUboBlockSize );
+
+    // The per-pass block is shared by consecutive draws until it is edited with GfxDevice::EditPassUniforms().
+    if (GfxDeviceGlobal::passUniforms.data != nullptr && !GfxDeviceGlobal::isPassUboDirty)
+    {
+        return;
+    }
+
+    const std::uint8_t* passBlock = reinterpret_cast< const std::uint8_t* >( &GfxDeviceGlobal::perObjectUboStruct ) + PerDrawUboBlockSize;
+    GfxDeviceGlobal::isPassUboDirty = false;
+    GfxDeviceGlobal::passUniforms = AllocateUniforms( PerPassUboBlockSize );
+    std::memcpy( GfxDeviceGlobal::passUniforms.data, passBlock, PerPassUboBlockSize );
+    Statistics::IncUniformUploadBytes( (int)PerPassUboBlockSize );
+}
+
+static void SetDynamicViewport( const VkViewport& viewport )
+{
+    GfxDeviceGlobal::recordingContext.viewport = viewport;
+    GfxDeviceGlobal::recordingContext.hasViewport = true;
+    vkCmdSetViewport( GfxDeviceGlobal::currentCmdBuffer, 0, 1, &viewport );
+}
+
+static void SetDynamicScissor( const VkRect2D& scissor )
+{
+    GfxDeviceGlobal::recordingContext.scissor = scissor;
+    GfxDeviceGlobal::recordingContext.hasScissor = true;
+    vkCmdSetScissor( GfxDeviceGlobal::currentCmdBuffer, 0, 1, &scissor );
+}
+
+/// Debug labels can't span command buffers, so open ones are closed at the end of a buffer and reopened in the next one.
+static void CloseMarkers( VkCommandBuffer cmdBuffer )
+{
+    for (std::size_t i = 0; i < GfxDeviceGlobal::recordingContext.markers.size(); ++i)
+    {
+        debug::EndRegion( cmdBuffer );
+    }
+}
+
+static void OpenMarkers( VkCommandBuffer cmdBuffer )
+{
+    for (const auto& marker : GfxDeviceGlobal::recordingContext.markers)
+    {
+        debug::BeginRegion( cmdBuffer, marker.c_str(), 0, 1, 0 );
+    }
+}
+
+/// Begins a secondary command buffer from a recording thread's pool and makes it the calling thread's current command buffer.
+static void BeginSecondaryCmdBuffer( int poolIndex )
+{
+    RecordingPool& pool = GetCurrentFrame().recordingPools[ poolIndex ];
+
+    if (pool.usedCount == pool.cmdBuffers.size())
+    {
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = pool.pool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocateInfo.commandBufferCount = 1;
+
+        VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;
+        VkResult err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &allocateInfo, &cmdBuffer );
+        AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers secondary" );
+        pool.cmdBuffers.push_back( cmdBuffer );
+    }
+
+    const VkCommandBuffer cmdBuffer = pool.cmdBuffers[ pool.usedCount++ ];
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = GfxDeviceGlobal::passRenderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = GfxDeviceGlobal::passFrameBuffer;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    VkResult err = vkBeginCommandBuffer( cmdBuffer, &beginInfo );
+    AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer secondary" );
+
+    GfxDeviceGlobal::currentCmdBuffer = cmdBuffer;
+
+    if (GfxDeviceGlobal::recordingContext.hasViewport)
+    {
+        vkCmdSetViewport( cmdBuffer, 0, 1, &GfxDeviceGlobal::recordingContext.viewport );
+    }
+
+    if (GfxDeviceGlobal::recordingContext.hasScissor)
+    {
+        vkCmdSetScissor( cmdBuffer, 0, 1, &GfxDeviceGlobal::recordingContext.scissor );
+    }
+
+    OpenMarkers( cmdBuffer );
+}
+
+static VkCommandBuffer EndSecondaryCmdBuffer()
+{
+    CloseMarkers( GfxDeviceGlobal::currentCmdBuffer );
+    VkResult err = vkEndCommandBuffer( GfxDeviceGlobal::currentCmdBuffer );
+    AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer secondary" );
+    return GfxDeviceGlobal::currentCmdBuffer;
+}
+
+/// Begins a render pass whose contents are recorded into secondary command buffers, so GfxDevice::RecordParallel() can split it between threads.
+static void BeginSecondaryRenderPass( VkCommandBuffer primaryCmdBuffer, const VkRenderPassBeginInfo& renderPassBeginInfo )
+{
+    ae3d::System::Assert( GfxDeviceGlobal::passPrimaryCmdBuffer == VK_NULL_HANDLE, "Render pass is already being recorded" );
+
+    CloseMarkers( primaryCmdBuffer );
+    vkCmdBeginRenderPass( primaryCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS );
+
+    GfxDeviceGlobal::passPrimaryCmdBuffer = primaryCmdBuffer;
+    GfxDeviceGlobal::cmdBufferAfterPass = primaryCmdBuffer;
+    GfxDeviceGlobal::passRenderPass = renderPassBeginInfo.renderPass;
+    GfxDeviceGlobal::passFrameBuffer = renderPassBeginInfo.framebuffer;
+    BeginSecondaryCmdBuffer( 0 );
+}
+
+/// Executes the pass's secondary command buffers in recording order and ends the pass.
+static void EndSecondaryRenderPass()
+{
+    GfxDeviceGlobal::passSecondaryCmdBuffers.push_back( EndSecondaryCmdBuffer() );
+
+    const VkCommandBuffer primaryCmdBuffer = GfxDeviceGlobal::passPrimaryCmdBuffer;
+    vkCmdExecuteCommands( primaryCmdBuffer, (std::uint32_t)GfxDeviceGlobal::passSecondaryCmdBuffers.size(), GfxDeviceGlobal::passSecondaryCmdBuffers.data() );
+    vkCmdEndRenderPass( primaryCmdBuffer );
+    OpenMarkers( primaryCmdBuffer );
+
+    GfxDeviceGlobal::passSecondaryCmdBuffers.clear();
+    GfxDeviceGlobal::passPrimaryCmdBuffer = VK_NULL_HANDLE;
+    GfxDeviceGlobal::currentCmdBuffer = GfxDeviceGlobal::cmdBufferAfterPass;
+}
+
+void ae3d::ReleaseAfterFrame( VkBuffer buffer, VulkanAllocation* memory )
+{
+    FrameResources& frame = GetCurrentFrame();
+    frame.pendingFreeBuffers.Add( buffer );
+    frame.pendingFreeAllocations.Add( memory );
+}
+
+static void FreePendingResources( FrameResources& frame )
+{
+    for (unsigned i = 0; i < frame.pendingFreeBuffers.count; ++i)
+    {
+        vkDestroyBuffer( GfxDeviceGlobal::device, frame.pendingFreeBuffers[ i ], nullptr );
+    }
+
+    frame.pendingFreeBuffers.Allocate( 0 );
+
+    for (unsigned i = 0; i < frame.pendingFreeAllocations.count; ++i)
+    {
+        ae3d::VulkanAllocator::Free( frame.pendingFreeAllocations[ i ] );
+    }
+
+    frame.pendingFreeAllocations.Allocate( 0 );
+}
+
+/// Reads back the timestamps of a frame slot's profiler scopes into Statistics. The slot's fence must have signaled.
+static void ReadGpuScopes( int slot )
+{
+    FrameResources& frame = GfxDeviceGlobal::frames[ slot ];
+
+    if (frame.gpuScopes.empty())
+    {
+        return;
+    }
+
+    const std::uint32_t queryCount = (std::uint32_t)frame.gpuScopes.size() * 2;
+    GfxDeviceGlobal::gpuTimestamps.resize( queryCount );
+
+    // The fence has signaled, so results of ended scopes are available without waiting. Scopes that were not ended are skipped.
+    VkResult err = vkGetQueryPoolResults( GfxDeviceGlobal::device, GfxDeviceGlobal::queryPool, GetFirstGpuScopeQuery( slot ), queryCount, queryCount * sizeof( std::uint64_t ),
+                                          GfxDeviceGlobal::gpuTimestamps.data(), sizeof( std::uint64_t ), VK_QUERY_RESULT_64_BIT );
+
+    if (err == VK_SUCCESS || err == VK_NOT_READY)
+    {
+        const double msPerTick = GfxDeviceGlobal::properties.limits.timestampPeriod / 1000000.0;
+
+        for (std::size_t i = 0; i < frame.gpuScopes.size(); ++i)
+        {
+            const std::uint64_t begin = GfxDeviceGlobal::gpuTimestamps[ i * 2 ];
+            const std::uint64_t end = GfxDeviceGlobal::gpuTimestamps[ i * 2 + 1 ];
+
+            if (frame.gpuScopes[ i ].isEnded && end >= begin)
+            {
+                Statistics::AddGpuScopeTime( frame.gpuScopes[ i ].name.c_str(), frame.gpuScopes[ i ].depth, (float)((end - begin) * msPerTick) );
+            }
+        }
+
+        Statistics::EndGpuScopeFrame();
+    }
+
+    frame.gpuScopes.clear();
+}
+
+/// Waits until the GPU has finished the frame that last used a slot's resources and makes them available for recording.
+static void RecycleFrame( int slot )
+{
+    FrameResources& frame = GfxDeviceGlobal::frames[ slot ];
+
+    Statistics::BeginFenceWaitProfiling();
+
+    if (frame.isSubmitted)
+    {
+        VkResult err = vkWaitForFences( GfxDeviceGlobal::device, 1, &frame.fence, VK_TRUE, UINT64_MAX );
+        AE3D_CHECK_VULKAN( err, "vkWaitForFences" );
+        Statistics::IncFenceCalls();
+
+        err = vkResetFences( GfxDeviceGlobal::device, 1, &frame.fence );
+        AE3D_CHECK_VULKAN( err, "vkResetFences" );
+        frame.isSubmitted = false;
+    }
+
+    Statistics::EndFenceWaitProfiling();
+    ReadGpuScopes( slot );
+
+    FreePendingResources( frame );
+
+    VkResult err = vkResetCommandPool( GfxDeviceGlobal::device, frame.cmdPool, 0 );
+    AE3D_CHECK_VULKAN( err, "vkResetCommandPool" );
+    frame.usedOffscreenCmdBuffers = 0;
+
+    for (int i = 0; i < MaxRecordingThreads; ++i)
+    {
+        err = vkResetCommandPool( GfxDeviceGlobal::device, frame.recordingPools[ i ].pool, 0 );
+        AE3D_CHECK_VULKAN( err, "vkResetCommandPool" );
+        frame.recordingPools[ i ].usedCount = 0;
+    }
+}
+
+/// Recording state that is copied from the calling thread to worker threads in GfxDevice::RecordParallel().
+struct ThreadRecordingState
+{
+    PerObjectUboStruct perObjectUboStruct;
+    VkImageView boundViews[ 13 ];
+    VkSampler boundSamplers[ 2 ];
+    UniformAllocation drawUniforms;
+    UniformAllocation passUniforms;
+    bool isPassUboDirty;
+    RecordingContext recordingContext;
+};
+
+void ae3d::GfxDevice::RecordParallel( int itemCount, int minItemsPerThread, RecordCallback recordItems, void* userData )
+{
+    AE3D_ZONE( "GfxDevice::RecordParallel" );
+    const int threadCount = std::min( std::min( WorkerPool::GetThreadCount(), MaxRecordingThreads ), itemCount / std::max( 1, minItemsPerThread ) );
+
+    if (threadCount < 2 || GfxDeviceGlobal::passPrimaryCmdBuffer == VK_NULL_HANDLE)
+    {
+        recordItems( 0, itemCount, userData );
+        return;
+    }
+
+    GfxDeviceGlobal::passSecondaryCmdBuffers.push_back( EndSecondaryCmdBuffer() );
+
+    ThreadRecordingState state;
+    state.perObjectUboStruct = GfxDeviceGlobal::perObjectUboStruct;
+    std::memcpy( state.boundViews, GfxDeviceGlobal::boundViews, sizeof( state.boundViews ) );
+    std::memcpy( state.boundSamplers, GfxDeviceGlobal::boundSamplers, sizeof( state.boundSamplers ) );
+    state.drawUniforms = GfxDeviceGlobal::drawUniforms;
+    state.passUniforms = GfxDeviceGlobal::passUniforms;
+    state.isPassUboDirty = GfxDeviceGlobal::isPassUboDirty;
+    state.recordingContext = GfxDeviceGlobal::recordingContext;
+
+    VkCommandBuffer cmdBuffers[ MaxRecordingThreads ];
+
+    struct Chunks
+    {
+        const ThreadRecordingState* state;
+        VkCommandBuffer* cmdBuffers;
+        RecordCallback recordItems;
+        void* userData;
+        int itemCount;
+        int itemsPerThread;
+    } chunks = { &state, cmdBuffers, recordItems, userData, itemCount, (itemCount + threadCount - 1) / threadCount };
+
+    // Chunk i is recorded into recording pool i, so each pool is used by one thread at a time.
+    WorkerPool::Run( threadCount, []( int threadIndex, void* chunksData )
+    {
+        AE3D_ZONE( "RecordParallel chunk" );
+        const Chunks& chunk = *static_cast< const Chunks* >( chunksData );
+
+        if (threadIndex != 0)
+        {
+            // Workers start from the calling thread's state, so the result is the same as recording all items on one thread.
+            GfxDeviceGlobal::perObjectUboStruct = chunk.state->perObjectUboStruct;
+            std::memcpy( GfxDeviceGlobal::boundViews, chunk.state->boundViews, sizeof( chunk.state->boundViews ) );
+            std::memcpy( GfxDeviceGlobal::boundSamplers, chunk.state->boundSamplers, sizeof( chunk.state->boundSamplers ) );
+            GfxDeviceGlobal::drawUniforms = chunk.state->drawUniforms;
+            GfxDeviceGlobal::passUniforms = chunk.state->passUniforms;
+            GfxDeviceGlobal::isPassUboDirty = chunk.state->isPassUboDirty;
+            GfxDeviceGlobal::recordingContext = chunk.state->recordingContext;
+        }
+
+        BeginSecondaryCmdBuffer( threadIndex );
+        const int begin = std::min( chunk.itemCount, threadIndex * chunk.itemsPerThread );
+        const int end = std::min( chunk.itemCount, begin + chunk.itemsPerThread );
+        chunk.recordItems( begin, end, chunk.userData );
+        chunk.cmdBuffers[ threadIndex ] = EndSecondaryCmdBuffer();
+    }, &chunks );
+
+    GfxDeviceGlobal::passSecondaryCmdBuffers.insert( GfxDeviceGlobal::passSecondaryCmdBuffers.end(), cmdBuffers, cmdBuffers + threadCount );
+    BeginSecondaryCmdBuffer( 0 );
+}
+
+void ae3d::GfxDevice::Init( int width, int height )
+{
+    GfxDeviceGlobal::backBufferWidth = width;
+    GfxDeviceGlobal::backBufferHeight = height;
+}
+
+void ae3d::GfxDevice::DrawUI( int scX, int scY, int scWidth, int scHeight, int elemCount, int offset )
+{
+    int scissor[ 4 ] = {};
+    scissor[ 0 ] = scX < 0 ? 0 : scX;
+    scissor[ 1 ] = scY < 0 ? 0 : scY;
+    scissor[ 2 ] = scWidth > 8191 ? 8191 : scWidth;
+    scissor[ 3 ] = scHeight > 8191 ? 8191 : scHeight;
+    SetScissor( scissor );
+    
+    Draw( GetCurrentFrame().uiVertexBuffer, offset, offset + elemCount, renderer.builtinShaders.uiShader, BlendMode::AlphaBlend, DepthFunc::NoneWriteOff, CullMode::Off, FillMode::Solid, GfxDevice::PrimitiveTopology::Triangles );
+}
+
+void ae3d::GfxDevice::ResetPSOCache()
+{
+    GfxDeviceGlobal::psoCache.clear();
+}
+
+void ae3d::GfxDevice::SetPipelineCachePath( const char* path )
+{
+    GfxDeviceGlobal::pipelineCachePath = path ? path : "";
+}
+
+bool ae3d::GfxDevice::SavePSOManifest( const char* path )
+{
+    // Different shader instances can share source files, so descriptions can repeat.
+    std::vector< std::string > lines;
+
+    for (const auto& entry : GfxDeviceGlobal::psoManifest)
+    {
+        const PSODescription& description = entry.second;
+
+        if (description.vertexShaderPath.empty() || description.fragmentShaderPath.empty())
+        {
+            continue;
+        }
+
+        std::ostringstream line;
+        line << (int)description.vertexFormat << " " << (int)description.blendMode << " " << (int)description.depthFunc << " " << (int)description.cullMode << " "
+             << (int)description.fillMode << " " << (int)description.topology << " " << (int)description.colorFormat << " " << description.sampleCount << "\t"
+             << description.vertexShaderPath << "\t" << description.fragmentShaderPath << "\n";
+        lines.push_back( line.str() );
+    }
+
+    std::sort( std::begin( lines ), std::end( lines ) );
+    lines.erase( std::unique( std::begin( lines ), std::end( lines ) ), std::end( lines ) );
+
+    std::ofstream manifest( path );
+
+    if (!manifest.is_open())
+    {
+        System::Print( "Could not write PSO manifest %s\n", path );
+        return false;
+    }
+
+    manifest << PSOManifestHeader << "\n";
+
+    for (const auto& line : lines)
+    {
+        manifest << line;
+    }
+
+    return true;
+}
+
+int ae3d::GfxDevice::PrewarmPSOs( const char* manifestPath )
+{
+    const FileSystem::FileContentsData manifest = FileSystem::FileContents( manifestPath );
+
+    if (!manifest.isLoaded)
+    {
+        return 0;
+    }
+
+    std::istringstream stream( std::string( std::begin( manifest.data ), std::end( manifest.data ) ) );
+    std::string line;
+
+    if (!std::getline( stream, line ) || line != PSOManifestHeader)
+    {
+        System::Print( "%s is not a PSO manifest\n", manifestPath );
+        return 0;
+    }
+
+    VertexBuffer inputStates[ (int)VertexBuffer::VertexFormat::Empty ];
+
+    for (int format = 0; format < (int)VertexBuffer::VertexFormat::Empty; ++format)
+    {
+        inputStates[ format ].CreateInputStateForFormat( (VertexBuffer::VertexFormat)format );
+    }
+
+    struct PrewarmJob
+    {
+        std::uint64_t hash;
+        PSODescription description;
+        Shader* shader;
+        VkRenderPass renderPass;
+        VkPipeline pso;
+    };
+
+    std::vector< PrewarmJob > jobs;
+
+    while (std::getline( stream, line ))
+    {
+        int fields[ 8 ] = {};
+        PSODescription description;
+        std::istringstream lineStream( line );
+
+        for (int& field : fields)
+        {
+            lineStream >> field;
+        }
+
+        lineStream.ignore( 1 );
+        std::getline( lineStream, description.vertexShaderPath, '\t' );
+        std::getline( lineStream, description.fragmentShaderPath );
+
+        if (lineStream.fail() || fields[ 0 ] < 0 || fields[ 0 ] >= (int)VertexBuffer::VertexFormat::Empty)
+        {
+            System::Print( "Invalid line in PSO manifest %s: %s\n", manifestPath, line.c_str() );
+            continue;
+        }
+
+        description.vertexFormat = (VertexBuffer::VertexFormat)fields[ 0 ];
+        description.blendMode = (BlendMode)fields[ 1 ];
+        description.depthFunc = (DepthFunc)fields[ 2 ];
+        description.cullMode = (CullMode)fields[ 3 ];
+        description.fillMode = (FillMode)fields[ 4 ];
+        description.topology = (PrimitiveTopology)fields[ 5 ];
+        description.colorFormat = (VkFormat)fields[ 6 ];
+        description.sampleCount = fields[ 7 ];
+
+        Shader* shader = FindLoadedShader( description.vertexShaderPath, description.fragmentShaderPath );
+
+        if (shader == nullptr || shader->GetVertexInfo().module == VK_NULL_HANDLE || shader->GetFragmentInfo().module == VK_NULL_HANDLE)
+        {
+            System::Print( "Not prewarming PSO for %s, %s because the shader is not loaded\n", description.vertexShaderPath.c_str(), description.fragmentShaderPath.c_str() );
+            continue;
+        }
+
+        const std::uint64_t hash = GetPSOHash( description.vertexFormat, *shader, description.blendMode, description.depthFunc, description.cullMode,
+                                               description.fillMode, description.colorFormat, description.sampleCount, description.topology );
+
+        const bool isQueued = std::find_if( std::begin( jobs ), std::end( jobs ), [hash]( const PrewarmJob& job ) { return job.hash == hash; } ) != std::end( jobs );
+
+        if (isQueued || GfxDeviceGlobal::psoCache.find( hash ) != std::end( GfxDeviceGlobal::psoCache ))
+        {
+            continue;
+        }
+
+        // Render passes are created here on the main thread, workers only create pipelines.
+        jobs.push_back( { hash, description, shader, GetCompatibleRenderPass( description ), VK_NULL_HANDLE } );
+    }
+
+    if (jobs.empty())
+    {
+        return 0;
+    }
+
+    struct PrewarmBatch
+    {
+        std::vector< PrewarmJob >* jobs;
+        const VertexBuffer* inputStates;
+        int threadCount;
+    } batch = { &jobs, inputStates, std::min( WorkerPool::GetThreadCount(), (int)jobs.size() ) };
+
+    WorkerPool::Run( batch.threadCount, []( int threadIndex, void* batchData )
+    {
+        const PrewarmBatch& prewarm = *static_cast< const PrewarmBatch* >( batchData );
+
+        for (std::size_t jobIndex = threadIndex; jobIndex < prewarm.jobs->size(); jobIndex += prewarm.threadCount)
+        {
+            PrewarmJob& job = (*prewarm.jobs)[ jobIndex ];
+            job.pso = CreatePSO( prewarm.inputStates[ (int)job.description.vertexFormat ].GetInputState(), *job.shader, job.description.blendMode, job.description.depthFunc,
+                                 job.description.cullMode, job.description.fillMode, job.renderPass, (VkSampleCountFlagBits)job.description.sampleCount, job.description.topology );
+        }
+    }, &batch );
+
+    for (const auto& job : jobs)
+    {
+        GfxDeviceGlobal::psoCache[ job.hash ] = job.pso;
+        GfxDeviceGlobal::psoManifest[ job.hash ] = job.description;
+    }
+
+    return (int)jobs.size();
+}
+
+void ae3d::GfxDevice::MapUIVertexBuffer( int /*vertexSize*/, int /*indexSize*/, void** outMappedVertices, void** outMappedIndices )
+{
+    *outMappedVertices = GfxDeviceGlobal::uiVertices;
+    *outMappedIndices = GfxDeviceGlobal::uiFaces;
+}
+
+void ae3d::GfxDevice::UnmapUIVertexBuffer()
+{
+    GetCurrentFrame().uiVertexBuffer.UpdateDynamic( GfxDeviceGlobal::uiFaces, UI_FACE_COUNT, GfxDeviceGlobal::uiVertices, UI_VERTICE_COUNT );
 }
 
 void ae3d::GfxDevice::SetPolygonOffset( bool, float, float )
@@ -1780,12 +2772,54 @@ void ae3d::GfxDevice::SetPolygonOffset( bool, float, float )
 
 void ae3d::GfxDevice::PushGroupMarker( const char* name )
 {
+    if (debug::hasMarker)
+    {
+        GfxDeviceGlobal::recordingContext.markers.push_back( name );
+    }
+
     debug::BeginRegion( GfxDeviceGlobal::currentCmdBuffer, name, 0, 1, 0 );
+
+    FrameResources& frame = GetCurrentFrame();
+
+    if (frame.gpuScopes.size() < MaxGpuScopesPerFrame)
+    {
+        GfxDeviceGlobal::gpuScopeStack.push_back( (int)frame.gpuScopes.size() );
+        const std::uint32_t query = GetFirstGpuScopeQuery( GetCurrentFrameSlot() ) + (std::uint32_t)frame.gpuScopes.size() * 2;
+        vkCmdWriteTimestamp( GfxDeviceGlobal::currentCmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, GfxDeviceGlobal::queryPool, query );
+
+        frame.gpuScopes.push_back( GpuProfilerScope() );
+        frame.gpuScopes.back().name = name;
+        frame.gpuScopes.back().depth = (int)GfxDeviceGlobal::gpuScopeStack.size() - 1;
+    }
+    else
+    {
+        GfxDeviceGlobal::gpuScopeStack.push_back( -1 );
+    }
 }
 
 void ae3d::GfxDevice::PopGroupMarker()
 {
+    if (!GfxDeviceGlobal::recordingContext.markers.empty())
+    {
+        GfxDeviceGlobal::recordingContext.markers.pop_back();
+    }
+
     debug::EndRegion( GfxDeviceGlobal::currentCmdBuffer );
+
+    if (GfxDeviceGlobal::gpuScopeStack.empty())
+    {
+        return;
+    }
+
+    const int scopeIndex = GfxDeviceGlobal::gpuScopeStack.back();
+    GfxDeviceGlobal::gpuScopeStack.pop_back();
+
+    if (scopeIndex >= 0)
+    {
+        const std::uint32_t query = GetFirstGpuScopeQuery( GetCurrentFrameSlot() ) + (std::uint32_t)scopeIndex * 2 + 1;
+        vkCmdWriteTimestamp( GfxDeviceGlobal::currentCmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GfxDeviceGlobal::queryPool, query );
+        GetCurrentFrame().gpuScopes[ scopeIndex ].isEnded = true;
+    }
 }
 
 void ae3d::GfxDevice::BeginRenderPassAndCommandBuffer()
@@ -1823,21 +2857,21 @@ void ae3d::GfxDevice::BeginRenderPassAndCommandBuffer()
     renderPassBeginInfo.pClearValues = clearValues;
     renderPassBeginInfo.framebuffer = GfxDeviceGlobal::frameBuffers[ GfxDeviceGlobal::currentBuffer ];
 
-    vkCmdBeginRenderPass( GfxDeviceGlobal::currentCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
+    BeginSecondaryRenderPass( GfxDeviceGlobal::currentCmdBuffer, renderPassBeginInfo );
 
     VkViewport viewport = {};
     viewport.height = (float)height;
     viewport.width = (float)width;
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
-    vkCmdSetViewport( GfxDeviceGlobal::currentCmdBuffer, 0, 1, &viewport );
+    SetDynamicViewport( viewport );
 
     VkRect2D scissor = {};
     scissor.extent.width = width;
     scissor.extent.height = height;
     scissor.offset.x = 0;
     scissor.offset.y = 0;
-    vkCmdSetScissor( GfxDeviceGlobal::currentCmdBuffer, 0, 1, &scissor );
+    SetDynamicScissor( scissor );
 }
 
 void ae3d::GfxDevice::BeginRenderPass()
@@ -1870,12 +2904,19 @@ void ae3d::GfxDevice::BeginRenderPass()
     renderPassBeginInfo.pClearValues = clearValues;
     renderPassBeginInfo.framebuffer = GfxDeviceGlobal::frameBuffers[ GfxDeviceGlobal::currentBuffer ];
 
-    vkCmdBeginRenderPass( GfxDeviceGlobal::currentCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
+    BeginSecondaryRenderPass( GfxDeviceGlobal::currentCmdBuffer, renderPassBeginInfo );
 }
 
 void ae3d::GfxDevice::EndRenderPass()
 {
-    vkCmdEndRenderPass( GfxDeviceGlobal::drawCmdBuffers[ GfxDeviceGlobal::currentBuffer ] );
+    if (GfxDeviceGlobal::passPrimaryCmdBuffer != VK_NULL_HANDLE)
+    {
+        EndSecondaryRenderPass();
+    }
+    else
+    {
+        vkCmdEndRenderPass( GetCurrentFrame().drawCmdBuffer );
+    }
 }
 
 void ae3d::GfxDevice::EndCommandBuffer()
@@ -1886,7 +2927,7 @@ void ae3d::GfxDevice::EndCommandBuffer()
 
 void ae3d::GfxDevice::EndRenderPassAndCommandBuffer()
 {
-    vkCmdEndRenderPass( GfxDeviceGlobal::drawCmdBuffers[ GfxDeviceGlobal::currentBuffer ] );
+    EndRenderPass();
 
     VkResult err = vkEndCommandBuffer( GfxDeviceGlobal::currentCmdBuffer );
     AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer" );
@@ -1902,8 +2943,9 @@ void ae3d::GfxDevice::SetClearColor( float red, float green, float blue )
 
 void ae3d::GfxDevice::GetGpuMemoryUsage( unsigned& outUsedMBytes, unsigned& outBudgetMBytes )
 {
-    outUsedMBytes = 0;
-    outBudgetMBytes = 0;
+    const VulkanAllocator::Stats stats = VulkanAllocator::GetStats();
+    outUsedMBytes = (unsigned)(stats.usedBytes / (1024 * 1024));
+    outBudgetMBytes = (unsigned)(stats.deviceLocalBudgetBytes / (1024 * 1024));
 }
 
 void ae3d::GfxDevice::ClearScreen( unsigned /*clearFlags*/ )
@@ -1930,7 +2972,7 @@ void ae3d::GfxDevice::SetViewport( int aViewport[ 4 ] )
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
 
-    vkCmdSetViewport( GfxDeviceGlobal::currentCmdBuffer, 0, 1, &viewport );    
+    SetDynamicViewport( viewport );
 }
 
 void ae3d::GfxDevice::SetScissor( int aScissor[ 4 ] )
@@ -1940,7 +2982,7 @@ void ae3d::GfxDevice::SetScissor( int aScissor[ 4 ] )
     scissor.extent.height = (std::uint32_t)aScissor[ 3 ];
     scissor.offset.x = (std::uint32_t)aScissor[ 0 ];
     scissor.offset.y = (std::uint32_t)aScissor[ 1 ];
-    vkCmdSetScissor( GfxDeviceGlobal::currentCmdBuffer, 0, 1, &scissor );
+    SetDynamicScissor( scissor );
 }
 
 static void PrintShaderStatistics( VkPipeline pso )
@@ -1957,7 +2999,7 @@ static void PrintShaderStatistics( VkPipeline pso )
     }
 }
 
-void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endIndex, Shader& shader, BlendMode blendMode, DepthFunc depthFunc,
+void ae3d::GfxDevice::Draw( const VertexBuffer& vertexBuffer, int startIndex, int endIndex, Shader& shader, BlendMode blendMode, DepthFunc depthFunc,
                             CullMode cullMode, FillMode fillMode, PrimitiveTopology topology )
 {
     System::Assert( startIndex > -1 && startIndex <= vertexBuffer.GetFaceCount() / 3, "Invalid vertex buffer draw range in startIndex" );
@@ -1974,46 +3016,71 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
         return;
     }
 
-    if (Statistics::GetDrawCalls() >= (int)GfxDeviceGlobal::descriptorSets.count)
+    const VkFormat colorFormat = GfxDeviceGlobal::renderTexture0 ? GfxDeviceGlobal::renderTexture0->GetColorFormat() : VK_FORMAT_UNDEFINED;
+    const int sampleCount = GfxDeviceGlobal::renderTexture0 ? GfxDeviceGlobal::renderTexture0->GetSampleCount() : (int)GfxDeviceGlobal::msaaSampleBits;
+    const std::uint64_t psoHash = GetPSOHash( vertexBuffer.GetVertexFormat(), shader, blendMode, depthFunc, cullMode, fillMode, colorFormat, sampleCount, topology );
+    std::unique_lock< std::mutex > psoLock( GfxDeviceGlobal::psoMutex );
+    auto pso = GfxDeviceGlobal::psoCache.find( psoHash );
+
+    if (pso == std::end( GfxDeviceGlobal::psoCache ))
     {
-        System::Print( "Skipping draw because draw call count %d exceeds descriptor set count %ld \n", Statistics::GetDrawCalls(), GfxDeviceGlobal::descriptorSets.count );
-        return;
+        Statistics::IncPSOCacheMisses();
+
+        const VkRenderPass renderPass = GfxDeviceGlobal::renderTexture0 ? GfxDeviceGlobal::renderTexture0->GetRenderPass() : GfxDeviceGlobal::renderPass;
+        pso = GfxDeviceGlobal::psoCache.insert( std::make_pair( psoHash, CreatePSO( vertexBuffer.GetInputState(), shader, blendMode, depthFunc, cullMode, fillMode,
+                                                                                     renderPass, (VkSampleCountFlagBits)sampleCount, topology ) ) ).first;
+
+        PSODescription description;
+        description.vertexShaderPath = shader.GetVertexShaderPath();
+        description.fragmentShaderPath = shader.GetFragmentShaderPath();
+        description.vertexFormat = vertexBuffer.GetVertexFormat();
+        description.blendMode = blendMode;
+        description.depthFunc = depthFunc;
+        description.cullMode = cullMode;
+        description.fillMode = fillMode;
+        description.topology = topology;
+        description.colorFormat = colorFormat;
+        description.sampleCount = sampleCount;
+        GfxDeviceGlobal::psoManifest[ psoHash ] = description;
     }
-
-    const std::uint64_t psoHash = GetPSOHash( vertexBuffer, shader, blendMode, depthFunc, cullMode, fillMode, GfxDeviceGlobal::renderTexture0 ? GfxDeviceGlobal::renderTexture0->GetRenderPass() : VK_NULL_HANDLE, topology );
-
-    if (GfxDeviceGlobal::psoCache.find( psoHash ) == std::end( GfxDeviceGlobal::psoCache ))
+    else
     {
-        CreatePSO( vertexBuffer, shader, blendMode, depthFunc, cullMode, fillMode, GfxDeviceGlobal::renderTexture0 ? GfxDeviceGlobal::renderTexture0->GetRenderPass() : VK_NULL_HANDLE, topology, psoHash );
+        Statistics::IncPSOCacheHits();
     }
 
+    const VkPipeline pipeline = pso->second;
+    psoLock.unlock();
+
     const unsigned activePointLights = GfxDeviceGlobal::lightTiler.GetPointLightCount();
     const unsigned activeSpotLights = GfxDeviceGlobal::lightTiler.GetSpotLightCount();
     const unsigned lightCount = ((activeSpotLights & 0xFFFFu) << 16) | (activePointLights & 0xFFFFu);
 
-    GfxDeviceGlobal::perObjectUboStruct.windowWidth = GfxDeviceGlobal::backBufferWidth;
-    GfxDeviceGlobal::perObjectUboStruct.windowHeight = GfxDeviceGlobal::backBufferHeight;
-    GfxDeviceGlobal::perObjectUboStruct.numLights = lightCount;
-    GfxDeviceGlobal::perObjectUboStruct.maxNumLightsPerTile = GfxDeviceGlobal::lightTiler.GetMaxNumLightsPerTile();
-    GfxDeviceGlobal::perObjectUboStruct.tilesXY.x = (float)GfxDeviceGlobal::lightTiler.GetNumTilesX();
-    GfxDeviceGlobal::perObjectUboStruct.tilesXY.y = (float)GfxDeviceGlobal::lightTiler.GetNumTilesY();
+    PerObjectUboStruct& passUniforms = GfxDevice::EditPassUniforms();
+    passUniforms.windowWidth = GfxDeviceGlobal::backBufferWidth;
+    passUniforms.windowHeight = GfxDeviceGlobal::backBufferHeight;
+    passUniforms.numLights = lightCount;
+    passUniforms.maxNumLightsPerTile = GfxDeviceGlobal::lightTiler.GetMaxNumLightsPerTile();
+    passUniforms.tilesXY.x = (float)GfxDeviceGlobal::lightTiler.GetNumTilesX();
+    passUniforms.tilesXY.y = (float)GfxDeviceGlobal::lightTiler.GetNumTilesY();
+    GfxDeviceGlobal::perObjectUboStruct.positionScale = Vec4( vertexBuffer.GetPositionScale(), vertexBuffer.GetVertexFormat() == VertexBuffer::VertexFormat::PTNTC_Quantized ? 1.0f : 0.0f );
+    GfxDeviceGlobal::perObjectUboStruct.positionOffset = Vec4( vertexBuffer.GetPositionOffset(), 0 );
 
     UploadPerObjectUbo();
 
-    VkDescriptorSet descriptorSet = AllocateDescriptorSet( GfxDeviceGlobal::ubos[ GfxDeviceGlobal::currentUbo ].uboDesc, GfxDeviceGlobal::boundViews[ 0 ], GfxDeviceGlobal::boundSamplers[ 0 ], GfxDeviceGlobal::boundViews[ 1 ],
-                                                           GfxDeviceGlobal::boundSamplers[ 1 ], GfxDeviceGlobal::boundViews[ 11 ], GfxDeviceGlobal::boundViews[ 12 ] );
-
-    vkCmdBindDescriptorSets( GfxDeviceGlobal::currentCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                             GfxDeviceGlobal::pipelineLayout, 0, 1, &descriptorSet, 0, nullptr );
+    if (!BindDescriptorSet( GfxDeviceGlobal::currentCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS ))
+    {
+        System::Print( "Skipping draw because all descriptor sets are in use\n" );
+        return;
+    }
 
-    vkCmdBindPipeline( GfxDeviceGlobal::currentCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, GfxDeviceGlobal::psoCache[ psoHash ] );
+    vkCmdBindPipeline( GfxDeviceGlobal::currentCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline );
 
     VkDeviceSize offsets[ 1 ] = { 0 };
     vkCmdBindVertexBuffers( GfxDeviceGlobal::currentCmdBuffer, VertexBuffer::VERTEX_BUFFER_BIND_ID, 1, vertexBuffer.GetVertexBuffer(), offsets );
 
     if (topology == PrimitiveTopology::Triangles)
     {
-        vkCmdBindIndexBuffer( GfxDeviceGlobal::currentCmdBuffer, *vertexBuffer.GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT16 );
+        vkCmdBindIndexBuffer( GfxDeviceGlobal::currentCmdBuffer, *vertexBuffer.GetIndexBuffer(), 0, vertexBuffer.GetIndexFormat() == VertexBuffer::IndexFormat::UInt32 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16 );
         vkCmdDrawIndexed( GfxDeviceGlobal::currentCmdBuffer, (endIndex - startIndex) * 3, 1, startIndex * 3, 0, 0 );
     }
     else if (topology == PrimitiveTopology::Lines)
@@ -2027,56 +3094,59 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
 
 void ae3d::GfxDevice::GetNewUniformBuffer()
 {
-    GfxDeviceGlobal::currentUbo = (GfxDeviceGlobal::currentUbo + 1) % GfxDeviceGlobal::ubos.count;
+    GfxDeviceGlobal::drawUniforms = AllocateUniforms( PerDrawUboBlockSize );
 }
 
 void ae3d::GfxDevice::CreateUniformBuffers()
 {
-    GfxDeviceGlobal::ubos.Allocate( 1800 );
-
-    for (unsigned uboIndex = 0; uboIndex < GfxDeviceGlobal::ubos.count; ++uboIndex)
+    for (int f = 0; f < GfxDeviceGlobal::framesInFlight; ++f)
     {
-        auto& ubo = GfxDeviceGlobal::ubos[ uboIndex ];
-
-        const VkDeviceSize uboSize = 256 * 3 + 80 * 64;
-        static_assert( uboSize >= sizeof( PerObjectUboStruct ), "UBO size must be larger than UBO struct" );
-
-        VkBufferCreateInfo bufferInfo = {};
-        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferInfo.size = uboSize;
-        bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-
-        VkResult err = vkCreateBuffer( GfxDeviceGlobal::device, &bufferInfo, nullptr, &ubo.ubo );
-        AE3D_CHECK_VULKAN( err, "vkCreateBuffer UBO" );
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)ubo.ubo, VK_OBJECT_TYPE_BUFFER, "ubo" );
-
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, ubo.ubo, &memReqs );
+        AddUniformRingBuffer( GfxDeviceGlobal::frames[ f ].uniformRing, UniformRingInitialSize );
+        CreateMappedBuffer( GfxDeviceGlobal::frames[ f ].bonePalette, MaxBonesInUbo * sizeof( Matrix44 ), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, "bone palette" );
+    }
+}
 
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-        err = vkAllocateMemory( GfxDeviceGlobal::device, &allocInfo, nullptr, &ubo.uboMemory );
-        AE3D_CHECK_VULKAN( err, "vkAllocateMemory UBO" );
-        Statistics::IncTotalAllocCalls();
-        Statistics::IncAllocCalls();
+void ae3d::GfxDevice::SetFramesInFlight( int count )
+{
+    System::Assert( GfxDeviceGlobal::device == VK_NULL_HANDLE, "SetFramesInFlight must be called before creating the window" );
+    GfxDeviceGlobal::framesInFlight = count < 2 ? 2 : (count > MaxFramesInFlight ? MaxFramesInFlight : count);
+}
 
-        err = vkBindBufferMemory( GfxDeviceGlobal::device, ubo.ubo, ubo.uboMemory, 0 );
-        AE3D_CHECK_VULKAN( err, "vkBindBufferMemory UBO" );
+void ae3d::GfxDevice::SetBonePalette( const Matrix44* matrices, int count )
+{
+    const VkDeviceSize size = count * sizeof( Matrix44 );
+    Ubo& bonePalette = GetCurrentFrame().bonePalette;
 
-        ubo.uboDesc.buffer = ubo.ubo;
-        ubo.uboDesc.offset = 0;
-        ubo.uboDesc.range = uboSize;
+    if (size > bonePalette.uboDesc.range)
+    {
+        // The frame that last used this palette has finished in Present(), so the old buffer is not in use anymore.
+        DestroyMappedBuffer( bonePalette );
+        CreateMappedBuffer( bonePalette, size * 2, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, "bone palette" );
+        // Cached sets reference the old buffer, and its handle value may be reused.
+        EvictDescriptorSets();
+    }
 
-        err = vkMapMemory( GfxDeviceGlobal::device, ubo.uboMemory, 0, uboSize, 0, (void **)&ubo.uboData );
-        AE3D_CHECK_VULKAN( err, "vkMapMemory UBO" );
+    if (count > 0)
+    {
+        std::memcpy( bonePalette.uboData, matrices, (std::size_t)size );
+        Statistics::IncUniformUploadBytes( (int)size );
     }
 }
 
+PerObjectUboStruct& ae3d::GfxDevice::EditPassUniforms()
+{
+    GfxDeviceGlobal::isPassUboDirty = true;
+    return GfxDeviceGlobal::perObjectUboStruct;
+}
+
 std::uint8_t* ae3d::GfxDevice::GetCurrentUbo()
 {
-    return GfxDeviceGlobal::ubos[ GfxDeviceGlobal::currentUbo ].uboData;
+    if (GfxDeviceGlobal::drawUniforms.data == nullptr)
+    {
+        GfxDeviceGlobal::drawUniforms = AllocateUniforms( PerDrawUboBlockSize );
+    }
+
+    return GfxDeviceGlobal::drawUniforms.data;
 }
 
 void ae3d::GfxDevice::BeginFrame()
@@ -2084,7 +3154,8 @@ void ae3d::GfxDevice::BeginFrame()
     ae3d::System::Assert( acquireNextImageKHR != nullptr, "function pointers not loaded" );
     ae3d::System::Assert( GfxDeviceGlobal::swapChain != VK_NULL_HANDLE, "swap chain not initialized" );
     
-    VkResult err = acquireNextImageKHR( GfxDeviceGlobal::device, GfxDeviceGlobal::swapChain, UINT64_MAX, GfxDeviceGlobal::presentCompleteSemaphore, (VkFence)nullptr, &GfxDeviceGlobal::currentBuffer );
+    FrameResources& frame = GetCurrentFrame();
+    VkResult err = acquireNextImageKHR( GfxDeviceGlobal::device, GfxDeviceGlobal::swapChain, UINT64_MAX, frame.presentCompleteSemaphore, (VkFence)nullptr, &GfxDeviceGlobal::currentBuffer );
 
     if (err == VK_TIMEOUT)
     {
@@ -2093,7 +3164,7 @@ void ae3d::GfxDevice::BeginFrame()
 
     AE3D_CHECK_VULKAN( err, "acquireNextImage" );
 
-    GfxDeviceGlobal::currentCmdBuffer = GfxDeviceGlobal::drawCmdBuffers[ GfxDeviceGlobal::currentBuffer ];
+    GfxDeviceGlobal::currentCmdBuffer = frame.drawCmdBuffer;
 
     SubmitPostPresentBarrier();
 
@@ -2107,17 +3178,18 @@ void ae3d::GfxDevice::BeginFrame()
 
 void SubmitQueue()
 {
+    FrameResources& frame = GetCurrentFrame();
     VkPipelineStageFlags pipelineStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
 
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.pWaitDstStageMask = &pipelineStages;
     submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &GfxDeviceGlobal::presentCompleteSemaphore;
+    submitInfo.pWaitSemaphores = &frame.presentCompleteSemaphore;
     submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &GfxDeviceGlobal::renderCompleteSemaphore;
+    submitInfo.pSignalSemaphores = &frame.renderCompleteSemaphore;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &GfxDeviceGlobal::drawCmdBuffers[ GfxDeviceGlobal::currentBuffer ];
+    submitInfo.pCommandBuffers = &frame.drawCmdBuffer;
 
     VkResult err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
     AE3D_CHECK_VULKAN( err, "vkQueueSubmit" );
@@ -2126,8 +3198,10 @@ void SubmitQueue()
 
 void ae3d::GfxDevice::Present()
 {
+    AE3D_ZONE( "GfxDevice::Present" );
     Statistics::BeginPresentTimeProfiling();
     VkResult err = VK_SUCCESS;
+    FrameResources& frame = GetCurrentFrame();
 
 #if AE3D_OPENVR
     VR::SubmitFrame();
@@ -2138,24 +3212,26 @@ void ae3d::GfxDevice::Present()
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.pWaitDstStageMask = &pipelineStages;
     submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &GfxDeviceGlobal::presentCompleteSemaphore;
+    submitInfo.pWaitSemaphores = &frame.presentCompleteSemaphore;
     submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &GfxDeviceGlobal::renderCompleteSemaphore;
+    submitInfo.pSignalSemaphores = &frame.renderCompleteSemaphore;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &GfxDeviceGlobal::drawCmdBuffers[ GfxDeviceGlobal::currentBuffer ];
+    submitInfo.pCommandBuffers = &frame.drawCmdBuffer;
 
     err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
     AE3D_CHECK_VULKAN( err, "vkQueueSubmit" );
 #endif
 
-    SubmitPrePresentBarrier();
+    // Submissions complete in order, so the fence of the last one covers the whole frame.
+    SubmitPrePresentBarrier( frame.prePresentCmdBuffer, frame.fence );
+    frame.isSubmitted = true;
 
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &GfxDeviceGlobal::swapChain;
     presentInfo.pImageIndices = &GfxDeviceGlobal::currentBuffer;
-    presentInfo.pWaitSemaphores = &GfxDeviceGlobal::renderCompleteSemaphore;
+    presentInfo.pWaitSemaphores = &frame.renderCompleteSemaphore;
     presentInfo.waitSemaphoreCount = 1;
     err = queuePresentKHR( GfxDeviceGlobal::graphicsQueue, &presentInfo );
 
@@ -2166,29 +3242,14 @@ void ae3d::GfxDevice::Present()
 
     AE3D_CHECK_VULKAN( err, "queuePresent" );
 
-    if (GfxDeviceGlobal::usedOffscreen)
-    {
-        GfxDeviceGlobal::usedOffscreen = false;
-
-        std::uint64_t timestamps[ 2 ] = {};
-		err = vkGetQueryPoolResults( GfxDeviceGlobal::device, GfxDeviceGlobal::queryPool, 0, 2, sizeof( std::uint64_t ) * 2, timestamps, sizeof( std::uint64_t ), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT );
-		//AE3D_CHECK_VULKAN( err, "vkGetQueryPoolResults" );
-
-        GfxDeviceGlobal::timings[ 0 ] = (timestamps[ 1 ] - timestamps[ 0 ]) / 1000.0f;
+    VulkanUploader::Update();
 
-        Statistics::SetDepthNormalsGpuTime( GfxDeviceGlobal::timings[ 0 ] );
-    }
-
-    // FIXME: This slows down rendering
-    err = vkQueueWaitIdle( GfxDeviceGlobal::graphicsQueue );
-    AE3D_CHECK_VULKAN( err, "vkQueueWaitIdle" );
+    GfxDeviceGlobal::gpuScopeStack.clear();
 
-    for (unsigned i = 0; i < GfxDeviceGlobal::pendingFreeVBs.count; ++i)
-    {
-        vkDestroyBuffer( GfxDeviceGlobal::device, GfxDeviceGlobal::pendingFreeVBs[ i ], nullptr );
-    }
-
-    GfxDeviceGlobal::pendingFreeVBs.Allocate( 0 );
+    // The next frame reuses the resources of the frame that was recorded framesInFlight frames ago.
+    ++GfxDeviceGlobal::frameIndex;
+    RecycleFrame( GetCurrentFrameSlot() );
+    RewindUniformRing();
     Statistics::EndPresentTimeProfiling();
 }
 
@@ -2211,7 +3272,7 @@ void ae3d::GfxDevice::ReleaseGPUObjects()
 
     vkDestroyImage( GfxDeviceGlobal::device, GfxDeviceGlobal::depthStencil.image, nullptr );
     vkDestroyImageView( GfxDeviceGlobal::device, GfxDeviceGlobal::depthStencil.view, nullptr );
-    vkFreeMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::depthStencil.mem, nullptr );
+    VulkanAllocator::Free( GfxDeviceGlobal::depthStencil.mem );
 
     vkDestroyDescriptorSetLayout( GfxDeviceGlobal::device, GfxDeviceGlobal::descriptorSetLayout, nullptr );
     vkDestroyDescriptorPool( GfxDeviceGlobal::device, GfxDeviceGlobal::descriptorPool, nullptr );
@@ -2224,44 +3285,79 @@ void ae3d::GfxDevice::ReleaseGPUObjects()
         vkDestroyImage( GfxDeviceGlobal::device, GfxDeviceGlobal::msaaTarget.depthImage, nullptr );
         vkDestroyImageView( GfxDeviceGlobal::device, GfxDeviceGlobal::msaaTarget.colorView, nullptr );
         vkDestroyImageView( GfxDeviceGlobal::device, GfxDeviceGlobal::msaaTarget.depthView, nullptr );
-        vkFreeMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::msaaTarget.depthMem, nullptr );
-        vkFreeMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::msaaTarget.colorMem, nullptr );
+        VulkanAllocator::Free( GfxDeviceGlobal::msaaTarget.depthMem );
+        VulkanAllocator::Free( GfxDeviceGlobal::msaaTarget.colorMem );
     }
 
-    for (unsigned i = 0; i < GfxDeviceGlobal::ubos.count; ++i)
+    for (int f = 0; f < GfxDeviceGlobal::framesInFlight; ++f)
     {
-        vkFreeMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::ubos[ i ].uboMemory, nullptr );
-        vkDestroyBuffer( GfxDeviceGlobal::device, GfxDeviceGlobal::ubos[ i ].ubo, nullptr );
+        FrameResources& frame = GfxDeviceGlobal::frames[ f ];
+
+        for (auto& buffer : frame.uniformRing.buffers)
+        {
+            DestroyMappedBuffer( buffer->ubo );
+        }
+
+        frame.uniformRing.buffers.clear();
+        DestroyMappedBuffer( frame.bonePalette );
+        FreePendingResources( frame );
     }
 
     Shader::DestroyShaders();
     ComputeShader::DestroyShaders();
+    VulkanUploader::Deinit();
     Texture2D::DestroyTextures();
     TextureCube::DestroyTextures();
     RenderTexture::DestroyTextures();
     VertexBuffer::DestroyBuffers();
     GfxDeviceGlobal::lightTiler.DestroyBuffers();
+    VulkanAllocator::Deinit();
 
     for (auto pso : GfxDeviceGlobal::psoCache)
     {
         vkDestroyPipeline( GfxDeviceGlobal::device, pso.second, nullptr );
     }
 
-    vkDestroySemaphore( GfxDeviceGlobal::device, GfxDeviceGlobal::renderCompleteSemaphore, nullptr );
-    vkDestroySemaphore( GfxDeviceGlobal::device, GfxDeviceGlobal::presentCompleteSemaphore, nullptr );
     vkDestroySemaphore( GfxDeviceGlobal::device, GfxDeviceGlobal::offscreenSemaphore, nullptr );
     vkDestroyPipelineLayout( GfxDeviceGlobal::device, GfxDeviceGlobal::pipelineLayout, nullptr );
+    SavePipelineCache();
     vkDestroyPipelineCache( GfxDeviceGlobal::device, GfxDeviceGlobal::pipelineCache, nullptr );
     vkDestroySwapchainKHR( GfxDeviceGlobal::device, GfxDeviceGlobal::swapChain, nullptr );
     vkDestroySurfaceKHR( GfxDeviceGlobal::instance, GfxDeviceGlobal::surface, nullptr );
     vkDestroyCommandPool( GfxDeviceGlobal::device, GfxDeviceGlobal::cmdPool, nullptr );
+
+    for (int f = 0; f < GfxDeviceGlobal::framesInFlight; ++f)
+    {
+        FrameResources& frame = GfxDeviceGlobal::frames[ f ];
+        vkDestroySemaphore( GfxDeviceGlobal::device, frame.renderCompleteSemaphore, nullptr );
+        vkDestroySemaphore( GfxDeviceGlobal::device, frame.presentCompleteSemaphore, nullptr );
+        vkDestroyFence( GfxDeviceGlobal::device, frame.fence, nullptr );
+        vkDestroyCommandPool( GfxDeviceGlobal::device, frame.cmdPool, nullptr );
+
+        for (int i = 0; i < MaxRecordingThreads; ++i)
+        {
+            vkDestroyCommandPool( GfxDeviceGlobal::device, frame.recordingPools[ i ].pool, nullptr );
+        }
+    }
+
     vkDestroyDevice( GfxDeviceGlobal::device, nullptr );
     vkDestroyInstance( GfxDeviceGlobal::instance, nullptr );
 }
 
 void ae3d::GfxDevice::SetRenderTarget( RenderTexture* target, unsigned /*cubeMapFace*/ )
 {
-    GfxDeviceGlobal::currentCmdBuffer = target ? GfxDeviceGlobal::offscreenCmdBuffer : GfxDeviceGlobal::drawCmdBuffers[ GfxDeviceGlobal::currentBuffer ];
+    const VkCommandBuffer cmdBuffer = target ? GfxDeviceGlobal::offscreenCmdBuffer : GetCurrentFrame().drawCmdBuffer;
+
+    // The pass's secondary command buffer stays current until the pass ends.
+    if (GfxDeviceGlobal::passPrimaryCmdBuffer != VK_NULL_HANDLE)
+    {
+        GfxDeviceGlobal::cmdBufferAfterPass = cmdBuffer;
+    }
+    else
+    {
+        GfxDeviceGlobal::currentCmdBuffer = cmdBuffer;
+    }
+
     GfxDeviceGlobal::renderTexture0 = target;
     GfxDeviceGlobal::frameBuffer0 = target ? target->GetFrameBuffer() : VK_NULL_HANDLE;
 }
@@ -2270,18 +3366,33 @@ void BeginOffscreen()
 {
     ae3d::System::Assert( GfxDeviceGlobal::renderTexture0 != nullptr, "Render texture must be set when beginning offscreen rendering" );
     
-    // FIXME: Use fence instead of queue wait.
-    vkQueueWaitIdle( GfxDeviceGlobal::graphicsQueue );
+    // Each offscreen pass gets its own command buffer from the frame's pool, so earlier passes don't need to finish first.
+    FrameResources& frame = GetCurrentFrame();
+
+    if (frame.usedOffscreenCmdBuffers == frame.offscreenCmdBuffers.size())
+    {
+        VkCommandBufferAllocateInfo allocateInfo = {};
+        allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocateInfo.commandPool = frame.cmdPool;
+        allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocateInfo.commandBufferCount = 1;
+
+        VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;
+        VkResult err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &allocateInfo, &cmdBuffer );
+        AE3D_CHECK_VULKAN( err, "Offscreen command buffer" );
+        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)cmdBuffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "offscreenCmdBuffer" );
+        frame.offscreenCmdBuffers.push_back( cmdBuffer );
+    }
+
+    GfxDeviceGlobal::offscreenCmdBuffer = frame.offscreenCmdBuffers[ frame.usedOffscreenCmdBuffers++ ];
 
     VkCommandBufferBeginInfo cmdBufInfo = {};
     cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     VkResult err = vkBeginCommandBuffer( GfxDeviceGlobal::offscreenCmdBuffer, &cmdBufInfo );
     AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer" );
 
-    vkCmdResetQueryPool( GfxDeviceGlobal::offscreenCmdBuffer, GfxDeviceGlobal::queryPool, 0, 2 );
-    vkCmdWriteTimestamp( GfxDeviceGlobal::offscreenCmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, GfxDeviceGlobal::queryPool, 0 );
-
     VkClearValue clearValues[ 2 ];
     clearValues[ 0 ].color = GfxDeviceGlobal::clearColor;
     clearValues[ 1 ].depthStencil = { 1.0f, 0 };
@@ -2297,15 +3408,12 @@ void BeginOffscreen()
     renderPassBeginInfo.pClearValues = clearValues;
     renderPassBeginInfo.framebuffer = GfxDeviceGlobal::frameBuffer0;
 
-    vkCmdBeginRenderPass( GfxDeviceGlobal::offscreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
-
-    GfxDeviceGlobal::usedOffscreen = true;
+    BeginSecondaryRenderPass( GfxDeviceGlobal::offscreenCmdBuffer, renderPassBeginInfo );
 }
 
 void EndOffscreen()
 {
-    vkCmdWriteTimestamp( GfxDeviceGlobal::offscreenCmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GfxDeviceGlobal::queryPool, 1 );
-    vkCmdEndRenderPass( GfxDeviceGlobal::offscreenCmdBuffer );
+    EndSecondaryRenderPass();
 
     VkResult err = vkEndCommandBuffer( GfxDeviceGlobal::offscreenCmdBuffer );
     AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer" );
@@ -7,6 +7,7 @@
 #include "Statistics.hpp"
 #include "System.hpp"
 #include "GfxDevice.hpp"
+#include "VulkanAllocator.hpp"
 #include "VulkanUtils.hpp"
 
 extern ae3d::Renderer renderer;
@@ -21,12 +22,12 @@ namespace GfxDeviceGlobal
     extern unsigned backBufferWidth;
     extern unsigned backBufferHeight;
     extern VkDevice device;
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
     extern VkCommandBuffer computeCmdBuffer;
     extern VkDescriptorSetLayout descriptorSetLayout;
     extern VkQueue computeQueue;
-    extern VkImageView boundViews[ 2 ];
-    extern VkSampler boundSamplers[ 2 ];
+    extern thread_local VkImageView boundViews[ 13 ];
+    extern thread_local VkSampler boundSamplers[ 2 ];
 }
 
 void UploadPerObjectUbo();
@@ -45,12 +46,12 @@ void ae3d::LightTiler::DestroyBuffers()
     vkDestroyBufferView( GfxDeviceGlobal::device, spotLightColorView, nullptr );
     vkDestroyBufferView( GfxDeviceGlobal::device, spotLightBufferView, nullptr );
     vkDestroyBufferView( GfxDeviceGlobal::device, spotLightParamsView, nullptr );
-    vkFreeMemory( GfxDeviceGlobal::device, perTileLightIndexBufferMemory, nullptr );
-    vkFreeMemory( GfxDeviceGlobal::device, pointLightCenterAndRadiusMemory, nullptr );
-    vkFreeMemory( GfxDeviceGlobal::device, pointLightColorMemory, nullptr );
-    vkFreeMemory( GfxDeviceGlobal::device, spotLightColorMemory, nullptr );
-    vkFreeMemory( GfxDeviceGlobal::device, spotLightCenterAndRadiusMemory, nullptr );
-    vkFreeMemory( GfxDeviceGlobal::device, spotLightParamsMemory, nullptr );
+    VulkanAllocator::Free( perTileLightIndexBufferMemory );
+    VulkanAllocator::Free( pointLightCenterAndRadiusMemory );
+    VulkanAllocator::Free( pointLightColorMemory );
+    VulkanAllocator::Free( spotLightColorMemory );
+    VulkanAllocator::Free( spotLightCenterAndRadiusMemory );
+    VulkanAllocator::Free( spotLightParamsMemory );
 }
 
 void ae3d::LightTiler::Init()
@@ -68,20 +69,7 @@ void ae3d::LightTiler::Init()
         AE3D_CHECK_VULKAN( err, "vkCreateBuffer" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)perTileLightIndexBuffer, VK_OBJECT_TYPE_BUFFER, "perTileLightIndexBuffer" );
 
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, perTileLightIndexBuffer, &memReqs );
-
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-        err = vkAllocateMemory( GfxDeviceGlobal::device, &allocInfo, nullptr, &perTileLightIndexBufferMemory );
-        AE3D_CHECK_VULKAN( err, "vkAllocateMemory perTileLightIndexBuffer" );
-
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)perTileLightIndexBufferMemory, VK_OBJECT_TYPE_DEVICE_MEMORY, "perTileLightIndexBufferMemory" );
-
-        err = vkBindBufferMemory( GfxDeviceGlobal::device, perTileLightIndexBuffer, perTileLightIndexBufferMemory, 0 );
-        AE3D_CHECK_VULKAN( err, "vkBindBufferMemory perTileLightIndexBuffer" );
+        perTileLightIndexBufferMemory = VulkanAllocator::AllocateBuffer( perTileLightIndexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VulkanAllocator::Strategy::FreeList, "perTileLightIndexBufferMemory" );
 
         VkBufferViewCreateInfo bufferViewInfo = {};
         bufferViewInfo.sType = VK_STRUCTURE_TYPE_BUFFER_VIEW_CREATE_INFO;
@@ -105,23 +93,8 @@ void ae3d::LightTiler::Init()
         AE3D_CHECK_VULKAN( err, "vkCreateBuffer" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)pointLightCenterAndRadiusBuffer, VK_OBJECT_TYPE_BUFFER, "pointLightCenterAndRadiusBuffer" );
 
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, pointLightCenterAndRadiusBuffer, &memReqs );
-
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-        err = vkAllocateMemory( GfxDeviceGlobal::device, &allocInfo, nullptr, &pointLightCenterAndRadiusMemory );
-        AE3D_CHECK_VULKAN( err, "vkAllocateMemory pointLightCenterAndRadiusMemory" );
-
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)pointLightCenterAndRadiusMemory, VK_OBJECT_TYPE_DEVICE_MEMORY, "pointLightCenterAndRadiusMemory" );
-
-        err = vkBindBufferMemory( GfxDeviceGlobal::device, pointLightCenterAndRadiusBuffer, pointLightCenterAndRadiusMemory, 0 );
-        AE3D_CHECK_VULKAN( err, "vkBindBufferMemory pointLightCenterAndRadiusBuffer" );
-
-        err = vkMapMemory( GfxDeviceGlobal::device, pointLightCenterAndRadiusMemory, 0, bufferInfo.size, 0, &mappedPointLightCenterAndRadiusMemory );
-        AE3D_CHECK_VULKAN( err, "vkMapMemory point lights" );
+        pointLightCenterAndRadiusMemory = VulkanAllocator::AllocateBuffer( pointLightCenterAndRadiusBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VulkanAllocator::Strategy::FreeList, "pointLightCenterAndRadiusMemory" );
+        mappedPointLightCenterAndRadiusMemory = pointLightCenterAndRadiusMemory->mappedData;
 
         VkBufferViewCreateInfo bufferViewInfo = {};
         bufferViewInfo.sType = VK_STRUCTURE_TYPE_BUFFER_VIEW_CREATE_INFO;
@@ -145,21 +118,8 @@ void ae3d::LightTiler::Init()
         AE3D_CHECK_VULKAN( err, "vkCreateBuffer" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)pointLightColorBuffer, VK_OBJECT_TYPE_BUFFER, "pointLightColorBuffer" );
 
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, pointLightColorBuffer, &memReqs );
-
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-        err = vkAllocateMemory( GfxDeviceGlobal::device, &allocInfo, nullptr, &pointLightColorMemory );
-        AE3D_CHECK_VULKAN( err, "vkAllocateMemory pointLightColorMemory" );
-
-        err = vkBindBufferMemory( GfxDeviceGlobal::device, pointLightColorBuffer, pointLightColorMemory, 0 );
-        AE3D_CHECK_VULKAN( err, "vkBindBufferMemory pointLightColorBuffer" );
-
-        err = vkMapMemory( GfxDeviceGlobal::device, pointLightColorMemory, 0, bufferInfo.size, 0, &mappedPointLightColorMemory );
-        AE3D_CHECK_VULKAN( err, "vkMapMemory point lights" );
+        pointLightColorMemory = VulkanAllocator::AllocateBuffer( pointLightColorBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VulkanAllocator::Strategy::FreeList, "pointLightColorMemory" );
+        mappedPointLightColorMemory = pointLightColorMemory->mappedData;
 
         VkBufferViewCreateInfo bufferViewInfo = {};
         bufferViewInfo.sType = VK_STRUCTURE_TYPE_BUFFER_VIEW_CREATE_INFO;
@@ -183,21 +143,8 @@ void ae3d::LightTiler::Init()
         AE3D_CHECK_VULKAN( err, "vkCreateBuffer" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)spotLightCenterAndRadiusBuffer, VK_OBJECT_TYPE_BUFFER, "spotLightCenterAndRadiusBuffer" );
 
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, spotLightCenterAndRadiusBuffer, &memReqs );
-
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-        err = vkAllocateMemory( GfxDeviceGlobal::device, &allocInfo, nullptr, &spotLightCenterAndRadiusMemory );
-        AE3D_CHECK_VULKAN( err, "vkAllocateMemory spotLightCenterAndRadiusMemory" );
-
-        err = vkBindBufferMemory( GfxDeviceGlobal::device, spotLightCenterAndRadiusBuffer, spotLightCenterAndRadiusMemory, 0 );
-        AE3D_CHECK_VULKAN( err, "vkBindBufferMemory spotLightCenterAndRadiusBuffer" );
-
-        err = vkMapMemory( GfxDeviceGlobal::device, spotLightCenterAndRadiusMemory, 0, bufferInfo.size, 0, &mappedSpotLightCenterAndRadiusMemory );
-        AE3D_CHECK_VULKAN( err, "vkMapMemory spot lights" );
+        spotLightCenterAndRadiusMemory = VulkanAllocator::AllocateBuffer( spotLightCenterAndRadiusBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VulkanAllocator::Strategy::FreeList, "spotLightCenterAndRadiusMemory" );
+        mappedSpotLightCenterAndRadiusMemory = spotLightCenterAndRadiusMemory->mappedData;
 
         VkBufferViewCreateInfo bufferViewInfo = {};
         bufferViewInfo.sType = VK_STRUCTURE_TYPE_BUFFER_VIEW_CREATE_INFO;
@@ -221,21 +168,8 @@ void ae3d::LightTiler::Init()
         AE3D_CHECK_VULKAN( err, "vkCreateBuffer" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)spotLightParamsBuffer, VK_OBJECT_TYPE_BUFFER, "spotLightParamsBuffer" );
 
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, spotLightParamsBuffer, &memReqs );
-
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-        err = vkAllocateMemory( GfxDeviceGlobal::device, &allocInfo, nullptr, &spotLightParamsMemory );
-        AE3D_CHECK_VULKAN( err, "vkAllocateMemory spotLightParamsMemory" );
-
-        err = vkBindBufferMemory( GfxDeviceGlobal::device, spotLightParamsBuffer, spotLightParamsMemory, 0 );
-        AE3D_CHECK_VULKAN( err, "vkBindBufferMemory spotLightParamsBuffer" );
-
-        err = vkMapMemory( GfxDeviceGlobal::device, spotLightParamsMemory, 0, bufferInfo.size, 0, &mappedSpotLightParamsMemory );
-        AE3D_CHECK_VULKAN( err, "vkMapMemory spot lights" );
+        spotLightParamsMemory = VulkanAllocator::AllocateBuffer( spotLightParamsBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VulkanAllocator::Strategy::FreeList, "spotLightParamsMemory" );
+        mappedSpotLightParamsMemory = spotLightParamsMemory->mappedData;
 
         VkBufferViewCreateInfo bufferViewInfo = {};
         bufferViewInfo.sType = VK_STRUCTURE_TYPE_BUFFER_VIEW_CREATE_INFO;
@@ -259,23 +193,8 @@ void ae3d::LightTiler::Init()
         AE3D_CHECK_VULKAN( err, "vkCreateBuffer" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)spotLightColorBuffer, VK_OBJECT_TYPE_BUFFER, "spotLightColorBuffer" );
 
-        VkMemoryRequirements memReqs;
-        vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, spotLightColorBuffer, &memReqs );
-
-        VkMemoryAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-        allocInfo.allocationSize = memReqs.size;
-        allocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-        err = vkAllocateMemory( GfxDeviceGlobal::device, &allocInfo, nullptr, &spotLightColorMemory );
-        AE3D_CHECK_VULKAN( err, "vkAllocateMemory spotLightColorMemory" );
-
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)spotLightColorMemory, VK_OBJECT_TYPE_DEVICE_MEMORY, "spotLightColorMemory" );
-
-        err = vkBindBufferMemory( GfxDeviceGlobal::device, spotLightColorBuffer, spotLightColorMemory, 0 );
-        AE3D_CHECK_VULKAN( err, "vkBindBufferMemory spotLightColorBuffer" );
-
-        err = vkMapMemory( GfxDeviceGlobal::device, spotLightColorMemory, 0, bufferInfo.size, 0, &mappedSpotLightColorMemory );
-        AE3D_CHECK_VULKAN( err, "vkMapMemory spot lights" );
+        spotLightColorMemory = VulkanAllocator::AllocateBuffer( spotLightColorBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, VulkanAllocator::Strategy::FreeList, "spotLightColorMemory" );
+        mappedSpotLightColorMemory = spotLightColorMemory->mappedData;
 
         VkBufferViewCreateInfo bufferViewInfo = {};
         bufferViewInfo.sType = VK_STRUCTURE_TYPE_BUFFER_VIEW_CREATE_INFO;
@@ -311,15 +230,16 @@ unsigned ae3d::LightTiler::GetNumTilesY() const
 
 void ae3d::LightTiler::CullLights( ComputeShader& shader, const Matrix44& projection, const Matrix44& localToView, RenderTexture& depthNormalTarget )
 {
-    Matrix44::Invert( projection, GfxDeviceGlobal::perObjectUboStruct.clipToView );
+    PerObjectUboStruct& passUniforms = GfxDevice::EditPassUniforms();
+    Matrix44::Invert( projection, passUniforms.clipToView );
 
     GfxDeviceGlobal::perObjectUboStruct.localToView = localToView;
-    GfxDeviceGlobal::perObjectUboStruct.windowWidth = depthNormalTarget.GetWidth();
-    GfxDeviceGlobal::perObjectUboStruct.windowHeight = depthNormalTarget.GetHeight();
-    GfxDeviceGlobal::perObjectUboStruct.numLights = (((unsigned)activeSpotLights & 0xFFFFu) << 16) | ((unsigned)activePointLights & 0xFFFFu);
-    GfxDeviceGlobal::perObjectUboStruct.maxNumLightsPerTile = GetMaxNumLightsPerTile();
-    GfxDeviceGlobal::perObjectUboStruct.tilesXY.x = (float)GetNumTilesX();
-    GfxDeviceGlobal::perObjectUboStruct.tilesXY.y = (float)GetNumTilesY();
+    passUniforms.windowWidth = depthNormalTarget.GetWidth();
+    passUniforms.windowHeight = depthNormalTarget.GetHeight();
+    passUniforms.numLights = (((unsigned)activeSpotLights & 0xFFFFu) << 16) | ((unsigned)activePointLights & 0xFFFFu);
+    passUniforms.maxNumLightsPerTile = GetMaxNumLightsPerTile();
+    passUniforms.tilesXY.x = (float)GetNumTilesX();
+    passUniforms.tilesXY.y = (float)GetNumTilesY();
     
     GfxDeviceGlobal::boundViews[ 0 ] = depthNormalTarget.GetColorView();
     GfxDeviceGlobal::boundSamplers[ 0 ] = depthNormalTarget.GetSampler();
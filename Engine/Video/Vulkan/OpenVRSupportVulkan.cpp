@@ -19,6 +19,7 @@
 #include "Shader.hpp"
 #include "TransformComponent.hpp"
 #include "Vec3.hpp"
+#include "VulkanAllocator.hpp"
 #include "VulkanUtils.hpp"
 
 void SubmitQueue();
@@ -38,7 +39,7 @@ namespace GfxDeviceGlobal
     extern VkInstance instance;
     extern VkQueue graphicsQueue;
     extern std::uint32_t graphicsQueueIndex;
-    extern VkCommandBuffer currentCmdBuffer;
+    extern thread_local VkCommandBuffer currentCmdBuffer;
     extern VkRenderPass renderPass;
 }
 
@@ -46,10 +47,10 @@ struct FramebufferDesc
 {
     VkImage image = VK_NULL_HANDLE;
     VkImageView imageView;
-    VkDeviceMemory deviceMemory;
+    ae3d::VulkanAllocation* deviceMemory;
     VkImage depthStencilImage = VK_NULL_HANDLE;
     VkImageView depthStencilImageView;
-    VkDeviceMemory depthStencilDeviceMemory;
+    ae3d::VulkanAllocation* depthStencilDeviceMemory;
     VkFramebuffer framebuffer;
     VkRenderPass renderPass;
     VkImageLayout imageLayout;
@@ -144,28 +145,7 @@ bool CreateFrameBuffer( int width, int height, FramebufferDesc& outFramebufferDe
 
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)outFramebufferDesc.image, VK_OBJECT_TYPE_IMAGE, debugName );
 
-    VkMemoryRequirements memoryRequirements = {};
-    vkGetImageMemoryRequirements( GfxDeviceGlobal::device, outFramebufferDesc.image, &memoryRequirements );
-
-    VkMemoryAllocateInfo memoryAllocateInfo;
-    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocateInfo.pNext = nullptr;
-    memoryAllocateInfo.allocationSize = memoryRequirements.size;
-    memoryAllocateInfo.memoryTypeIndex = GetMemoryType( memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-
-    result = vkAllocateMemory( GfxDeviceGlobal::device, &memoryAllocateInfo, nullptr, &outFramebufferDesc.deviceMemory );
-    if (result != VK_SUCCESS)
-    {
-        System::Print( "Failed to create a framebuffer!\n" );
-        return false;
-    }
-
-    result = vkBindImageMemory( GfxDeviceGlobal::device, outFramebufferDesc.image, outFramebufferDesc.deviceMemory, 0 );
-    if (result != VK_SUCCESS)
-    {
-        System::Print( "Failed to create a framebuffer!\n" );
-        return false;
-    }
+    outFramebufferDesc.deviceMemory = VulkanAllocator::AllocateImage( outFramebufferDesc.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, debugName );
 
     VkImageViewCreateInfo imageViewCreateInfo;
     imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -200,24 +180,7 @@ bool CreateFrameBuffer( int width, int height, FramebufferDesc& outFramebufferDe
 
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)outFramebufferDesc.image, VK_OBJECT_TYPE_IMAGE, "VR depthstencil" );
 
-    vkGetImageMemoryRequirements( GfxDeviceGlobal::device, outFramebufferDesc.depthStencilImage, &memoryRequirements );
-
-    memoryAllocateInfo.allocationSize = memoryRequirements.size;
-    memoryAllocateInfo.memoryTypeIndex = GetMemoryType( memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-
-    result = vkAllocateMemory( GfxDeviceGlobal::device, &memoryAllocateInfo, nullptr, &outFramebufferDesc.depthStencilDeviceMemory );
-    if (result != VK_SUCCESS)
-    {
-        System::Print( "Failed to create a framebuffer!\n" );
-        return false;
-    }
-
-    result = vkBindImageMemory( GfxDeviceGlobal::device, outFramebufferDesc.depthStencilImage, outFramebufferDesc.depthStencilDeviceMemory, 0 );
-    if (result != VK_SUCCESS)
-    {
-        System::Print( "Failed to create a framebuffer!\n" );
-        return false;
-    }
+    outFramebufferDesc.depthStencilDeviceMemory = VulkanAllocator::AllocateImage( outFramebufferDesc.depthStencilImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "VR depthstencil memory" );
 
     imageViewCreateInfo.image = outFramebufferDesc.depthStencilImage;
     imageViewCreateInfo.format = imageCreateInfo.format;
@@ -458,11 +421,11 @@ void ae3d::VR::Deinit()
     {
         vkDestroyImage( GfxDeviceGlobal::device, Global::leftEyeDesc.image, nullptr );
         vkDestroyImageView( GfxDeviceGlobal::device, Global::leftEyeDesc.imageView, nullptr );
-        vkFreeMemory( GfxDeviceGlobal::device, Global::leftEyeDesc.deviceMemory, nullptr );
+        VulkanAllocator::Free( Global::leftEyeDesc.deviceMemory );
 
         vkDestroyImage( GfxDeviceGlobal::device, Global::rightEyeDesc.image, nullptr );
         vkDestroyImageView( GfxDeviceGlobal::device, Global::rightEyeDesc.imageView, nullptr );
-        vkFreeMemory( GfxDeviceGlobal::device, Global::rightEyeDesc.deviceMemory, nullptr );
+        VulkanAllocator::Free( Global::rightEyeDesc.deviceMemory );
 
         vr::VR_Shutdown();
         Global::hmd = nullptr;
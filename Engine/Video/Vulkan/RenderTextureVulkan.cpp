@@ -7,12 +7,17 @@
 #include "Macros.hpp"
 #include "System.hpp"
 #include "Statistics.hpp"
+#include "VulkanAllocator.hpp"
 #include "VulkanUtils.hpp"
 
 namespace ae3d
 {
     void AllocateSetupCommandBuffer();
     void FlushSetupCommandBuffer();
+
+    /// Creates a render pass with a color and a depth attachment. Pipelines created for it are compatible with all render textures
+    /// that have the same color format and sample count.
+    VkRenderPass CreateRenderTextureRenderPass( VkFormat colorFormat, VkSampleCountFlagBits sampleCount );
 }
 
 namespace GfxDeviceGlobal
@@ -21,7 +26,7 @@ namespace GfxDeviceGlobal
     extern VkCommandBuffer setupCmdBuffer;
     extern VkFormat colorFormat;
     extern VkFormat depthFormat;
-    extern VkCommandBuffer currentCmdBuffer;
+    extern thread_local VkCommandBuffer currentCmdBuffer;
     extern VkSampleCountFlagBits msaaSampleBits;
 }
 
@@ -30,7 +35,7 @@ namespace RenderTextureGlobal
     std::vector< VkSampler > samplersToReleaseAtExit;
     std::vector< VkImage > imagesToReleaseAtExit;
     std::vector< VkImageView > imageViewsToReleaseAtExit;
-    std::vector< VkDeviceMemory > memoryToReleaseAtExit;
+    std::vector< ae3d::VulkanAllocation* > memoryToReleaseAtExit;
     std::vector< VkFramebuffer > fbsToReleaseAtExit;
     std::vector< VkRenderPass > renderPassesToReleaseAtExit;
 }
@@ -54,7 +59,7 @@ void ae3d::RenderTexture::DestroyTextures()
 
     for (std::size_t memoryIndex = 0; memoryIndex < RenderTextureGlobal::memoryToReleaseAtExit.size(); ++memoryIndex)
     {
-        vkFreeMemory( GfxDeviceGlobal::device, RenderTextureGlobal::memoryToReleaseAtExit[ memoryIndex ], nullptr );
+        VulkanAllocator::Free( RenderTextureGlobal::memoryToReleaseAtExit[ memoryIndex ] );
     }
 
     for (std::size_t fbIndex = 0; fbIndex < RenderTextureGlobal::fbsToReleaseAtExit.size(); ++fbIndex)
@@ -204,22 +209,8 @@ void ae3d::RenderTexture::Create2D( int aWidth, int aHeight, DataType aDataType,
     RenderTextureGlobal::imagesToReleaseAtExit.push_back( color.image );
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)color.image, VK_OBJECT_TYPE_IMAGE, debugName );
 
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements( GfxDeviceGlobal::device, color.image, &memReqs );
-
-    VkMemoryAllocateInfo memAlloc = {};
-    memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memAlloc.allocationSize = memReqs.size;
-
-    memAlloc.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-    err = vkAllocateMemory( GfxDeviceGlobal::device, &memAlloc, nullptr, &color.mem );
-    AE3D_CHECK_VULKAN( err, "render texture 2d color image memory" );
+    color.mem = VulkanAllocator::AllocateImage( color.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "render texture 2d color memory" );
     RenderTextureGlobal::memoryToReleaseAtExit.push_back( color.mem );
-    Statistics::IncAllocCalls();
-    Statistics::IncTotalAllocCalls();
-
-    err = vkBindImageMemory( GfxDeviceGlobal::device, color.image, color.mem, 0 );
-    AE3D_CHECK_VULKAN( err, "render texture 2d color image bind memory" );
 
     AllocateSetupCommandBuffer();
 
@@ -259,17 +250,8 @@ void ae3d::RenderTexture::Create2D( int aWidth, int aHeight, DataType aDataType,
     RenderTextureGlobal::imagesToReleaseAtExit.push_back( depth.image );
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)depth.image, VK_OBJECT_TYPE_IMAGE, "render texture 2d depth" );
 
-    vkGetImageMemoryRequirements( GfxDeviceGlobal::device, depth.image, &memReqs );
-    memAlloc.allocationSize = memReqs.size;
-    memAlloc.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-    err = vkAllocateMemory( GfxDeviceGlobal::device, &memAlloc, nullptr, &depth.mem );
-    AE3D_CHECK_VULKAN( err, "render texture 2d depth memory" );
+    depth.mem = VulkanAllocator::AllocateImage( depth.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "render texture 2d depth memory" );
     RenderTextureGlobal::memoryToReleaseAtExit.push_back( depth.mem );
-    Statistics::IncAllocCalls();
-    Statistics::IncTotalAllocCalls();
-
-    err = vkBindImageMemory( GfxDeviceGlobal::device, depth.image, depth.mem, 0 );
-    AE3D_CHECK_VULKAN( err, "render texture 2d depth bind" );
 
     SetImageLayout( GfxDeviceGlobal::setupCmdBuffer,
         depth.image,
@@ -361,20 +343,9 @@ void ae3d::RenderTexture::CreateCube( int aDimension, DataType aDataType, Textur
     RenderTextureGlobal::imagesToReleaseAtExit.push_back( color.image );
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)color.image, VK_OBJECT_TYPE_IMAGE, debugName );
 
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements( GfxDeviceGlobal::device, color.image, &memReqs );
-
-    VkMemoryAllocateInfo memAllocInfo = {};
-    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memAllocInfo.allocationSize = memReqs.size;
-    memAllocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-    err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &color.mem );
-    AE3D_CHECK_VULKAN( err, "vkAllocateMemory in RenderTextureCube" );
+    color.mem = VulkanAllocator::AllocateImage( color.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "render texture cube color memory" );
     RenderTextureGlobal::memoryToReleaseAtExit.push_back( color.mem );
 
-    err = vkBindImageMemory( GfxDeviceGlobal::device, color.image, color.mem, 0 );
-    AE3D_CHECK_VULKAN( err, "vkBindImageMemory in RenderTextureCube" );
-
     AllocateSetupCommandBuffer();
 
     SetImageLayout( GfxDeviceGlobal::setupCmdBuffer,
@@ -425,21 +396,8 @@ void ae3d::RenderTexture::CreateCube( int aDimension, DataType aDataType, Textur
     RenderTextureGlobal::imagesToReleaseAtExit.push_back( depth.image );
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)depth.image, VK_OBJECT_TYPE_IMAGE, "render texture cube depth" );
 
-    vkGetImageMemoryRequirements( GfxDeviceGlobal::device, depth.image, &memReqs );
-
-    VkMemoryAllocateInfo memAlloc = {};
-    memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memAlloc.allocationSize = memReqs.size;
-    
-    memAlloc.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-    err = vkAllocateMemory( GfxDeviceGlobal::device, &memAlloc, nullptr, &depth.mem );
-    AE3D_CHECK_VULKAN( err, "render texture cube depth memory" );
+    depth.mem = VulkanAllocator::AllocateImage( depth.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "render texture cube depth memory" );
     RenderTextureGlobal::memoryToReleaseAtExit.push_back( depth.mem );
-    Statistics::IncAllocCalls();
-    Statistics::IncTotalAllocCalls();
-
-    err = vkBindImageMemory( GfxDeviceGlobal::device, depth.image, depth.mem, 0 );
-    AE3D_CHECK_VULKAN( err, "render texture cube depth bind" );
 
     SetImageLayout( GfxDeviceGlobal::setupCmdBuffer,
         depth.image,
@@ -477,11 +435,11 @@ void ae3d::RenderTexture::CreateCube( int aDimension, DataType aDataType, Textur
     CreateSampler( filter, wrap, sampler, mipLevelCount );
 }
 
-void ae3d::RenderTexture::CreateRenderPass()
+VkRenderPass ae3d::CreateRenderTextureRenderPass( VkFormat colorFormat, VkSampleCountFlagBits sampleCount )
 {
     VkAttachmentDescription attachments[ 2 ];
     attachments[ 0 ].format = colorFormat;
-    attachments[ 0 ].samples = sampleCount == 1 ? VK_SAMPLE_COUNT_1_BIT : GfxDeviceGlobal::msaaSampleBits;
+    attachments[ 0 ].samples = sampleCount;
     attachments[ 0 ].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachments[ 0 ].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachments[ 0 ].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -528,10 +486,18 @@ void ae3d::RenderTexture::CreateRenderPass()
     renderPassInfo.pSubpasses = &subpass;
     renderPassInfo.dependencyCount = 0;
 
+    VkRenderPass renderPass;
     VkResult err = vkCreateRenderPass( GfxDeviceGlobal::device, &renderPassInfo, nullptr, &renderPass );
     AE3D_CHECK_VULKAN( err, "RenderTexture vkCreateRenderPass" );
 
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)renderPass, VK_OBJECT_TYPE_RENDER_PASS, "renderpass cube" );
 
     RenderTextureGlobal::renderPassesToReleaseAtExit.push_back( renderPass );
+
+    return renderPass;
+}
+
+void ae3d::RenderTexture::CreateRenderPass()
+{
+    renderPass = CreateRenderTextureRenderPass( colorFormat, sampleCount == 1 ? VK_SAMPLE_COUNT_1_BIT : GfxDeviceGlobal::msaaSampleBits );
 }
@@ -22,9 +22,9 @@ constexpr int MaxModuleCount = 600;
 namespace GfxDeviceGlobal
 {
     extern VkDevice device;
-    extern VkImageView boundViews[ 13 ];
-    extern VkSampler boundSamplers[ 2 ];
-	extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local VkImageView boundViews[ 13 ];
+    extern thread_local VkSampler boundSamplers[ 2 ];
+	extern thread_local PerObjectUboStruct perObjectUboStruct;
     extern VkCommandBuffer texCmdBuffer;
     extern ae3d::RenderTexture* renderTexture0;
 }
@@ -50,6 +50,19 @@ struct ShaderCacheEntry
 
 Array< ShaderCacheEntry > cacheEntries;
 
+ae3d::Shader* FindLoadedShader( const std::string& vertexPath, const std::string& fragmentPath )
+{
+    for (unsigned i = 0; i < cacheEntries.count; ++i)
+    {
+        if (cacheEntries[ i ].vertexPath == vertexPath && cacheEntries[ i ].fragmentPath == fragmentPath)
+        {
+            return cacheEntries[ i ].shader;
+        }
+    }
+
+    return nullptr;
+}
+
 void ShaderReload( const std::string& path )
 {
     ae3d::System::Print("Reloading shader %s\n", path.c_str());
@@ -14,6 +14,8 @@
 #include "Macros.hpp"
 #include "System.hpp"
 #include "Statistics.hpp"
+#include "VulkanAllocator.hpp"
+#include "VulkanUploader.hpp"
 #include "VulkanUtils.hpp"
 
 bool HasStbExtension( const std::string& path ); // Defined in TextureCommon.cpp
@@ -42,7 +44,7 @@ namespace Texture2DGlobal
     std::vector< VkSampler > samplersToReleaseAtExit;
     std::vector< VkImage > imagesToReleaseAtExit;
     std::vector< VkImageView > imageViewsToReleaseAtExit;
-    std::vector< VkDeviceMemory > memoryToReleaseAtExit;
+    std::vector< ae3d::VulkanAllocation* > memoryToReleaseAtExit;
 }
 
 void ae3d::Texture2D::DestroyTextures()
@@ -64,7 +66,7 @@ void ae3d::Texture2D::DestroyTextures()
 
     for (std::size_t memoryIndex = 0; memoryIndex < Texture2DGlobal::memoryToReleaseAtExit.size(); ++memoryIndex)
     {
-        vkFreeMemory( GfxDeviceGlobal::device, Texture2DGlobal::memoryToReleaseAtExit[ memoryIndex ], nullptr );
+        VulkanAllocator::Free( Texture2DGlobal::memoryToReleaseAtExit[ memoryIndex ] );
     }
 }
 
@@ -78,12 +80,16 @@ void ae3d::Texture2D::LoadFromData( const void* imageData, int aWidth, int aHeig
 
     CreateVulkanObjects( const_cast< void* >( imageData ), 4, colorSpace == ColorSpace::Linear ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB, usageFlags );
 
+    // Textures created from data are used right away, often by commands that don't go through GetView().
+    VulkanUploader::Wait( uploadBatch );
+
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)view, VK_OBJECT_TYPE_IMAGE_VIEW, debugName );
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)image, VK_OBJECT_TYPE_IMAGE, debugName );
 }
 
 void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, TextureWrap aWrap, TextureFilter aFilter, Mipmaps aMipmaps, ColorSpace aColorSpace, Anisotropy aAnisotropy )
 {
+    AE3D_ZONE( "Texture2D::Load" );
     filter = aFilter;
     wrap = aWrap;
     mipmaps = aMipmaps;
@@ -141,31 +147,27 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
     imageCreateInfo.extent = { (std::uint32_t)width, (std::uint32_t)height, 1 };
     imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
+    std::uint32_t queueFamilies[ 2 ];
+
+    if (VulkanUploader::UsesSeparateQueueFamily( queueFamilies ))
+    {
+        imageCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageCreateInfo.queueFamilyIndexCount = 2;
+        imageCreateInfo.pQueueFamilyIndices = queueFamilies;
+    }
+
     VkResult err = vkCreateImage( GfxDeviceGlobal::device, &imageCreateInfo, nullptr, &image );
     AE3D_CHECK_VULKAN( err, "vkCreateImage" );
     Texture2DGlobal::imagesToReleaseAtExit.push_back( image );
 
-    VkMemoryRequirements memReqs = {};
-    vkGetImageMemoryRequirements( GfxDeviceGlobal::device, image, &memReqs );
-
-    VkMemoryAllocateInfo memAllocInfo = {};
-    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memAllocInfo.allocationSize = memReqs.size;
-    memAllocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-
-    err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &deviceMemory );
-    AE3D_CHECK_VULKAN( err, "vkAllocateMemory" );
-    Statistics::IncAllocCalls();
-    Statistics::IncTotalAllocCalls();
+    deviceMemory = VulkanAllocator::AllocateImage( image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "tex2d dds memory" );
     Texture2DGlobal::memoryToReleaseAtExit.push_back( deviceMemory );
-	debug::SetObjectName( GfxDeviceGlobal::device, ( std::uint64_t )deviceMemory, VK_OBJECT_TYPE_DEVICE_MEMORY, "tex2d dds memory" );
 
-    err = vkBindImageMemory( GfxDeviceGlobal::device, image, deviceMemory, 0 );
-    AE3D_CHECK_VULKAN( err, "vkBindImageMemory" );
+    // All mips share one staging range, so they are always recorded into the same batch.
+    Array< VkDeviceSize > mipSizes( mipLevelCount );
+    Array< VkDeviceSize > mipOffsets( mipLevelCount );
+    VkDeviceSize stagingSize = 0;
 
-    Array< VkBuffer > stagingBuffers( mipLevelCount );
-    Array< VkDeviceMemory > stagingMemory( mipLevelCount );
-    
     for (int mipIndex = 0; mipIndex < mipLevelCount; ++mipIndex)
     {
         const std::int32_t mipWidth = MathUtil::Max( width >> mipIndex, 1 );
@@ -179,47 +181,23 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
         {
             imageSize = 16;
         }
-        
-        VkBufferCreateInfo bufferCreateInfo = {};
-        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferCreateInfo.size = imageSize;
-        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        err = vkCreateBuffer( GfxDeviceGlobal::device, &bufferCreateInfo, nullptr, &stagingBuffers[ mipIndex ] );
-        AE3D_CHECK_VULKAN( err, "vkCreateBuffer staging" );
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)stagingBuffers[ mipIndex ], VK_OBJECT_TYPE_BUFFER, "stagingBuffer2D" );
-
-        vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, stagingBuffers[ mipIndex ], &memReqs );
-
-        memAllocInfo.allocationSize = memReqs.size;
-        memAllocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
-
-		err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &stagingMemory[ mipIndex ] );
-		AE3D_CHECK_VULKAN( err, "vkAllocateMemory" );
-		debug::SetObjectName( GfxDeviceGlobal::device, ( std::uint64_t )deviceMemory, VK_OBJECT_TYPE_DEVICE_MEMORY, "tex2d memory" );
-
-        err = vkBindBufferMemory( GfxDeviceGlobal::device, stagingBuffers[ mipIndex ], stagingMemory[ mipIndex ], 0 );
-        AE3D_CHECK_VULKAN( err, "vkBindBufferMemory staging" );
-
-        void* stagingData;
-        err = vkMapMemory( GfxDeviceGlobal::device, stagingMemory[ mipIndex ], 0, memReqs.size, 0, &stagingData );
-        AE3D_CHECK_VULKAN( err, "vkMapMemory in Texture2D" );
-        VkDeviceSize amountToCopy = imageSize;
-        if (mipChain.dataOffsets[ mipIndex ] + imageSize >= (unsigned)mipChain.imageData.count)
+
+        mipSizes[ mipIndex ] = imageSize;
+        mipOffsets[ mipIndex ] = stagingSize;
+        stagingSize += (imageSize + 15) & ~VkDeviceSize( 15 );
+    }
+
+    const VulkanUploader::StagingRange staging = VulkanUploader::AllocateStaging( stagingSize, 16 );
+
+    for (int mipIndex = 0; mipIndex < mipLevelCount; ++mipIndex)
+    {
+        VkDeviceSize amountToCopy = mipSizes[ mipIndex ];
+        if (mipChain.dataOffsets[ mipIndex ] + mipSizes[ mipIndex ] >= (unsigned)mipChain.imageData.count)
         {
             amountToCopy = mipChain.imageData.count - mipChain.dataOffsets[ mipIndex ];
         }
         
-        std::memcpy( stagingData, &mipChain.imageData[ mipChain.dataOffsets[ mipIndex ] ], amountToCopy );
-
-        VkMappedMemoryRange flushRange = {};
-        flushRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        flushRange.memory = stagingMemory[ mipIndex ];
-        flushRange.offset = 0;
-        flushRange.size = VK_WHOLE_SIZE;
-        vkFlushMappedMemoryRanges( GfxDeviceGlobal::device, 1, &flushRange );
-
-        vkUnmapMemory( GfxDeviceGlobal::device, stagingMemory[ mipIndex ] );
+        std::memcpy( staging.data + mipOffsets[ mipIndex ], &mipChain.imageData[ mipChain.dataOffsets[ mipIndex ] ], amountToCopy );
     }
 
     VkImageViewCreateInfo viewInfo = {};
@@ -237,12 +215,7 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
     AE3D_CHECK_VULKAN( err, "vkCreateImageView in Texture2D" );
     Texture2DGlobal::imageViewsToReleaseAtExit.push_back( view );
 
-    VkCommandBufferBeginInfo cmdBufInfo = {};
-    cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    cmdBufInfo.flags = 0;
-
-    err = vkBeginCommandBuffer( GfxDeviceGlobal::texCmdBuffer, &cmdBufInfo );
-    AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer in Texture2D" );
+    const VkCommandBuffer transferCmdBuffer = VulkanUploader::GetTransferCommandBuffer();
 
     VkImageSubresourceRange range = {};
     range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -263,7 +236,7 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
     imageMemoryBarrier.subresourceRange = range;
 
     vkCmdPipelineBarrier(
-            GfxDeviceGlobal::texCmdBuffer,
+            transferCmdBuffer,
             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
             VK_PIPELINE_STAGE_TRANSFER_BIT,
             0,
@@ -284,38 +257,19 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
         bufferCopyRegion.imageExtent.width = mipWidth;
         bufferCopyRegion.imageExtent.height = mipHeight;
         bufferCopyRegion.imageExtent.depth = 1;
-        bufferCopyRegion.bufferOffset = 0;
+        bufferCopyRegion.bufferOffset = staging.offset + mipOffsets[ mipLevel ];
 
-        vkCmdCopyBufferToImage( GfxDeviceGlobal::texCmdBuffer, stagingBuffers[ mipLevel ], image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion );
+        vkCmdCopyBufferToImage( transferCmdBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion );
     }
 
-    imageMemoryBarrier = {};
-    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageMemoryBarrier.srcAccessMask = 0;
-    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-    imageMemoryBarrier.image = image;
-    imageMemoryBarrier.subresourceRange = range;
-    
-    vkCmdPipelineBarrier(
-        GfxDeviceGlobal::texCmdBuffer,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &imageMemoryBarrier );
-
+    // Fragment shader stages are not available on a transfer queue, so the final transition runs on the graphics queue.
     imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
     imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
     vkCmdPipelineBarrier(
-            GfxDeviceGlobal::texCmdBuffer,
+            VulkanUploader::GetGraphicsCommandBuffer(),
             VK_PIPELINE_STAGE_TRANSFER_BIT,
             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
             0,
@@ -323,23 +277,8 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
             0, nullptr,
             1, &imageMemoryBarrier );
 
-    vkEndCommandBuffer( GfxDeviceGlobal::texCmdBuffer );
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &GfxDeviceGlobal::texCmdBuffer;
-
-    err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
-    AE3D_CHECK_VULKAN( err, "vkQueueSubmit in Texture2D" );
-
-    vkDeviceWaitIdle( GfxDeviceGlobal::device );
-
-    for (int mipLevel = 0; mipLevel < mipLevelCount; ++mipLevel)
-    {
-        vkDestroyBuffer( GfxDeviceGlobal::device, stagingBuffers[ mipLevel ], nullptr );
-        vkFreeMemory( GfxDeviceGlobal::device, stagingMemory[ mipLevel ], nullptr );
-    }
+    layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    uploadBatch = VulkanUploader::GetCurrentBatch();
     
     VkSamplerCreateInfo samplerInfo = {};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -363,6 +302,16 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)sampler, VK_OBJECT_TYPE_SAMPLER, "sampler" );
 }
 
+VkImageView ae3d::Texture2D::GetView() const
+{
+    if (uploadBatch > VulkanUploader::GetCompletedBatch())
+    {
+        return GetDefaultTexture()->view;
+    }
+
+    return view;
+}
+
 void ae3d::Texture2D::CreateUAV( int aWidth, int aHeight, const char* debugName )
 {
     LoadFromData( nullptr, aWidth, aHeight, 4, debugName, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT );
@@ -424,70 +373,31 @@ void ae3d::Texture2D::CreateVulkanObjects( void* data, int bytesPerPixel, VkForm
     imageCreateInfo.extent = { (std::uint32_t)width, (std::uint32_t)height, 1 };
     imageCreateInfo.usage = usageFlags;
 
+    std::uint32_t queueFamilies[ 2 ];
+
+    if (VulkanUploader::UsesSeparateQueueFamily( queueFamilies ))
+    {
+        imageCreateInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageCreateInfo.queueFamilyIndexCount = 2;
+        imageCreateInfo.pQueueFamilyIndices = queueFamilies;
+    }
+
     VkResult err = vkCreateImage( GfxDeviceGlobal::device, &imageCreateInfo, nullptr, &image );
     AE3D_CHECK_VULKAN( err, "vkCreateImage" );
     Texture2DGlobal::imagesToReleaseAtExit.push_back( image );
 
-    VkMemoryRequirements memReqs = {};
-    vkGetImageMemoryRequirements( GfxDeviceGlobal::device, image, &memReqs );
-
-    VkMemoryAllocateInfo memAllocInfo = {};
-    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memAllocInfo.allocationSize = memReqs.size;
-    memAllocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-
-    err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &deviceMemory );
-    AE3D_CHECK_VULKAN( err, "vkAllocateMemory" );
-    Statistics::IncAllocCalls();
-    Statistics::IncTotalAllocCalls();
+    deviceMemory = VulkanAllocator::AllocateImage( image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "tex2d memory" );
     Texture2DGlobal::memoryToReleaseAtExit.push_back( deviceMemory );
-	debug::SetObjectName( GfxDeviceGlobal::device, ( std::uint64_t )deviceMemory, VK_OBJECT_TYPE_DEVICE_MEMORY, "tex2d memory" );
-
-    err = vkBindImageMemory( GfxDeviceGlobal::device, image, deviceMemory, 0 );
-    AE3D_CHECK_VULKAN( err, "vkBindImageMemory" );
 
-    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VulkanUploader::StagingRange staging;
 
-    VkDeviceSize imageSize = width * height * bytesPerPixel;
-
-    VkBufferCreateInfo bufferCreateInfo = {};
-    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferCreateInfo.size = imageSize;
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    err = vkCreateBuffer( GfxDeviceGlobal::device, &bufferCreateInfo, nullptr, &stagingBuffer );
-    AE3D_CHECK_VULKAN( err, "vkCreateBuffer staging" );
-    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)stagingBuffer, VK_OBJECT_TYPE_BUFFER, "staging2D" );
-
-    vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, stagingBuffer, &memReqs );
-
-    memAllocInfo.allocationSize = memReqs.size;
-    memAllocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
-    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
-    err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &stagingMemory );
-    AE3D_CHECK_VULKAN( err, "vkAllocateMemory" );
-
-    err = vkBindBufferMemory( GfxDeviceGlobal::device, stagingBuffer, stagingMemory, 0 );
-    AE3D_CHECK_VULKAN( err, "vkBindBufferMemory staging" );
-
-    void* stagingData;
-    err = vkMapMemory( GfxDeviceGlobal::device, stagingMemory, 0, memReqs.size, 0, &stagingData );
-    AE3D_CHECK_VULKAN( err, "vkMapMemory in Texture2D" );
-    
     if (data)
     {
-        std::memcpy( stagingData, data, imageSize );
+        const VkDeviceSize imageSize = width * height * bytesPerPixel;
+        staging = VulkanUploader::AllocateStaging( imageSize, 16 );
+        std::memcpy( staging.data, data, imageSize );
     }
 
-    VkMappedMemoryRange flushRange = {};
-    flushRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    flushRange.memory = stagingMemory;
-    flushRange.offset = 0;
-    flushRange.size = VK_WHOLE_SIZE;
-    vkFlushMappedMemoryRanges( GfxDeviceGlobal::device, 1, &flushRange );
-
-    vkUnmapMemory( GfxDeviceGlobal::device, stagingMemory );
-
     VkImageViewCreateInfo viewInfo = {};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -503,13 +413,7 @@ void ae3d::Texture2D::CreateVulkanObjects( void* data, int bytesPerPixel, VkForm
     AE3D_CHECK_VULKAN( err, "vkCreateImageView in Texture2D" );
     Texture2DGlobal::imageViewsToReleaseAtExit.push_back( view );
 
-    VkCommandBufferBeginInfo cmdBufInfo = {};
-    cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    cmdBufInfo.pInheritanceInfo = nullptr;
-    cmdBufInfo.flags = 0;
-
-    err = vkBeginCommandBuffer( GfxDeviceGlobal::texCmdBuffer, &cmdBufInfo );
-    AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer in Texture2D" );
+    const VkCommandBuffer transferCmdBuffer = VulkanUploader::GetTransferCommandBuffer();
 
     VkImageSubresourceRange range = {};
     range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -530,7 +434,7 @@ void ae3d::Texture2D::CreateVulkanObjects( void* data, int bytesPerPixel, VkForm
     imageMemoryBarrier.subresourceRange = range;
 
     vkCmdPipelineBarrier(
-            GfxDeviceGlobal::texCmdBuffer,
+            transferCmdBuffer,
             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
             VK_PIPELINE_STAGE_TRANSFER_BIT,
             0,
@@ -538,53 +442,38 @@ void ae3d::Texture2D::CreateVulkanObjects( void* data, int bytesPerPixel, VkForm
             0, nullptr,
             1, &imageMemoryBarrier );
 
-    VkBufferImageCopy bufferCopyRegion = {};
-    bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    bufferCopyRegion.imageSubresource.mipLevel = 0;
-    bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-    bufferCopyRegion.imageSubresource.layerCount = 1;
-    bufferCopyRegion.imageExtent.width = width;
-    bufferCopyRegion.imageExtent.height = height;
-    bufferCopyRegion.imageExtent.depth = 1;
-    bufferCopyRegion.bufferOffset = 0;
+    if (data)
+    {
+        VkBufferImageCopy bufferCopyRegion = {};
+        bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        bufferCopyRegion.imageSubresource.mipLevel = 0;
+        bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+        bufferCopyRegion.imageSubresource.layerCount = 1;
+        bufferCopyRegion.imageExtent.width = width;
+        bufferCopyRegion.imageExtent.height = height;
+        bufferCopyRegion.imageExtent.depth = 1;
+        bufferCopyRegion.bufferOffset = staging.offset;
 
-    vkCmdCopyBufferToImage( GfxDeviceGlobal::texCmdBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion );
+        vkCmdCopyBufferToImage( transferCmdBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion );
+    }
 
-    imageMemoryBarrier = {};
-    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageMemoryBarrier.srcAccessMask = 0;
-    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    // Blits and fragment shader stages are not available on a transfer queue, so the rest runs on the graphics queue.
+    const VkCommandBuffer graphicsCmdBuffer = VulkanUploader::GetGraphicsCommandBuffer();
+
+    imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
     imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-    imageMemoryBarrier.image = image;
-    imageMemoryBarrier.subresourceRange = range;
 
     vkCmdPipelineBarrier(
-        GfxDeviceGlobal::texCmdBuffer,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+        graphicsCmdBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
         VK_PIPELINE_STAGE_TRANSFER_BIT,
         0,
         0, nullptr,
         0, nullptr,
         1, &imageMemoryBarrier );
 
-    vkEndCommandBuffer( GfxDeviceGlobal::texCmdBuffer );
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &GfxDeviceGlobal::texCmdBuffer;
-
-    err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
-    AE3D_CHECK_VULKAN( err, "vkQueueSubmit in Texture2D" );
-
-    vkDeviceWaitIdle( GfxDeviceGlobal::device );
-
-    err = vkBeginCommandBuffer( GfxDeviceGlobal::texCmdBuffer, &cmdBufInfo );
-    AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer in Texture2D" );
-
     for (int i = 1; i < mipLevelCount; ++i)
     {
         const std::int32_t mipWidth = MathUtil::Max( width >> i, 1 );
@@ -605,7 +494,7 @@ void ae3d::Texture2D::CreateVulkanObjects( void* data, int bytesPerPixel, VkForm
         imageBlit.dstOffsets[ 0 ] = { 0, 0, 0 };
         imageBlit.dstOffsets[ 1 ] = { mipWidth, mipHeight, 1 };
 
-        vkCmdBlitImage( GfxDeviceGlobal::texCmdBuffer, image, VK_IMAGE_LAYOUT_GENERAL, image,
+        vkCmdBlitImage( graphicsCmdBuffer, image, VK_IMAGE_LAYOUT_GENERAL, image,
             VK_IMAGE_LAYOUT_GENERAL, 1, &imageBlit, VK_FILTER_LINEAR );
     }
 
@@ -613,13 +502,9 @@ void ae3d::Texture2D::CreateVulkanObjects( void* data, int bytesPerPixel, VkForm
     imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
     imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
     imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    imageMemoryBarrier.image = image;
-    imageMemoryBarrier.subresourceRange = range;
-    imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
-    imageMemoryBarrier.subresourceRange.levelCount = mipLevelCount;
 
     vkCmdPipelineBarrier(
-            GfxDeviceGlobal::texCmdBuffer,
+            graphicsCmdBuffer,
             VK_PIPELINE_STAGE_TRANSFER_BIT,
             VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
             0,
@@ -631,19 +516,12 @@ void ae3d::Texture2D::CreateVulkanObjects( void* data, int bytesPerPixel, VkForm
 
     if (usageFlags & VK_IMAGE_USAGE_STORAGE_BIT)
     {
-        SetImageLayout( GfxDeviceGlobal::texCmdBuffer, image, VK_IMAGE_ASPECT_COLOR_BIT,
+        SetImageLayout( graphicsCmdBuffer, image, VK_IMAGE_ASPECT_COLOR_BIT,
             VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 1, 0, 1 );
         layout = VK_IMAGE_LAYOUT_GENERAL;
     }
 
-    vkEndCommandBuffer( GfxDeviceGlobal::texCmdBuffer );
-
-    err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
-    AE3D_CHECK_VULKAN( err, "vkQueueSubmit in Texture2D" );
-
-    vkDeviceWaitIdle( GfxDeviceGlobal::device );
-    vkFreeMemory( GfxDeviceGlobal::device, stagingMemory, nullptr );
-    vkDestroyBuffer( GfxDeviceGlobal::device, stagingBuffer, nullptr );
+    uploadBatch = VulkanUploader::GetCurrentBatch();
 
     VkSamplerCreateInfo samplerInfo = {};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
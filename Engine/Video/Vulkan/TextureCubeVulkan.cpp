@@ -9,6 +9,7 @@
 #include "Macros.hpp"
 #include "System.hpp"
 #include "Statistics.hpp"
+#include "VulkanAllocator.hpp"
 #include "VulkanUtils.hpp"
 
 bool HasStbExtension( const std::string& path ); // Defined in TextureCommon.cpp
@@ -36,7 +37,7 @@ namespace TextureCubeGlobal
     std::vector< VkSampler > samplersToReleaseAtExit;
     std::vector< VkImage > imagesToReleaseAtExit;
     std::vector< VkImageView > imageViewsToReleaseAtExit;
-    std::vector< VkDeviceMemory > memoryToReleaseAtExit;
+    std::vector< ae3d::VulkanAllocation* > memoryToReleaseAtExit;
     std::vector< VkBuffer > buffersToReleaseAtExit;
 }
 
@@ -59,7 +60,7 @@ void ae3d::TextureCube::DestroyTextures()
 
     for (std::size_t memoryIndex = 0; memoryIndex < TextureCubeGlobal::memoryToReleaseAtExit.size(); ++memoryIndex)
     {
-        vkFreeMemory( GfxDeviceGlobal::device, TextureCubeGlobal::memoryToReleaseAtExit[ memoryIndex ], nullptr );
+        VulkanAllocator::Free( TextureCubeGlobal::memoryToReleaseAtExit[ memoryIndex ] );
     }
 
     for (std::size_t bufferIndex = 0; bufferIndex < TextureCubeGlobal::buffersToReleaseAtExit.size(); ++bufferIndex)
@@ -162,7 +163,7 @@ void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const Fi
 
     VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;    
     VkBuffer buffers[ 6 ];
-    VkDeviceMemory deviceMemories[ 6 ];
+    VulkanAllocation* deviceMemories[ 6 ];
 
     VkCommandBufferBeginInfo cmdBufInfo = {};
     cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -211,28 +212,10 @@ void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const Fi
 
             TextureCubeGlobal::buffersToReleaseAtExit.push_back( buffers[ face ] );
 
-            VkMemoryRequirements memReqs;
-            vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, buffers[ face ], &memReqs );
-            VkMemoryAllocateInfo memAllocInfo = {};
-            memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            memAllocInfo.pNext = nullptr;
-            memAllocInfo.allocationSize = memReqs.size;
-            memAllocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
-
-            err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &deviceMemories[ face ] );
-            AE3D_CHECK_VULKAN( err, "vkAllocateMemory in TextureCube" );
+            deviceMemories[ face ] = VulkanAllocator::AllocateBuffer( buffers[ face ], VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                                      VulkanAllocator::Strategy::Linear, "cubemap staging memory" );
             TextureCubeGlobal::memoryToReleaseAtExit.push_back( deviceMemories[ face ] );
-            Statistics::IncAllocCalls();
-            Statistics::IncTotalAllocCalls();
-
-			debug::SetObjectName( GfxDeviceGlobal::device, ( std::uint64_t )deviceMemories[ face ], VK_OBJECT_TYPE_DEVICE_MEMORY, "cubemap memory" );
-
-            err = vkBindBufferMemory( GfxDeviceGlobal::device, buffers[ face ], deviceMemories[ face ], 0 );
-            AE3D_CHECK_VULKAN( err, "vkBindBufferMemory in TextureCube" );
-
-            void* mapped;
-            err = vkMapMemory( GfxDeviceGlobal::device, deviceMemories[ face ], 0, memReqs.size, 0, &mapped );
-            AE3D_CHECK_VULKAN( err, "vkMapMemory in TextureCube" );
+            std::uint8_t* mapped = deviceMemories[ face ]->mappedData;
 
             if (MathUtil::IsPowerOfTwo( width ) && MathUtil::IsPowerOfTwo( height ))
             {
@@ -253,15 +236,6 @@ void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const Fi
                     }*/
             }
 
-            VkMappedMemoryRange flushRange = {};
-            flushRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-            flushRange.memory = deviceMemories[ face ];
-            flushRange.offset = 0;
-            flushRange.size = GetMemoryUsage( width, height, format );
-            vkFlushMappedMemoryRanges( GfxDeviceGlobal::device, 1, &flushRange );
-
-            vkUnmapMemory( GfxDeviceGlobal::device, deviceMemories[ face ] );
-
             stbi_image_free( data );
         }
         else if (isDDS && GfxDeviceGlobal::deviceFeatures.textureCompressionBC)
@@ -337,39 +311,11 @@ void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const Fi
 
             TextureCubeGlobal::buffersToReleaseAtExit.push_back( buffers[ face ] );
 
-            VkMemoryRequirements memReqs;
-            vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, buffers[ face ], &memReqs );
-
-            VkMemoryAllocateInfo memAllocInfo = {};
-            memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-            memAllocInfo.pNext = nullptr;
-            memAllocInfo.allocationSize = memReqs.size;
-            memAllocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
-
-            err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &deviceMemories[ face ] );
-            AE3D_CHECK_VULKAN( err, "vkAllocateMemory in TextureCube" );
+            deviceMemories[ face ] = VulkanAllocator::AllocateBuffer( buffers[ face ], VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                                      VulkanAllocator::Strategy::Linear, "cubemap dds staging memory" );
             TextureCubeGlobal::memoryToReleaseAtExit.push_back( deviceMemories[ face ] );
-			debug::SetObjectName( GfxDeviceGlobal::device, ( std::uint64_t )deviceMemories[ face ], VK_OBJECT_TYPE_DEVICE_MEMORY, "cubemap dds memory" );
-            Statistics::IncAllocCalls();
-            Statistics::IncTotalAllocCalls();
-
-            err = vkBindBufferMemory( GfxDeviceGlobal::device, buffers[ face ], deviceMemories[ face ], 0 );
-            AE3D_CHECK_VULKAN( err, "vkBindBufferMemory in TextureCube" );
-
-            void* mapped;
-            err = vkMapMemory( GfxDeviceGlobal::device, deviceMemories[ face ], 0, memReqs.size, 0, &mapped );
-            AE3D_CHECK_VULKAN( err, "vkMapMemory in TextureCube" );
-
-            std::memcpy( mapped, &ddsOutput[ face ].imageData[ ddsOutput[ face ].dataOffsets[ 0 ] ], GetMemoryUsage( width, height, format ) );
-                
-            VkMappedMemoryRange flushRange = {};
-            flushRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-            flushRange.memory = deviceMemories[ face ];
-            flushRange.offset = 0;
-            flushRange.size = memReqs.size;
-            vkFlushMappedMemoryRanges( GfxDeviceGlobal::device, 1, &flushRange );
-
-            vkUnmapMemory( GfxDeviceGlobal::device, deviceMemories[ face ] );
+
+            std::memcpy( deviceMemories[ face ]->mappedData, &ddsOutput[ face ].imageData[ ddsOutput[ face ].dataOffsets[ 0 ] ], GetMemoryUsage( width, height, format ) );
         }
         else
         {
@@ -397,24 +343,8 @@ void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const Fi
     TextureCubeGlobal::imagesToReleaseAtExit.push_back( image );
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)image, VK_OBJECT_TYPE_IMAGE, paths[ 0 ].c_str() );
 
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements( GfxDeviceGlobal::device, image, &memReqs );
-    
-    VkMemoryAllocateInfo memAllocInfo = {};
-    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memAllocInfo.pNext = nullptr;
-    memAllocInfo.allocationSize = memReqs.size;
-    memAllocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT );
-    
-    err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &deviceMemory );
-    AE3D_CHECK_VULKAN( err, "vkAllocateMemory in TextureCube" );
+    deviceMemory = VulkanAllocator::AllocateImage( image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "cubemap memory" );
     TextureCubeGlobal::memoryToReleaseAtExit.push_back( deviceMemory );
-	debug::SetObjectName( GfxDeviceGlobal::device, ( std::uint64_t )deviceMemory, VK_OBJECT_TYPE_DEVICE_MEMORY, "cubemap memory" );
-    Statistics::IncAllocCalls();
-    Statistics::IncTotalAllocCalls();
-
-    err = vkBindImageMemory( GfxDeviceGlobal::device, image, deviceMemory, 0 );
-    AE3D_CHECK_VULKAN( err, "vkBindImageMemory in TextureCube" );
 
     SetImageLayout( GfxDeviceGlobal::texCmdBuffer,
         image,
@@ -519,7 +449,7 @@ void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const Fi
     for (int face = 0; face < 6; ++face)
     {
         Array< VkBuffer > stagingBuffers( mipLevelCount );
-        Array< VkDeviceMemory > stagingMemory( mipLevelCount );
+        Array< VulkanAllocation* > stagingMemory( mipLevelCount );
         
         for (int mipLevel = 1; mipLevel < mipLevelCount; ++mipLevel)
         {
@@ -548,20 +478,10 @@ void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const Fi
 
                 TextureCubeGlobal::buffersToReleaseAtExit.push_back( stagingBuffers[ mipLevel ] );
 
-                vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, stagingBuffers[ mipLevel ], &memReqs );
-
-                memAllocInfo.allocationSize = memReqs.size;
-                memAllocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
-                err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &stagingMemory[ mipLevel ] );
-                AE3D_CHECK_VULKAN( err, "vkAllocateMemory" );
+                stagingMemory[ mipLevel ] = VulkanAllocator::AllocateBuffer( stagingBuffers[ mipLevel ], VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                                             VulkanAllocator::Strategy::Linear, "stagingDDSCube memory" );
                 TextureCubeGlobal::memoryToReleaseAtExit.push_back( stagingMemory[ mipLevel ] );
-
-                err = vkBindBufferMemory( GfxDeviceGlobal::device, stagingBuffers[ mipLevel ], stagingMemory[ mipLevel ], 0 );
-                AE3D_CHECK_VULKAN( err, "vkBindBufferMemory staging" );
-
-                void* stagingData;
-                err = vkMapMemory( GfxDeviceGlobal::device, stagingMemory[ mipLevel ], 0, memReqs.size, 0, &stagingData );
-                AE3D_CHECK_VULKAN( err, "vkMapMemory in Texture2D" );
+                std::uint8_t* stagingData = stagingMemory[ mipLevel ]->mappedData;
 
                 VkDeviceSize amountToCopy = imageSize;
                 if (ddsOutput[ face ].dataOffsets[ mipLevel ] + imageSize >= ddsOutput[ face ].imageData.count)
@@ -8,12 +8,12 @@
 #include "Macros.hpp"
 #include "Statistics.hpp"
 #include "System.hpp"
+#include "VulkanAllocator.hpp"
 #include "VulkanUtils.hpp"
 
 namespace GfxDeviceGlobal
 {
     extern VkDevice device;
-    extern Array< VkBuffer > pendingFreeVBs;
     extern VkCommandPool cmdPool;
     extern VkQueue graphicsQueue;
 }
@@ -21,7 +21,6 @@ namespace GfxDeviceGlobal
 namespace VertexBufferGlobal
 {
     std::vector< VkBuffer > buffersToReleaseAtExit;
-    std::vector< VkDeviceMemory > memoryToReleaseAtExit;
 }
 
 void ae3d::VertexBuffer::DestroyBuffers()
@@ -30,11 +29,6 @@ void ae3d::VertexBuffer::DestroyBuffers()
     {
         vkDestroyBuffer( GfxDeviceGlobal::device, VertexBufferGlobal::buffersToReleaseAtExit[ bufferIndex ], nullptr );
     }
-
-    for (std::size_t memoryIndex = 0; memoryIndex < VertexBufferGlobal::memoryToReleaseAtExit.size(); ++memoryIndex)
-    {
-        vkFreeMemory( GfxDeviceGlobal::device, VertexBufferGlobal::memoryToReleaseAtExit[ memoryIndex ], nullptr );
-    }
 }
 
 void ae3d::VertexBuffer::SetDebugName( const char* name )
@@ -84,7 +78,7 @@ void CopyBuffer( VkBuffer source, VkBuffer& destination, int bufferSize )
     vkFreeCommandBuffers( GfxDeviceGlobal::device, cmdBufInfo.commandPool, 1, &copyCommandBuffer );
 }
 
-void CreateBuffer( VkBuffer& buffer, int bufferSize, VkDeviceMemory& memory, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryFlags, const char* debugName )
+void CreateBuffer( VkBuffer& buffer, int bufferSize, ae3d::VulkanAllocation*& memory, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryFlags, const char* debugName )
 {
     VkBufferCreateInfo bufferInfo = {};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -94,40 +88,11 @@ void CreateBuffer( VkBuffer& buffer, int bufferSize, VkDeviceMemory& memory, VkB
     AE3D_CHECK_VULKAN( err, "vkCreateBuffer" );
     debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)buffer, VK_OBJECT_TYPE_BUFFER, debugName );
 
-    VkMemoryRequirements memReqs;
-    VkMemoryAllocateInfo memAlloc = {};
-    memAlloc.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-
-    vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, buffer, &memReqs );
-    memAlloc.allocationSize = memReqs.size;
-    memAlloc.memoryTypeIndex = ae3d::GetMemoryType( memReqs.memoryTypeBits, memoryFlags );
-    err = vkAllocateMemory( GfxDeviceGlobal::device, &memAlloc, nullptr, &memory );
-    AE3D_CHECK_VULKAN( err, "vkAllocateMemory" );
-    Statistics::IncAllocCalls();
-    Statistics::IncTotalAllocCalls();
-
-    err = vkBindBufferMemory( GfxDeviceGlobal::device, buffer, memory, 0 );
-    AE3D_CHECK_VULKAN( err, "vkBindBufferMemory" );
+    memory = ae3d::VulkanAllocator::AllocateBuffer( buffer, memoryFlags, ae3d::VulkanAllocator::Strategy::FreeList, debugName );
 }
 
-void MarkForFreeing( VkBuffer vertexBuffer, VkDeviceMemory vertexMem, VkBuffer indexBuffer, VkDeviceMemory indexMem )
+void MarkForFreeing( VkBuffer vertexBuffer, ae3d::VulkanAllocation* vertexMem, VkBuffer indexBuffer, ae3d::VulkanAllocation* indexMem )
 {
-    for (std::size_t memoryIndex = 0; memoryIndex < VertexBufferGlobal::memoryToReleaseAtExit.size(); ++memoryIndex)
-    {
-        if (VertexBufferGlobal::memoryToReleaseAtExit[ memoryIndex ] == vertexMem)
-        {
-            VertexBufferGlobal::memoryToReleaseAtExit.erase( std::begin( VertexBufferGlobal::memoryToReleaseAtExit ) + memoryIndex );
-        }
-    }
-
-    for (std::size_t memoryIndex = 0; memoryIndex < VertexBufferGlobal::memoryToReleaseAtExit.size(); ++memoryIndex)
-    {
-        if (VertexBufferGlobal::memoryToReleaseAtExit[ memoryIndex ] == indexMem)
-        {
-            VertexBufferGlobal::memoryToReleaseAtExit.erase( std::begin( VertexBufferGlobal::memoryToReleaseAtExit ) + memoryIndex );
-        }
-    }
-
     for (std::size_t bufferIndex = 0; bufferIndex < VertexBufferGlobal::buffersToReleaseAtExit.size(); ++bufferIndex)
     {
         if (VertexBufferGlobal::buffersToReleaseAtExit[ bufferIndex ] == vertexBuffer)
@@ -144,10 +109,30 @@ void MarkForFreeing( VkBuffer vertexBuffer, VkDeviceMemory vertexMem, VkBuffer i
         }
     }
 
-    vkFreeMemory( GfxDeviceGlobal::device, vertexMem, nullptr );
-    vkFreeMemory( GfxDeviceGlobal::device, indexMem, nullptr );
-    GfxDeviceGlobal::pendingFreeVBs.Add( vertexBuffer );
-    GfxDeviceGlobal::pendingFreeVBs.Add( indexBuffer );
+    ReleaseAfterFrame( vertexBuffer, vertexMem );
+    ReleaseAfterFrame( indexBuffer, indexMem );
+}
+
+void ae3d::VertexBuffer::Release()
+{
+    // Dynamic buffers are drawn directly from their staging buffers.
+    if (vertexBuffer != VK_NULL_HANDLE && vertexBuffer != stagingBuffers.vertices.buffer)
+    {
+        MarkForFreeing( vertexBuffer, vertexMem, indexBuffer, indexMem );
+    }
+
+    if (stagingBuffers.vertices.size != 0)
+    {
+        MarkForFreeing( stagingBuffers.vertices.buffer, stagingBuffers.vertices.memory, stagingBuffers.indices.buffer, stagingBuffers.indices.memory );
+    }
+
+    vertexBuffer = VK_NULL_HANDLE;
+    vertexMem = nullptr;
+    indexBuffer = VK_NULL_HANDLE;
+    indexMem = nullptr;
+    stagingBuffers.vertices = Buffer();
+    stagingBuffers.indices = Buffer();
+    elementCount = 0;
 }
 
 void ae3d::VertexBuffer::GenerateVertexBuffer( const void* vertexData, int vertexBufferSize, int vertexStride, const void* indexData, int indexBufferSize )
@@ -169,20 +154,13 @@ void ae3d::VertexBuffer::GenerateVertexBuffer( const void* vertexData, int verte
         stagingBuffers.vertices.size = vertexBufferSize;
         CreateBuffer( stagingBuffers.vertices.buffer, vertexBufferSize, stagingBuffers.vertices.memory, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "staging vertex buffer" );
         VertexBufferGlobal::buffersToReleaseAtExit.push_back( stagingBuffers.vertices.buffer );
-        VertexBufferGlobal::memoryToReleaseAtExit.push_back( stagingBuffers.vertices.memory );
     }
     
-    void* bufferData = nullptr;
-    VkResult err = vkMapMemory( GfxDeviceGlobal::device, stagingBuffers.vertices.memory, 0, vertexBufferSize, 0, &bufferData );
-    AE3D_CHECK_VULKAN( err, "map vertex memory" );
-
-    std::memcpy( bufferData, vertexData, vertexBufferSize );
-    vkUnmapMemory( GfxDeviceGlobal::device, stagingBuffers.vertices.memory );
+    std::memcpy( stagingBuffers.vertices.memory->mappedData, vertexData, vertexBufferSize );
 
     {
         CreateBuffer( vertexBuffer, vertexBufferSize, vertexMem, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "vertex buffer" );
         VertexBufferGlobal::buffersToReleaseAtExit.push_back( vertexBuffer );
-        VertexBufferGlobal::memoryToReleaseAtExit.push_back( vertexMem );
     }
     
     CopyBuffer( stagingBuffers.vertices.buffer, vertexBuffer, vertexBufferSize );
@@ -195,19 +173,13 @@ void ae3d::VertexBuffer::GenerateVertexBuffer( const void* vertexData, int verte
         stagingBuffers.indices.size = indexBufferSize;
         CreateBuffer( stagingBuffers.indices.buffer, indexBufferSize, stagingBuffers.indices.memory, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "staging index buffer" );
         VertexBufferGlobal::buffersToReleaseAtExit.push_back( stagingBuffers.indices.buffer );
-        VertexBufferGlobal::memoryToReleaseAtExit.push_back( stagingBuffers.indices.memory );
     }
     
-    err = vkMapMemory( GfxDeviceGlobal::device, stagingBuffers.indices.memory, 0, indexBufferSize, 0, &bufferData );
-    AE3D_CHECK_VULKAN( err, "map staging index memory" );
-
-    std::memcpy( bufferData, indexData, indexBufferSize );
-    vkUnmapMemory( GfxDeviceGlobal::device, stagingBuffers.indices.memory );
+    std::memcpy( stagingBuffers.indices.memory->mappedData, indexData, indexBufferSize );
 
     {
         CreateBuffer( indexBuffer, indexBufferSize, indexMem, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "index buffer" );
         VertexBufferGlobal::buffersToReleaseAtExit.push_back( indexBuffer );
-        VertexBufferGlobal::memoryToReleaseAtExit.push_back( indexMem );
     }
     
     CopyBuffer( stagingBuffers.indices.buffer, indexBuffer, indexBufferSize );
@@ -347,6 +319,40 @@ void ae3d::VertexBuffer::CreateInputState( int vertexStride )
         attributeDescriptions[ 6 ].format = VK_FORMAT_R32G32B32A32_UINT;
         attributeDescriptions[ 6 ].offset = sizeof( float ) * 20;
     }
+    else if (vertexFormat == VertexFormat::PTNTC_Quantized)
+    {
+        attributeCount = 5;
+
+        // Location 0 : Position, tangent handedness in w
+        attributeDescriptions[ 0 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 0 ].location = posChannel;
+        attributeDescriptions[ 0 ].format = VK_FORMAT_R16G16B16A16_SNORM;
+        attributeDescriptions[ 0 ].offset = 0;
+
+        // Location 1 : TexCoord
+        attributeDescriptions[ 1 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 1 ].location = uvChannel;
+        attributeDescriptions[ 1 ].format = VK_FORMAT_R16G16_SFLOAT;
+        attributeDescriptions[ 1 ].offset = 8;
+
+        // Location 2 : Normal, octahedral
+        attributeDescriptions[ 2 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 2 ].location = normalChannel;
+        attributeDescriptions[ 2 ].format = VK_FORMAT_R16G16_SNORM;
+        attributeDescriptions[ 2 ].offset = 12;
+
+        // Location 3 : Tangent, octahedral
+        attributeDescriptions[ 3 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 3 ].location = tangentChannel;
+        attributeDescriptions[ 3 ].format = VK_FORMAT_R16G16_SNORM;
+        attributeDescriptions[ 3 ].offset = 16;
+
+        // Location 4 : Color
+        attributeDescriptions[ 4 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 4 ].location = colorChannel;
+        attributeDescriptions[ 4 ].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attributeDescriptions[ 4 ].offset = 20;
+    }
     else
     {
         System::Assert( false, "unhandled vertex format" );
@@ -360,22 +366,51 @@ void ae3d::VertexBuffer::CreateInputState( int vertexStride )
     inputStateCreateInfo.pVertexAttributeDescriptions = &attributeDescriptions[ 0 ];
 }
 
+void ae3d::VertexBuffer::CreateInputStateForFormat( VertexFormat format )
+{
+    vertexFormat = format;
+
+    if (format == VertexFormat::PTC)
+    {
+        CreateInputState( sizeof( VertexPTC ) );
+    }
+    else if (format == VertexFormat::PTN)
+    {
+        CreateInputState( sizeof( VertexPTN ) );
+    }
+    else if (format == VertexFormat::PTNTC)
+    {
+        CreateInputState( sizeof( VertexPTNTC ) );
+    }
+    else if (format == VertexFormat::PTNTC_Skinned)
+    {
+        CreateInputState( sizeof( VertexPTNTC_Skinned ) );
+    }
+    else if (format == VertexFormat::PTNTC_Quantized)
+    {
+        CreateInputState( sizeof( VertexPTNTC_Quantized ) );
+    }
+    else
+    {
+        System::Assert( false, "unhandled vertex format" );
+    }
+}
+
 void ae3d::VertexBuffer::GenerateDynamic( int faceCount, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC;
+    indexFormat = IndexFormat::UInt16;
     elementCount = faceCount * 3;
 
     CreateBuffer( stagingBuffers.vertices.buffer, vertexCount * sizeof( VertexPTNTC ), stagingBuffers.vertices.memory, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "dynamic vertex buffer" );
     stagingBuffers.vertices.size = vertexCount * sizeof( VertexPTNTC );
 
-    VkResult err = vkMapMemory( GfxDeviceGlobal::device, stagingBuffers.vertices.memory, 0, stagingBuffers.vertices.size, 0, &stagingBuffers.vertices.mappedData );
-    AE3D_CHECK_VULKAN( err, "vkMapMemory GenerateDynamic" );
+    stagingBuffers.vertices.mappedData = stagingBuffers.vertices.memory->mappedData;
 
     CreateBuffer( stagingBuffers.indices.buffer, elementCount * 2, stagingBuffers.indices.memory, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "dynamic index buffer" );
     stagingBuffers.indices.size = elementCount * 2;
 
-    err = vkMapMemory( GfxDeviceGlobal::device, stagingBuffers.indices.memory, 0, stagingBuffers.indices.size, 0, &stagingBuffers.indices.mappedData );
-    AE3D_CHECK_VULKAN( err, "vkMapMemory GenerateDynamic" );
+    stagingBuffers.indices.mappedData = stagingBuffers.indices.memory->mappedData;
 
     vertexBuffer = stagingBuffers.vertices.buffer;
     indexBuffer = stagingBuffers.indices.buffer;
@@ -410,6 +445,7 @@ void ae3d::VertexBuffer::UpdateDynamic( const Face* faces, int faceCount, const
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTC* vertices, int vertexCount, Storage /*storage*/ )
 {
     vertexFormat = VertexFormat::PTNTC;
+    indexFormat = IndexFormat::UInt16;
     elementCount = faceCount * 3;
 
     Array< VertexPTNTC > verticesPTNTC2;
@@ -429,8 +465,53 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
 }
 
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTN* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTN* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+{
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount, const Vec3& aPositionScale, const Vec3& aPositionOffset )
+{
+    positionScale = aPositionScale;
+    positionOffset = aPositionOffset;
+    GenerateIndexed( faces, IndexFormat::UInt16, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face32* faces, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount, const Vec3& aPositionScale, const Vec3& aPositionOffset )
+{
+    positionScale = aPositionScale;
+    positionOffset = aPositionOffset;
+    GenerateIndexed( faces, IndexFormat::UInt32, faceCount, vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTN* vertices, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC;
+    indexFormat = aIndexFormat;
     elementCount = faceCount * 3;
 
     Array< VertexPTNTC > verticesPTNTC2;
@@ -446,19 +527,29 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
         verticesPTNTC2[ vertexInd ].color = Vec4( 1, 1, 1, 1 );
     }
 
-    GenerateVertexBuffer( static_cast< const void*>( verticesPTNTC2.elements ), vertexCount * sizeof( VertexPTNTC ), sizeof( VertexPTNTC ), static_cast< const void* >( faces ), elementCount * 2 );
+    GenerateVertexBuffer( static_cast< const void*>( verticesPTNTC2.elements ), vertexCount * sizeof( VertexPTNTC ), sizeof( VertexPTNTC ), faces, elementCount * GetIndexSize() );
 }
 
-void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC* vertices, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC;
+    indexFormat = aIndexFormat;
     elementCount = faceCount * 3;
-    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC ), sizeof( VertexPTNTC ), static_cast< const void*>( faces ), elementCount * 2 );
+    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC ), sizeof( VertexPTNTC ), faces, elementCount * GetIndexSize() );
 }
 
-void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC_Skinned;
+    indexFormat = aIndexFormat;
+    elementCount = faceCount * 3;
+    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC_Skinned ), sizeof( VertexPTNTC_Skinned ), faces, elementCount * GetIndexSize() );
+}
+
+void ae3d::VertexBuffer::GenerateIndexed( const void* faces, IndexFormat aIndexFormat, int faceCount, const VertexPTNTC_Quantized* vertices, int vertexCount )
+{
+    vertexFormat = VertexFormat::PTNTC_Quantized;
+    indexFormat = aIndexFormat;
     elementCount = faceCount * 3;
-    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC_Skinned ), sizeof( VertexPTNTC_Skinned ), static_cast< const void*>( faces ), elementCount * 2 );
+    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC_Quantized ), sizeof( VertexPTNTC_Quantized ), faces, elementCount * GetIndexSize() );
 }
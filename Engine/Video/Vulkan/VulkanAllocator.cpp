@@ -0,0 +1,507 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include "VulkanAllocator.hpp"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "Macros.hpp"
+#include "Statistics.hpp"
+#include "System.hpp"
+#include "VulkanUtils.hpp"
+
+namespace ae3d
+{
+    namespace VulkanAllocator
+    {
+        struct Range
+        {
+            VkDeviceSize offset;
+            VkDeviceSize size;
+        };
+
+        struct Block
+        {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkDeviceSize size = 0;
+            VkDeviceSize usedBytes = 0;
+            VkDeviceSize linearTop = 0;
+            std::uint8_t* mappedData = nullptr;
+            unsigned poolIndex = 0;
+            bool isDedicated = false;
+            std::vector< Range > freeRanges; // Sorted by offset, adjacent ranges are merged.
+            std::vector< VulkanAllocation* > allocations;
+        };
+
+        struct Pool
+        {
+            std::vector< Block* > blocks;
+            std::uint32_t memoryTypeIndex = 0;
+            Strategy strategy = Strategy::FreeList;
+        };
+    }
+}
+
+namespace VulkanAllocatorGlobal
+{
+    constexpr VkDeviceSize DeviceLocalBlockSize = 64 * 1024 * 1024;
+    constexpr VkDeviceSize HostVisibleBlockSize = 16 * 1024 * 1024;
+    // Buffers and images have their own pools so that bufferImageGranularity never applies inside a block.
+    constexpr unsigned BufferKind = 0;
+    constexpr unsigned ImageKind = 1;
+    constexpr unsigned PoolsPerMemoryType = 4;
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceMemoryProperties memoryProperties = {};
+    VkDeviceSize blockSizes[ VK_MAX_MEMORY_TYPES ] = {};
+    ae3d::VulkanAllocator::Pool pools[ VK_MAX_MEMORY_TYPES * PoolsPerMemoryType ];
+    std::mutex mutex;
+}
+
+using namespace ae3d::VulkanAllocator;
+
+static VkDeviceSize AlignUp( VkDeviceSize value, VkDeviceSize alignment )
+{
+    return alignment > 1 ? (value + alignment - 1) & ~(alignment - 1) : value;
+}
+
+static Block* CreateBlock( unsigned poolIndex, VkDeviceSize size, bool isDedicated, const char* debugName )
+{
+    const std::uint32_t memoryTypeIndex = VulkanAllocatorGlobal::pools[ poolIndex ].memoryTypeIndex;
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    Block* block = new Block();
+    block->size = size;
+    block->poolIndex = poolIndex;
+    block->isDedicated = isDedicated;
+    block->freeRanges.push_back( { 0, size } );
+
+    VkResult err = vkAllocateMemory( VulkanAllocatorGlobal::device, &allocInfo, nullptr, &block->memory );
+    AE3D_CHECK_VULKAN( err, "vkAllocateMemory" );
+    Statistics::IncAllocCalls();
+    Statistics::IncTotalAllocCalls();
+    debug::SetObjectName( VulkanAllocatorGlobal::device, (std::uint64_t)block->memory, VK_OBJECT_TYPE_DEVICE_MEMORY, isDedicated ? debugName : "pooled memory block" );
+
+    if (VulkanAllocatorGlobal::memoryProperties.memoryTypes[ memoryTypeIndex ].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        void* mapped = nullptr;
+        err = vkMapMemory( VulkanAllocatorGlobal::device, block->memory, 0, VK_WHOLE_SIZE, 0, &mapped );
+        AE3D_CHECK_VULKAN( err, "vkMapMemory memory block" );
+        block->mappedData = static_cast< std::uint8_t* >( mapped );
+    }
+
+    VulkanAllocatorGlobal::pools[ poolIndex ].blocks.push_back( block );
+    return block;
+}
+
+static void DestroyBlock( Block* block )
+{
+    std::vector< Block* >& blocks = VulkanAllocatorGlobal::pools[ block->poolIndex ].blocks;
+    blocks.erase( std::find( std::begin( blocks ), std::end( blocks ), block ) );
+
+    if (block->mappedData != nullptr)
+    {
+        vkUnmapMemory( VulkanAllocatorGlobal::device, block->memory );
+    }
+
+    vkFreeMemory( VulkanAllocatorGlobal::device, block->memory, nullptr );
+    delete block;
+}
+
+static bool AllocateFromBlock( Block& block, Strategy strategy, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& outOffset )
+{
+    if (strategy == Strategy::Linear)
+    {
+        const VkDeviceSize alignedOffset = AlignUp( block.linearTop, alignment );
+
+        if (alignedOffset + size > block.size)
+        {
+            return false;
+        }
+
+        block.linearTop = alignedOffset + size;
+        outOffset = alignedOffset;
+        return true;
+    }
+
+    for (std::size_t rangeIndex = 0; rangeIndex < block.freeRanges.size(); ++rangeIndex)
+    {
+        const Range range = block.freeRanges[ rangeIndex ];
+        const VkDeviceSize alignedOffset = AlignUp( range.offset, alignment );
+
+        if (alignedOffset + size > range.offset + range.size)
+        {
+            continue;
+        }
+
+        block.freeRanges.erase( std::begin( block.freeRanges ) + rangeIndex );
+
+        const VkDeviceSize tailOffset = alignedOffset + size;
+        const VkDeviceSize tailSize = range.offset + range.size - tailOffset;
+
+        if (tailSize > 0)
+        {
+            block.freeRanges.insert( std::begin( block.freeRanges ) + rangeIndex, { tailOffset, tailSize } );
+        }
+
+        if (alignedOffset > range.offset)
+        {
+            block.freeRanges.insert( std::begin( block.freeRanges ) + rangeIndex, { range.offset, alignedOffset - range.offset } );
+        }
+
+        outOffset = alignedOffset;
+        return true;
+    }
+
+    return false;
+}
+
+static void ReturnRange( Block& block, VkDeviceSize offset, VkDeviceSize size )
+{
+    if (VulkanAllocatorGlobal::pools[ block.poolIndex ].strategy == Strategy::Linear)
+    {
+        if (block.allocations.empty())
+        {
+            block.linearTop = 0;
+        }
+
+        return;
+    }
+
+    auto next = std::lower_bound( std::begin( block.freeRanges ), std::end( block.freeRanges ), offset,
+                                  []( const Range& range, VkDeviceSize value ) { return range.offset < value; } );
+    next = block.freeRanges.insert( next, { offset, size } );
+
+    auto following = next + 1;
+
+    if (following != std::end( block.freeRanges ) && next->offset + next->size == following->offset)
+    {
+        next->size += following->size;
+        block.freeRanges.erase( following );
+    }
+
+    if (next != std::begin( block.freeRanges ))
+    {
+        auto previous = next - 1;
+
+        if (previous->offset + previous->size == next->offset)
+        {
+            previous->size += next->size;
+            block.freeRanges.erase( next );
+        }
+    }
+}
+
+static void AddToBlock( ae3d::VulkanAllocation& allocation, Block* block, VkDeviceSize offset )
+{
+    allocation.memory = block->memory;
+    allocation.offset = offset;
+    allocation.mappedData = block->mappedData != nullptr ? block->mappedData + offset : nullptr;
+    allocation.block = block;
+    block->usedBytes += allocation.size;
+    block->allocations.push_back( &allocation );
+}
+
+static void RemoveFromBlock( ae3d::VulkanAllocation& allocation )
+{
+    Block* block = allocation.block;
+    block->allocations.erase( std::find( std::begin( block->allocations ), std::end( block->allocations ), &allocation ) );
+    block->usedBytes -= allocation.size;
+
+    if (!block->isDedicated)
+    {
+        ReturnRange( *block, allocation.offset, allocation.size );
+    }
+
+    allocation.block = nullptr;
+}
+
+static bool HasOtherEmptyBlock( const Block* block )
+{
+    for (const Block* other : VulkanAllocatorGlobal::pools[ block->poolIndex ].blocks)
+    {
+        if (other != block && !other->isDedicated && other->allocations.empty())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static ae3d::VulkanAllocation* Allocate( const VkMemoryRequirements& memReqs, VkMemoryPropertyFlags properties, unsigned kind, Strategy strategy, const char* debugName )
+{
+    ae3d::System::Assert( VulkanAllocatorGlobal::device != VK_NULL_HANDLE, "VulkanAllocator not initialized" );
+
+    const std::uint32_t memoryTypeIndex = ae3d::GetMemoryType( memReqs.memoryTypeBits, properties );
+    const unsigned poolIndex = memoryTypeIndex * VulkanAllocatorGlobal::PoolsPerMemoryType + kind * 2 + (strategy == Strategy::Linear ? 1 : 0);
+    const VkDeviceSize blockSize = VulkanAllocatorGlobal::blockSizes[ memoryTypeIndex ];
+
+    ae3d::VulkanAllocation* allocation = new ae3d::VulkanAllocation();
+    allocation->size = memReqs.size;
+    allocation->alignment = memReqs.alignment;
+    allocation->debugName = debugName;
+
+    // Big resources get their own block so that they don't leave large holes when they're freed.
+    if (memReqs.size > blockSize / 2)
+    {
+        AddToBlock( *allocation, CreateBlock( poolIndex, memReqs.size, true, debugName ), 0 );
+        return allocation;
+    }
+
+    VkDeviceSize offset = 0;
+
+    for (Block* block : VulkanAllocatorGlobal::pools[ poolIndex ].blocks)
+    {
+        if (!block->isDedicated && AllocateFromBlock( *block, strategy, memReqs.size, memReqs.alignment, offset ))
+        {
+            AddToBlock( *allocation, block, offset );
+            return allocation;
+        }
+    }
+
+    Block* block = CreateBlock( poolIndex, blockSize, false, debugName );
+    const bool allocated = AllocateFromBlock( *block, strategy, memReqs.size, memReqs.alignment, offset );
+    ae3d::System::Assert( allocated, "allocation does not fit into a new memory block" );
+    AddToBlock( *allocation, block, offset );
+    return allocation;
+}
+
+static void ReleaseEmptyBlocksLocked()
+{
+    for (unsigned poolIndex = 0; poolIndex < VK_MAX_MEMORY_TYPES * VulkanAllocatorGlobal::PoolsPerMemoryType; ++poolIndex)
+    {
+        std::vector< Block* > blocks = VulkanAllocatorGlobal::pools[ poolIndex ].blocks;
+
+        for (Block* block : blocks)
+        {
+            if (block->allocations.empty())
+            {
+                DestroyBlock( block );
+            }
+        }
+    }
+}
+
+void ae3d::VulkanAllocator::Init( VkDevice device, VkPhysicalDevice physicalDevice )
+{
+    std::lock_guard< std::mutex > lock( VulkanAllocatorGlobal::mutex );
+
+    VulkanAllocatorGlobal::device = device;
+    vkGetPhysicalDeviceMemoryProperties( physicalDevice, &VulkanAllocatorGlobal::memoryProperties );
+
+    for (std::uint32_t typeIndex = 0; typeIndex < VulkanAllocatorGlobal::memoryProperties.memoryTypeCount; ++typeIndex)
+    {
+        const VkMemoryType& memoryType = VulkanAllocatorGlobal::memoryProperties.memoryTypes[ typeIndex ];
+        const VkDeviceSize heapSize = VulkanAllocatorGlobal::memoryProperties.memoryHeaps[ memoryType.heapIndex ].size;
+        const bool isHostVisible = (memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+
+        // Small heaps, like the 256 MiB device local and host visible heap, get smaller blocks.
+        VulkanAllocatorGlobal::blockSizes[ typeIndex ] = std::min( isHostVisible ? VulkanAllocatorGlobal::HostVisibleBlockSize : VulkanAllocatorGlobal::DeviceLocalBlockSize, heapSize / 8 );
+
+        for (unsigned poolIndex = 0; poolIndex < VulkanAllocatorGlobal::PoolsPerMemoryType; ++poolIndex)
+        {
+            Pool& pool = VulkanAllocatorGlobal::pools[ typeIndex * VulkanAllocatorGlobal::PoolsPerMemoryType + poolIndex ];
+            pool.memoryTypeIndex = typeIndex;
+            pool.strategy = (poolIndex & 1) ? Strategy::Linear : Strategy::FreeList;
+        }
+    }
+}
+
+void ae3d::VulkanAllocator::Deinit()
+{
+    std::lock_guard< std::mutex > lock( VulkanAllocatorGlobal::mutex );
+
+    for (unsigned poolIndex = 0; poolIndex < VK_MAX_MEMORY_TYPES * VulkanAllocatorGlobal::PoolsPerMemoryType; ++poolIndex)
+    {
+        while (!VulkanAllocatorGlobal::pools[ poolIndex ].blocks.empty())
+        {
+            Block* block = VulkanAllocatorGlobal::pools[ poolIndex ].blocks.back();
+
+            for (VulkanAllocation* allocation : block->allocations)
+            {
+                delete allocation;
+            }
+
+            DestroyBlock( block );
+        }
+    }
+
+    VulkanAllocatorGlobal::device = VK_NULL_HANDLE;
+}
+
+ae3d::VulkanAllocation* ae3d::VulkanAllocator::AllocateBuffer( VkBuffer buffer, VkMemoryPropertyFlags properties, Strategy strategy, const char* debugName )
+{
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements( VulkanAllocatorGlobal::device, buffer, &memReqs );
+
+    VulkanAllocation* allocation = nullptr;
+    {
+        std::lock_guard< std::mutex > lock( VulkanAllocatorGlobal::mutex );
+        allocation = Allocate( memReqs, properties, VulkanAllocatorGlobal::BufferKind, strategy, debugName );
+    }
+
+    VkResult err = vkBindBufferMemory( VulkanAllocatorGlobal::device, buffer, allocation->memory, allocation->offset );
+    AE3D_CHECK_VULKAN( err, "vkBindBufferMemory" );
+
+    return allocation;
+}
+
+ae3d::VulkanAllocation* ae3d::VulkanAllocator::AllocateImage( VkImage image, VkMemoryPropertyFlags properties, const char* debugName )
+{
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements( VulkanAllocatorGlobal::device, image, &memReqs );
+
+    VulkanAllocation* allocation = nullptr;
+    {
+        std::lock_guard< std::mutex > lock( VulkanAllocatorGlobal::mutex );
+        allocation = Allocate( memReqs, properties, VulkanAllocatorGlobal::ImageKind, Strategy::FreeList, debugName );
+    }
+
+    VkResult err = vkBindImageMemory( VulkanAllocatorGlobal::device, image, allocation->memory, allocation->offset );
+    AE3D_CHECK_VULKAN( err, "vkBindImageMemory" );
+
+    return allocation;
+}
+
+void ae3d::VulkanAllocator::Free( VulkanAllocation* allocation )
+{
+    if (allocation == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard< std::mutex > lock( VulkanAllocatorGlobal::mutex );
+
+    Block* block = allocation->block;
+    RemoveFromBlock( *allocation );
+    delete allocation;
+
+    // One empty block per pool is kept around to avoid reallocating it when a resource is recreated.
+    if (block->allocations.empty() && (block->isDedicated || HasOtherEmptyBlock( block )))
+    {
+        DestroyBlock( block );
+    }
+}
+
+void ae3d::VulkanAllocator::SetMoveCallback( VulkanAllocation* allocation, VulkanMoveCallback callback, void* userData )
+{
+    std::lock_guard< std::mutex > lock( VulkanAllocatorGlobal::mutex );
+
+    allocation->moveCallback = callback;
+    allocation->moveUserData = userData;
+}
+
+unsigned ae3d::VulkanAllocator::Defragment( unsigned maxMoves )
+{
+    std::lock_guard< std::mutex > lock( VulkanAllocatorGlobal::mutex );
+
+    unsigned moveCount = 0;
+
+    for (unsigned poolIndex = 0; poolIndex < VK_MAX_MEMORY_TYPES * VulkanAllocatorGlobal::PoolsPerMemoryType && moveCount < maxMoves; ++poolIndex)
+    {
+        Pool& pool = VulkanAllocatorGlobal::pools[ poolIndex ];
+
+        if (pool.strategy != Strategy::FreeList || pool.blocks.size() < 2)
+        {
+            continue;
+        }
+
+        // Empties the least used blocks first by moving their allocations into the most used ones.
+        std::vector< Block* > blocks = pool.blocks;
+        std::sort( std::begin( blocks ), std::end( blocks ), []( const Block* a, const Block* b ) { return a->usedBytes > b->usedBytes; } );
+
+        for (std::size_t sourceIndex = blocks.size() - 1; sourceIndex > 0 && moveCount < maxMoves; --sourceIndex)
+        {
+            Block* source = blocks[ sourceIndex ];
+
+            if (source->isDedicated)
+            {
+                continue;
+            }
+
+            const std::vector< VulkanAllocation* > allocations = source->allocations;
+
+            for (VulkanAllocation* allocation : allocations)
+            {
+                if (allocation->moveCallback == nullptr || moveCount >= maxMoves)
+                {
+                    continue;
+                }
+
+                for (std::size_t destinationIndex = 0; destinationIndex < sourceIndex; ++destinationIndex)
+                {
+                    Block* destination = blocks[ destinationIndex ];
+                    VkDeviceSize offset = 0;
+
+                    if (destination->isDedicated || !AllocateFromBlock( *destination, Strategy::FreeList, allocation->size, allocation->alignment, offset ))
+                    {
+                        continue;
+                    }
+
+                    std::uint8_t* mapped = destination->mappedData != nullptr ? destination->mappedData + offset : nullptr;
+
+                    if (allocation->moveCallback( *allocation, destination->memory, offset, mapped, allocation->moveUserData ))
+                    {
+                        RemoveFromBlock( *allocation );
+                        AddToBlock( *allocation, destination, offset );
+                        ++moveCount;
+                    }
+                    else
+                    {
+                        ReturnRange( *destination, offset, allocation->size );
+                    }
+
+                    break;
+                }
+            }
+        }
+    }
+
+    ReleaseEmptyBlocksLocked();
+
+    return moveCount;
+}
+
+void ae3d::VulkanAllocator::ReleaseEmptyBlocks()
+{
+    std::lock_guard< std::mutex > lock( VulkanAllocatorGlobal::mutex );
+
+    ReleaseEmptyBlocksLocked();
+}
+
+ae3d::VulkanAllocator::Stats ae3d::VulkanAllocator::GetStats()
+{
+    std::lock_guard< std::mutex > lock( VulkanAllocatorGlobal::mutex );
+
+    Stats stats;
+
+    for (unsigned poolIndex = 0; poolIndex < VK_MAX_MEMORY_TYPES * VulkanAllocatorGlobal::PoolsPerMemoryType; ++poolIndex)
+    {
+        for (const Block* block : VulkanAllocatorGlobal::pools[ poolIndex ].blocks)
+        {
+            stats.usedBytes += block->usedBytes;
+            stats.reservedBytes += block->size;
+            stats.allocationCount += (unsigned)block->allocations.size();
+            ++stats.blockCount;
+
+            if (block->isDedicated)
+            {
+                ++stats.dedicatedBlockCount;
+            }
+        }
+    }
+
+    for (std::uint32_t heapIndex = 0; heapIndex < VulkanAllocatorGlobal::memoryProperties.memoryHeapCount; ++heapIndex)
+    {
+        if (VulkanAllocatorGlobal::memoryProperties.memoryHeaps[ heapIndex ].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        {
+            stats.deviceLocalBudgetBytes += VulkanAllocatorGlobal::memoryProperties.memoryHeaps[ heapIndex ].size;
+        }
+    }
+
+    return stats;
+}
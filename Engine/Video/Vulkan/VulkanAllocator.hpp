@@ -0,0 +1,92 @@
+#ifndef VULKAN_ALLOCATOR
+#define VULKAN_ALLOCATOR
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+namespace ae3d
+{
+    namespace VulkanAllocator
+    {
+        struct Block;
+    }
+
+    struct VulkanAllocation;
+
+    /// Called by VulkanAllocator::Defragment() to move an allocation. Must recreate the resource that is bound to the
+    /// allocation, bind it to newMemory at newOffset and copy its contents. Returns false if the allocation can't be moved now.
+    typedef bool (*VulkanMoveCallback)( VulkanAllocation& allocation, VkDeviceMemory newMemory, VkDeviceSize newOffset, std::uint8_t* newMappedData, void* userData );
+
+    /// Range of a pooled VkDeviceMemory block. Owned by VulkanAllocator, resources hold a pointer to it.
+    struct VulkanAllocation
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        VkDeviceSize alignment = 1;
+        /// Persistently mapped pointer to the beginning of the range if memory is host visible, otherwise null.
+        std::uint8_t* mappedData = nullptr;
+        const char* debugName = "";
+        /// Defragmentation hook, set with VulkanAllocator::SetMoveCallback(). Allocations without it are never moved.
+        VulkanMoveCallback moveCallback = nullptr;
+        void* moveUserData = nullptr;
+        VulkanAllocator::Block* block = nullptr;
+    };
+
+    /// Sub-allocates buffers and images from large VkDeviceMemory blocks, one pool per memory type, resource kind and strategy.
+    namespace VulkanAllocator
+    {
+        enum class Strategy
+        {
+            /// First-fit with coalescing of freed ranges. For resources with unrelated lifetimes.
+            FreeList,
+            /// Bump allocation, a block is rewound when all its allocations are freed. For short-lived staging memory.
+            Linear
+        };
+
+        struct Stats
+        {
+            VkDeviceSize usedBytes = 0;
+            VkDeviceSize reservedBytes = 0;
+            VkDeviceSize deviceLocalBudgetBytes = 0;
+            unsigned blockCount = 0;
+            unsigned dedicatedBlockCount = 0;
+            unsigned allocationCount = 0;
+        };
+
+        void Init( VkDevice device, VkPhysicalDevice physicalDevice );
+
+        /// Frees all blocks. Resources bound to them must have been destroyed.
+        void Deinit();
+
+        /// Allocates memory for a buffer and binds it.
+        /// \param buffer Buffer.
+        /// \param properties Required memory properties. Host visible memory is mapped.
+        /// \param strategy Allocation strategy.
+        /// \param debugName Name shown in statistics and debuggers.
+        /// \return Allocation. Never null, failure is fatal.
+        VulkanAllocation* AllocateBuffer( VkBuffer buffer, VkMemoryPropertyFlags properties, Strategy strategy, const char* debugName );
+
+        /// Allocates memory for an optimally tiled image and binds it.
+        VulkanAllocation* AllocateImage( VkImage image, VkMemoryPropertyFlags properties, const char* debugName );
+
+        /// Returns the allocation's range to its block. The GPU must not be using the memory anymore. Null is ignored.
+        void Free( VulkanAllocation* allocation );
+
+        /// Marks an allocation as movable by Defragment().
+        void SetMoveCallback( VulkanAllocation* allocation, VulkanMoveCallback callback, void* userData );
+
+        /// Moves movable allocations from sparsely used free-list blocks into holes of other blocks and releases emptied blocks.
+        /// The GPU must be idle.
+        /// \param maxMoves Maximum number of allocations to move.
+        /// \return Number of moved allocations.
+        unsigned Defragment( unsigned maxMoves );
+
+        /// Releases blocks that have no allocations.
+        void ReleaseEmptyBlocks();
+
+        Stats GetStats();
+    }
+}
+
+#endif
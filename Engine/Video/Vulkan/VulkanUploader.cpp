@@ -0,0 +1,387 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include "VulkanUploader.hpp"
+#include <atomic>
+#include <vector>
+#include "Macros.hpp"
+#include "System.hpp"
+#include "VulkanAllocator.hpp"
+#include "VulkanUtils.hpp"
+
+namespace ae3d
+{
+    namespace VulkanUploader
+    {
+        struct Batch
+        {
+            VkCommandBuffer transferCmdBuffer = VK_NULL_HANDLE;
+            VkCommandBuffer graphicsCmdBuffer = VK_NULL_HANDLE;
+            VkSemaphore transferComplete = VK_NULL_HANDLE;
+            VkFence fence = VK_NULL_HANDLE;
+            std::uint64_t ringEnd = 0; // Ring head after the batch's last allocation.
+            bool isSubmitted = false;
+            // Uploads that don't fit into the ring.
+            std::vector< VkBuffer > oversizedBuffers;
+            std::vector< VulkanAllocation* > oversizedMemory;
+        };
+    }
+}
+
+namespace VulkanUploaderGlobal
+{
+    constexpr VkDeviceSize RingSize = 32 * 1024 * 1024;
+    // Bigger uploads get their own buffer.
+    constexpr VkDeviceSize MaxRingAllocationSize = RingSize / 4;
+    // The open batch is submitted when its staging usage grows over this, so big loads are copied while the rest is still being read.
+    constexpr VkDeviceSize MaxBatchBytes = 8 * 1024 * 1024;
+    constexpr int BatchCount = 4;
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue transferQueue = VK_NULL_HANDLE;
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
+    std::uint32_t transferQueueFamily = 0;
+    std::uint32_t graphicsQueueFamily = 0;
+    VkCommandPool transferCmdPool = VK_NULL_HANDLE;
+    VkCommandPool graphicsCmdPool = VK_NULL_HANDLE;
+
+    VkBuffer ringBuffer = VK_NULL_HANDLE;
+    ae3d::VulkanAllocation* ringMemory = nullptr;
+    // Monotonic byte positions, the ring offset is position % RingSize.
+    std::uint64_t ringHead = 0;
+    std::uint64_t ringTail = 0;
+
+    ae3d::VulkanUploader::Batch batches[ BatchCount ];
+    // Batch that is recorded, or will be recorded next if isRecording is false.
+    std::uint64_t recordingBatch = 1;
+    std::uint64_t oldestPendingBatch = 1;
+    std::atomic< std::uint64_t > completedBatch( 0 );
+    std::uint64_t recordingBatchStart = 0;
+    bool isRecording = false;
+}
+
+static VkDeviceSize AlignUp( std::uint64_t value, VkDeviceSize alignment )
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static ae3d::VulkanUploader::Batch& GetBatch( std::uint64_t id )
+{
+    return VulkanUploaderGlobal::batches[ id % VulkanUploaderGlobal::BatchCount ];
+}
+
+static void RetireOldestBatch()
+{
+    ae3d::VulkanUploader::Batch& batch = GetBatch( VulkanUploaderGlobal::oldestPendingBatch );
+    ae3d::System::Assert( batch.isSubmitted, "retired batch has not been submitted" );
+
+    VkResult err = vkWaitForFences( VulkanUploaderGlobal::device, 1, &batch.fence, VK_TRUE, UINT64_MAX );
+    AE3D_CHECK_VULKAN( err, "vkWaitForFences in VulkanUploader" );
+    err = vkResetFences( VulkanUploaderGlobal::device, 1, &batch.fence );
+    AE3D_CHECK_VULKAN( err, "vkResetFences in VulkanUploader" );
+
+    for (std::size_t i = 0; i < batch.oversizedBuffers.size(); ++i)
+    {
+        vkDestroyBuffer( VulkanUploaderGlobal::device, batch.oversizedBuffers[ i ], nullptr );
+        ae3d::VulkanAllocator::Free( batch.oversizedMemory[ i ] );
+    }
+
+    batch.oversizedBuffers.clear();
+    batch.oversizedMemory.clear();
+    batch.isSubmitted = false;
+
+    VulkanUploaderGlobal::ringTail = batch.ringEnd;
+    VulkanUploaderGlobal::completedBatch.store( VulkanUploaderGlobal::oldestPendingBatch );
+    ++VulkanUploaderGlobal::oldestPendingBatch;
+}
+
+static void BeginBatch()
+{
+    if (VulkanUploaderGlobal::isRecording)
+    {
+        return;
+    }
+
+    ae3d::VulkanUploader::Batch& batch = GetBatch( VulkanUploaderGlobal::recordingBatch );
+
+    // The slot's previous batch must have completed before its command buffers can be reused.
+    while (batch.isSubmitted)
+    {
+        RetireOldestBatch();
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkResult err = vkBeginCommandBuffer( batch.transferCmdBuffer, &beginInfo );
+    AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer in VulkanUploader" );
+    err = vkBeginCommandBuffer( batch.graphicsCmdBuffer, &beginInfo );
+    AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer in VulkanUploader" );
+
+    VulkanUploaderGlobal::recordingBatchStart = VulkanUploaderGlobal::ringHead;
+    VulkanUploaderGlobal::isRecording = true;
+}
+
+void ae3d::VulkanUploader::Init( VkDevice device, VkQueue transferQueue, std::uint32_t transferQueueFamily, VkQueue graphicsQueue, std::uint32_t graphicsQueueFamily )
+{
+    VulkanUploaderGlobal::device = device;
+    VulkanUploaderGlobal::transferQueue = transferQueue;
+    VulkanUploaderGlobal::transferQueueFamily = transferQueueFamily;
+    VulkanUploaderGlobal::graphicsQueue = graphicsQueue;
+    VulkanUploaderGlobal::graphicsQueueFamily = graphicsQueueFamily;
+
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = transferQueueFamily;
+
+    VkResult err = vkCreateCommandPool( device, &poolInfo, nullptr, &VulkanUploaderGlobal::transferCmdPool );
+    AE3D_CHECK_VULKAN( err, "vkCreateCommandPool in VulkanUploader" );
+
+    poolInfo.queueFamilyIndex = graphicsQueueFamily;
+    err = vkCreateCommandPool( device, &poolInfo, nullptr, &VulkanUploaderGlobal::graphicsCmdPool );
+    AE3D_CHECK_VULKAN( err, "vkCreateCommandPool in VulkanUploader" );
+
+    VkCommandBufferAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocateInfo.commandBufferCount = 1;
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    for (int i = 0; i < VulkanUploaderGlobal::BatchCount; ++i)
+    {
+        Batch& batch = VulkanUploaderGlobal::batches[ i ];
+
+        allocateInfo.commandPool = VulkanUploaderGlobal::transferCmdPool;
+        err = vkAllocateCommandBuffers( device, &allocateInfo, &batch.transferCmdBuffer );
+        AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers in VulkanUploader" );
+
+        allocateInfo.commandPool = VulkanUploaderGlobal::graphicsCmdPool;
+        err = vkAllocateCommandBuffers( device, &allocateInfo, &batch.graphicsCmdBuffer );
+        AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers in VulkanUploader" );
+
+        err = vkCreateSemaphore( device, &semaphoreInfo, nullptr, &batch.transferComplete );
+        AE3D_CHECK_VULKAN( err, "vkCreateSemaphore in VulkanUploader" );
+
+        err = vkCreateFence( device, &fenceInfo, nullptr, &batch.fence );
+        AE3D_CHECK_VULKAN( err, "vkCreateFence in VulkanUploader" );
+    }
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = VulkanUploaderGlobal::RingSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    err = vkCreateBuffer( device, &bufferInfo, nullptr, &VulkanUploaderGlobal::ringBuffer );
+    AE3D_CHECK_VULKAN( err, "vkCreateBuffer staging ring" );
+    debug::SetObjectName( device, (std::uint64_t)VulkanUploaderGlobal::ringBuffer, VK_OBJECT_TYPE_BUFFER, "staging ring" );
+
+    VulkanUploaderGlobal::ringMemory = VulkanAllocator::AllocateBuffer( VulkanUploaderGlobal::ringBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                                       VulkanAllocator::Strategy::FreeList, "staging ring" );
+}
+
+void ae3d::VulkanUploader::Deinit()
+{
+    for (int i = 0; i < VulkanUploaderGlobal::BatchCount; ++i)
+    {
+        Batch& batch = VulkanUploaderGlobal::batches[ i ];
+
+        for (std::size_t b = 0; b < batch.oversizedBuffers.size(); ++b)
+        {
+            vkDestroyBuffer( VulkanUploaderGlobal::device, batch.oversizedBuffers[ b ], nullptr );
+            VulkanAllocator::Free( batch.oversizedMemory[ b ] );
+        }
+
+        batch.oversizedBuffers.clear();
+        batch.oversizedMemory.clear();
+        vkDestroySemaphore( VulkanUploaderGlobal::device, batch.transferComplete, nullptr );
+        vkDestroyFence( VulkanUploaderGlobal::device, batch.fence, nullptr );
+        batch = Batch();
+    }
+
+    vkDestroyCommandPool( VulkanUploaderGlobal::device, VulkanUploaderGlobal::transferCmdPool, nullptr );
+    vkDestroyCommandPool( VulkanUploaderGlobal::device, VulkanUploaderGlobal::graphicsCmdPool, nullptr );
+    vkDestroyBuffer( VulkanUploaderGlobal::device, VulkanUploaderGlobal::ringBuffer, nullptr );
+    VulkanAllocator::Free( VulkanUploaderGlobal::ringMemory );
+
+    VulkanUploaderGlobal::ringBuffer = VK_NULL_HANDLE;
+    VulkanUploaderGlobal::ringMemory = nullptr;
+    VulkanUploaderGlobal::isRecording = false;
+}
+
+ae3d::VulkanUploader::StagingRange ae3d::VulkanUploader::AllocateStaging( VkDeviceSize size, VkDeviceSize alignment )
+{
+    StagingRange range;
+
+    if (size > VulkanUploaderGlobal::MaxRingAllocationSize)
+    {
+        BeginBatch();
+
+        VkBufferCreateInfo bufferInfo = {};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VkResult err = vkCreateBuffer( VulkanUploaderGlobal::device, &bufferInfo, nullptr, &range.buffer );
+        AE3D_CHECK_VULKAN( err, "vkCreateBuffer oversized staging" );
+
+        VulkanAllocation* memory = VulkanAllocator::AllocateBuffer( range.buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                                                   VulkanAllocator::Strategy::Linear, "oversized staging" );
+        range.data = memory->mappedData;
+
+        Batch& batch = GetBatch( VulkanUploaderGlobal::recordingBatch );
+        batch.oversizedBuffers.push_back( range.buffer );
+        batch.oversizedMemory.push_back( memory );
+        return range;
+    }
+
+    if (VulkanUploaderGlobal::isRecording && VulkanUploaderGlobal::ringHead - VulkanUploaderGlobal::recordingBatchStart + size > VulkanUploaderGlobal::MaxBatchBytes)
+    {
+        Flush();
+    }
+
+    BeginBatch();
+
+    std::uint64_t position = AlignUp( VulkanUploaderGlobal::ringHead, alignment );
+
+    // Allocations don't wrap around the end of the ring.
+    if ((position % VulkanUploaderGlobal::RingSize) + size > VulkanUploaderGlobal::RingSize)
+    {
+        position = AlignUp( position, VulkanUploaderGlobal::RingSize );
+    }
+
+    while (position + size - VulkanUploaderGlobal::ringTail > VulkanUploaderGlobal::RingSize)
+    {
+        if (VulkanUploaderGlobal::oldestPendingBatch == VulkanUploaderGlobal::recordingBatch)
+        {
+            // Only the open batch holds staging memory, so it must be completed first.
+            Flush();
+        }
+
+        RetireOldestBatch();
+        BeginBatch();
+    }
+
+    VulkanUploaderGlobal::ringHead = position + size;
+
+    range.buffer = VulkanUploaderGlobal::ringBuffer;
+    range.offset = position % VulkanUploaderGlobal::RingSize;
+    range.data = VulkanUploaderGlobal::ringMemory->mappedData + range.offset;
+    return range;
+}
+
+VkCommandBuffer ae3d::VulkanUploader::GetTransferCommandBuffer()
+{
+    BeginBatch();
+    return GetBatch( VulkanUploaderGlobal::recordingBatch ).transferCmdBuffer;
+}
+
+VkCommandBuffer ae3d::VulkanUploader::GetGraphicsCommandBuffer()
+{
+    BeginBatch();
+    return GetBatch( VulkanUploaderGlobal::recordingBatch ).graphicsCmdBuffer;
+}
+
+std::uint64_t ae3d::VulkanUploader::GetCurrentBatch()
+{
+    return VulkanUploaderGlobal::recordingBatch;
+}
+
+std::uint64_t ae3d::VulkanUploader::GetCompletedBatch()
+{
+    return VulkanUploaderGlobal::completedBatch.load();
+}
+
+void ae3d::VulkanUploader::Flush()
+{
+    if (!VulkanUploaderGlobal::isRecording)
+    {
+        return;
+    }
+
+    Batch& batch = GetBatch( VulkanUploaderGlobal::recordingBatch );
+
+    VkResult err = vkEndCommandBuffer( batch.transferCmdBuffer );
+    AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer in VulkanUploader" );
+    err = vkEndCommandBuffer( batch.graphicsCmdBuffer );
+    AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer in VulkanUploader" );
+
+    if (VulkanUploaderGlobal::transferQueue != VulkanUploaderGlobal::graphicsQueue)
+    {
+        VkSubmitInfo transferSubmit = {};
+        transferSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        transferSubmit.commandBufferCount = 1;
+        transferSubmit.pCommandBuffers = &batch.transferCmdBuffer;
+        transferSubmit.signalSemaphoreCount = 1;
+        transferSubmit.pSignalSemaphores = &batch.transferComplete;
+
+        err = vkQueueSubmit( VulkanUploaderGlobal::transferQueue, 1, &transferSubmit, VK_NULL_HANDLE );
+        AE3D_CHECK_VULKAN( err, "vkQueueSubmit transfer in VulkanUploader" );
+
+        const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+        VkSubmitInfo graphicsSubmit = {};
+        graphicsSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        graphicsSubmit.waitSemaphoreCount = 1;
+        graphicsSubmit.pWaitSemaphores = &batch.transferComplete;
+        graphicsSubmit.pWaitDstStageMask = &waitStage;
+        graphicsSubmit.commandBufferCount = 1;
+        graphicsSubmit.pCommandBuffers = &batch.graphicsCmdBuffer;
+
+        err = vkQueueSubmit( VulkanUploaderGlobal::graphicsQueue, 1, &graphicsSubmit, batch.fence );
+        AE3D_CHECK_VULKAN( err, "vkQueueSubmit graphics in VulkanUploader" );
+    }
+    else
+    {
+        const VkCommandBuffer cmdBuffers[ 2 ] = { batch.transferCmdBuffer, batch.graphicsCmdBuffer };
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 2;
+        submitInfo.pCommandBuffers = cmdBuffers;
+
+        err = vkQueueSubmit( VulkanUploaderGlobal::graphicsQueue, 1, &submitInfo, batch.fence );
+        AE3D_CHECK_VULKAN( err, "vkQueueSubmit in VulkanUploader" );
+    }
+
+    batch.ringEnd = VulkanUploaderGlobal::ringHead;
+    batch.isSubmitted = true;
+    VulkanUploaderGlobal::isRecording = false;
+    ++VulkanUploaderGlobal::recordingBatch;
+}
+
+void ae3d::VulkanUploader::Update()
+{
+    while (VulkanUploaderGlobal::oldestPendingBatch < VulkanUploaderGlobal::recordingBatch &&
+           vkGetFenceStatus( VulkanUploaderGlobal::device, GetBatch( VulkanUploaderGlobal::oldestPendingBatch ).fence ) == VK_SUCCESS)
+    {
+        RetireOldestBatch();
+    }
+
+    Flush();
+}
+
+void ae3d::VulkanUploader::Wait( std::uint64_t batch )
+{
+    if (batch >= VulkanUploaderGlobal::recordingBatch)
+    {
+        Flush();
+    }
+
+    while (VulkanUploaderGlobal::oldestPendingBatch <= batch && VulkanUploaderGlobal::oldestPendingBatch < VulkanUploaderGlobal::recordingBatch)
+    {
+        RetireOldestBatch();
+    }
+}
+
+bool ae3d::VulkanUploader::UsesSeparateQueueFamily( std::uint32_t outFamilies[ 2 ] )
+{
+    outFamilies[ 0 ] = VulkanUploaderGlobal::transferQueueFamily;
+    outFamilies[ 1 ] = VulkanUploaderGlobal::graphicsQueueFamily;
+    return VulkanUploaderGlobal::transferQueueFamily != VulkanUploaderGlobal::graphicsQueueFamily;
+}
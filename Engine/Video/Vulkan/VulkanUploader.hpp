@@ -0,0 +1,60 @@
+#ifndef VULKAN_UPLOADER
+#define VULKAN_UPLOADER
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+namespace ae3d
+{
+    /// Streams resource data to the GPU without stalling the frame. Source data is copied into a persistently mapped staging ring
+    /// and the copies are recorded into batches that are submitted to a transfer queue. Batches complete in submission order.
+    namespace VulkanUploader
+    {
+        /// Staging memory that is recycled when its batch completes.
+        struct StagingRange
+        {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            std::uint8_t* data = nullptr;
+        };
+
+        /// \param transferQueue Queue for copies. Can be the graphics queue if the device has no suitable transfer queue.
+        void Init( VkDevice device, VkQueue transferQueue, std::uint32_t transferQueueFamily, VkQueue graphicsQueue, std::uint32_t graphicsQueueFamily );
+
+        /// Destroys the staging ring and batches. The device must be idle.
+        void Deinit();
+
+        /// Reserves staging memory in the open batch. Waits for the oldest batch if the ring is full.
+        /// \param size Size in bytes.
+        /// \param alignment Offset alignment, must be a power of two.
+        StagingRange AllocateStaging( VkDeviceSize size, VkDeviceSize alignment );
+
+        /// \return Command buffer of the open batch that runs on the transfer queue. Only for copies and barriers.
+        VkCommandBuffer GetTransferCommandBuffer();
+
+        /// \return Command buffer of the open batch that runs on the graphics queue after the transfer commands. For blits and
+        ///         transitions into shader-readable layouts.
+        VkCommandBuffer GetGraphicsCommandBuffer();
+
+        /// \return Id of the open batch. Work recorded now has finished when GetCompletedBatch() reaches it.
+        std::uint64_t GetCurrentBatch();
+
+        /// \return Id of the newest completed batch. Thread-safe.
+        std::uint64_t GetCompletedBatch();
+
+        /// Submits the open batch if anything was recorded into it.
+        void Flush();
+
+        /// Polls batch fences, recycles staging memory of completed batches and submits the open batch. Called once per frame.
+        void Update();
+
+        /// Submits batches up to and including batch and blocks until they have completed.
+        void Wait( std::uint64_t batch );
+
+        /// \param outFamilies Receives the transfer and graphics queue families.
+        /// \return True if transfer and graphics queues are in different families, so images must be created with VK_SHARING_MODE_CONCURRENT.
+        bool UsesSeparateQueueFamily( std::uint32_t outFamilies[ 2 ] );
+    }
+}
+
+#endif
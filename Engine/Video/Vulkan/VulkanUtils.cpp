@@ -8,6 +8,7 @@
 #include "System.hpp"
 #include "Statistics.hpp"
 #include "GfxDevice.hpp"
+#include "VertexBuffer.hpp"
 
 namespace debug
 {
@@ -190,17 +191,19 @@ namespace debug
 
 namespace ae3d
 {
-    std::uint64_t GetPSOHash( ae3d::VertexBuffer& vertexBuffer, ae3d::Shader& shader, ae3d::GfxDevice::BlendMode blendMode,
-        ae3d::GfxDevice::DepthFunc depthFunc, ae3d::GfxDevice::CullMode cullMode, ae3d::GfxDevice::FillMode fillMode, VkRenderPass renderPass, ae3d::GfxDevice::PrimitiveTopology topology )
+    std::uint64_t GetPSOHash( ae3d::VertexBuffer::VertexFormat vertexFormat, ae3d::Shader& shader, ae3d::GfxDevice::BlendMode blendMode,
+        ae3d::GfxDevice::DepthFunc depthFunc, ae3d::GfxDevice::CullMode cullMode, ae3d::GfxDevice::FillMode fillMode, VkFormat colorFormat, int sampleCount, ae3d::GfxDevice::PrimitiveTopology topology )
     {
-        std::uint64_t outResult = (ptrdiff_t)&vertexBuffer;
-        outResult += (ptrdiff_t)&shader;
-        outResult += (unsigned)blendMode;
-        outResult += ((unsigned)depthFunc) * 2;
-        outResult += ((unsigned)cullMode) * 4;
-        outResult += ((unsigned)fillMode) * 8;
-        outResult += ((ptrdiff_t)&renderPass) * 16;
-        outResult += ((unsigned)topology) * 32;
+        const std::uint64_t values[] = { (std::uint64_t)vertexFormat, (std::uint64_t)(ptrdiff_t)&shader, (std::uint64_t)blendMode, (std::uint64_t)depthFunc,
+                                         (std::uint64_t)cullMode, (std::uint64_t)fillMode, (std::uint64_t)colorFormat, (std::uint64_t)sampleCount, (std::uint64_t)topology };
+
+        // FNV-1a
+        std::uint64_t outResult = 14695981039346656037ull;
+
+        for (std::uint64_t value : values)
+        {
+            outResult = (outResult ^ value) * 1099511628211ull;
+        }
 
         return outResult;
     }
@@ -2,10 +2,10 @@
 #define VULKAN_UTILS
 
 #include <vulkan/vulkan.h>
+#include "VertexBuffer.hpp"
 
 namespace ae3d
 {
-	class VertexBuffer;
 	class Shader;
 
 	namespace GfxDevice
@@ -20,11 +20,18 @@ namespace ae3d
     void SetImageLayout( VkCommandBuffer cmdbuffer, VkImage image, VkImageAspectFlags aspectMask, VkImageLayout oldImageLayout,
         VkImageLayout newImageLayout, unsigned layerCount, unsigned mipLevel, unsigned mipLevelCount );
 
-    std::uint64_t GetPSOHash( ae3d::VertexBuffer& vertexBuffer, ae3d::Shader& shader, ae3d::GfxDevice::BlendMode blendMode,
-        ae3d::GfxDevice::DepthFunc depthFunc, ae3d::GfxDevice::CullMode cullMode, ae3d::GfxDevice::FillMode fillMode, VkRenderPass renderPass, ae3d::GfxDevice::PrimitiveTopology topology );
+    /// \param colorFormat Render target's color format, VK_FORMAT_UNDEFINED for the backbuffer.
+    /// \param sampleCount Render target's sample count.
+    std::uint64_t GetPSOHash( ae3d::VertexBuffer::VertexFormat vertexFormat, ae3d::Shader& shader, ae3d::GfxDevice::BlendMode blendMode,
+        ae3d::GfxDevice::DepthFunc depthFunc, ae3d::GfxDevice::CullMode cullMode, ae3d::GfxDevice::FillMode fillMode, VkFormat colorFormat, int sampleCount, ae3d::GfxDevice::PrimitiveTopology topology );
 
     void CreateInstance( VkInstance* outInstance );
     std::uint32_t GetMemoryType( std::uint32_t typeBits, VkFlags properties );
+
+    struct VulkanAllocation;
+
+    /// Destroys a buffer and frees its memory when the GPU has finished the frame that is being recorded.
+    void ReleaseAfterFrame( VkBuffer buffer, VulkanAllocation* memory );
 }
 
 namespace debug
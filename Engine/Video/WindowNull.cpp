@@ -0,0 +1,54 @@
+#include "Window.hpp"
+#include "GfxDevice.hpp"
+
+// Headless window for the null renderer. It never produces input events.
+
+namespace WindowGlobal
+{
+    bool isOpen = false;
+    int windowWidth = 640;
+    int windowHeight = 480;
+    int presentInterval = 1;
+}
+
+void PlatformInitGamePad()
+{
+}
+
+bool ae3d::Window::IsOpen()
+{
+    return WindowGlobal::isOpen;
+}
+
+void ae3d::Window::Create( int width, int height, WindowCreateFlags /*flags*/ )
+{
+    WindowGlobal::windowWidth = width == 0 ? 1920 : width;
+    WindowGlobal::windowHeight = height == 0 ? 1080 : height;
+
+    GfxDevice::Init( WindowGlobal::windowWidth, WindowGlobal::windowHeight );
+    WindowGlobal::isOpen = true;
+}
+
+void ae3d::Window::SetTitle( const char* /*title*/ )
+{
+}
+
+void ae3d::Window::GetSize( int& outWidth, int& outHeight )
+{
+    outWidth = WindowGlobal::windowWidth;
+    outHeight = WindowGlobal::windowHeight;
+}
+
+void ae3d::Window::PumpEvents()
+{
+}
+
+void ae3d::Window::SwapBuffers()
+{
+    GfxDevice::Present();
+}
+
+bool ae3d::Window::PollEvent( WindowEvent& /*outEvent*/ )
+{
+    return false;
+}
@@ -123,8 +123,8 @@ int main()
 
 		++frame;
 
-        char statStr[ 512 ] = {};
-        System::Statistics::GetStatistics( statStr );
+        char statStr[ 2048 ] = {};
+        System::Statistics::GetStatistics( statStr, sizeof( statStr ) );
         textContainer.GetComponent<TextRendererComponent>()->SetText( (frame % 5 == 0) ? "Aether3D \nGame Engine" : "Aether3D" );
         textContainer.GetComponent<TextRendererComponent>()->SetText( statStr );
     }
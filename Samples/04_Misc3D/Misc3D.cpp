@@ -540,7 +540,7 @@ int main()
     std::map< std::string, Texture2D* > sponzaTextureNameToTexture;
     Array< Mesh* > sponzaMeshes;
 #ifdef TEST_SPONZA
-    auto res = scene.Deserialize( FileSystem::FileContents( "sponza.scene" ), sponzaGameObjects, sponzaTextureNameToTexture,
+    auto res = scene.Deserialize( FileSystem::MappedFile( "sponza.scene" ), sponzaGameObjects, sponzaTextureNameToTexture,
                                   sponzaMaterialNameToMaterial, sponzaMeshes );
     if (res != Scene::DeserializeResult::Success)
     {
@@ -887,8 +887,8 @@ int main()
 
         if (animationFrame % 60 == 0)
         {
-            static char statStr[ 512 ] = {};
-            System::Statistics::GetStatistics( statStr );
+            static char statStr[ 2048 ] = {};
+            System::Statistics::GetStatistics( statStr, sizeof( statStr ) );
             statsContainer.GetComponent<TextRendererComponent>()->SetText( statStr );
         }
         
@@ -984,8 +984,8 @@ using namespace ae3d;
     rotation = ae3d::Quaternion::FromEuler( ae3d::Vec3( angle, angle, angle ) );
     rotatingCube.GetComponent< ae3d::TransformComponent >()->SetLocalRotation( rotation );
     
-    char statStr[ 512 ] = {};
-    ae3d::System::Statistics::GetStatistics( statStr );
+    char statStr[ 2048 ] = {};
+    ae3d::System::Statistics::GetStatistics( statStr, sizeof( statStr ) );
     text.GetComponent<ae3d::TextRendererComponent>()->SetText( statStr );
     
     static int animationFrame = 0;
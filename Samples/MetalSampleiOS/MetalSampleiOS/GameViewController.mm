@@ -353,8 +353,8 @@ int gTouchCount = 0;
     rotation = ae3d::Quaternion::FromEuler( ae3d::Vec3( angle, angle, angle ) );
     cube.GetComponent< ae3d::TransformComponent >()->SetLocalRotation( rotation );
     
-    char statStr[ 512 ] = {};
-    ae3d::System::Statistics::GetStatistics( statStr );
+    char statStr[ 2048 ] = {};
+    ae3d::System::Statistics::GetStatistics( statStr, sizeof( statStr ) );
     //text.GetComponent<ae3d::TextRendererComponent>()->SetText( statStr );
     
 //#ifdef TEST_FORWARD_PLUS
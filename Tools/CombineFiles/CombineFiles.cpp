@@ -1,83 +1,573 @@
 /**
-  Combines files listed in input text file into one.
-  
-  Usage: CombineFiles input.txt output
+  Combines files listed in input text file into one .pak file.
+
+  Usage: CombineFiles [-l level] [-s percent] [-i previous.pak] input.txt output
 
   Input file contains one path per line.
-  
-  Output file's first 4 bytes is the block count. After it blocks are followed where data is ordered like below:
-  offset      data
-      0       file name
-    128       file length
-    132       file contents
+
+  Output is in .pak version 2 format described in Engine/Core/PakFormat.hpp: a header,
+  a table of contents sorted by path hash, the paths and then the file contents.
+  Contents are written in path order, so files in the same directory are near each other.
+  Files with identical contents are stored once and their TOC entries point to the same bytes.
+  Files are read and compressed on all hardware threads.
+
+  -l level          Compression level, 0 stores files uncompressed, 1 (default) is fastest and 9 compresses best.
+  -s percent        Blocks and files that compress to more than percent of their size are stored uncompressed. Default is 90.
+  -i previous.pak   Incremental build. Files whose contents are unchanged from previous.pak are copied from it without compressing
+                    them again, so they keep their previous compression. previous.pak can be the output file.
 */
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
-#include <sstream>
-#include <list>
+#include <iostream>
+#include <iterator>
+#include <map>
 #include <string>
+#include <thread>
 #include <vector>
-#include <cstring>
+#include "../../Engine/Core/Lz4.hpp"
+#include "../../Engine/Core/PakFormat.hpp"
 
-struct FileMetaBlock
+struct InputFile
 {
     std::string path;
-    unsigned dataSize;
+    std::vector< unsigned char > data;
+    /// Contents as written into the pak, either data or its compressed blocks. Only filled for the first file of each distinct contents.
+    std::vector< unsigned char > stored;
+    Pak::TocEntry entry;
+    /// Checksum() of data, used to find files with identical contents.
+    std::uint32_t contentHash = 0;
+    /// Index of the file whose stored contents this file shares. Its own index if it's the first file with these contents.
+    std::size_t blob = 0;
+    /// True if stored was copied from the previous pak.
+    bool isReused = false;
+    bool isRead = false;
 };
 
+/// .pak file of an earlier build, for incremental builds.
+struct PreviousPak
+{
+    std::vector< unsigned char > bytes;
+    std::map< std::string, Pak::TocEntry > pathToEntry;
+};
+
+static const std::uint32_t BlockSize = 256 * 1024;
+
+static std::uint64_t AlignUp( std::uint64_t value, std::uint64_t alignment )
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/// Runs function( index ) for indices 0..count-1 on all hardware threads.
+template< typename Function > static void ParallelFor( std::size_t count, Function function )
+{
+    std::atomic< std::size_t > nextIndex( 0 );
+    auto run = [&]()
+    {
+        for (std::size_t i = nextIndex++; i < count; i = nextIndex++)
+        {
+            function( i );
+        }
+    };
+
+    const std::size_t threadCount = std::min( count, static_cast< std::size_t >( std::max( 1u, std::thread::hardware_concurrency() ) ) );
+    std::vector< std::thread > threads;
+
+    for (std::size_t t = 1; t < threadCount; ++t)
+    {
+        threads.emplace_back( run );
+    }
+
+    run();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+/// Fills file.stored and file.entry.flags. Falls back to storing data if it doesn't compress below storePercent.
+static void Compress( InputFile& file, int level, int storePercent )
+{
+    file.entry.flags = 0;
+
+    if (level == 0 || file.data.empty())
+    {
+        file.stored = file.data;
+        return;
+    }
+
+    Pak::CompressedHeader header;
+    header.blockSize = BlockSize;
+    header.blockCount = static_cast< std::uint32_t >( (file.data.size() + BlockSize - 1) / BlockSize );
+
+    std::vector< std::uint32_t > blockSizes( header.blockCount );
+    std::vector< unsigned char > blocks;
+    std::vector< unsigned char > compressed( Lz4::CompressBound( BlockSize ) );
+
+    for (std::uint32_t b = 0; b < header.blockCount; ++b)
+    {
+        const unsigned char* block = file.data.data() + static_cast< std::size_t >( b ) * BlockSize;
+        const std::size_t blockLength = std::min( static_cast< std::size_t >( BlockSize ), file.data.size() - static_cast< std::size_t >( b ) * BlockSize );
+        const std::size_t compressedLength = Lz4::Compress( block, blockLength, compressed.data(), level );
+
+        if (compressedLength * 100 > blockLength * static_cast< std::size_t >( storePercent ))
+        {
+            blockSizes[ b ] = static_cast< std::uint32_t >( blockLength ) | Pak::BlockUncompressed;
+            blocks.insert( blocks.end(), block, block + blockLength );
+        }
+        else
+        {
+            blockSizes[ b ] = static_cast< std::uint32_t >( compressedLength );
+            blocks.insert( blocks.end(), compressed.begin(), compressed.begin() + static_cast< std::ptrdiff_t >( compressedLength ) );
+        }
+    }
+
+    const std::size_t storedSize = sizeof( header ) + blockSizes.size() * sizeof( std::uint32_t ) + blocks.size();
+
+    if (storedSize * 100 > file.data.size() * static_cast< std::size_t >( storePercent ))
+    {
+        file.stored = file.data;
+        return;
+    }
+
+    file.stored.resize( sizeof( header ) + blockSizes.size() * sizeof( std::uint32_t ) );
+    std::memcpy( file.stored.data(), &header, sizeof( header ) );
+    std::memcpy( file.stored.data() + sizeof( header ), blockSizes.data(), blockSizes.size() * sizeof( std::uint32_t ) );
+    file.stored.insert( file.stored.end(), blocks.begin(), blocks.end() );
+    file.entry.flags = Pak::EntryCompressed;
+}
+
+/// Decompresses a compressed entry.
+/// \param stored Stored contents.
+/// \param available Bytes available at stored.
+/// \param size Uncompressed size.
+/// \param out Receives size bytes.
+/// \return Size of the stored contents, or 0 if they are invalid.
+static std::size_t Decode( const unsigned char* stored, std::size_t available, std::size_t size, unsigned char* out )
+{
+    Pak::CompressedHeader header;
+
+    if (available < sizeof( header ))
+    {
+        return 0;
+    }
+
+    std::memcpy( &header, stored, sizeof( header ) );
+
+    if (header.blockSize == 0 || header.blockCount != (size + header.blockSize - 1) / header.blockSize ||
+        available < sizeof( header ) + static_cast< std::size_t >( header.blockCount ) * sizeof( std::uint32_t ))
+    {
+        return 0;
+    }
+
+    std::size_t blockOffset = sizeof( header ) + header.blockCount * sizeof( std::uint32_t );
+
+    for (std::uint32_t b = 0; b < header.blockCount; ++b)
+    {
+        std::uint32_t blockSize;
+        std::memcpy( &blockSize, stored + sizeof( header ) + b * sizeof( std::uint32_t ), sizeof( blockSize ) );
+        const std::size_t srcSize = blockSize & ~Pak::BlockUncompressed;
+        const std::size_t blockBegin = static_cast< std::size_t >( b ) * header.blockSize;
+        const std::size_t blockLength = std::min( static_cast< std::size_t >( header.blockSize ), size - blockBegin );
+
+        if (srcSize > available - blockOffset)
+        {
+            return 0;
+        }
+
+        if (blockSize & Pak::BlockUncompressed)
+        {
+            if (srcSize != blockLength)
+            {
+                return 0;
+            }
+
+            std::memcpy( out + blockBegin, stored + blockOffset, blockLength );
+        }
+        else if (!Lz4::Decompress( stored + blockOffset, srcSize, out + blockBegin, blockLength ))
+        {
+            return 0;
+        }
+
+        blockOffset += srcSize;
+    }
+
+    return blockOffset;
+}
+
+/// Decompresses every compressed entry.
+/// \return Decompressed bytes per second, or 0 if nothing was compressed.
+static double MeasureDecodeSpeed( const std::vector< InputFile >& files )
+{
+    std::size_t decodedBytes = 0;
+    std::vector< unsigned char > decoded;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (const auto& file : files)
+    {
+        if (file.stored.empty() || !(file.entry.flags & Pak::EntryCompressed))
+        {
+            continue;
+        }
+
+        decoded.resize( file.data.size() );
+
+        if (Decode( file.stored.data(), file.stored.size(), file.data.size(), decoded.data() ) == 0)
+        {
+            std::cout << "Could not decompress " << file.path << std::endl;
+            std::exit( 1 );
+        }
+
+        decodedBytes += file.data.size();
+    }
+
+    const double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+    return decodedBytes > 0 && seconds > 0 ? static_cast< double >( decodedBytes ) / seconds : 0;
+}
+
+/// Reads path's TOC into outPak.
+/// \return True if path is a valid .pak v2 file.
+static bool ReadPreviousPak( const char* path, PreviousPak& outPak )
+{
+    std::ifstream ifs( path, std::ios::binary );
+
+    if (!ifs.is_open())
+    {
+        return false;
+    }
+
+    outPak.bytes.assign( std::istreambuf_iterator< char >( ifs ), std::istreambuf_iterator< char >() );
+
+    Pak::Header header;
+
+    if (outPak.bytes.size() < sizeof( header ))
+    {
+        return false;
+    }
+
+    std::memcpy( &header, outPak.bytes.data(), sizeof( header ) );
+    const std::uint64_t byteCount = outPak.bytes.size();
+
+    if (std::memcmp( header.magic, Pak::Magic, sizeof( Pak::Magic ) ) != 0 || header.version != Pak::Version ||
+        header.tocOffset > byteCount || static_cast< std::uint64_t >( header.entryCount ) * sizeof( Pak::TocEntry ) > byteCount - header.tocOffset ||
+        header.pathsOffset > byteCount || header.pathBytes > byteCount - header.pathsOffset)
+    {
+        return false;
+    }
+
+    for (std::uint32_t i = 0; i < header.entryCount; ++i)
+    {
+        Pak::TocEntry entry;
+        std::memcpy( &entry, outPak.bytes.data() + header.tocOffset + i * sizeof( Pak::TocEntry ), sizeof( entry ) );
+
+        if (entry.pathOffset > header.pathBytes || entry.pathLength > header.pathBytes - entry.pathOffset || entry.offset > byteCount)
+        {
+            return false;
+        }
+
+        const char* entryPath = reinterpret_cast< const char* >( outPak.bytes.data() + header.pathsOffset + entry.pathOffset );
+        outPak.pathToEntry[ std::string( entryPath, entry.pathLength ) ] = entry;
+    }
+
+    return true;
+}
+
+/// Copies file's stored contents from previous if its path is there with identical contents.
+/// \return True if the contents were copied.
+static bool ReuseFromPreviousPak( InputFile& file, const PreviousPak& previous )
+{
+    const auto it = previous.pathToEntry.find( file.path );
+
+    if (it == previous.pathToEntry.end() || it->second.size != file.data.size())
+    {
+        return false;
+    }
+
+    const Pak::TocEntry& entry = it->second;
+    const unsigned char* stored = previous.bytes.data() + entry.offset;
+    const std::size_t available = previous.bytes.size() - static_cast< std::size_t >( entry.offset );
+    std::size_t storedSize = file.data.size();
+
+    if (entry.flags & Pak::EntryCompressed)
+    {
+        std::vector< unsigned char > decoded( file.data.size() );
+        storedSize = Decode( stored, available, decoded.size(), decoded.data() );
+
+        if (storedSize == 0 || decoded != file.data)
+        {
+            return false;
+        }
+    }
+    else if (storedSize > available || (storedSize > 0 && std::memcmp( stored, file.data.data(), storedSize ) != 0))
+    {
+        return false;
+    }
+
+    file.stored.assign( stored, stored + storedSize );
+    file.entry.flags = entry.flags & Pak::EntryCompressed;
+    file.isReused = true;
+    return true;
+}
+
 int main( int argCount, char* args[] )
 {
-    if (argCount != 3)
+    int level = 1;
+    int storePercent = 90;
+    const char* previousPath = nullptr;
+    int argIndex = 1;
+
+    for (; argIndex + 1 < argCount && args[ argIndex ][ 0 ] == '-'; argIndex += 2)
+    {
+        if (std::strcmp( args[ argIndex ], "-l" ) == 0)
+        {
+            level = std::max( 0, std::min( 9, std::atoi( args[ argIndex + 1 ] ) ) );
+        }
+        else if (std::strcmp( args[ argIndex ], "-s" ) == 0)
+        {
+            storePercent = std::max( 0, std::min( 100, std::atoi( args[ argIndex + 1 ] ) ) );
+        }
+        else if (std::strcmp( args[ argIndex ], "-i" ) == 0)
+        {
+            previousPath = args[ argIndex + 1 ];
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (argCount - argIndex != 2)
     {
-        std::cout << "Usage: CombineFiles indexFile.txt outputfile" << std::endl;
+        std::cout << "Usage: CombineFiles [-l level] [-s percent] [-i previous.pak] indexFile.txt outputfile" << std::endl;
         return 1;
     }
 
-    std::ifstream fileListFile( args[ 1 ] );
+    const char* indexPath = args[ argIndex ];
+    const char* outputPath = args[ argIndex + 1 ];
+
+    std::ifstream fileListFile( indexPath );
     if (!fileListFile.is_open())
     {
-        std::cout << "Could not open " << args[ 1 ] << std::endl;
+        std::cout << "Could not open " << indexPath << std::endl;
         return 1;
     }
 
-    std::list< FileMetaBlock > fileList;
+    std::vector< InputFile > files;
     std::string line;
-    const unsigned MaxPathLength = 128;
 
     while (std::getline( fileListFile, line ))
     {
-        fileList.push_back( FileMetaBlock() );
-        fileList.back().path = line;
-        
-        if (line.length() > MaxPathLength)
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+
+        if (line.empty())
+        {
+            continue;
+        }
+
+        files.push_back( InputFile() );
+        files.back().path = line;
+    }
+
+    // Contents are written in path order.
+    std::sort( files.begin(), files.end(), []( const InputFile& a, const InputFile& b ) { return a.path < b.path; } );
+
+    for (std::size_t i = 1; i < files.size(); ++i)
+    {
+        if (files[ i - 1 ].path == files[ i ].path)
+        {
+            std::cout << "Duplicate path " << files[ i ].path << std::endl;
+            return 1;
+        }
+    }
+
+    PreviousPak previous;
+
+    if (previousPath != nullptr && !ReadPreviousPak( previousPath, previous ))
+    {
+        std::cout << "Could not read " << previousPath << ", building all files." << std::endl;
+        previous.pathToEntry.clear();
+    }
+
+    ParallelFor( files.size(), [&files]( std::size_t i )
+    {
+        InputFile& file = files[ i ];
+        std::ifstream ifs( file.path, std::ios::binary | std::ios::ate );
+
+        if (!ifs.is_open())
+        {
+            return;
+        }
+
+        file.data.resize( static_cast< std::size_t >( ifs.tellg() ) );
+        ifs.seekg( 0 );
+        ifs.read( reinterpret_cast< char* >( file.data.data() ), static_cast< std::streamsize >( file.data.size() ) );
+        file.isRead = ifs.good() || file.data.empty();
+        file.contentHash = Pak::Checksum( file.data.data(), file.data.size() );
+    } );
+
+    for (const auto& file : files)
+    {
+        if (!file.isRead)
         {
-            std::cout << "Too long path in " << line << ". Max length is " << MaxPathLength << std::endl;
+            std::cout << "Could not open " << file.path << std::endl;
             return 1;
         }
     }
 
-    // 1st pass: Determine file sizes.    
-    for (auto& file : fileList)
+    // Files with identical contents share the first one's stored contents.
+    std::map< std::pair< std::uint64_t, std::uint32_t >, std::vector< std::size_t > > contentToBlobs;
+    std::vector< std::size_t > blobs;
+
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        files[ i ].blob = i;
+        auto& candidates = contentToBlobs[ std::make_pair( static_cast< std::uint64_t >( files[ i ].data.size() ), files[ i ].contentHash ) ];
+
+        for (std::size_t candidate : candidates)
+        {
+            if (files[ candidate ].data == files[ i ].data)
+            {
+                files[ i ].blob = candidate;
+                break;
+            }
+        }
+
+        if (files[ i ].blob == i)
+        {
+            candidates.push_back( i );
+            blobs.push_back( i );
+        }
+    }
+
+    ParallelFor( blobs.size(), [&]( std::size_t b )
+    {
+        InputFile& file = files[ blobs[ b ] ];
+        file.entry = Pak::TocEntry();
+
+        if (!ReuseFromPreviousPak( file, previous ))
+        {
+            Compress( file, level, storePercent );
+        }
+
+        file.entry.checksum = Pak::Checksum( file.stored.data(), file.stored.size() );
+    } );
+
+    std::uint64_t pathBytes = 0;
+
+    for (auto& file : files)
+    {
+        const InputFile& blob = files[ file.blob ];
+        file.entry.pathHash = Pak::HashPath( file.path.data(), file.path.size() );
+        file.entry.size = file.data.size();
+        file.entry.pathOffset = static_cast< std::uint32_t >( pathBytes );
+        file.entry.pathLength = static_cast< std::uint32_t >( file.path.size() );
+        file.entry.checksum = blob.entry.checksum;
+        file.entry.flags = blob.entry.flags;
+        pathBytes += file.path.size();
+    }
+
+    if (pathBytes > 0xFFFFFFFFu)
+    {
+        std::cout << "Paths are too long, their combined length must fit in 32 bits." << std::endl;
+        return 1;
+    }
+
+    Pak::Header header;
+    std::memcpy( header.magic, Pak::Magic, sizeof( Pak::Magic ) );
+    header.version = Pak::Version;
+    header.entryCount = static_cast< std::uint32_t >( files.size() );
+    header.pathBytes = static_cast< std::uint32_t >( pathBytes );
+    header.tocOffset = sizeof( Pak::Header );
+    header.pathsOffset = header.tocOffset + files.size() * sizeof( Pak::TocEntry );
+
+    std::uint64_t dataOffset = header.pathsOffset + pathBytes;
+
+    for (std::size_t blob : blobs)
+    {
+        dataOffset = AlignUp( dataOffset, Pak::DataAlignment );
+        files[ blob ].entry.offset = dataOffset;
+        dataOffset += files[ blob ].stored.size();
+    }
+
+    for (auto& file : files)
+    {
+        file.entry.offset = files[ file.blob ].entry.offset;
+    }
+
+    // FileSystem binary searches the TOC by path hash.
+    std::vector< Pak::TocEntry > toc( files.size() );
+
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        toc[ i ] = files[ i ].entry;
+    }
+
+    std::stable_sort( toc.begin(), toc.end(), []( const Pak::TocEntry& a, const Pak::TocEntry& b ) { return a.pathHash < b.pathHash; } );
+
+    // The previous pak has been read into memory, so it can be overwritten.
+    std::ofstream ofs( outputPath, std::ios::out | std::ios::binary );
+
+    if (!ofs.is_open())
+    {
+        std::cout << "Could not open " << outputPath << std::endl;
+        return 1;
+    }
+
+    ofs.write( reinterpret_cast< const char* >( &header ), sizeof( header ) );
+    ofs.write( reinterpret_cast< const char* >( toc.data() ), static_cast< std::streamsize >( toc.size() * sizeof( Pak::TocEntry ) ) );
+
+    for (const auto& file : files)
+    {
+        ofs.write( file.path.data(), static_cast< std::streamsize >( file.path.size() ) );
+    }
+
+    std::uint64_t position = header.pathsOffset + pathBytes;
+    const char padding[ Pak::DataAlignment ] = {};
+    std::uint64_t inputBytes = 0;
+    std::uint64_t storedBytes = 0;
+    std::size_t reusedCount = 0;
+
+    for (std::size_t blob : blobs)
+    {
+        const InputFile& file = files[ blob ];
+        ofs.write( padding, static_cast< std::streamsize >( file.entry.offset - position ) );
+        ofs.write( reinterpret_cast< const char* >( file.stored.data() ), static_cast< std::streamsize >( file.stored.size() ) );
+        position = file.entry.offset + file.stored.size();
+        storedBytes += file.stored.size();
+        reusedCount += file.isReused ? 1 : 0;
+    }
+
+    for (const auto& file : files)
+    {
+        inputBytes += file.data.size();
+    }
+
+    if (!ofs.good())
     {
-        std::ifstream ifs( file.path );
-        ifs.seekg( 0, std::ios::end );
-        file.dataSize = static_cast< unsigned >( ifs.tellg() );
+        std::cout << "Could not write " << outputPath << std::endl;
+        return 1;
     }
-    
-    std::ofstream ofs( args[ 2 ], std::ios::out | std::ios::binary );
-    const unsigned listLength = static_cast< unsigned >( fileList.size() );
-    ofs.write( (char*)&listLength, 4 );
 
-    for (const auto& file : fileList)
+    std::cout << "Wrote " << files.size() << " files into " << outputPath << " (" << position << " bytes)." << std::endl;
+    std::cout << blobs.size() << " distinct contents, " << reusedCount << " copied from the previous pak." << std::endl;
+
+    if (inputBytes > 0)
+    {
+        std::cout << "Contents: " << inputBytes << " -> " << storedBytes << " bytes, ratio " << static_cast< double >( inputBytes ) / static_cast< double >( storedBytes ) << std::endl;
+    }
+
+    const double decodeSpeed = MeasureDecodeSpeed( files );
+
+    if (decodeSpeed > 0)
     {
-        char path[ MaxPathLength ] = { 0 };
-        std::strcpy( path, file.path.c_str() );
-        ofs.write( (char*)path, MaxPathLength );
-        ofs.write( (char*)&file.dataSize, 4 );
-        std::vector< unsigned char > data;
-        std::ifstream ifs( file.path );
-        data.assign( std::istreambuf_iterator< char >( ifs ), std::istreambuf_iterator< char >() );
-        ofs.write( (char*)data.data(), data.size() );
+        std::cout << "Decode speed: " << decodeSpeed / (1024 * 1024) << " MB/s on one thread" << std::endl;
     }
 
     return 0;
@@ -393,10 +393,10 @@ void ImportMeshNodes( FbxNode* node )
                 gMeshes.back().tcoord.push_back( uv[ j ] );
                 gMeshes.back().nonInterleavedTangents.push_back( tangent[ j ] );
 
-                face.vInd[ j ] = (unsigned short)vertexIndex;
-                face.vnInd[ j ] = (unsigned short)vertexCounter;
-                face.uvInd[ j ] = (unsigned short)vertexCounter;
-                face.tInd[ j ] = (unsigned short)vertexCounter;
+                face.vInd[ j ] = (unsigned)vertexIndex;
+                face.vnInd[ j ] = (unsigned)vertexCounter;
+                face.uvInd[ j ] = (unsigned)vertexCounter;
+                face.tInd[ j ] = (unsigned)vertexCounter;
                 ++vertexCounter;
             }
             
@@ -653,35 +653,40 @@ void LoadFBX( const std::string& path )
 
 int main( int paramCount, char** params )
 {
-    if (paramCount != 2)
+    const bool quantize = paramCount == 3 && std::string( params[ 1 ] ) == "-quantize";
+
+    if (paramCount != 2 && !quantize)
     {
-        std::cerr << "Usage: ./convert_fbx file.fbx" << std::endl;
+        std::cerr << "Usage: ./convert_fbx [-quantize] file.fbx" << std::endl;
+        std::cerr << "  -quantize writes quantized PTNTC vertices. Skinned meshes are not quantized." << std::endl;
         return 1;
     }
 
-    std::ifstream ifs( params[ 1 ], std::ios_base::binary );
+    const char* path = params[ paramCount - 1 ];
+
+    std::ifstream ifs( path, std::ios_base::binary );
 
     if (!ifs)
     {
-        std::cerr << "Couldn't open file " << params[ 1 ] << std::endl;
+        std::cerr << "Couldn't open file " << path << std::endl;
         return 1;
     }
 
     std::cerr << "Converting... " << std::endl;
 
-    LoadFBX( params[ 1 ] );
+    LoadFBX( path );
 
     if (gMeshes.empty())
     {
-        std::cout << std::string( params[ 1 ] ) << " didn't contain any meshes." << std::endl;
+        std::cout << std::string( path ) << " didn't contain any meshes." << std::endl;
         return 0;
     }
 
     // Creates a new file name by replacing 'obj' with 'ae3d'.
-    std::string outFile = std::string( params[ 1 ] );
+    std::string outFile = std::string( path );
     outFile = outFile.substr( 0, outFile.length() - 3 );
     outFile.append( "ae3d" );
 
-    WriteAe3d( outFile, VertexFormat::PTNTC );
+    WriteAe3d( outFile, quantize ? VertexFormat::PTNTC_Quantized : VertexFormat::PTNTC );
     return 0;
 }
@@ -34,22 +34,22 @@ void ConvertIndices()
     {
         auto& face = gMeshes.back().face[ f ];
         
-        face.vInd[ 0 ] = (unsigned short)vertGlobalLocal[ face.vInd[ 0 ] ];
-        face.vInd[ 1 ] = (unsigned short)vertGlobalLocal[ face.vInd[ 1 ] ];
-        face.vInd[ 2 ] = (unsigned short)vertGlobalLocal[ face.vInd[ 2 ] ];
+        face.vInd[ 0 ] = (unsigned)vertGlobalLocal[ face.vInd[ 0 ] ];
+        face.vInd[ 1 ] = (unsigned)vertGlobalLocal[ face.vInd[ 1 ] ];
+        face.vInd[ 2 ] = (unsigned)vertGlobalLocal[ face.vInd[ 2 ] ];
         
         if (hasVNormals)
         {
-            face.vnInd[ 0 ] = (unsigned short)normGlobalLocal[ face.vnInd[ 0 ] ];
-            face.vnInd[ 1 ] = (unsigned short)normGlobalLocal[ face.vnInd[ 1 ] ];
-            face.vnInd[ 2 ] = (unsigned short)normGlobalLocal[ face.vnInd[ 2 ] ];
+            face.vnInd[ 0 ] = (unsigned)normGlobalLocal[ face.vnInd[ 0 ] ];
+            face.vnInd[ 1 ] = (unsigned)normGlobalLocal[ face.vnInd[ 1 ] ];
+            face.vnInd[ 2 ] = (unsigned)normGlobalLocal[ face.vnInd[ 2 ] ];
         }
         
         if (hasTextureCoords)
         {
-            face.uvInd[ 0 ] = (unsigned short)tcoordGlobalLocal[ face.uvInd[ 0 ] ];
-            face.uvInd[ 1 ] = (unsigned short)tcoordGlobalLocal[ face.uvInd[ 1 ] ];
-            face.uvInd[ 2 ] = (unsigned short)tcoordGlobalLocal[ face.uvInd[ 2 ] ];
+            face.uvInd[ 0 ] = (unsigned)tcoordGlobalLocal[ face.uvInd[ 0 ] ];
+            face.uvInd[ 1 ] = (unsigned)tcoordGlobalLocal[ face.uvInd[ 1 ] ];
+            face.uvInd[ 2 ] = (unsigned)tcoordGlobalLocal[ face.uvInd[ 2 ] ];
         }
     }
 }
@@ -201,7 +201,7 @@ void LoadObj( const std::string& path )
                 gMeshes.back().vertex.push_back( vertex[va-1] );
                 vertGlobalLocal[ va - 1 ] = (int)gMeshes.back().vertex.size() - 1;
             }
-            face.vInd[0] = static_cast< unsigned short >( va - 1 );
+            face.vInd[0] = static_cast< unsigned >( va - 1 );
             // Reads '/' if any.
             stm >> slash;
 
@@ -211,7 +211,7 @@ void LoadObj( const std::string& path )
                 stm.unget();
 
                 stm >> vb;
-                face.vInd[1] = static_cast< unsigned short >( vb - 1 );
+                face.vInd[1] = static_cast< unsigned >( vb - 1 );
 
                 // Didn't find the index in index conversion map, so add it.
                 if (vertGlobalLocal.find(vb-1) == vertGlobalLocal.end())
@@ -221,7 +221,7 @@ void LoadObj( const std::string& path )
                 }
                 
                 stm >> vc;
-                face.vInd[2] = static_cast< unsigned short >( vc - 1 );
+                face.vInd[2] = static_cast< unsigned >( vc - 1 );
 
                 if (vertGlobalLocal.find(vc-1) == vertGlobalLocal.end())
                 {
@@ -252,7 +252,7 @@ void LoadObj( const std::string& path )
                     tcoordGlobalLocal[ ta - 1 ] = (int)gMeshes.back().tcoord.size() - 1;
                 }
                 
-                face.uvInd[0] = static_cast< unsigned short >( ta - 1 );
+                face.uvInd[0] = static_cast< unsigned >( ta - 1 );
             }
             else
             {
@@ -282,7 +282,7 @@ void LoadObj( const std::string& path )
                         normGlobalLocal[ na - 1 ] = (int)gMeshes.back().vnormal.size() - 1;
                     }
                     
-                    face.vnInd[0] = static_cast< unsigned short >( na - 1 );
+                    face.vnInd[0] = static_cast< unsigned >( na - 1 );
                 }
                 else
                 {
@@ -303,7 +303,7 @@ void LoadObj( const std::string& path )
                 vertGlobalLocal[ vb - 1 ] = (int)gMeshes.back().vertex.size() - 1;
             }
 
-            face.vInd[1] = static_cast< unsigned short >( vb - 1 );
+            face.vInd[1] = static_cast< unsigned >( vb - 1 );
 
             // Texture coordinate index of this vertex.
             if (hasTextureCoords)
@@ -323,7 +323,7 @@ void LoadObj( const std::string& path )
                     tcoordGlobalLocal[ tb - 1 ] = (int)gMeshes.back().tcoord.size() - 1;
                 }
 
-                face.uvInd[1] = static_cast< unsigned short >( tb - 1 );
+                face.uvInd[1] = static_cast< unsigned >( tb - 1 );
             }
             // Eats '/' if face has normals but not texture coords.
             if (!hasTextureCoords && hasVNormals)
@@ -348,7 +348,7 @@ void LoadObj( const std::string& path )
                     normGlobalLocal[ nb - 1 ] = (int)gMeshes.back().vnormal.size() - 1;
                 }
 
-                face.vnInd[1] = static_cast< unsigned short >( nb - 1 );
+                face.vnInd[1] = static_cast< unsigned >( nb - 1 );
             }
 
             // Reads the third vertex.
@@ -365,7 +365,7 @@ void LoadObj( const std::string& path )
                 vertGlobalLocal[ vc - 1 ] = (int)gMeshes.back().vertex.size() - 1;
             }
 
-            face.vInd[2] = static_cast< unsigned short >( vc - 1 );
+            face.vInd[2] = static_cast< unsigned >( vc - 1 );
             
             // Texture coordinate index of this vertex.
             if (hasTextureCoords)
@@ -385,7 +385,7 @@ void LoadObj( const std::string& path )
                     tcoordGlobalLocal[ tc - 1 ] = (int)gMeshes.back().tcoord.size() - 1;
                 }
 
-                face.uvInd[2] = static_cast< unsigned short >( tc - 1 );
+                face.uvInd[2] = static_cast< unsigned >( tc - 1 );
             }
             // Eats '/' if face has normals but not texture coords.
             if (!hasTextureCoords && hasVNormals)
@@ -410,7 +410,7 @@ void LoadObj( const std::string& path )
                     normGlobalLocal[ nc - 1 ] = (int)gMeshes.back().vnormal.size() - 1;
                 }
 
-                face.vnInd[2] = static_cast< unsigned short >( nc - 1 );
+                face.vnInd[2] = static_cast< unsigned >( nc - 1 );
             }
             gMeshes.back().face.push_back(face);
 
@@ -431,7 +431,7 @@ void LoadObj( const std::string& path )
                     vertGlobalLocal[ vd - 1 ] = (int)gMeshes.back().vertex.size() - 1;
                 }
                 Face face2;
-                face2.vInd[1] = static_cast< unsigned short >( vd - 1 );
+                face2.vInd[1] = static_cast< unsigned >( vd - 1 );
 
                 face2.vInd[0] = face.vInd[2];
                 face2.uvInd[0] = face.uvInd[2];
@@ -459,7 +459,7 @@ void LoadObj( const std::string& path )
                         tcoordGlobalLocal[ td - 1 ] = (int)gMeshes.back().tcoord.size() - 1;
                     }
 
-                    face2.uvInd[1] = static_cast< unsigned short >( td - 1 );
+                    face2.uvInd[1] = static_cast< unsigned >( td - 1 );
 
                 }
                 // Eats '/' if the mesh has normals but not texture coords.
@@ -485,7 +485,7 @@ void LoadObj( const std::string& path )
                         normGlobalLocal[ nd - 1 ] = (int)gMeshes.back().vnormal.size() - 1;
                     }
 
-                    face2.vnInd[1] = static_cast< unsigned short >( nd - 1 );
+                    face2.vnInd[1] = static_cast< unsigned >( nd - 1 );
                 }
                 gMeshes.back().face.push_back( face2 );
             }
@@ -500,7 +500,7 @@ int main( int paramCount, char** params )
     if (paramCount != 3)
     {
         std::cerr << "Usage: ./convert_obj <vertexformat> file.obj" << std::endl;
-        std::cerr << "  where <vertexformat> is 0 for PTNTC and 1 for PTN." << std::endl;
+        std::cerr << "  where <vertexformat> is 0 for PTNTC, 1 for PTN and 2 for quantized PTNTC." << std::endl;
         return 1;
     }
 
@@ -519,6 +519,10 @@ int main( int paramCount, char** params )
     {
         vertexFormat = VertexFormat::PTN;
     }
+    else if (std::string( params[ 1 ] ) == "2")
+    {
+        vertexFormat = VertexFormat::PTNTC_Quantized;
+    }
     
     WriteAe3d( outFile, vertexFormat );
     return 0;
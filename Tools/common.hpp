@@ -6,14 +6,18 @@
 #include <cassert>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <algorithm>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 #include "Matrix.hpp"
 #include "Vec3.hpp"
+#include "../Engine/Core/MeshFormat.hpp"
 
 // Cache optimization code adapted from http://gameangst.com/wp-content/uploads/2009/03/forsythtriangleorderoptimizer.cpp
 
@@ -57,21 +61,21 @@ struct Face
         tInd[ 0 ] = tInd[ 1 ] = tInd[ 2 ] = 0;
     }
 
-    unsigned short vInd[ 3 ];
-    unsigned short uvInd[ 3 ];
-    unsigned short vnInd[ 3 ];
-    unsigned short colInd[ 3 ];
-    unsigned short tInd[ 3 ];
+    unsigned vInd[ 3 ];
+    unsigned uvInd[ 3 ];
+    unsigned vnInd[ 3 ];
+    unsigned colInd[ 3 ];
+    unsigned tInd[ 3 ];
 };
 
 // Defines a face used in a vertex array.
 // a, b and c are indices to Mesh::interleavedVertices.
 struct VertexInd
 {
-    unsigned short a, b, c;
+    unsigned a, b, c;
 };
 
-enum class VertexFormat { PTNTC_Skinned, PTNTC, PTN };
+enum class VertexFormat { PTNTC_Skinned, PTNTC, PTN, PTNTC_Quantized };
 
 struct VertexPTNTC_Skinned
 {
@@ -100,6 +104,16 @@ struct VertexPTN
     ae3d::Vec3 normal;
 };
 
+// Same layout as VertexBuffer::VertexPTNTC_Quantized.
+struct VertexPTNTC_Quantized
+{
+    std::int16_t position[ 4 ];
+    std::uint16_t texCoord[ 2 ];
+    std::int16_t normal[ 2 ];
+    std::int16_t tangent[ 2 ];
+    std::uint8_t color[ 4 ];
+};
+
 struct VertexData
 {
     float    score = 0;
@@ -142,6 +156,8 @@ struct Mesh
     void SolveVertexTangents();
     void CopyInterleavedVerticesToPTN();
     void CopyInterleavedVerticesToPTNTC();
+    void CopyInterleavedVerticesToPTNTC_Quantized();
+    void BuildMeshlets();
     
     void OptimizeFaces(); // Implements https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
     bool ComputeVertexScores();
@@ -166,7 +182,9 @@ struct Mesh
     std::vector< VertexPTNTC_Skinned > interleavedVertices;
     std::vector< VertexPTNTC > interleavedVerticesPTNTC;
     std::vector< VertexPTN > interleavedVerticesPTN;
+    std::vector< VertexPTNTC_Quantized > interleavedVerticesPTNTC_Quantized;
     std::vector< VertexInd > indices;
+    std::vector< MeshFormat::MeshletEntry > meshlets;
 
     // Used to calculate tangent-space handedness.
     std::vector< ae3d::Vec3 > bitangents;  // For faces.
@@ -216,6 +234,229 @@ void Mesh::CopyInterleavedVerticesToPTNTC()
     }
 }
 
+/// \return f in -1..1 as a 16-bit normalized integer.
+std::int16_t QuantizeSnorm16( float f )
+{
+    return (std::int16_t)std::lround( std::max( -1.0f, std::min( 1.0f, f ) ) * 32767.0f );
+}
+
+/// \return f in 0..1 as an 8-bit normalized integer.
+std::uint8_t QuantizeUnorm8( float f )
+{
+    return (std::uint8_t)std::lround( std::max( 0.0f, std::min( 1.0f, f ) ) * 255.0f );
+}
+
+/// \return f as a half-float. Rounds to nearest, flushes denormals to zero and overflows to infinity.
+std::uint16_t FloatToHalf( float f )
+{
+    std::uint32_t bits;
+    std::memcpy( &bits, &f, sizeof( bits ) );
+
+    const std::uint32_t sign = (bits >> 16) & 0x8000;
+    const int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+    const std::uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent <= 0)
+    {
+        return (std::uint16_t)sign;
+    }
+
+    if (exponent >= 31)
+    {
+        return (std::uint16_t)(sign | 0x7C00);
+    }
+
+    // A carry from rounding the mantissa correctly increments the exponent.
+    std::uint32_t half = ((std::uint32_t)exponent << 10) | (mantissa >> 13);
+    half += (mantissa >> 12) & 1;
+    return (std::uint16_t)(sign | half);
+}
+
+/// Encodes a unit vector into the octahedral mapping that the shaders decode in DecodeOctahedral().
+void EncodeOctahedral( const ae3d::Vec3& v, std::int16_t outEncoded[ 2 ] )
+{
+    const float length = std::fabs( v.x ) + std::fabs( v.y ) + std::fabs( v.z );
+    float x = length > 0 ? v.x / length : 0;
+    float y = length > 0 ? v.y / length : 0;
+
+    if (v.z < 0)
+    {
+        const float ox = x;
+        x = (1.0f - std::fabs( y )) * (x >= 0 ? 1.0f : -1.0f);
+        y = (1.0f - std::fabs( ox )) * (y >= 0 ? 1.0f : -1.0f);
+    }
+
+    outEncoded[ 0 ] = QuantizeSnorm16( x );
+    outEncoded[ 1 ] = QuantizeSnorm16( y );
+}
+
+/// Positions are normalized to -1..1 inside the AABB, so SolveAABB() must have been called.
+void Mesh::CopyInterleavedVerticesToPTNTC_Quantized()
+{
+    const ae3d::Vec3 center = (aabbMax + aabbMin) * 0.5f;
+    const ae3d::Vec3 halfSize = (aabbMax - aabbMin) * 0.5f;
+    interleavedVerticesPTNTC_Quantized.resize( interleavedVertices.size() );
+
+    for (size_t i = 0; i < interleavedVerticesPTNTC_Quantized.size(); ++i)
+    {
+        const VertexPTNTC_Skinned& source = interleavedVertices[ i ];
+        VertexPTNTC_Quantized& quantized = interleavedVerticesPTNTC_Quantized[ i ];
+        const ae3d::Vec3 position = source.position - center;
+
+        quantized.position[ 0 ] = QuantizeSnorm16( halfSize.x > 0 ? position.x / halfSize.x : 0 );
+        quantized.position[ 1 ] = QuantizeSnorm16( halfSize.y > 0 ? position.y / halfSize.y : 0 );
+        quantized.position[ 2 ] = QuantizeSnorm16( halfSize.z > 0 ? position.z / halfSize.z : 0 );
+        quantized.position[ 3 ] = source.tangent.w < 0 ? -32767 : 32767;
+        quantized.texCoord[ 0 ] = FloatToHalf( source.texCoord.u );
+        quantized.texCoord[ 1 ] = FloatToHalf( source.texCoord.v );
+        EncodeOctahedral( source.normal, quantized.normal );
+        EncodeOctahedral( ae3d::Vec3( source.tangent.x, source.tangent.y, source.tangent.z ), quantized.tangent );
+        quantized.color[ 0 ] = QuantizeUnorm8( source.color.x );
+        quantized.color[ 1 ] = QuantizeUnorm8( source.color.y );
+        quantized.color[ 2 ] = QuantizeUnorm8( source.color.z );
+        quantized.color[ 3 ] = QuantizeUnorm8( source.color.w );
+    }
+}
+
+/// \return Morton code of p, whose components must be in 0..1023.
+std::uint32_t MortonCode( const ae3d::Vec3& p )
+{
+    std::uint32_t code = 0;
+
+    for (std::uint32_t bit = 0; bit < 10; ++bit)
+    {
+        code |= (((std::uint32_t)p.x >> bit) & 1) << (bit * 3 + 0);
+        code |= (((std::uint32_t)p.y >> bit) & 1) << (bit * 3 + 1);
+        code |= (((std::uint32_t)p.z >> bit) & 1) << (bit * 3 + 2);
+    }
+
+    return code;
+}
+
+/**
+ Splits faces into meshlets of consecutive faces and calculates their bounds and normal cones.
+ Meshlets are then reordered along a Morton curve, so nearby meshlets are near each other in the index buffer
+ and visible meshlets can be drawn with few index ranges. Faces inside a meshlet keep their order.
+ Faces must have been optimized and their normals solved.
+ */
+void Mesh::BuildMeshlets()
+{
+    meshlets.clear();
+
+    // Index of the last meshlet that contains each vertex.
+    std::vector< std::uint32_t > vertexMeshlet( interleavedVertices.size(), std::numeric_limits< std::uint32_t >::max() );
+    std::uint32_t meshletVertexCount = 0;
+
+    for (std::size_t f = 0; f < indices.size(); ++f)
+    {
+        const unsigned vertices[ 3 ] = { indices[ f ].a, indices[ f ].b, indices[ f ].c };
+
+        auto countNewVertices = [&]( std::uint32_t meshlet )
+        {
+            std::uint32_t count = 0;
+
+            for (int v = 0; v < 3; ++v)
+            {
+                const bool isDuplicate = (v > 0 && vertices[ v ] == vertices[ 0 ]) || (v > 1 && vertices[ v ] == vertices[ 1 ]);
+                count += (vertexMeshlet[ vertices[ v ] ] != meshlet && !isDuplicate) ? 1 : 0;
+            }
+
+            return count;
+        };
+
+        std::uint32_t newVertexCount = meshlets.empty() ? 0 : countNewVertices( (std::uint32_t)meshlets.size() - 1 );
+
+        if (meshlets.empty() || meshletVertexCount + newVertexCount > MeshFormat::MaxMeshletVertices || meshlets.back().faceCount == MeshFormat::MaxMeshletFaces)
+        {
+            MeshFormat::MeshletEntry meshlet;
+            std::memset( &meshlet, 0, sizeof( meshlet ) );
+            meshlet.firstFace = (std::uint32_t)f;
+            meshlets.push_back( meshlet );
+            meshletVertexCount = 0;
+            newVertexCount = countNewVertices( (std::uint32_t)meshlets.size() - 1 );
+        }
+
+        for (int v = 0; v < 3; ++v)
+        {
+            vertexMeshlet[ vertices[ v ] ] = (std::uint32_t)meshlets.size() - 1;
+        }
+
+        meshletVertexCount += newVertexCount;
+        ++meshlets.back().faceCount;
+    }
+
+    for (auto& meshlet : meshlets)
+    {
+        ae3d::Vec3 meshletMin = interleavedVertices[ indices[ meshlet.firstFace ].a ].position;
+        ae3d::Vec3 meshletMax = meshletMin;
+        ae3d::Vec3 normalSum;
+
+        for (std::uint32_t f = meshlet.firstFace; f < meshlet.firstFace + meshlet.faceCount; ++f)
+        {
+            const unsigned vertices[ 3 ] = { indices[ f ].a, indices[ f ].b, indices[ f ].c };
+
+            for (int v = 0; v < 3; ++v)
+            {
+                meshletMin = ae3d::Vec3::Min2( meshletMin, interleavedVertices[ vertices[ v ] ].position );
+                meshletMax = ae3d::Vec3::Max2( meshletMax, interleavedVertices[ vertices[ v ] ].position );
+            }
+
+            normalSum += fnormal[ f ];
+        }
+
+        const ae3d::Vec3 axis = normalSum.Length() > 0.0001f ? normalSum.Normalized() : ae3d::Vec3( 0, 0, 1 );
+        float minDot = normalSum.Length() > 0.0001f ? 1.0f : -1.0f;
+
+        for (std::uint32_t f = meshlet.firstFace; f < meshlet.firstFace + meshlet.faceCount; ++f)
+        {
+            // Degenerate faces don't have a normal and can't be seen.
+            if (fnormal[ f ].Length() > 0.5f)
+            {
+                minDot = std::min( minDot, ae3d::Vec3::Dot( axis, fnormal[ f ] ) );
+            }
+        }
+
+        std::memcpy( meshlet.aabbMin, &meshletMin.x, sizeof( meshlet.aabbMin ) );
+        std::memcpy( meshlet.aabbMax, &meshletMax.x, sizeof( meshlet.aabbMax ) );
+        std::memcpy( meshlet.coneAxis, &axis.x, sizeof( meshlet.coneAxis ) );
+        // Cones wider than about 84 degrees would be culled so rarely that they are not tested.
+        meshlet.coneCutoff = minDot <= 0.1f ? 1.0f : std::sqrt( 1.0f - minDot * minDot );
+    }
+
+    const ae3d::Vec3 size = aabbMax - aabbMin;
+    std::vector< std::pair< std::uint32_t, std::size_t > > codes( meshlets.size() );
+
+    for (std::size_t m = 0; m < meshlets.size(); ++m)
+    {
+        const ae3d::Vec3 center = (ae3d::Vec3( meshlets[ m ].aabbMin[ 0 ], meshlets[ m ].aabbMin[ 1 ], meshlets[ m ].aabbMin[ 2 ] ) +
+                                   ae3d::Vec3( meshlets[ m ].aabbMax[ 0 ], meshlets[ m ].aabbMax[ 1 ], meshlets[ m ].aabbMax[ 2 ] )) * 0.5f;
+        const ae3d::Vec3 relative = center - aabbMin;
+        const ae3d::Vec3 cell( size.x > 0 ? relative.x / size.x * 1023 : 0, size.y > 0 ? relative.y / size.y * 1023 : 0, size.z > 0 ? relative.z / size.z * 1023 : 0 );
+        codes[ m ] = std::make_pair( MortonCode( cell ), m );
+    }
+
+    std::stable_sort( codes.begin(), codes.end() );
+
+    std::vector< MeshFormat::MeshletEntry > sortedMeshlets( meshlets.size() );
+    std::vector< VertexInd > sortedIndices;
+    std::vector< ae3d::Vec3 > sortedNormals;
+    sortedIndices.reserve( indices.size() );
+    sortedNormals.reserve( fnormal.size() );
+
+    for (std::size_t m = 0; m < codes.size(); ++m)
+    {
+        MeshFormat::MeshletEntry& meshlet = sortedMeshlets[ m ];
+        meshlet = meshlets[ codes[ m ].second ];
+        sortedIndices.insert( sortedIndices.end(), indices.begin() + meshlet.firstFace, indices.begin() + meshlet.firstFace + meshlet.faceCount );
+        sortedNormals.insert( sortedNormals.end(), fnormal.begin() + meshlet.firstFace, fnormal.begin() + meshlet.firstFace + meshlet.faceCount );
+        meshlet.firstFace = (std::uint32_t)(sortedIndices.size() - meshlet.faceCount);
+    }
+
+    meshlets.swap( sortedMeshlets );
+    indices.swap( sortedIndices );
+    fnormal.swap( sortedNormals );
+}
+
 float ComputeVertexCacheScore( int cachePosition, int vertexCacheSize )
 {
     const float findVertexScore_CacheDecayPower = 1.5f;
@@ -355,7 +596,7 @@ void Mesh::OptimizeFaces()
     // fill out face list per vertex
     for (unsigned i = 0; i < static_cast< unsigned >( indices.size() ); ++i)
     {
-        unsigned short index = indices[ i ].a;
+        unsigned index = indices[ i ].a;
         VertexPTNTCWithData& vertexDataA = verticesWithCachedata[ index ];
         activeFaceList[ vertexDataA.data.activeFaceListStart + vertexDataA.data.activeFaceListSize ] = i;
         ++vertexDataA.data.activeFaceListSize;
@@ -374,9 +615,9 @@ void Mesh::OptimizeFaces()
     std::vector<std::uint8_t> processedFaceList;
     processedFaceList.resize( indices.size() );
 
-    unsigned short vertexCacheBuffer[ (MaxVertexCacheSize + 3) * 2 ];
-    unsigned short* cache0 = vertexCacheBuffer;
-    unsigned short* cache1 = vertexCacheBuffer + (MaxVertexCacheSize + 3);
+    unsigned vertexCacheBuffer[ (MaxVertexCacheSize + 3) * 2 ];
+    unsigned* cache0 = vertexCacheBuffer;
+    unsigned* cache1 = vertexCacheBuffer + (MaxVertexCacheSize + 3);
     unsigned short entriesInCache0 = 0;
 
     unsigned bestFace = 0;
@@ -399,19 +640,19 @@ void Mesh::OptimizeFaces()
                     unsigned fface = j;
                     float faceScore = 0.f;
                    
-                    unsigned short indexA = indices[ fface ].a;
+                    unsigned indexA = indices[ fface ].a;
                     VertexPTNTCWithData& vertexDataA = verticesWithCachedata[ indexA ];
                     assert( vertexDataA.data.activeFaceListSize > 0 );
                     assert( vertexDataA.data.cachePos0 >= lruCacheSize );
                     faceScore += vertexDataA.data.score;
 
-                    unsigned short indexB = indices[ fface ].b;
+                    unsigned indexB = indices[ fface ].b;
                     VertexPTNTCWithData& vertexDataB = verticesWithCachedata[ indexB ];
                     assert( vertexDataB.data.activeFaceListSize > 0 );
                     assert( vertexDataB.data.cachePos0 >= lruCacheSize );
                     faceScore += vertexDataB.data.score;
 
-                    unsigned short indexC = indices[ fface ].c;
+                    unsigned indexC = indices[ fface ].c;
                     VertexPTNTCWithData& vertexDataC = verticesWithCachedata[ indexC ];
                     assert( vertexDataC.data.activeFaceListSize > 0 );
                     assert( vertexDataC.data.cachePos0 >= lruCacheSize );
@@ -438,7 +679,7 @@ void Mesh::OptimizeFaces()
 
         // add bestFace to LRU cache and to newIndexList
         {
-            unsigned short indexA = indices[ bestFace ].a;
+            unsigned indexA = indices[ bestFace ].a;
             newIndexList[ i ].a = indexA;
 
             VertexPTNTCWithData& vertexData = verticesWithCachedata[ indexA ];
@@ -470,7 +711,7 @@ void Mesh::OptimizeFaces()
         }
 
         {
-            unsigned short indexB = indices[ bestFace ].b;
+            unsigned indexB = indices[ bestFace ].b;
             newIndexList[ i ].b = indexB;
 
             VertexPTNTCWithData& vertexData = verticesWithCachedata[ indexB ];
@@ -502,7 +743,7 @@ void Mesh::OptimizeFaces()
         }
 
         {
-            unsigned short indexC = indices[ bestFace ].c;
+            unsigned indexC = indices[ bestFace ].c;
             newIndexList[ i ].c = indexC;
 
             VertexPTNTCWithData& vertexData = verticesWithCachedata[ indexC ];
@@ -535,7 +776,7 @@ void Mesh::OptimizeFaces()
         // move the rest of the old verts in the cache down and compute their new scores
         for (unsigned c0 = 0; c0 < entriesInCache0; ++c0)
         {
-            unsigned short index = cache0[ c0 ];
+            unsigned index = cache0[ c0 ];
             VertexPTNTCWithData& vertexData = verticesWithCachedata[ index ];
 
             if (vertexData.data.cachePos1 >= entriesInCache1)
@@ -550,7 +791,7 @@ void Mesh::OptimizeFaces()
         bestScore = -1.f;
         for (unsigned c1 = 0; c1 < entriesInCache1; ++c1)
         {
-            unsigned short index = cache1[ c1 ];
+            unsigned index = cache1[ c1 ];
             VertexPTNTCWithData& vertexData = verticesWithCachedata[ index ];
             vertexData.data.cachePos0 = vertexData.data.cachePos1;
             vertexData.data.cachePos1 = kEvictedCacheIndex;
@@ -559,15 +800,15 @@ void Mesh::OptimizeFaces()
                 unsigned fface = activeFaceList[ vertexData.data.activeFaceListStart + j ];
                 float faceScore = 0.f;
                     
-                unsigned short faceIndexA = indices[ fface ].a;
+                unsigned faceIndexA = indices[ fface ].a;
                 VertexPTNTCWithData& faceVertexDataA = verticesWithCachedata[ faceIndexA ];
                 faceScore += faceVertexDataA.data.score;
 
-                unsigned short faceIndexB = indices[ fface ].b;
+                unsigned faceIndexB = indices[ fface ].b;
                 VertexPTNTCWithData& faceVertexDataB = verticesWithCachedata[ faceIndexB ];
                 faceScore += faceVertexDataB.data.score;
 
-                unsigned short faceIndexC = indices[ fface ].c;
+                unsigned faceIndexC = indices[ fface ].c;
                 VertexPTNTCWithData& faceVertexDataC = verticesWithCachedata[ faceIndexC ];
                 faceScore += faceVertexDataC.data.score;
 
@@ -620,9 +861,9 @@ void Mesh::SolveFaceNormals()
 
     for (std::size_t faceInd = 0; faceInd < indices.size(); ++faceInd)
     {
-        const unsigned short& faceA = indices[ faceInd ].a;
-        const unsigned short& faceB = indices[ faceInd ].b;
-        const unsigned short& faceC = indices[ faceInd ].c;
+        const unsigned& faceA = indices[ faceInd ].a;
+        const unsigned& faceB = indices[ faceInd ].b;
+        const unsigned& faceC = indices[ faceInd ].c;
 
         const ae3d::Vec3 va = interleavedVertices[ faceA ].position;
         ae3d::Vec3 vb = interleavedVertices[ faceB ].position;
@@ -712,9 +953,9 @@ void Mesh::SolveVertexNormals()
             face[ faceInd ].vnInd[ 1 ] = face[ faceInd ].vInd[ 1 ];
             face[ faceInd ].vnInd[ 2 ] = face[ faceInd ].vInd[ 2 ];
 
-            const unsigned short& faceA = face[ faceInd ].vInd[ 0 ];
-            const unsigned short& faceB = face[ faceInd ].vInd[ 1 ];
-            const unsigned short& faceC = face[ faceInd ].vInd[ 2 ];
+            const unsigned& faceA = face[ faceInd ].vInd[ 0 ];
+            const unsigned& faceB = face[ faceInd ].vInd[ 1 ];
+            const unsigned& faceC = face[ faceInd ].vInd[ 2 ];
 
             const ae3d::Vec3 va = vertex[ faceA ];
             ae3d::Vec3 vb = vertex[ faceB ] - va;
@@ -837,7 +1078,7 @@ void Mesh::Interleave()
             
             interleavedVertices.push_back( newVertex );
 
-            newFace.a = (unsigned short)(interleavedVertices.size() - 1);
+            newFace.a = (unsigned)(interleavedVertices.size() - 1);
         }
 
         // vertind 1
@@ -888,7 +1129,7 @@ void Mesh::Interleave()
             
             interleavedVertices.push_back( newVertex );
 
-            newFace.b = (unsigned short)(interleavedVertices.size() - 1);
+            newFace.b = (unsigned)(interleavedVertices.size() - 1);
         }
 
         // vertind 2
@@ -938,17 +1179,11 @@ void Mesh::Interleave()
             
             interleavedVertices.push_back( newVertex );
 
-            newFace.c = (unsigned short)(interleavedVertices.size() - 1);
+            newFace.c = (unsigned)(interleavedVertices.size() - 1);
         }
 
         indices.push_back( newFace );
     }
-
-    if (interleavedVertices.size() > 65536)
-    {
-        std::cerr << "Mesh " << name << " has more than 65536 vertices!" << std::endl;
-        exit( 1 );
-    }
 }
 
 bool Mesh::AlmostEquals( const ae3d::Vec3& v1, const ae3d::Vec3& v2 ) const
@@ -975,30 +1210,17 @@ bool Mesh::AlmostEquals( const TexCoord& t1, const TexCoord& t2 ) const
     return true;
 }
 
-/**
- bytes  data
- (2)    magic number, e.g. "a7"
- (4*6)  Object's AABB min, AABB max.
- (2)    # of meshes
- (4*6)      Mesh's AABB min, AABB max.
- (2)        mesh name length in bytes.
- (*)        mesh name (1 character = 1 byte)
- (2)        # of vertices.
- (*)        Vertex data array of type Vertex.
- (2)        # of faces
- (*)        faces
- (2)        # of joints if magic number is >= a8
- (*)        joints
- (1)    terminator byte: 100
- */
-
-/// Writes a .ae3d model to a file.
+/// Writes a .ae3d model to a file in version 3 format, described in Engine/Core/MeshFormat.hpp.
+/// Indices are 16-bit, or 32-bit in meshes that have more than 65536 vertices. Meshes that are not skinned are split into meshlets.
 /// \param aOutFile File name to save the model into.
 void WriteAe3d( const std::string& aOutFile, VertexFormat vertexFormat )
 {
     static_assert( sizeof( VertexPTNTC) == 64, "" );
     static_assert( sizeof( ae3d::Vec3 ) == 12, "" );
-    static_assert( sizeof( VertexInd  ) ==  6, "" );
+    static_assert( sizeof( VertexInd  ) == 12, "" );
+    static_assert( sizeof( VertexPTNTC_Skinned ) == 96, "" );
+    static_assert( sizeof( VertexPTN ) == 32, "" );
+    static_assert( sizeof( VertexPTNTC_Quantized ) == 24, "" );
 
     if (gMeshes.empty())
     {
@@ -1046,97 +1268,132 @@ void WriteAe3d( const std::string& aOutFile, VertexFormat vertexFormat )
         aabbMax = ae3d::Vec3::Max2( aabbMax, gMeshes[ m ].aabbMax );
     }
 
-    // The file starts with identification bytes.
-    const char* gAe3dVersion = "a9";
-    ofs.write( gAe3dVersion, 2 );
-
-    ofs.write( reinterpret_cast< char* >( &aabbMin.x ), 3 * 4 );
-    ofs.write( reinterpret_cast< char* >( &aabbMax.x ), 3 * 4 );
-
-    const std::size_t meshes = gMeshes.size();
-    // # of meshes.
-    ofs.write( reinterpret_cast< const char* >( &meshes ), 2 );
+    // Sections are appended after the header and the section table, which are filled last.
+    std::vector< char > bytes( sizeof( MeshFormat::Header ) + gMeshes.size() * sizeof( MeshFormat::SubMeshEntry ) );
 
-    for (std::size_t m = 0; m < meshes; ++m)
+    auto appendSection = [&bytes]( const void* data, std::size_t size ) -> MeshFormat::Section
     {
-        assert( gMeshes[ m ].fnormal.size() == gMeshes[ m ].indices.size() );
-
-        // AABB.
-        ofs.write( reinterpret_cast< char* >( &gMeshes[ m ].aabbMin.x ), 3 * 4 );
-        ofs.write( reinterpret_cast< char* >( &gMeshes[ m ].aabbMax.x ), 3 * 4 );
-
-        // Writes name's length.
-        const unsigned short nameLength = (unsigned short)gMeshes[ m ].name.length();
-        ofs.write( reinterpret_cast< char* >((char*)&nameLength ), 2 );
-        // Writes name.
-        ofs.write(reinterpret_cast<char*>((char*)gMeshes[m].name.data()),
-                  nameLength);
-        
-        // Writes # of vertices.
-        const unsigned short nVertices = (unsigned short)gMeshes[ m ].interleavedVertices.size();
-        ofs.write( reinterpret_cast< char* >((char*)&nVertices), 2 );
+        MeshFormat::Section section;
+        section.offset = MeshFormat::AlignSection( bytes.size() );
+        section.size = size;
+        bytes.resize( section.offset + size );
 
-        // Writes vertex data.
-        if (vertexFormat == VertexFormat::PTNTC_Skinned || !gMeshes[ m ].joints.empty())
+        if (size > 0)
         {
-            const unsigned char format = 2;
-            ofs.write( (char*)&format, 1 );
+            std::memcpy( &bytes[ section.offset ], data, size );
+        }
+
+        return section;
+    };
 
-            ofs.write( (char*)&gMeshes[ m ].interleavedVertices[ 0 ], gMeshes[ m ].interleavedVertices.size() * sizeof( VertexPTNTC_Skinned ) );
+    std::vector< MeshFormat::SubMeshEntry > entries( gMeshes.size() );
+
+    for (std::size_t m = 0; m < gMeshes.size(); ++m)
+    {
+        Mesh& mesh = gMeshes[ m ];
+        MeshFormat::SubMeshEntry& entry = entries[ m ];
+        assert( mesh.fnormal.size() == mesh.indices.size() );
+
+        std::memcpy( entry.aabbMin, &mesh.aabbMin.x, sizeof( entry.aabbMin ) );
+        std::memcpy( entry.aabbMax, &mesh.aabbMax.x, sizeof( entry.aabbMax ) );
+        entry.vertexCount = (std::uint32_t)mesh.interleavedVertices.size();
+        entry.faceCount = (std::uint32_t)mesh.indices.size();
+        entry.jointCount = (std::uint32_t)mesh.joints.size();
+        entry.name = appendSection( mesh.name.data(), mesh.name.length() );
+
+        if (vertexFormat == VertexFormat::PTNTC_Skinned || !mesh.joints.empty())
+        {
+            entry.vertexFormat = MeshFormat::PTNTC_Skinned;
+            entry.vertices = appendSection( mesh.interleavedVertices.data(), mesh.interleavedVertices.size() * sizeof( VertexPTNTC_Skinned ) );
         }
         else if (vertexFormat == VertexFormat::PTNTC)
         {
-            gMeshes[ m ].CopyInterleavedVerticesToPTNTC();
-            
-            const unsigned char format = 0;
-            ofs.write( (char*)&format, 1 );
-            
-            ofs.write( (char*)&gMeshes[ m ].interleavedVerticesPTNTC[ 0 ], gMeshes[ m ].interleavedVerticesPTNTC.size() * sizeof( VertexPTNTC ) );
+            mesh.CopyInterleavedVerticesToPTNTC();
+            entry.vertexFormat = MeshFormat::PTNTC;
+            entry.vertices = appendSection( mesh.interleavedVerticesPTNTC.data(), mesh.interleavedVerticesPTNTC.size() * sizeof( VertexPTNTC ) );
         }
         else if (vertexFormat == VertexFormat::PTN)
         {
-            gMeshes[ m ].CopyInterleavedVerticesToPTN();
-
-            const unsigned char format = 1;
-            ofs.write( (char*)&format, 1 );
-        
-            ofs.write( (char*)&gMeshes[m].interleavedVerticesPTN[ 0 ], gMeshes[ m ].interleavedVerticesPTN.size() * sizeof( VertexPTN ) );
+            mesh.CopyInterleavedVerticesToPTN();
+            entry.vertexFormat = MeshFormat::PTN;
+            entry.vertices = appendSection( mesh.interleavedVerticesPTN.data(), mesh.interleavedVerticesPTN.size() * sizeof( VertexPTN ) );
+        }
+        else if (vertexFormat == VertexFormat::PTNTC_Quantized)
+        {
+            mesh.CopyInterleavedVerticesToPTNTC_Quantized();
+            entry.vertexFormat = MeshFormat::PTNTC_Quantized;
+            entry.vertices = appendSection( mesh.interleavedVerticesPTNTC_Quantized.data(), mesh.interleavedVerticesPTNTC_Quantized.size() * sizeof( VertexPTNTC_Quantized ) );
         }
         else
         {
             std::cerr << "WriteAe3d: Unhandled Vertex format!" << std::endl;
             exit( 1 );
         }
-        
-        // Writes # of indices.
-        const unsigned short indexCount = (unsigned short)gMeshes[m].indices.size();
-        ofs.write( reinterpret_cast< char* >((char*)&indexCount), 2 );
 
-        // Writes indices.
-        ofs.write( (char*)&gMeshes[m].indices[ 0 ], gMeshes[m].indices.size() * sizeof( VertexInd ) );
+        // Skinned faces move away from meshlet bounds, so they are not split. Meshlets reorder faces, so they are built before writing indices.
+        if (mesh.joints.empty())
+        {
+            mesh.BuildMeshlets();
+        }
 
-        // Writes # of joints.
-        const unsigned short jointCount = (unsigned short)gMeshes[ m ].joints.size();
-        ofs.write( reinterpret_cast< char* >((char*)&jointCount), 2 );
+        if (mesh.interleavedVertices.size() > 65536)
+        {
+            entry.indexSize = 4;
+            entry.indices = appendSection( mesh.indices.data(), mesh.indices.size() * sizeof( VertexInd ) );
+        }
+        else
+        {
+            std::vector< std::uint16_t > indices16( mesh.indices.size() * 3 );
+
+            for (std::size_t f = 0; f < mesh.indices.size(); ++f)
+            {
+                indices16[ f * 3 + 0 ] = (std::uint16_t)mesh.indices[ f ].a;
+                indices16[ f * 3 + 1 ] = (std::uint16_t)mesh.indices[ f ].b;
+                indices16[ f * 3 + 2 ] = (std::uint16_t)mesh.indices[ f ].c;
+            }
+
+            entry.indexSize = 2;
+            entry.indices = appendSection( indices16.data(), indices16.size() * sizeof( std::uint16_t ) );
+        }
 
-        // Writes joints.
-        for (size_t j = 0; j < gMeshes[ m ].joints.size(); ++j)
+        std::vector< MeshFormat::JointEntry > joints( mesh.joints.size() );
+
+        for (std::size_t j = 0; j < mesh.joints.size(); ++j)
         {
-            ofs.write( (char*)&gMeshes[ m ].joints[ j ].globalBindposeInverse, sizeof( ae3d::Matrix44 ) );
-            ofs.write( (char*)&gMeshes[ m ].joints[ j ].parentIndex, 4 );
-            const int jointNameLength = (int)gMeshes[ m ].joints[ j ].name.length();
-            ofs.write( (char*)&jointNameLength, sizeof( int ) );
-            ofs.write( reinterpret_cast<char*>((char*)gMeshes[m].joints[ j ].name.data()),
-                jointNameLength );
-            const int animLength = (int)gMeshes[ m ].joints[ j ].animTransforms.size();
-            ofs.write( (char*)&animLength, sizeof( int ) );
-            ofs.write( (char*)&gMeshes[ m ].joints[ j ].animTransforms[ 0 ].m[ 0 ], gMeshes[ m ].joints[ j ].animTransforms.size() * sizeof( ae3d::Matrix44 ) );
+            const Joint& joint = mesh.joints[ j ];
+
+            if (joint.name.length() >= sizeof( joints[ j ].name ))
+            {
+                std::cerr << "Joint " << joint.name << " has too long name, max is " << sizeof( joints[ j ].name ) - 1 << " characters." << std::endl;
+                exit( 1 );
+            }
+
+            std::memset( &joints[ j ], 0, sizeof( joints[ j ] ) );
+            std::memcpy( joints[ j ].globalBindposeInverse, &joint.globalBindposeInverse.m[ 0 ], sizeof( joints[ j ].globalBindposeInverse ) );
+            joints[ j ].parentIndex = joint.parentIndex;
+            joints[ j ].nameLength = (std::uint32_t)joint.name.length();
+            std::memcpy( joints[ j ].name, joint.name.data(), joint.name.length() );
+            joints[ j ].animTransforms = appendSection( joint.animTransforms.data(), joint.animTransforms.size() * sizeof( ae3d::Matrix44 ) );
         }
+
+        entry.joints = appendSection( joints.data(), joints.size() * sizeof( MeshFormat::JointEntry ) );
+        entry.meshletCount = (std::uint32_t)mesh.meshlets.size();
+        entry.meshlets = appendSection( mesh.meshlets.data(), mesh.meshlets.size() * sizeof( MeshFormat::MeshletEntry ) );
     }
 
-    // Terminator.
-    const unsigned char byte = 100;
-    ofs.write( (char*)&byte, 1 );
+    MeshFormat::Header header;
+    std::memcpy( header.magic, MeshFormat::Magic, sizeof( header.magic ) );
+    header.version = MeshFormat::Version;
+    header.subMeshCount = (std::uint32_t)gMeshes.size();
+    header.reserved = 0;
+    std::memcpy( header.aabbMin, &aabbMin.x, sizeof( header.aabbMin ) );
+    std::memcpy( header.aabbMax, &aabbMax.x, sizeof( header.aabbMax ) );
+    header.subMeshesOffset = sizeof( MeshFormat::Header );
+
+    std::memcpy( &bytes[ 0 ], &header, sizeof( header ) );
+    std::memcpy( &bytes[ sizeof( header ) ], entries.data(), entries.size() * sizeof( MeshFormat::SubMeshEntry ) );
+
+    ofs.write( bytes.data(), (std::streamsize)bytes.size() );
 
     std::cout << "Wrote " << aOutFile << std::endl;
 }